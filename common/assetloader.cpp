@@ -0,0 +1,186 @@
+#include <chrono>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <common/assetloader.hpp>
+#include <common/texturecook.hpp>
+
+bool allocateTextureStorage(unsigned int textureID, const MipChain &levels)
+{
+    unsigned int internalFormat, format;
+    textureGLFormats(levels.format, levels.components, internalFormat, format);
+    unsigned int numLevels = levels.numLevels();
+
+    //every level comes from the chain, none are generated. Immutable storage
+    //where the GL has it so the driver knows the whole chain up front,
+    //otherwise each level is specified empty.
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    bool immutable = GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    if (immutable)
+        glTexStorage2D(GL_TEXTURE_2D, numLevels, internalFormat, levels.width, levels.height);
+    else
+    {
+        for (unsigned int level = 0; level < numLevels; level++)
+        {
+            int width = levels.levelWidth(level);
+            int height = levels.levelHeight(level);
+            if (levels.format != BLOCK_NONE)
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0,
+                                       static_cast<GLsizei>(levels.levelSize(level)), NULL);
+            else
+                glTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+
+    // Set texture wrapping options
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return immutable;
+}
+
+void uploadTexture(unsigned int textureID, const MipChain &levels)
+{
+    bool compressed = levels.format != BLOCK_NONE;
+    unsigned int internalFormat, format;
+    textureGLFormats(levels.format, levels.components, internalFormat, format);
+    unsigned int numLevels = levels.numLevels();
+    bool immutable = allocateTextureStorage(textureID, levels);
+
+    //rows of 1 and 3 channel images aren't 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int level = 0; level < numLevels; level++)
+    {
+        int width = levels.levelWidth(level);
+        int height = levels.levelHeight(level);
+        GLsizei size = static_cast<GLsizei>(levels.levelSize(level));
+        if (compressed && immutable)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, internalFormat, size, levels.level(level));
+        else if (compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0, size, levels.level(level));
+        else if (immutable)
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE, levels.level(level));
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, levels.level(level));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+AssetLoader::AssetLoader(size_t maxReady, ThreadPool &pool, TextureCache &textures)
+    : pool(pool), textures(textures), maxReady(maxReady > 0 ? maxReady : 1), numQueued(0), numRunning(0), closing(false)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    closing = true;
+    changed.notify_all();
+    changed.wait(lock, [this]() { return numRunning == 0; });
+    ready.clear();
+}
+
+TextureHandle AssetLoader::loadTexture(const char *path)
+{
+    // The cache hands out the placeholder the caller can bind until the
+    // real image arrives
+    bool needsLoad;
+    TextureHandle texture = textures.reserve(path, true, needsLoad);
+    if (!needsLoad)
+        return texture;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        numQueued++;
+        numRunning++;
+    }
+
+    std::string file(path);
+    pool.submit([this, file, texture]()
+    {
+        DecodedImage image;
+        textures.decode(file.c_str(), true, image);
+        push([this, file, texture, image]()
+        {
+            textures.complete(file.c_str(), true, texture, image);
+        });
+        jobFinished();
+    });
+    return texture;
+}
+
+void AssetLoader::loadModel(Model &model, const char *path, unsigned int flags, unsigned int lodLevels)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        numQueued++;
+        numRunning++;
+    }
+
+    std::string file(path);
+    Model *target = &model;
+    pool.submit([this, file, target, flags, lodLevels]()
+    {
+        target->load(file.c_str(), flags, lodLevels);
+        push([target]() { target->upload(); });
+        jobFinished();
+    });
+}
+
+void AssetLoader::push(std::function<void()> upload)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return closing || ready.size() < maxReady; });
+    if (!closing)
+        ready.push_back(std::move(upload));
+}
+
+void AssetLoader::jobFinished()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    numRunning--;
+    changed.notify_all();
+}
+
+size_t AssetLoader::update(double budgetMilliseconds)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        std::function<void()> upload;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ready.empty())
+                return numQueued;
+            upload = std::move(ready.front());
+            ready.pop_front();
+        }
+        changed.notify_all();
+
+        upload();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        numQueued--;
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= budgetMilliseconds)
+            return numQueued;
+    }
+}
+
+void AssetLoader::finish()
+{
+    while (update(1e9) > 0)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return !ready.empty() || numQueued == 0; });
+    }
+}
+
+size_t AssetLoader::outstanding() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return numQueued;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <string>
+#include <cstddef>
+
+#include <common/threadpool.hpp>
+#include <common/model.hpp>
+#include <common/texturecache.hpp>
+#include <common/mipmap.hpp>
+
+// Uploads a mip chain level by level into a texture name with repeat
+// wrapping, the way every texture in the coursework is set up
+void uploadTexture(unsigned int textureID, const MipChain &levels);
+
+// Binds textureID and gives it storage for every level of levels, with the
+// same parameters as uploadTexture, but no pixels. Returns whether the
+// storage is immutable.
+bool allocateTextureStorage(unsigned int textureID, const MipChain &levels);
+
+// Loads assets in the background. File reading and decoding run on pool
+// workers, the finished payloads wait in a bounded queue and update()
+// uploads them on the GL thread within a time budget. Everything returned
+// can be used straight away and fills in once uploaded.
+class AssetLoader
+{
+public:
+    // At most maxReady payloads wait for upload, workers hold on to the
+    // rest until there is room so decoded memory stays bounded
+    explicit AssetLoader(size_t maxReady = 4, ThreadPool &pool = ThreadPool::shared(),
+                         TextureCache &textures = TextureCache::shared());
+
+    // Waits for running jobs, payloads that weren't uploaded are dropped
+    ~AssetLoader();
+
+    // Returns a texture that is 1x1 black until the image is uploaded, the
+    // fragment shader lights black textures with its placeholder colours.
+    // Textures already in the cache, loading or known to be missing come
+    // straight back without a job.
+    TextureHandle loadTexture(const char *path);
+
+    // Loads model on a worker and uploads it in update(). The model has to
+    // stay alive and untouched until isUploaded() is true.
+    void loadModel(Model &model, const char *path,
+                   unsigned int flags = MODEL_OPTIMISE | MODEL_LOD | MODEL_MESHLETS,
+                   unsigned int lodLevels = 3);
+
+    // Upload waiting payloads on the calling GL thread until budget
+    // milliseconds have passed, a payload that is started is always
+    // finished. Returns the number of assets not uploaded yet.
+    size_t update(double budgetMilliseconds);
+
+    // Load and upload everything that is left
+    void finish();
+
+    size_t outstanding() const;
+
+private:
+    ThreadPool &pool;
+    TextureCache &textures;
+    size_t maxReady;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::function<void()> > ready;
+    size_t numQueued;           // submitted and not uploaded
+    size_t numRunning;          // jobs on workers
+    bool closing;
+
+    // Called by workers, waits for room in the ready queue
+    void push(std::function<void()> upload);
+    void jobFinished();
+
+    AssetLoader(const AssetLoader &);
+    AssetLoader &operator=(const AssetLoader &);
+};
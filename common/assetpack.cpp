@@ -0,0 +1,369 @@
+#include <mutex>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <stdio.h>
+
+#include <common/assetpack.hpp>
+#include <common/mappedfile.hpp>
+#include <common/lzcompress.hpp>
+#include <common/hash.hpp>
+
+namespace
+{
+    const char packMagic[4] = { 'C', 'G', 'P', 'K' };
+    const size_t entryAlignment = 4096;
+    const size_t compressionBlock = 256 * 1024;
+    const unsigned int maxBlockSize = 64 * 1024 * 1024;
+
+    // An LZ4 block never decodes to more than 255 bytes per byte of it, and
+    // a little over for the shortest blocks
+    const unsigned long long maxExpansion = 256;
+
+    // Followed by the table of contents, then the names
+    struct PackHeader
+    {
+        char magic[4];
+        unsigned int version;
+        unsigned int numEntries;
+        unsigned int blockSize;
+        unsigned long long namesOffset;
+        unsigned long long namesSize;
+    };
+
+    // Sorted by pathHash, then name. A compressed file is stored as
+    // numBlocks 32-bit compressed sizes followed by the blocks, every one
+    // blockSize bytes once decompressed but the last.
+    struct PackEntry
+    {
+        unsigned long long pathHash;
+        unsigned long long offset;
+        unsigned long long storedSize;
+        unsigned long long size;
+        long long modified;
+        unsigned int nameOffset;
+        unsigned int nameLength;
+        unsigned int numBlocks;         // 0 if stored as it is
+        unsigned int padding;
+    };
+
+    struct MountedPack
+    {
+        MappedFile file;
+        PackHeader header;
+        const PackEntry *entries;
+        const char *names;
+        ThreadPool *pool;
+
+        // Decompressed files still open somewhere, so they are shared
+        std::mutex mutex;
+        std::vector<std::weak_ptr<std::vector<char> > > decompressed;
+    };
+
+    std::mutex mountMutex;
+    std::vector<std::shared_ptr<MountedPack> > mounted;
+
+    inline size_t alignUp(size_t offset)
+    {
+        return (offset + entryAlignment - 1) & ~(entryAlignment - 1);
+    }
+
+    // What a path is stored and looked up as
+    std::string pathKey(const char *path)
+    {
+        std::string key(path);
+        for (size_t i = 0; i < key.size(); i++)
+            key[i] = key[i] == '\\' ? '/' : static_cast<char>(tolower(static_cast<unsigned char>(key[i])));
+        while (key.compare(0, 2, "./") == 0)
+            key.erase(0, 2);
+        return key;
+    }
+
+    unsigned long long keyHash(const std::string &key)
+    {
+        return hashBytes(key.data(), key.size());
+    }
+
+    // Index of the entry for key, or numEntries
+    size_t findEntry(const MountedPack &pack, const std::string &key, unsigned long long hash)
+    {
+        const PackEntry *begin = pack.entries;
+        const PackEntry *end = pack.entries + pack.header.numEntries;
+        const PackEntry *entry = std::lower_bound(begin, end, hash, [](const PackEntry &a, unsigned long long b)
+        {
+            return a.pathHash < b;
+        });
+        for (; entry != end && entry->pathHash == hash; ++entry)
+            if (entry->nameLength == key.size() && memcmp(pack.names + entry->nameOffset, key.data(), key.size()) == 0)
+                return static_cast<size_t>(entry - begin);
+        return pack.header.numEntries;
+    }
+
+    bool validPack(const MappedFile &file, PackHeader &header)
+    {
+        if (file.size() < sizeof(header))
+            return false;
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, packMagic, 4) != 0 || header.version != assetPackVersion ||
+            header.blockSize == 0 || header.blockSize > maxBlockSize)
+            return false;
+        unsigned long long tocEnd = sizeof(header) + static_cast<unsigned long long>(header.numEntries) * sizeof(PackEntry);
+        if (tocEnd > file.size() || header.namesOffset < tocEnd ||
+            header.namesOffset > file.size() || header.namesSize > file.size() - header.namesOffset)
+            return false;
+
+        const PackEntry *entries = reinterpret_cast<const PackEntry*>(file.data() + sizeof(header));
+        for (unsigned int i = 0; i < header.numEntries; i++)
+        {
+            const PackEntry &entry = entries[i];
+            if (static_cast<unsigned long long>(entry.nameOffset) + entry.nameLength > header.namesSize ||
+                entry.offset > file.size() || entry.storedSize > file.size() - entry.offset)
+                return false;
+            if (entry.numBlocks == 0)
+            {
+                if (entry.storedSize != entry.size)
+                    return false;
+                continue;
+            }
+
+            // The size is allocated before anything is decoded, so it has to
+            // be one the blocks could decompress to
+            unsigned long long numBlocks = entry.size / header.blockSize + (entry.size % header.blockSize != 0);
+            unsigned long long headerBytes = static_cast<unsigned long long>(entry.numBlocks) * sizeof(unsigned int);
+            if (entry.numBlocks != numBlocks || entry.storedSize < headerBytes ||
+                entry.size > (entry.storedSize - headerBytes) * maxExpansion)
+                return false;
+        }
+        return true;
+    }
+
+    // Decodes the blocks of a compressed entry across the pool, null if
+    // they are corrupt
+    std::shared_ptr<std::vector<char> > decompressEntry(MountedPack &pack, size_t index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pack.mutex);
+            std::shared_ptr<std::vector<char> > existing = pack.decompressed[index].lock();
+            if (existing)
+                return existing;
+        }
+
+        const PackEntry &entry = pack.entries[index];
+        const char *stored = pack.file.data() + entry.offset;
+        std::vector<unsigned int> blockSizes(entry.numBlocks);
+        memcpy(blockSizes.data(), stored, entry.numBlocks * sizeof(unsigned int));
+        std::vector<size_t> blockOffsets(entry.numBlocks);
+        size_t offset = entry.numBlocks * sizeof(unsigned int);
+        for (unsigned int i = 0; i < entry.numBlocks; i++)
+        {
+            blockOffsets[i] = offset;
+            offset += blockSizes[i];
+        }
+        if (offset > entry.storedSize)
+            return std::shared_ptr<std::vector<char> >();
+
+        std::shared_ptr<std::vector<char> > out = std::make_shared<std::vector<char> >(static_cast<size_t>(entry.size));
+        size_t blockSize = pack.header.blockSize;
+        std::atomic<bool> ok(true);
+        pack.pool->parallelFor(entry.numBlocks, [&](size_t i)
+        {
+            size_t size = std::min(blockSize, static_cast<size_t>(entry.size) - i * blockSize);
+            if (!lzDecompress(stored + blockOffsets[i], blockSizes[i], out->data() + i * blockSize, size))
+                ok = false;
+        });
+        if (!ok)
+            return std::shared_ptr<std::vector<char> >();
+
+        std::lock_guard<std::mutex> lock(pack.mutex);
+        pack.decompressed[index] = out;
+        return out;
+    }
+}
+
+bool writeAssetPack(const char *packPath, const std::vector<std::string> &paths, bool compress, ThreadPool &pool)
+{
+    // One entry a file, another spelling of the same path is dropped
+    struct Source
+    {
+        std::string path;
+        std::string key;
+        unsigned long long hash;
+    };
+    std::vector<Source> sources;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        Source source;
+        source.path = paths[i];
+        source.key = pathKey(paths[i].c_str());
+        source.hash = keyHash(source.key);
+        sources.push_back(source);
+    }
+    std::sort(sources.begin(), sources.end(), [](const Source &a, const Source &b)
+    {
+        return a.hash != b.hash ? a.hash < b.hash : a.key < b.key;
+    });
+    sources.erase(std::unique(sources.begin(), sources.end(), [](const Source &a, const Source &b)
+    {
+        return a.key == b.key;
+    }), sources.end());
+
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, packMagic, 4);
+    header.version = assetPackVersion;
+    header.numEntries = static_cast<unsigned int>(sources.size());
+    header.blockSize = static_cast<unsigned int>(compressionBlock);
+    header.namesOffset = sizeof(header) + sources.size() * sizeof(PackEntry);
+
+    std::vector<PackEntry> entries(sources.size());
+    std::string names;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        memset(&entries[i], 0, sizeof(PackEntry));
+        entries[i].pathHash = sources[i].hash;
+        entries[i].nameOffset = static_cast<unsigned int>(names.size());
+        entries[i].nameLength = static_cast<unsigned int>(sources[i].key.size());
+        names += sources[i].key;
+    }
+    header.namesSize = names.size();
+
+    // Files are written after the names, the header and table once their
+    // offsets are known. Written aside and swapped in like the caches.
+    std::string tempPath = std::string(packPath) + ".tmp";
+    FILE *out = fopen(tempPath.c_str(), "wb");
+    if (out == NULL)
+        return false;
+    static const char zeros[entryAlignment] = { 0 };
+    size_t offset = static_cast<size_t>(header.namesOffset);
+    bool ok = fseek(out, static_cast<long>(offset), SEEK_SET) == 0 &&
+              fwrite(names.data(), 1, names.size(), out) == names.size();
+    offset += names.size();
+    for (size_t i = 0; i < sources.size() && ok; i++)
+    {
+        PackEntry &entry = entries[i];
+        MappedFile file;
+        unsigned long long size;
+        if (!getFileInfo(sources[i].path.c_str(), size, entry.modified) || !file.open(sources[i].path.c_str()))
+        {
+            printf("Couldn't read %s into the asset pack\n", sources[i].path.c_str());
+            ok = false;
+            break;
+        }
+        entry.size = file.size();
+
+        // Blocks compress on the pool, kept if they save an eighth
+        std::vector<char> compressed;
+        if (compress)
+        {
+            size_t numBlocks = (file.size() + compressionBlock - 1) / compressionBlock;
+            std::vector<std::vector<char> > blocks(numBlocks);
+            pool.parallelFor(numBlocks, [&](size_t b)
+            {
+                size_t size = std::min(compressionBlock, file.size() - b * compressionBlock);
+                blocks[b].resize(lzCompressBound(size));
+                blocks[b].resize(lzCompress(file.data() + b * compressionBlock, size, blocks[b].data()));
+            });
+            size_t total = numBlocks * sizeof(unsigned int);
+            for (size_t b = 0; b < numBlocks; b++)
+                total += blocks[b].size();
+            if (total <= file.size() - file.size() / 8)
+            {
+                compressed.resize(numBlocks * sizeof(unsigned int));
+                for (size_t b = 0; b < numBlocks; b++)
+                {
+                    unsigned int blockSize = static_cast<unsigned int>(blocks[b].size());
+                    memcpy(&compressed[b * sizeof(unsigned int)], &blockSize, sizeof(blockSize));
+                    compressed.insert(compressed.end(), blocks[b].begin(), blocks[b].end());
+                }
+                entry.numBlocks = static_cast<unsigned int>(numBlocks);
+            }
+        }
+        const char *data = entry.numBlocks != 0 ? compressed.data() : file.data();
+        entry.storedSize = entry.numBlocks != 0 ? compressed.size() : file.size();
+
+        size_t padding = alignUp(offset) - offset;
+        entry.offset = offset + padding;
+        ok = fwrite(zeros, 1, padding, out) == padding &&
+             fwrite(data, 1, static_cast<size_t>(entry.storedSize), out) == entry.storedSize;
+        offset = static_cast<size_t>(entry.offset + entry.storedSize);
+    }
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1 &&
+         (entries.empty() || fwrite(entries.data(), sizeof(PackEntry), entries.size(), out) == entries.size());
+    ok = fclose(out) == 0 && ok;
+
+    if (ok)
+    {
+        remove(packPath);
+        ok = rename(tempPath.c_str(), packPath) == 0;
+    }
+    if (!ok)
+        remove(tempPath.c_str());
+    return ok;
+}
+
+bool mountAssetPack(const char *packPath, ThreadPool &pool)
+{
+    std::shared_ptr<MountedPack> pack = std::make_shared<MountedPack>();
+    if (!pack->file.open(packPath, MAPPED_RANDOM) || !validPack(pack->file, pack->header))
+        return false;
+    pack->entries = reinterpret_cast<const PackEntry*>(pack->file.data() + sizeof(PackHeader));
+    pack->names = pack->file.data() + pack->header.namesOffset;
+    pack->pool = &pool;
+    pack->decompressed.resize(pack->header.numEntries);
+
+    std::lock_guard<std::mutex> lock(mountMutex);
+    mounted.push_back(pack);
+    return true;
+}
+
+void unmountAssetPacks()
+{
+    std::lock_guard<std::mutex> lock(mountMutex);
+    mounted.clear();
+}
+
+bool findPackedFile(const char *path, PackedFile &file, bool readData)
+{
+    std::vector<std::shared_ptr<MountedPack> > packs;
+    {
+        std::lock_guard<std::mutex> lock(mountMutex);
+        if (mounted.empty())
+            return false;
+        packs = mounted;
+    }
+
+    std::string key = pathKey(path);
+    unsigned long long hash = keyHash(key);
+    for (size_t i = packs.size(); i-- > 0;)
+    {
+        MountedPack &pack = *packs[i];
+        size_t index = findEntry(pack, key, hash);
+        if (index == pack.header.numEntries)
+            continue;
+
+        const PackEntry &entry = pack.entries[index];
+        file.data = nullptr;
+        file.size = static_cast<size_t>(entry.size);
+        file.modified = entry.modified;
+        file.owner.reset();
+        if (!readData)
+            return true;
+        if (entry.numBlocks == 0)
+        {
+            file.data = pack.file.data() + entry.offset;
+            file.owner = packs[i];
+            return true;
+        }
+        std::shared_ptr<std::vector<char> > decompressed = decompressEntry(pack, index);
+        if (!decompressed)
+        {
+            printf("%s is corrupt in the asset pack\n", path);
+            return false;
+        }
+        file.data = decompressed->data();
+        file.owner = decompressed;
+        return true;
+    }
+    return false;
+}
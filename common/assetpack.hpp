@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include <common/threadpool.hpp>
+
+// Bumped whenever the pack layout changes
+const unsigned int assetPackVersion = 1;
+
+// Asset files packed into one. A table of contents sorted by path hash is
+// looked up with a binary search in the mapping, and each file starts on
+// a page boundary so containers inside stay aligned for upload. Files that
+// shrink enough are stored compressed in independent blocks, which are
+// decoded in parallel on the pool when the file is opened.
+//
+// Paths are stored as the loaders ask for them, relative to the working
+// directory, and match the way Windows matches them: case doesn't matter
+// and either slash will do.
+
+// Packs paths into packPath, compressing the files it is worth it for.
+// False if any of them can't be read or the pack can't be written.
+bool writeAssetPack(const char *packPath, const std::vector<std::string> &paths, bool compress = true,
+                    ThreadPool &pool = ThreadPool::shared());
+
+// Once mounted, MappedFile::open and getFileInfo find files in the pack
+// before looking on disk, packs mounted later first. Anything not in a
+// pack, and everything when there is no pack, is read loose. False if
+// packPath isn't a pack.
+bool mountAssetPack(const char *packPath, ThreadPool &pool = ThreadPool::shared());
+
+// Files opened from the packs stay valid until they are closed
+void unmountAssetPacks();
+
+// A file in a mounted pack. owner keeps data alive, the pack's mapping or
+// the decompressed copy.
+struct PackedFile
+{
+    const char *data;
+    size_t size;
+    long long modified;             // of the file when it was packed
+    std::shared_ptr<const void> owner;
+};
+
+// Looks path up in the mounted packs. With readData false only the size
+// and time are filled in and nothing is decompressed.
+bool findPackedFile(const char *path, PackedFile &file, bool readData = true);
@@ -0,0 +1,727 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <common/blockcompression.hpp>
+
+namespace
+{
+    // Block of 16 pixels, RGBA as floats so the fitting needs no conversions
+    struct PixelBlock
+    {
+        float p[16][4];
+    };
+
+    // Copies a 4x4 block, clamping at the right and bottom edges
+    void loadBlock(const unsigned char *rgba, int width, int height, int bx, int by, PixelBlock &block)
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int sy = std::min(by * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int sx = std::min(bx * 4 + x, width - 1);
+                const unsigned char *pixel = &rgba[(static_cast<size_t>(sy) * width + sx) * 4];
+                for (int c = 0; c < 4; c++)
+                    block.p[y * 4 + x][c] = pixel[c];
+            }
+        }
+    }
+
+    inline int clampByte(float v)
+    {
+        return static_cast<int>(std::min(std::max(v + 0.5f, 0.0f), 255.0f));
+    }
+
+    // Principal axis of the first channels of a block by power iteration,
+    // with the block's mean
+    void principalAxis(const PixelBlock &block, int channels, float mean[4], float axis[4])
+    {
+        for (int c = 0; c < 4; c++)
+            mean[c] = axis[c] = 0.0f;
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < channels; c++)
+                mean[c] += block.p[i][c] / 16.0f;
+
+        float cov[4][4] = { { 0.0f } };
+        for (int i = 0; i < 16; i++)
+            for (int a = 0; a < channels; a++)
+                for (int b = 0; b < channels; b++)
+                    cov[a][b] += (block.p[i][a] - mean[a]) * (block.p[i][b] - mean[b]);
+
+        // Start along the largest spread, converges in a few steps
+        int largest = 0;
+        for (int c = 1; c < channels; c++)
+            if (cov[c][c] > cov[largest][largest])
+                largest = c;
+        axis[largest] = 1.0f;
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            float length = 0.0f;
+            for (int a = 0; a < channels; a++)
+            {
+                for (int b = 0; b < channels; b++)
+                    next[a] += cov[a][b] * axis[b];
+                length += next[a] * next[a];
+            }
+            if (length == 0.0f)
+                break;
+            length = std::sqrt(length);
+            for (int c = 0; c < channels; c++)
+                axis[c] = next[c] / length;
+        }
+    }
+
+    // Ends of the block along its principal axis
+    void axisEndpoints(const PixelBlock &block, int channels, float low[4], float high[4])
+    {
+        float mean[4], axis[4];
+        principalAxis(block, channels, mean, axis);
+        float minT = 0.0f, maxT = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channels; c++)
+                t += (block.p[i][c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        for (int c = 0; c < 4; c++)
+        {
+            low[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+            high[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+        }
+    }
+
+    // Least squares endpoints for fixed interpolation weights, weights[i] is
+    // how much of the second endpoint pixel i gets. false if degenerate.
+    bool fitEndpoints(const PixelBlock &block, int channels, const float weights[16], float e0[4], float e1[4])
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ap[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float bp[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+        {
+            float b = weights[i];
+            float a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < channels; c++)
+            {
+                ap[c] += a * block.p[i][c];
+                bp[c] += b * block.p[i][c];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (std::fabs(det) < 1e-6f)
+            return false;
+        for (int c = 0; c < channels; c++)
+        {
+            e0[c] = std::min(std::max((ap[c] * bb - bp[c] * ab) / det, 0.0f), 255.0f);
+            e1[c] = std::min(std::max((bp[c] * aa - ap[c] * ab) / det, 0.0f), 255.0f);
+        }
+        return true;
+    }
+
+    // Nearest of 16 palette entries for every pixel, returns the total error
+    float nearestIndices16(const PixelBlock &block, const float palette[16][4], unsigned char indices[16])
+    {
+        float total = 0.0f;
+#ifdef BLOCK_SSE2
+        // Palette as four registers per channel, 4 entries compared at once
+        __m128 channel[4][4];
+        for (int c = 0; c < 4; c++)
+            for (int k = 0; k < 4; k++)
+                channel[c][k] = _mm_setr_ps(palette[k * 4][c], palette[k * 4 + 1][c],
+                                            palette[k * 4 + 2][c], palette[k * 4 + 3][c]);
+        for (int i = 0; i < 16; i++)
+        {
+            __m128 distance[4];
+            for (int k = 0; k < 4; k++)
+            {
+                distance[k] = _mm_setzero_ps();
+                for (int c = 0; c < 4; c++)
+                {
+                    __m128 d = _mm_sub_ps(channel[c][k], _mm_set1_ps(block.p[i][c]));
+                    distance[k] = _mm_add_ps(distance[k], _mm_mul_ps(d, d));
+                }
+            }
+            __m128 best = _mm_min_ps(_mm_min_ps(distance[0], distance[1]), _mm_min_ps(distance[2], distance[3]));
+            best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+            best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(1, 0, 3, 2)));
+            for (int k = 0; k < 4; k++)
+            {
+                int mask = _mm_movemask_ps(_mm_cmpeq_ps(distance[k], best));
+                if (mask != 0)
+                {
+                    int lane = 0;
+                    while (!(mask & (1 << lane)))
+                        lane++;
+                    indices[i] = static_cast<unsigned char>(k * 4 + lane);
+                    break;
+                }
+            }
+            total += _mm_cvtss_f32(best);
+        }
+#else
+        for (int i = 0; i < 16; i++)
+        {
+            float best = std::numeric_limits<float>::max();
+            for (int k = 0; k < 16; k++)
+            {
+                float distance = 0.0f;
+                for (int c = 0; c < 4; c++)
+                {
+                    float d = palette[k][c] - block.p[i][c];
+                    distance += d * d;
+                }
+                if (distance < best)
+                {
+                    best = distance;
+                    indices[i] = static_cast<unsigned char>(k);
+                }
+            }
+            total += best;
+        }
+#endif
+        return total;
+    }
+
+    // Little endian bit packing for BC7
+    void putBits(unsigned char *out, int &position, unsigned int value, int count)
+    {
+        for (int i = 0; i < count; i++, position++)
+            if (value & (1u << i))
+                out[position >> 3] |= static_cast<unsigned char>(1 << (position & 7));
+    }
+
+    unsigned int getBits(const unsigned char *in, int &position, int count)
+    {
+        unsigned int value = 0;
+        for (int i = 0; i < count; i++, position++)
+            value |= ((in[position >> 3] >> (position & 7)) & 1u) << i;
+        return value;
+    }
+
+    // BC1 -----------------------------------------------------------------
+
+    inline unsigned short to565(const float c[4])
+    {
+        int r = clampByte(c[0] * 31.0f / 255.0f);
+        int g = clampByte(c[1] * 63.0f / 255.0f);
+        int b = clampByte(c[2] * 31.0f / 255.0f);
+        return static_cast<unsigned short>((std::min(r, 31) << 11) | (std::min(g, 63) << 5) | std::min(b, 31));
+    }
+
+    inline void from565(unsigned short v, int c[3])
+    {
+        int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+        c[0] = (r << 3) | (r >> 2);
+        c[1] = (g << 2) | (g >> 4);
+        c[2] = (b << 3) | (b >> 2);
+    }
+
+    // Four colour palette, three colours and black when c0 <= c1
+    void bc1Palette(unsigned short c0, unsigned short c1, bool forceFour, int palette[4][3])
+    {
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            if (c0 > c1 || forceFour)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+    }
+
+    float bc1Indices(const PixelBlock &block, const int palette[4][3], unsigned char indices[16])
+    {
+        float total = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float best = std::numeric_limits<float>::max();
+            for (int k = 0; k < 4; k++)
+            {
+                float distance = 0.0f;
+                for (int c = 0; c < 3; c++)
+                {
+                    float d = palette[k][c] - block.p[i][c];
+                    distance += d * d;
+                }
+                if (distance < best)
+                {
+                    best = distance;
+                    indices[i] = static_cast<unsigned char>(k);
+                }
+            }
+            total += best;
+        }
+        return total;
+    }
+
+    void encodeBC1(const PixelBlock &block, unsigned char out[8])
+    {
+        // Endpoints along the principal axis, then least squares refinement
+        // for the indices they give while that lowers the error
+        float e0[4], e1[4];
+        axisEndpoints(block, 3, e1, e0);
+        const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+        unsigned short best0 = 0, best1 = 0;
+        unsigned char bestIndices[16] = { 0 };
+        float bestError = std::numeric_limits<float>::max();
+        for (int iteration = 0; iteration < 3; iteration++)
+        {
+            unsigned short c0 = to565(e0), c1 = to565(e1);
+            if (c0 < c1)
+                std::swap(c0, c1);
+            int palette[4][3];
+            bc1Palette(c0, c1, true, palette);
+            unsigned char indices[16];
+            float error = bc1Indices(block, palette, indices);
+            if (error >= bestError)
+                break;
+            bestError = error;
+            best0 = c0;
+            best1 = c1;
+            memcpy(bestIndices, indices, 16);
+
+            float pixelWeights[16];
+            for (int i = 0; i < 16; i++)
+                pixelWeights[i] = weights[indices[i]];
+            if (!fitEndpoints(block, 3, pixelWeights, e0, e1))
+                break;
+        }
+
+        // Equal endpoints decode in three colour mode, index 0 still works
+        if (best0 == best1)
+            memset(bestIndices, 0, 16);
+        out[0] = best0 & 0xff;
+        out[1] = best0 >> 8;
+        out[2] = best1 & 0xff;
+        out[3] = best1 >> 8;
+        for (int row = 0; row < 4; row++)
+            out[4 + row] = static_cast<unsigned char>(bestIndices[row * 4] | (bestIndices[row * 4 + 1] << 2) |
+                                                      (bestIndices[row * 4 + 2] << 4) | (bestIndices[row * 4 + 3] << 6));
+    }
+
+    void decodeBC1(const unsigned char in[8], bool forceFour, unsigned char pixels[16][4])
+    {
+        unsigned short c0 = static_cast<unsigned short>(in[0] | (in[1] << 8));
+        unsigned short c1 = static_cast<unsigned short>(in[2] | (in[3] << 8));
+        int palette[4][3];
+        bc1Palette(c0, c1, forceFour, palette);
+        for (int i = 0; i < 16; i++)
+        {
+            int index = (in[4 + i / 4] >> ((i % 4) * 2)) & 3;
+            for (int c = 0; c < 3; c++)
+                pixels[i][c] = static_cast<unsigned char>(palette[index][c]);
+        }
+    }
+
+    // BC4 -----------------------------------------------------------------
+
+    // Eight values with a0 > a1, otherwise six and the extremes 0 and 255
+    void bc4Palette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1)
+        {
+            for (int i = 1; i < 7; i++)
+                palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+        }
+        else
+        {
+            for (int i = 1; i < 5; i++)
+                palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    int bc4Indices(const float values[16], const int palette[8], unsigned char indices[16])
+    {
+        int total = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int v = clampByte(values[i]);
+            int best = 1 << 30;
+            for (int k = 0; k < 8; k++)
+            {
+                int d = (palette[k] - v) * (palette[k] - v);
+                if (d < best)
+                {
+                    best = d;
+                    indices[i] = static_cast<unsigned char>(k);
+                }
+            }
+            total += best;
+        }
+        return total;
+    }
+
+    void encodeBC4(const float values[16], unsigned char out[8])
+    {
+        float low = 255.0f, high = 0.0f, innerLow = 255.0f, innerHigh = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            low = std::min(low, values[i]);
+            high = std::max(high, values[i]);
+            if (values[i] > 0.0f && values[i] < 255.0f)
+            {
+                innerLow = std::min(innerLow, values[i]);
+                innerHigh = std::max(innerHigh, values[i]);
+            }
+        }
+
+        // Eight value mode over the full range, refined, or six values
+        // between the inner extremes when the block touches 0 or 255
+        int candidates[4][2] = {
+            { clampByte(high), clampByte(low) },
+            { 0, 0 },
+            { clampByte(innerLow), clampByte(innerHigh) },
+            { clampByte(low), clampByte(high) }
+        };
+        int numCandidates = innerLow <= innerHigh ? 3 : 1;
+
+        // Least squares on the eight value mode
+        {
+            int palette[8];
+            unsigned char indices[16];
+            bc4Palette(candidates[0][0], candidates[0][1], palette);
+            bc4Indices(values, palette, indices);
+            static const float weights[8] = { 0.0f, 1.0f, 1.0f / 7, 2.0f / 7, 3.0f / 7, 4.0f / 7, 5.0f / 7, 6.0f / 7 };
+            PixelBlock block;
+            float pixelWeights[16];
+            for (int i = 0; i < 16; i++)
+            {
+                block.p[i][0] = values[i];
+                pixelWeights[i] = weights[indices[i]];
+            }
+            float e0[4], e1[4];
+            if (fitEndpoints(block, 1, pixelWeights, e0, e1))
+            {
+                candidates[1][0] = clampByte(e0[0]);
+                candidates[1][1] = clampByte(e1[0]);
+                if (candidates[1][0] <= candidates[1][1])
+                    candidates[1][0] = candidates[1][1] = candidates[0][0];
+                numCandidates = std::max(numCandidates, 2);
+            }
+            else
+                candidates[1][0] = candidates[1][1] = candidates[0][0];
+        }
+
+        int bestError = 1 << 30;
+        int best = 0;
+        unsigned char bestIndices[16] = { 0 };
+        for (int c = 0; c < std::max(numCandidates, 3); c++)
+        {
+            if (c == 2 && innerLow > innerHigh)
+                continue;
+            int palette[8];
+            unsigned char indices[16];
+            bc4Palette(candidates[c][0], candidates[c][1], palette);
+            int error = bc4Indices(values, palette, indices);
+            if (error < bestError)
+            {
+                bestError = error;
+                best = c;
+                memcpy(bestIndices, indices, 16);
+            }
+        }
+
+        out[0] = static_cast<unsigned char>(candidates[best][0]);
+        out[1] = static_cast<unsigned char>(candidates[best][1]);
+        unsigned long long bits = 0;
+        for (int i = 0; i < 16; i++)
+            bits |= static_cast<unsigned long long>(bestIndices[i]) << (i * 3);
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = static_cast<unsigned char>(bits >> (i * 8));
+    }
+
+    void decodeBC4(const unsigned char in[8], unsigned char pixels[16][4], int channel)
+    {
+        int palette[8];
+        bc4Palette(in[0], in[1], palette);
+        unsigned long long bits = 0;
+        for (int i = 0; i < 6; i++)
+            bits |= static_cast<unsigned long long>(in[2 + i]) << (i * 8);
+        for (int i = 0; i < 16; i++)
+            pixels[i][channel] = static_cast<unsigned char>(palette[(bits >> (i * 3)) & 7]);
+    }
+
+    void encodeBC4Channel(const PixelBlock &block, int channel, unsigned char out[8])
+    {
+        float values[16];
+        for (int i = 0; i < 16; i++)
+            values[i] = block.p[i][channel];
+        encodeBC4(values, out);
+    }
+
+    // BC7 mode 6 ----------------------------------------------------------
+
+    const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    inline int bc7Interpolate(int e0, int e1, int weight)
+    {
+        return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+    }
+
+    // 7 bit endpoint with the p-bit that brings it closest to value
+    void quantiseMode6(const float value[4], int quantised[4], int &pBit)
+    {
+        float bestError = std::numeric_limits<float>::max();
+        for (int p = 0; p < 2; p++)
+        {
+            int q[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                q[c] = std::min(std::max(static_cast<int>(std::floor((value[c] - p) / 2.0f + 0.5f)), 0), 127);
+                float d = static_cast<float>((q[c] << 1) | p) - value[c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pBit = p;
+                memcpy(quantised, q, sizeof(q));
+            }
+        }
+    }
+
+    void encodeBC7(const PixelBlock &block, unsigned char out[16])
+    {
+        float e0[4], e1[4];
+        axisEndpoints(block, 4, e0, e1);
+
+        int best0[4] = { 0 }, best1[4] = { 0 };
+        int bestP0 = 0, bestP1 = 0;
+        unsigned char bestIndices[16] = { 0 };
+        float bestError = std::numeric_limits<float>::max();
+        for (int iteration = 0; iteration < 3; iteration++)
+        {
+            int q0[4], q1[4], p0, p1;
+            quantiseMode6(e0, q0, p0);
+            quantiseMode6(e1, q1, p1);
+
+            float palette[16][4];
+            for (int k = 0; k < 16; k++)
+                for (int c = 0; c < 4; c++)
+                    palette[k][c] = static_cast<float>(bc7Interpolate((q0[c] << 1) | p0, (q1[c] << 1) | p1, bc7Weights[k]));
+            unsigned char indices[16];
+            float error = nearestIndices16(block, palette, indices);
+            if (error >= bestError)
+                break;
+            bestError = error;
+            memcpy(best0, q0, sizeof(q0));
+            memcpy(best1, q1, sizeof(q1));
+            bestP0 = p0;
+            bestP1 = p1;
+            memcpy(bestIndices, indices, 16);
+
+            float pixelWeights[16];
+            for (int i = 0; i < 16; i++)
+                pixelWeights[i] = bc7Weights[indices[i]] / 64.0f;
+            if (!fitEndpoints(block, 4, pixelWeights, e0, e1))
+                break;
+        }
+
+        // The first index has an implied zero top bit
+        if (bestIndices[0] & 8)
+        {
+            for (int c = 0; c < 4; c++)
+                std::swap(best0[c], best1[c]);
+            std::swap(bestP0, bestP1);
+            for (int i = 0; i < 16; i++)
+                bestIndices[i] = static_cast<unsigned char>(15 - bestIndices[i]);
+        }
+
+        memset(out, 0, 16);
+        int position = 0;
+        putBits(out, position, 1u << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            putBits(out, position, best0[c], 7);
+            putBits(out, position, best1[c], 7);
+        }
+        putBits(out, position, bestP0, 1);
+        putBits(out, position, bestP1, 1);
+        putBits(out, position, bestIndices[0], 3);
+        for (int i = 1; i < 16; i++)
+            putBits(out, position, bestIndices[i], 4);
+    }
+
+    void decodeBC7(const unsigned char in[16], unsigned char pixels[16][4])
+    {
+        if ((in[0] & 0x7f) != 0x40)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                pixels[i][0] = pixels[i][2] = pixels[i][3] = 255;
+                pixels[i][1] = 0;
+            }
+            return;
+        }
+
+        int position = 7;
+        int e[2][4];
+        for (int c = 0; c < 4; c++)
+        {
+            e[0][c] = getBits(in, position, 7);
+            e[1][c] = getBits(in, position, 7);
+        }
+        int p0 = getBits(in, position, 1);
+        int p1 = getBits(in, position, 1);
+        for (int c = 0; c < 4; c++)
+        {
+            e[0][c] = (e[0][c] << 1) | p0;
+            e[1][c] = (e[1][c] << 1) | p1;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int index = getBits(in, position, i == 0 ? 3 : 4);
+            for (int c = 0; c < 4; c++)
+                pixels[i][c] = static_cast<unsigned char>(bc7Interpolate(e[0][c], e[1][c], bc7Weights[index]));
+        }
+    }
+}
+
+size_t blockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 || format == BLOCK_BC4 ? 8 : 16;
+}
+
+size_t compressedSize(BlockFormat format, int width, int height)
+{
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+const char *blockFormatName(BlockFormat format)
+{
+    static const char *names[] = { "BC1", "BC3", "BC4", "BC5", "BC7", "uncompressed" };
+    return names[format];
+}
+
+int blockFormatChannels(BlockFormat format)
+{
+    static const int channels[] = { 3, 4, 1, 2, 4, 4 };
+    return channels[format];
+}
+
+void compressBlocks(const unsigned char *rgba, int width, int height, BlockFormat format,
+                    unsigned char *out, ThreadPool &pool)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t bytes = blockBytes(format);
+    pool.parallelFor(blocksY, [&](size_t by)
+    {
+        PixelBlock block;
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            loadBlock(rgba, width, height, bx, static_cast<int>(by), block);
+            unsigned char *dst = out + (by * blocksX + bx) * bytes;
+            switch (format)
+            {
+            case BLOCK_BC1:
+                encodeBC1(block, dst);
+                break;
+            case BLOCK_BC3:
+                encodeBC4Channel(block, 3, dst);
+                encodeBC1(block, dst + 8);
+                break;
+            case BLOCK_BC4:
+                encodeBC4Channel(block, 0, dst);
+                break;
+            case BLOCK_BC5:
+                encodeBC4Channel(block, 0, dst);
+                encodeBC4Channel(block, 1, dst + 8);
+                break;
+            case BLOCK_BC7:
+                encodeBC7(block, dst);
+                break;
+            default:
+                break;
+            }
+        }
+    });
+}
+
+void decompressBlocks(const unsigned char *blocks, int width, int height, BlockFormat format,
+                      unsigned char *rgba)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t bytes = blockBytes(format);
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            unsigned char pixels[16][4];
+            memset(pixels, 0, sizeof(pixels));
+            for (int i = 0; i < 16; i++)
+                pixels[i][3] = 255;
+
+            const unsigned char *src = blocks + (static_cast<size_t>(by) * blocksX + bx) * bytes;
+            switch (format)
+            {
+            case BLOCK_BC1:
+                decodeBC1(src, false, pixels);
+                break;
+            case BLOCK_BC3:
+                decodeBC4(src, pixels, 3);
+                decodeBC1(src + 8, true, pixels);
+                break;
+            case BLOCK_BC4:
+                decodeBC4(src, pixels, 0);
+                break;
+            case BLOCK_BC5:
+                decodeBC4(src, pixels, 0);
+                decodeBC4(src + 8, pixels, 1);
+                break;
+            case BLOCK_BC7:
+                decodeBC7(src, pixels);
+                break;
+            default:
+                break;
+            }
+
+            for (int y = 0; y < 4 && by * 4 + y < height; y++)
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                    memcpy(&rgba[((static_cast<size_t>(by) * 4 + y) * width + bx * 4 + x) * 4], pixels[y * 4 + x], 4);
+        }
+    }
+}
+
+double computePSNR(const unsigned char *a, const unsigned char *b, int width, int height, int channels)
+{
+    double sum = 0.0;
+    size_t count = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < count; i++)
+        for (int c = 0; c < channels; c++)
+        {
+            double d = static_cast<double>(a[i * 4 + c]) - b[i * 4 + c];
+            sum += d * d;
+        }
+    double mse = sum / (static_cast<double>(count) * channels);
+    if (mse == 0.0)
+        return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
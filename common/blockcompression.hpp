@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+#include <common/threadpool.hpp>
+
+// GPU block compressed formats, 4x4 pixel blocks of 8 or 16 bytes
+enum BlockFormat
+{
+    BLOCK_BC1,      // RGB, 4 bits a pixel
+    BLOCK_BC3,      // RGBA, BC1 colour with a BC4 alpha block
+    BLOCK_BC4,      // one channel
+    BLOCK_BC5,      // two channels, for normal map x and y
+    BLOCK_BC7,      // RGBA, 8 bits a pixel
+    BLOCK_NONE
+};
+
+size_t blockBytes(BlockFormat format);
+size_t compressedSize(BlockFormat format, int width, int height);
+const char *blockFormatName(BlockFormat format);
+
+// Leading RGBA channels a format stores, the ones PSNR is measured over
+int blockFormatChannels(BlockFormat format);
+
+// Compresses RGBA8 pixels, rows of blocks are spread over pool. Edge blocks
+// of sizes that aren't a multiple of 4 repeat the last row and column.
+// BC7 is written in mode 6 only: one subset, 7 bit endpoints with a p-bit
+// and 4 bit indices.
+void compressBlocks(const unsigned char *rgba, int width, int height, BlockFormat format,
+                    unsigned char *out, ThreadPool &pool = ThreadPool::shared());
+
+// Decodes blocks back to RGBA8, the way the GPU would, to measure quality
+// without one. Channels a format doesn't store are 0, alpha 255. BC7
+// blocks in modes other than 6 decode as magenta.
+void decompressBlocks(const unsigned char *blocks, int width, int height, BlockFormat format,
+                      unsigned char *rgba);
+
+// Peak signal to noise ratio in dB over the first channels of two RGBA8
+// images, infinite when they are identical
+double computePSNR(const unsigned char *a, const unsigned char *b, int width, int height, int channels);
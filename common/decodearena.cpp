@@ -0,0 +1,332 @@
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <common/decodearena.hpp>
+
+namespace
+{
+    // Where an allocation came from, in front of it
+    enum AllocationKind
+    {
+        ALLOCATION_HEAP,
+        ALLOCATION_CHUNK,
+        ALLOCATION_BLOCK
+    };
+
+    // Two words so the allocation after it keeps malloc's alignment
+    struct AllocationHeader
+    {
+        size_t size;
+        size_t kind;
+    };
+
+    const size_t chunkBytes = 1024 * 1024;
+    const size_t maxChunkAllocation = 64 * 1024;    // bigger ones get a block
+    const size_t blockGranularity = 64 * 1024;
+    const size_t maxSpareBytes = 128 * 1024 * 1024; // of blocks a thread keeps between decodes
+
+    std::atomic<bool> arenaEnabled(true);
+
+    // A block is a heap allocation of its header and capacity bytes
+    struct Block
+    {
+        AllocationHeader *header;
+        size_t capacity;
+    };
+
+    struct ThreadArena
+    {
+        int depth;                          // scopes alive
+        bool enabled;
+        size_t imageBytes;
+        std::vector<char*> chunks;
+        size_t chunk;                       // the one being bumped
+        size_t chunkUsed;
+        AllocationHeader *lastInChunk;      // can grow or shrink in place
+        std::vector<Block> blocks;          // handed out
+        std::vector<Block> spare;
+        DecodeAllocationStats stats;
+        long long liveBytes;
+
+        ThreadArena() : depth(0), enabled(false), imageBytes(0), chunk(0), chunkUsed(0), lastInChunk(nullptr), liveBytes(0)
+        {
+            memset(&stats, 0, sizeof(stats));
+        }
+
+        ~ThreadArena()
+        {
+            for (size_t i = 0; i < chunks.size(); i++)
+                free(chunks[i]);
+            for (size_t i = 0; i < blocks.size(); i++)
+                free(blocks[i].header);
+            for (size_t i = 0; i < spare.size(); i++)
+                free(spare[i].header);
+        }
+    };
+
+    thread_local ThreadArena arena;
+
+    AllocationHeader *headerOf(void *pointer)
+    {
+        return static_cast<AllocationHeader*>(pointer) - 1;
+    }
+
+    size_t roundUp(size_t value, size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    // Only while a scope is alive, frees of images on other threads don't
+    // count against this one
+    void countAllocation(long long freed, long long allocated, bool heap)
+    {
+        if (arena.depth == 0)
+            return;
+        if (allocated > 0)
+            arena.stats.allocations++;
+        if (heap)
+            arena.stats.heapAllocations++;
+        arena.liveBytes += allocated - freed;
+        if (arena.liveBytes > static_cast<long long>(arena.stats.peakBytes))
+            arena.stats.peakBytes = static_cast<size_t>(arena.liveBytes);
+    }
+
+    AllocationHeader *allocateHeap(size_t size)
+    {
+        AllocationHeader *header = static_cast<AllocationHeader*>(malloc(sizeof(AllocationHeader) + size));
+        if (header == nullptr)
+            return nullptr;
+        header->size = size;
+        header->kind = ALLOCATION_HEAP;
+        countAllocation(0, static_cast<long long>(size), true);
+        return header;
+    }
+
+    AllocationHeader *allocateChunk(size_t size)
+    {
+        size_t needed = sizeof(AllocationHeader) + roundUp(size, sizeof(AllocationHeader));
+        if (arena.chunk < arena.chunks.size() && arena.chunkUsed + needed > chunkBytes)
+        {
+            arena.chunk++;
+            arena.chunkUsed = 0;
+        }
+        bool heap = arena.chunk == arena.chunks.size();
+        if (heap)
+        {
+            char *chunk = static_cast<char*>(malloc(chunkBytes));
+            if (chunk == nullptr)
+                return nullptr;
+            arena.chunks.push_back(chunk);
+        }
+        AllocationHeader *header = reinterpret_cast<AllocationHeader*>(arena.chunks[arena.chunk] + arena.chunkUsed);
+        arena.chunkUsed += needed;
+        arena.lastInChunk = header;
+        header->size = size;
+        header->kind = ALLOCATION_CHUNK;
+        countAllocation(0, static_cast<long long>(size), heap);
+        return header;
+    }
+
+    AllocationHeader *allocateBlock(size_t size)
+    {
+        // The smallest spare block it fits in, a new one if none does
+        size_t best = arena.spare.size();
+        for (size_t i = 0; i < arena.spare.size(); i++)
+            if (arena.spare[i].capacity >= size && (best == arena.spare.size() || arena.spare[i].capacity < arena.spare[best].capacity))
+                best = i;
+        Block block;
+        bool heap = best == arena.spare.size();
+        if (heap)
+        {
+            block.capacity = roundUp(size, blockGranularity);
+            block.header = static_cast<AllocationHeader*>(malloc(sizeof(AllocationHeader) + block.capacity));
+            if (block.header == nullptr)
+                return nullptr;
+        }
+        else
+        {
+            block = arena.spare[best];
+            arena.spare.erase(arena.spare.begin() + best);
+        }
+        arena.blocks.push_back(block);
+        block.header->size = size;
+        block.header->kind = ALLOCATION_BLOCK;
+        countAllocation(0, static_cast<long long>(size), heap);
+        return block.header;
+    }
+
+    // Index of the handed out block of header, or the number of them
+    size_t findBlock(const AllocationHeader *header)
+    {
+        size_t i = 0;
+        while (i < arena.blocks.size() && arena.blocks[i].header != header)
+            i++;
+        return i;
+    }
+
+    void releaseArena()
+    {
+        // Whatever the decode didn't free goes back with the rest
+        arena.spare.insert(arena.spare.end(), arena.blocks.begin(), arena.blocks.end());
+        arena.blocks.clear();
+        arena.chunk = 0;
+        arena.chunkUsed = 0;
+        arena.lastInChunk = nullptr;
+
+        // Biggest blocks go first, a one-off huge image shouldn't pin memory
+        std::sort(arena.spare.begin(), arena.spare.end(), [](const Block &a, const Block &b)
+        {
+            return a.capacity < b.capacity;
+        });
+        size_t spareBytes = 0;
+        for (size_t i = 0; i < arena.spare.size(); i++)
+            spareBytes += arena.spare[i].capacity;
+        while (spareBytes > maxSpareBytes)
+        {
+            spareBytes -= arena.spare.back().capacity;
+            free(arena.spare.back().header);
+            arena.spare.pop_back();
+        }
+    }
+}
+
+DecodeArenaScope::DecodeArenaScope(size_t imageBytes)
+{
+    if (arena.depth++ > 0)
+        return;
+    arena.enabled = arenaEnabled;
+    arena.imageBytes = imageBytes;
+    memset(&arena.stats, 0, sizeof(arena.stats));
+    arena.liveBytes = 0;
+}
+
+DecodeArenaScope::~DecodeArenaScope()
+{
+    if (--arena.depth == 0)
+        releaseArena();
+}
+
+void *DecodeArenaScope::keep(void *pixels)
+{
+    if (pixels == nullptr)
+        return nullptr;
+    AllocationHeader *header = headerOf(pixels);
+    if (header->kind == ALLOCATION_BLOCK)
+    {
+        // The block becomes an ordinary heap allocation
+        size_t i = findBlock(header);
+        if (i < arena.blocks.size())
+            arena.blocks.erase(arena.blocks.begin() + i);
+        header->kind = ALLOCATION_HEAP;
+    }
+    else if (header->kind == ALLOCATION_CHUNK)
+    {
+        AllocationHeader *copy = allocateHeap(header->size);
+        if (copy == nullptr)
+            return nullptr;
+        memcpy(copy + 1, pixels, header->size);
+        decodeArenaFree(pixels);
+        return copy + 1;
+    }
+    return pixels;
+}
+
+DecodeAllocationStats DecodeArenaScope::stats() const
+{
+    return arena.stats;
+}
+
+void setDecodeArenaEnabled(bool enabled)
+{
+    arenaEnabled = enabled;
+}
+
+void *decodeArenaMalloc(size_t size)
+{
+    AllocationHeader *header;
+    if (arena.depth == 0 || !arena.enabled || (size == arena.imageBytes && size > maxChunkAllocation))
+        header = allocateHeap(size);
+    else if (size <= maxChunkAllocation)
+        header = allocateChunk(size);
+    else
+        header = allocateBlock(size);
+    return header != nullptr ? header + 1 : nullptr;
+}
+
+void *decodeArenaRealloc(void *pointer, size_t size)
+{
+    if (pointer == nullptr)
+        return decodeArenaMalloc(size);
+    AllocationHeader *header = headerOf(pointer);
+    size_t oldSize = header->size;
+    if (header->kind == ALLOCATION_HEAP)
+    {
+        header = static_cast<AllocationHeader*>(realloc(header, sizeof(AllocationHeader) + size));
+        if (header == nullptr)
+            return nullptr;
+        header->size = size;
+        countAllocation(static_cast<long long>(oldSize), static_cast<long long>(size), true);
+        return header + 1;
+    }
+
+    // In place when the last allocation of the chunk or the block has room
+    bool inPlace = false;
+    if (header->kind == ALLOCATION_CHUNK && header == arena.lastInChunk && size <= maxChunkAllocation)
+    {
+        size_t start = reinterpret_cast<char*>(header) - arena.chunks[arena.chunk];
+        size_t needed = sizeof(AllocationHeader) + roundUp(size, sizeof(AllocationHeader));
+        inPlace = start + needed <= chunkBytes;
+        if (inPlace)
+            arena.chunkUsed = start + needed;
+    }
+    else if (header->kind == ALLOCATION_BLOCK)
+    {
+        size_t i = findBlock(header);
+        inPlace = i < arena.blocks.size() && arena.blocks[i].capacity >= size;
+    }
+    if (inPlace)
+    {
+        header->size = size;
+        countAllocation(static_cast<long long>(oldSize), static_cast<long long>(size), false);
+        return pointer;
+    }
+
+    void *moved = decodeArenaMalloc(size);
+    if (moved == nullptr)
+        return nullptr;
+    memcpy(moved, pointer, std::min(oldSize, size));
+    decodeArenaFree(pointer);
+    return moved;
+}
+
+void decodeArenaFree(void *pointer)
+{
+    if (pointer == nullptr)
+        return;
+    AllocationHeader *header = headerOf(pointer);
+    countAllocation(static_cast<long long>(header->size), 0, false);
+    if (header->kind == ALLOCATION_HEAP)
+        free(header);
+    else if (header->kind == ALLOCATION_CHUNK)
+    {
+        // Only the last one gives its room back, the rest goes with the
+        // scope
+        if (header == arena.lastInChunk)
+        {
+            arena.chunkUsed = reinterpret_cast<char*>(header) - arena.chunks[arena.chunk];
+            arena.lastInChunk = nullptr;
+        }
+    }
+    else
+    {
+        size_t i = findBlock(header);
+        if (i < arena.blocks.size())
+        {
+            arena.spare.push_back(arena.blocks[i]);
+            arena.blocks.erase(arena.blocks.begin() + i);
+        }
+    }
+}
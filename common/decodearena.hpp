@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+
+// Allocations stb_image made on a thread while a DecodeArenaScope was alive
+struct DecodeAllocationStats
+{
+    unsigned long long allocations;         // mallocs and reallocs asked for
+    unsigned long long heapAllocations;     // the ones that went to the heap
+    size_t peakBytes;                       // most asked for and not freed at once
+};
+
+// Every stb_image allocation on a thread with a scope alive comes out of an
+// arena of that thread: small ones are bumped out of chunks, big ones get
+// blocks of their own that a later decode on the thread reuses. Nothing goes
+// back to the heap until the scope ends, and then only what the arena
+// doesn't keep for the next image, so a batch of decodes stops faulting in
+// fresh pages for the same buffers and threads don't contend on the heap.
+// Scopes nest, the outermost resets the arena.
+class DecodeArenaScope
+{
+public:
+    // Allocations of imageBytes are taken to be the decoded image and come
+    // from the heap, so the image doesn't carry a block off with it. 0 if
+    // the size isn't known.
+    explicit DecodeArenaScope(size_t imageBytes = 0);
+    ~DecodeArenaScope();
+
+    // Takes an image out of the arena so it outlives the scope. It is freed
+    // with stbi_image_free as usual, on any thread.
+    void *keep(void *pixels);
+
+    // Of the scope so far
+    DecodeAllocationStats stats() const;
+
+private:
+    DecodeArenaScope(const DecodeArenaScope &);
+    DecodeArenaScope &operator=(const DecodeArenaScope &);
+};
+
+// Scopes started while disabled still count allocations but send all of
+// them to the heap, to compare the two
+void setDecodeArenaEnabled(bool enabled);
+
+// Allocation hooks of stb_image. Include this before stb_image.hpp where
+// STB_IMAGE_IMPLEMENTATION is defined, every stb_image allocation has to
+// go through them.
+void *decodeArenaMalloc(size_t size);
+void *decodeArenaRealloc(void *pointer, size_t size);
+void decodeArenaFree(void *pointer);
+
+#define STBI_MALLOC(size) decodeArenaMalloc(size)
+#define STBI_REALLOC(pointer, size) decodeArenaRealloc(pointer, size)
+#define STBI_FREE(pointer) decodeArenaFree(pointer)
@@ -0,0 +1,57 @@
+#include <cstring>
+
+#include <common/hash.hpp>
+
+namespace
+{
+    const unsigned long long prime1 = 0x9e3779b185ebca87ull;
+    const unsigned long long prime2 = 0xc2b2ae3d27d4eb4full;
+
+    inline unsigned long long rotate(unsigned long long x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline unsigned long long mix(unsigned long long h, unsigned long long word)
+    {
+        h ^= rotate(word * prime2, 31) * prime1;
+        return rotate(h, 27) * prime1 + prime2;
+    }
+}
+
+unsigned long long hashBytes(const void *data, size_t size, unsigned long long seed)
+{
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    unsigned long long h[4] = { seed + prime1, seed + prime2, seed, seed - prime1 };
+
+    // Four independent lanes of 8 bytes each keep the multiplier busy
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            unsigned long long word;
+            memcpy(&word, p + i + lane * 8, 8);
+            h[lane] = mix(h[lane], word);
+        }
+    }
+
+    unsigned long long result = rotate(h[0], 1) + rotate(h[1], 7) + rotate(h[2], 12) + rotate(h[3], 18);
+    for (; i + 8 <= size; i += 8)
+    {
+        unsigned long long word;
+        memcpy(&word, p + i, 8);
+        result = mix(result, word);
+    }
+    for (; i < size; i++)
+        result = mix(result, p[i]);
+
+    // Final avalanche
+    result ^= size;
+    result ^= result >> 33;
+    result *= prime2;
+    result ^= result >> 29;
+    result *= prime1;
+    result ^= result >> 32;
+    return result;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstddef>
+
+// Fast non-cryptographic 64-bit hash used to fingerprint asset contents
+unsigned long long hashBytes(const void *data, size_t size, unsigned long long seed = 0);
@@ -0,0 +1,154 @@
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+#include <common/imagedecoder.hpp>
+#include <common/mappedfile.hpp>
+#include <common/hash.hpp>
+#include <common/stb_image.hpp>
+
+bool decodeImage(const void *data, size_t size, bool flip, DecodedImage &image)
+{
+    // Scratch comes out of the thread's arena, only the pixels outlive it.
+    // The flip flag is per thread so workers don't race on it.
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int width = 0, height = 0, components = 0;
+    stbi_info_from_memory(static_cast<const stbi_uc*>(data), static_cast<int>(size), &width, &height, &components);
+    DecodeArenaScope arena(static_cast<size_t>(width) * height * components);
+    stbi_set_flip_vertically_on_load_thread(flip);
+    stbi_uc *pixels = stbi_load_from_memory(static_cast<const stbi_uc*>(data), static_cast<int>(size),
+                                            &image.width, &image.height, &image.components, 0);
+    image.pixels.reset(static_cast<unsigned char*>(arena.keep(pixels)), stbi_image_free);
+    image.allocations = arena.stats();
+    image.decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return image.pixels != nullptr;
+}
+
+bool decodeImageFile(const char *path, bool flip, DecodedImage &image)
+{
+    image = DecodedImage();
+    image.found = getFileInfo(path, image.size, image.modified);
+    MappedFile file;
+    if (!image.found || !file.open(path) || file.size() == 0)
+        return false;
+    image.hash = hashBytes(file.data(), file.size());
+    return decodeImage(file.data(), file.size(), flip, image);
+}
+
+void decodeImages(const std::vector<std::string> &paths, bool flip, ThreadPool &pool,
+                  const std::function<void(size_t index, DecodedImage &image)> &completed,
+                  const ImageDecodeFunction &decode)
+{
+    // Finished images queue up here for the calling thread
+    struct Shared
+    {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::deque<std::pair<size_t, DecodedImage> > finished;
+    };
+    std::shared_ptr<Shared> state = std::make_shared<Shared>();
+
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        std::string path = paths[i];
+        pool.submit([state, path, flip, i, decode]()
+        {
+            DecodedImage image;
+            decode(path.c_str(), flip, image);
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->finished.push_back(std::make_pair(i, image));
+            state->done.notify_one();
+        });
+    }
+
+    for (size_t received = 0; received < paths.size(); received++)
+    {
+        std::pair<size_t, DecodedImage> next;
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->done.wait(lock, [&state]() { return !state->finished.empty(); });
+            next = state->finished.front();
+            state->finished.pop_front();
+        }
+        completed(next.first, next.second);
+    }
+}
+
+BandDecoder::BandDecoder()
+    : band(nullptr), imageWidth(0), imageHeight(0), imageComponents(0), nextRow(0), corrupt(false), released(0)
+{
+}
+
+BandDecoder::~BandDecoder()
+{
+    close();
+}
+
+bool BandDecoder::open(const char *path)
+{
+    close();
+    if (!file.open(path) || file.size() == 0 || file.size() > static_cast<size_t>(INT_MAX))
+    {
+        file.close();
+        return false;
+    }
+    band = stbi_band_open_from_memory(reinterpret_cast<const stbi_uc*>(file.data()), static_cast<int>(file.size()),
+                                      &imageWidth, &imageHeight, &imageComponents);
+    if (band != nullptr)
+        return true;
+
+    // Not a kind that streams, it has to fit in memory after all
+    DecodedImage image;
+    bool decoded = decodeImage(file.data(), file.size(), false, image);
+    file.close();
+    if (!decoded)
+        return false;
+    whole = image.pixels;
+    imageWidth = image.width;
+    imageHeight = image.height;
+    imageComponents = image.components;
+    return true;
+}
+
+void BandDecoder::close()
+{
+    stbi_band_close(band);
+    band = nullptr;
+    whole.reset();
+    file.close();
+    imageWidth = imageHeight = imageComponents = nextRow = 0;
+    corrupt = false;
+    released = 0;
+}
+
+int BandDecoder::read(unsigned char *rows, int maxRows)
+{
+    size_t rowBytes = static_cast<size_t>(imageWidth) * imageComponents;
+    int count = std::max(std::min(maxRows, imageHeight - nextRow), 0);
+    if (whole != nullptr)
+        memcpy(rows, whole.get() + nextRow * rowBytes, count * rowBytes);
+    else if (band != nullptr)
+    {
+        count = stbi_band_read(band, rows, count);
+        if (nextRow + count < imageHeight && count < maxRows)
+            corrupt = true;
+
+        // The decoder never goes back, what it has read can leave memory.
+        // From the start each time, release() only drops whole pages.
+        size_t offset = static_cast<size_t>(stbi_band_input_offset(band));
+        if (offset > released)
+        {
+            file.release(0, offset);
+            released = offset;
+        }
+    }
+    else
+        count = 0;
+    nextRow += count;
+    return count;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstddef>
+
+#include <common/threadpool.hpp>
+#include <common/mipmap.hpp>
+#include <common/mappedfile.hpp>
+#include <common/decodearena.hpp>
+
+struct stbi_band;
+
+// Pixels decoded from an image file, 8 bits a channel, or its mip chain
+// when it was cooked
+struct DecodedImage
+{
+    std::shared_ptr<unsigned char> pixels;
+    std::shared_ptr<MipChain> levels;
+    bool found;                     // false if the file doesn't exist
+    unsigned long long size;        // of the file
+    long long modified;
+    unsigned long long hash;        // of the file contents
+    int width;
+    int height;
+    int components;
+    double decodeMilliseconds;
+    DecodeAllocationStats allocations;  // of the decode
+};
+
+// Decodes an image already in memory, flipped bottom row first for OpenGL
+// when flip is set. Safe on any thread.
+bool decodeImage(const void *data, size_t size, bool flip, DecodedImage &image);
+
+// Maps the file, hashes it and decodes it from the mapping
+bool decodeImageFile(const char *path, bool flip, DecodedImage &image);
+
+// Decodes every path on the pool and hands each image to completed on the
+// calling thread as soon as it is done, so uploads overlap the decoding
+// of the rest. Images that failed have no pixels. Can't be called from a
+// job on the same pool. decode replaces decodeImageFile, for cooking.
+typedef std::function<bool(const char *path, bool flip, DecodedImage &image)> ImageDecodeFunction;
+void decodeImages(const std::vector<std::string> &paths, bool flip, ThreadPool &pool,
+                  const std::function<void(size_t index, DecodedImage &image)> &completed,
+                  const ImageDecodeFunction &decode = decodeImageFile);
+
+// Reads an image file a band of rows at a time, top row first and never
+// flipped, so a huge image is never whole in memory. Non-interlaced 8-bit
+// PNGs and baseline JPEGs are decoded straight from the mapping, which is
+// let go of behind the decoder. Anything else stb_image reads is decoded
+// whole by open() and handed out the same way.
+class BandDecoder
+{
+public:
+    BandDecoder();
+
+    // Calls close()
+    ~BandDecoder();
+
+    bool open(const char *path);
+    void close();
+
+    // Decodes up to maxRows more rows of width() * components() bytes
+    // into rows, returns how many. 0 once they are all out, or when the
+    // rest of the file is corrupt, see failed().
+    int read(unsigned char *rows, int maxRows);
+
+    int width() const { return imageWidth; }
+    int height() const { return imageHeight; }
+    int components() const { return imageComponents; }
+    int rowsRead() const { return nextRow; }
+    bool isStreamed() const { return band != nullptr; }
+    bool failed() const { return corrupt; }
+
+private:
+    MappedFile file;
+    stbi_band *band;
+    std::shared_ptr<unsigned char> whole;
+    int imageWidth;
+    int imageHeight;
+    int imageComponents;
+    int nextRow;
+    bool corrupt;
+    size_t released;                // bytes at the start of the mapping let go of
+
+    BandDecoder(const BandDecoder &);
+    BandDecoder &operator=(const BandDecoder &);
+};
@@ -0,0 +1,164 @@
+#include <vector>
+#include <cstring>
+
+#include <common/lzcompress.hpp>
+
+namespace
+{
+    const size_t minMatch = 4;
+    const size_t maxOffset = 65535;
+    const size_t lastLiterals = 5;      // the block always ends in literals
+    const size_t matchSafety = 12;      // no match starts closer to the end
+    const int hashBits = 16;
+
+    inline unsigned int read32(const unsigned char *p)
+    {
+        unsigned int value;
+        memcpy(&value, p, 4);
+        return value;
+    }
+
+    inline unsigned int hashSequence(unsigned int sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - hashBits);
+    }
+
+    // 15 in the token, then bytes of 255 and the remainder
+    unsigned char *writeLength(unsigned char *out, size_t length)
+    {
+        for (length -= 15; length >= 255; length -= 255)
+            *out++ = 255;
+        *out++ = static_cast<unsigned char>(length);
+        return out;
+    }
+
+    unsigned char *writeSequence(unsigned char *out, const unsigned char *literals, size_t numLiterals,
+                                 size_t offset, size_t matchLength)
+    {
+        unsigned char *token = out++;
+        *token = static_cast<unsigned char>((numLiterals >= 15 ? 15 : numLiterals) << 4);
+        if (numLiterals >= 15)
+            out = writeLength(out, numLiterals);
+        memcpy(out, literals, numLiterals);
+        out += numLiterals;
+        if (matchLength == 0)
+            return out;
+
+        *out++ = static_cast<unsigned char>(offset);
+        *out++ = static_cast<unsigned char>(offset >> 8);
+        size_t length = matchLength - minMatch;
+        *token |= static_cast<unsigned char>(length >= 15 ? 15 : length);
+        if (length >= 15)
+            out = writeLength(out, length);
+        return out;
+    }
+
+    // Adds the bytes after 15 to a length, false if they run past the end
+    bool readLength(const unsigned char *&in, const unsigned char *end, size_t &length)
+    {
+        unsigned char byte;
+        do
+        {
+            if (in == end)
+                return false;
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+}
+
+size_t lzCompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t lzCompress(const void *data, size_t size, void *out)
+{
+    const unsigned char *in = static_cast<const unsigned char*>(data);
+    unsigned char *start = static_cast<unsigned char*>(out);
+    unsigned char *op = start;
+    size_t anchor = 0;
+    if (size > matchSafety)
+    {
+        // Greedy, the last position each 4 byte sequence was seen is the
+        // candidate. Runs without matches are stepped over faster.
+        std::vector<unsigned int> table(static_cast<size_t>(1) << hashBits, 0);
+        size_t matchEnd = size - lastLiterals;
+        size_t i = 0;
+        while (i + matchSafety <= size)
+        {
+            unsigned int sequence = read32(in + i);
+            unsigned int &slot = table[hashSequence(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<unsigned int>(i + 1);
+            if (candidate == 0 || i - (candidate - 1) > maxOffset || read32(in + candidate - 1) != sequence)
+            {
+                i += 1 + ((i - anchor) >> 6);
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = minMatch;
+            while (i + length < matchEnd && in[match + length] == in[i + length])
+                length++;
+            while (i > anchor && match > 0 && in[i - 1] == in[match - 1])
+            {
+                i--;
+                match--;
+                length++;
+            }
+            op = writeSequence(op, in + anchor, i - anchor, i - match, length);
+            i += length;
+            anchor = i;
+            if (i >= 2 && i + matchSafety <= size)
+                table[hashSequence(read32(in + i - 2))] = static_cast<unsigned int>(i - 1);
+        }
+    }
+    op = writeSequence(op, in + anchor, size - anchor, 0, 0);
+    return static_cast<size_t>(op - start);
+}
+
+bool lzDecompress(const void *data, size_t compressedSize, void *out, size_t size)
+{
+    const unsigned char *in = static_cast<const unsigned char*>(data);
+    const unsigned char *end = in + compressedSize;
+    unsigned char *start = static_cast<unsigned char*>(out);
+    unsigned char *op = start;
+    unsigned char *outEnd = start + size;
+    while (in < end)
+    {
+        unsigned int token = *in++;
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15 && !readLength(in, end, numLiterals))
+            return false;
+        if (numLiterals > static_cast<size_t>(end - in) || numLiterals > static_cast<size_t>(outEnd - op))
+            return false;
+        memcpy(op, in, numLiterals);
+        in += numLiterals;
+        op += numLiterals;
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            return false;
+        size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(in, end, length))
+            return false;
+        length += minMatch;
+        if (offset == 0 || offset > static_cast<size_t>(op - start) || length > static_cast<size_t>(outEnd - op))
+            return false;
+
+        // Overlapping matches repeat the bytes just written
+        const unsigned char *match = op - offset;
+        if (offset >= length)
+            memcpy(op, match, length);
+        else
+            for (size_t i = 0; i < length; i++)
+                op[i] = match[i];
+        op += length;
+    }
+    return op == outEnd;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Byte oriented LZ77 compression in the LZ4 block format: each sequence
+// is a token of literal and match lengths, the literals, a 16-bit offset
+// back into the output and the match. Fast to decode, meant for assets
+// that are read far more often than they are written.
+
+// Most bytes compressing size bytes can take
+size_t lzCompressBound(size_t size);
+
+// Compresses size bytes into out, which has to hold lzCompressBound(size)
+// bytes. Returns the compressed size.
+size_t lzCompress(const void *data, size_t size, void *out);
+
+// Decompresses a block into exactly size bytes of out, false if it is
+// corrupt or doesn't decode to that size. Never reads or writes outside
+// the buffers.
+bool lzDecompress(const void *data, size_t compressedSize, void *out, size_t size);
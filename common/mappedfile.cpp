@@ -0,0 +1,266 @@
+#include <algorithm>
+
+#include <common/mappedfile.hpp>
+#include <common/assetpack.hpp>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+namespace
+{
+    // What empty files point at, they can't be mapped but are valid to read
+    const char emptyFile[1] = { 0 };
+}
+
+MappedFile::MappedFile()
+    : fileData(nullptr), fileSize(0)
+#ifdef _WIN32
+    , fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char *path, MappedFileAccess access)
+{
+    close();
+
+    // Files in a mounted asset pack are read from its mapping
+    PackedFile packed;
+    if (findPackedFile(path, packed))
+    {
+        fileData = packed.data;
+        fileSize = packed.size;
+        packedData = packed.owner;
+        return true;
+    }
+    return map(path, access);
+}
+
+void MappedFile::close()
+{
+    if (packedData)
+    {
+        packedData.reset();
+        fileData = nullptr;
+        fileSize = 0;
+        return;
+    }
+    unmap();
+}
+
+void MappedFile::release(size_t offset, size_t size)
+{
+    // The pack's pages are shared with every file in it
+    if (!packedData)
+        releasePages(offset, size);
+}
+
+#ifdef _WIN32
+
+bool MappedFile::map(const char *path, MappedFileAccess access)
+{
+    DWORD hint = access == MAPPED_RANDOM ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN;
+    fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | hint, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(fileHandle, &length))
+    {
+        close();
+        return false;
+    }
+    if (length.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+        fileData = emptyFile;
+        return true;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL)
+    {
+        close();
+        return false;
+    }
+
+    fileData = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (fileData == nullptr)
+    {
+        close();
+        return false;
+    }
+    fileSize = static_cast<size_t>(length.QuadPart);
+    return true;
+}
+
+void MappedFile::releasePages(size_t offset, size_t size)
+{
+    // Unlocking pages that aren't locked takes them out of the working set
+    offset = std::min(offset, fileSize);
+    size = std::min(size, fileSize - offset);
+    if (size > 0)
+        VirtualUnlock(const_cast<char*>(fileData + offset), size);
+}
+
+void MappedFile::unmap()
+{
+    if (fileData && fileData != emptyFile)
+        UnmapViewOfFile(fileData);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fileHandle);
+
+    fileData = nullptr;
+    fileSize = 0;
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::map(const char *path, MappedFileAccess access)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        fileData = emptyFile;
+        return true;
+    }
+
+    void *ptr = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+
+    // Let the kernel read ahead for front to back reads
+    madvise(ptr, static_cast<size_t>(st.st_size), access == MAPPED_RANDOM ? MADV_RANDOM : MADV_SEQUENTIAL);
+
+    fileData = static_cast<const char*>(ptr);
+    fileSize = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::releasePages(size_t offset, size_t size)
+{
+    // Only whole pages inside the range can go
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    offset = std::min(offset, fileSize);
+    size_t end = std::min(offset + size, fileSize);
+    size_t first = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t last = end == fileSize ? end : end / pageSize * pageSize;
+    if (first < last)
+        madvise(const_cast<char*>(fileData + first), last - first, MADV_DONTNEED);
+}
+
+void MappedFile::unmap()
+{
+    if (fileData && fileData != emptyFile)
+        munmap(const_cast<char*>(fileData), fileSize);
+
+    fileData = nullptr;
+    fileSize = 0;
+}
+
+#endif
+
+bool getFileInfo(const char *path, unsigned long long &size, long long &modified)
+{
+    PackedFile packed;
+    if (findPackedFile(path, packed, false))
+    {
+        size = packed.size;
+        modified = packed.modified;
+        return true;
+    }
+
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+#endif
+    size = static_cast<unsigned long long>(st.st_size);
+    modified = static_cast<long long>(st.st_mtime);
+    return true;
+}
+
+bool listFiles(const char *directory, std::vector<std::string> &paths)
+{
+    std::string base(directory);
+    if (!base.empty() && base[base.size() - 1] != '/' && base[base.size() - 1] != '\\')
+        base += '/';
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE find = FindFirstFileA((base + "*").c_str(), &found);
+    if (find == INVALID_HANDLE_VALUE)
+        return false;
+    do
+    {
+        std::string name(found.cFileName);
+        if (name == "." || name == "..")
+            continue;
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            listFiles((base + name).c_str(), paths);
+        else
+            paths.push_back(base + name);
+    } while (FindNextFileA(find, &found));
+    FindClose(find);
+#else
+    DIR *dir = opendir(directory);
+    if (dir == nullptr)
+        return false;
+    while (dirent *entry = readdir(dir))
+    {
+        std::string name(entry->d_name);
+        if (name == "." || name == "..")
+            continue;
+        std::string path = base + name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            listFiles(path.c_str(), paths);
+        else if (S_ISREG(st.st_mode))
+            paths.push_back(path);
+    }
+    closedir(dir);
+#endif
+    return true;
+}
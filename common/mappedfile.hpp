@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// How a mapping will be read, so the OS can read ahead or not
+enum MappedFileAccess
+{
+    MAPPED_SEQUENTIAL,
+    MAPPED_RANDOM
+};
+
+// Read-only memory mapping of a whole file. The mapping is released when the
+// object is destroyed or close() is called. Files in a mounted asset pack
+// point into the pack instead, see assetpack.hpp.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Map the file at path, returns false if it can't be opened or mapped
+    bool open(const char *path, MappedFileAccess access = MAPPED_SEQUENTIAL);
+
+    // Unmap the file
+    void close();
+
+    // Drop the resident pages of a range that has been read, they are
+    // read back from the file if touched again
+    void release(size_t offset, size_t size);
+
+    const char *data() const { return fileData; }
+    size_t size() const { return fileSize; }
+    bool isOpen() const { return fileData != nullptr; }
+
+private:
+    const char *fileData;
+    size_t fileSize;
+    std::shared_ptr<const void> packedData;    // keeps a packed file alive, nothing is mapped then
+
+#ifdef _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+#endif
+
+    bool map(const char *path, MappedFileAccess access);
+    void unmap();
+    void releasePages(size_t offset, size_t size);
+
+    // Mappings can't be copied
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+// Size and last modification time of a file, false if it doesn't exist.
+// Packed files give the ones they had when they were packed.
+bool getFileInfo(const char *path, unsigned long long &size, long long &modified);
+
+// Appends the path of every file under directory, in subdirectories too,
+// in no particular order. False if directory can't be read.
+bool listFiles(const char *directory, std::vector<std::string> &paths);
@@ -0,0 +1,103 @@
+#include <cstring>
+
+#include <common/mesh.hpp>
+
+namespace
+{
+    const unsigned int emptySlot = 0xffffffffu;
+
+    inline unsigned int floatBits(float f)
+    {
+        unsigned int bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+}
+
+MeshBounds computeBounds(const glm::vec3 *points, size_t count)
+{
+    MeshBounds bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    if (count == 0)
+        return bounds;
+
+    bounds.min = bounds.max = points[0];
+    for (size_t i = 1; i < count; i++)
+    {
+        bounds.min = glm::min(bounds.min, points[i]);
+        bounds.max = glm::max(bounds.max, points[i]);
+    }
+    return bounds;
+}
+
+VertexWelder::VertexWelder(std::vector<glm::vec3> &vertices,
+                           std::vector<glm::vec2> &uvs,
+                           std::vector<glm::vec3> &normals)
+    : vertices(vertices), uvs(uvs), normals(normals), mask(0)
+{
+    reserve(1024);
+}
+
+void VertexWelder::reserve(size_t numVertices)
+{
+    vertices.reserve(numVertices);
+    uvs.reserve(numVertices);
+    normals.reserve(numVertices);
+
+    // Keep the table at most half full
+    size_t numSlots = 16;
+    while (numSlots < numVertices * 2)
+        numSlots *= 2;
+    if (numSlots > table.size())
+        rehash(numSlots);
+}
+
+size_t VertexWelder::hash(const glm::vec3 &vertex, const glm::vec2 &uv, const glm::vec3 &normal) const
+{
+    // FNV-1a style mix of the raw float bits
+    const float values[8] = { vertex.x, vertex.y, vertex.z, uv.x, uv.y, normal.x, normal.y, normal.z };
+    unsigned long long h = 14695981039346656037ull;
+    for (int i = 0; i < 8; i++)
+    {
+        h ^= floatBits(values[i]);
+        h *= 1099511628211ull;
+        h ^= h >> 29;
+    }
+    return static_cast<size_t>(h);
+}
+
+void VertexWelder::rehash(size_t numSlots)
+{
+    table.assign(numSlots, emptySlot);
+    mask = numSlots - 1;
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        size_t slot = hash(vertices[i], uvs[i], normals[i]) & mask;
+        while (table[slot] != emptySlot)
+            slot = (slot + 1) & mask;
+        table[slot] = static_cast<unsigned int>(i);
+    }
+}
+
+unsigned int VertexWelder::add(const glm::vec3 &vertex, const glm::vec2 &uv, const glm::vec3 &normal)
+{
+    size_t slot = hash(vertex, uv, normal) & mask;
+    while (table[slot] != emptySlot)
+    {
+        unsigned int index = table[slot];
+        if (memcmp(&vertices[index], &vertex, sizeof(glm::vec3)) == 0 &&
+            memcmp(&uvs[index], &uv, sizeof(glm::vec2)) == 0 &&
+            memcmp(&normals[index], &normal, sizeof(glm::vec3)) == 0)
+            return index;
+        slot = (slot + 1) & mask;
+    }
+
+    unsigned int index = static_cast<unsigned int>(vertices.size());
+    vertices.push_back(vertex);
+    uvs.push_back(uv);
+    normals.push_back(normal);
+    table[slot] = index;
+
+    if (vertices.size() * 2 > table.size())
+        rehash(table.size() * 2);
+    return index;
+}
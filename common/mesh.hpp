@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box
+struct MeshBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Range of the index list drawn with one material
+struct Submesh
+{
+    unsigned int firstIndex;
+    unsigned int numIndices;
+    unsigned int material;
+    unsigned int padding;
+};
+
+// Material constants as laid out in the std140 MaterialTable block of the
+// fragment shader. Specular w is the shininess and diffuse w the opacity.
+struct PackedMaterial
+{
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+// Size of the MaterialTable array in the fragment shader
+const unsigned int maxMaterials = 256;
+
+// Bounds of a list of points, zero sized at the origin if there are none
+MeshBounds computeBounds(const glm::vec3 *points, size_t count);
+
+// Builds an indexed vertex list from triangle corners, corners with
+// bitwise identical position, uv and normal share one vertex
+class VertexWelder
+{
+public:
+    VertexWelder(std::vector<glm::vec3> &vertices,
+                 std::vector<glm::vec2> &uvs,
+                 std::vector<glm::vec3> &normals);
+
+    // Size the table for about this many unique vertices
+    void reserve(size_t numVertices);
+
+    // Returns the index of the vertex, adding it if it hasn't been seen
+    unsigned int add(const glm::vec3 &vertex, const glm::vec2 &uv, const glm::vec3 &normal);
+
+private:
+    std::vector<glm::vec3> &vertices;
+    std::vector<glm::vec2> &uvs;
+    std::vector<glm::vec3> &normals;
+
+    // Open addressed table of vertex indices, empty slots hold ~0u
+    std::vector<unsigned int> table;
+    size_t mask;
+
+    void rehash(size_t numSlots);
+    size_t hash(const glm::vec3 &vertex, const glm::vec2 &uv, const glm::vec3 &normal) const;
+};
@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <cstring>
+#include <stdio.h>
+
+#include <common/meshcache.hpp>
+#include <common/hash.hpp>
+
+namespace
+{
+    const char meshMagic[4] = { 'C', 'G', 'M', 'S' };
+    const size_t sectionAlignment = 64;
+
+    enum MeshSection
+    {
+        SectionVertices,
+        SectionIndices,
+        SectionSubmeshes,
+        SectionLodErrors,
+        SectionMeshlets,
+        SectionMaterials,
+        SectionDependencies,
+        NumSections
+    };
+
+    // Fixed size header at the start of the file, all offsets are from the
+    // start of the file
+    struct MeshFileHeader
+    {
+        char magic[4];
+        unsigned int version;
+        unsigned long long sourceSize;
+        long long sourceModified;
+        unsigned long long sourceHash;
+        unsigned int options;
+        unsigned int numVertices;
+        unsigned int numIndices;
+        unsigned int indexSize;
+        unsigned int numSubmeshes;
+        unsigned int numLods;
+        unsigned int numMeshlets;
+        unsigned int numMaterials;
+        unsigned int numDependencies;
+        float boundsMin[3];
+        float boundsMax[3];
+        unsigned long long sectionOffset[NumSections];
+        unsigned long long sectionSize[NumSections];
+    };
+
+    // Followed by pathLength bytes of path and padding to 8 bytes
+    struct DependencyRecord
+    {
+        unsigned long long size;
+        long long modified;
+        unsigned int pathLength;
+        unsigned int padding;
+    };
+
+    inline size_t alignDependency(size_t length)
+    {
+        return (length + 7) & ~static_cast<size_t>(7);
+    }
+
+    // True if every recorded dependency still has the same size and time,
+    // their paths go in paths
+    bool dependenciesUnchanged(const char *section, size_t size, unsigned int count,
+                               std::vector<std::string> &paths)
+    {
+        size_t offset = 0;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            DependencyRecord record;
+            if (offset + sizeof(record) > size)
+                return false;
+            memcpy(&record, section + offset, sizeof(record));
+            offset += sizeof(record);
+            if (offset + record.pathLength > size)
+                return false;
+            std::string path(section + offset, record.pathLength);
+            offset += alignDependency(record.pathLength);
+            paths.push_back(path);
+
+            unsigned long long currentSize;
+            long long currentModified;
+            if (!getFileInfo(path.c_str(), currentSize, currentModified) ||
+                currentSize != record.size || currentModified != record.modified)
+                return false;
+        }
+        return true;
+    }
+
+    inline size_t alignUp(size_t offset)
+    {
+        return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+    }
+
+    inline bool rangeInside(unsigned long long first, unsigned long long count, unsigned long long total)
+    {
+        return count <= total && first <= total - count;
+    }
+
+    // True if every submesh and meshlet lies inside the index stream and
+    // every index inside the vertex stream, so a damaged cache can't be
+    // drawn out of bounds
+    bool rangesValid(const MeshFileHeader &header, const char *base)
+    {
+        const Submesh *submeshes = reinterpret_cast<const Submesh*>(base + header.sectionOffset[SectionSubmeshes]);
+        size_t numSubmeshes = static_cast<size_t>(header.numLods) * header.numSubmeshes;
+        for (size_t i = 0; i < numSubmeshes; i++)
+            if (!rangeInside(submeshes[i].firstIndex, submeshes[i].numIndices, header.numIndices))
+                return false;
+
+        const Meshlet *meshlets = reinterpret_cast<const Meshlet*>(base + header.sectionOffset[SectionMeshlets]);
+        for (unsigned int i = 0; i < header.numMeshlets; i++)
+            if (!rangeInside(meshlets[i].firstIndex, meshlets[i].numIndices, header.numIndices))
+                return false;
+
+        const char *indices = base + header.sectionOffset[SectionIndices];
+        unsigned int largest = 0;
+        if (header.indexSize == sizeof(unsigned short))
+        {
+            const unsigned short *shortIndices = reinterpret_cast<const unsigned short*>(indices);
+            for (unsigned int i = 0; i < header.numIndices; i++)
+                largest = std::max<unsigned int>(largest, shortIndices[i]);
+        }
+        else
+        {
+            const unsigned int *longIndices = reinterpret_cast<const unsigned int*>(indices);
+            for (unsigned int i = 0; i < header.numIndices; i++)
+                largest = std::max(largest, longIndices[i]);
+        }
+        return header.numIndices == 0 || largest < header.numVertices;
+    }
+
+    // Hashes the source file, 0 if it can't be read
+    unsigned long long hashFile(const char *path)
+    {
+        MappedFile source;
+        if (!source.open(path))
+            return 0;
+        return hashBytes(source.data(), source.size());
+    }
+}
+
+std::string MeshCache::cachePath(const char *sourcePath)
+{
+    return std::string(sourcePath) + ".mesh";
+}
+
+bool MeshCache::open(const char *sourcePath, unsigned int options)
+{
+    close();
+
+    unsigned long long sourceSize;
+    long long sourceModified;
+    if (!getFileInfo(sourcePath, sourceSize, sourceModified))
+        return false;
+
+    std::string path = cachePath(sourcePath);
+    if (!file.open(path.c_str()) || file.size() < sizeof(MeshFileHeader))
+    {
+        close();
+        return false;
+    }
+
+    MeshFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, meshMagic, 4) != 0 || header.version != version ||
+        header.sourceSize != sourceSize || header.options != options ||
+        (header.indexSize != 2 && header.indexSize != 4) || header.numLods == 0)
+    {
+        close();
+        return false;
+    }
+
+    // A touched but unchanged source only costs a hash of the file
+    if (header.sourceModified != sourceModified && header.sourceHash != hashFile(sourcePath))
+    {
+        close();
+        return false;
+    }
+
+    // Every section has to lie inside the file and match the counts, in
+    // 64 bits so no size can wrap round
+    const unsigned long long expected[NumSections] = {
+        static_cast<unsigned long long>(header.numVertices) * sizeof(PackedVertex),
+        static_cast<unsigned long long>(header.numIndices) * header.indexSize,
+        static_cast<unsigned long long>(header.numLods) * header.numSubmeshes * sizeof(Submesh),
+        static_cast<unsigned long long>(header.numLods) * sizeof(float),
+        static_cast<unsigned long long>(header.numMeshlets) * sizeof(Meshlet),
+        static_cast<unsigned long long>(header.numMaterials) * sizeof(PackedMaterial),
+        header.sectionSize[SectionDependencies]
+    };
+    for (int i = 0; i < NumSections; i++)
+    {
+        if (header.sectionSize[i] != expected[i] ||
+            header.sectionOffset[i] % sectionAlignment != 0 ||
+            header.sectionSize[i] > file.size() || header.sectionOffset[i] > file.size() - header.sectionSize[i])
+        {
+            close();
+            return false;
+        }
+    }
+
+    const char *base = file.data();
+    if (!rangesValid(header, base) ||
+        !dependenciesUnchanged(base + header.sectionOffset[SectionDependencies],
+                               static_cast<size_t>(header.sectionSize[SectionDependencies]),
+                               header.numDependencies, dependencyPaths))
+    {
+        close();
+        return false;
+    }
+
+    mesh.vertices = reinterpret_cast<const PackedVertex*>(base + header.sectionOffset[SectionVertices]);
+    mesh.indices = base + header.sectionOffset[SectionIndices];
+    mesh.submeshes = reinterpret_cast<const Submesh*>(base + header.sectionOffset[SectionSubmeshes]);
+    mesh.lodErrors = reinterpret_cast<const float*>(base + header.sectionOffset[SectionLodErrors]);
+    mesh.meshlets = reinterpret_cast<const Meshlet*>(base + header.sectionOffset[SectionMeshlets]);
+    mesh.materials = reinterpret_cast<const PackedMaterial*>(base + header.sectionOffset[SectionMaterials]);
+    mesh.indexSize = header.indexSize;
+    mesh.numVertices = header.numVertices;
+    mesh.numIndices = header.numIndices;
+    mesh.numSubmeshes = header.numSubmeshes;
+    mesh.numLods = header.numLods;
+    mesh.numMeshlets = header.numMeshlets;
+    mesh.numMaterials = header.numMaterials;
+    mesh.bounds.min = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    mesh.bounds.max = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    return true;
+}
+
+void MeshCache::close()
+{
+    file.close();
+    mesh = MeshView();
+    dependencyPaths.clear();
+}
+
+bool MeshCache::save(const char *sourcePath, const MeshView &mesh, unsigned int options,
+                     const std::vector<std::string> &dependencies)
+{
+    // Dependencies are recorded as they are now
+    std::vector<char> dependencySection;
+    for (size_t i = 0; i < dependencies.size(); i++)
+    {
+        DependencyRecord record;
+        memset(&record, 0, sizeof(record));
+        if (!getFileInfo(dependencies[i].c_str(), record.size, record.modified))
+            return false;
+        record.pathLength = static_cast<unsigned int>(dependencies[i].size());
+        size_t offset = dependencySection.size();
+        dependencySection.resize(offset + sizeof(record) + alignDependency(record.pathLength), 0);
+        memcpy(&dependencySection[offset], &record, sizeof(record));
+        memcpy(&dependencySection[offset + sizeof(record)], dependencies[i].data(), record.pathLength);
+    }
+
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, meshMagic, 4);
+    header.version = version;
+    if (!getFileInfo(sourcePath, header.sourceSize, header.sourceModified))
+        return false;
+    header.sourceHash = hashFile(sourcePath);
+    header.options = options;
+    header.numVertices = mesh.numVertices;
+    header.numIndices = mesh.numIndices;
+    header.indexSize = mesh.indexSize;
+    header.numSubmeshes = mesh.numSubmeshes;
+    header.numLods = mesh.numLods;
+    header.numMeshlets = mesh.numMeshlets;
+    header.numMaterials = mesh.numMaterials;
+    header.numDependencies = static_cast<unsigned int>(dependencies.size());
+    for (int i = 0; i < 3; i++)
+    {
+        header.boundsMin[i] = mesh.bounds.min[i];
+        header.boundsMax[i] = mesh.bounds.max[i];
+    }
+
+    const void *sections[NumSections] = {
+        mesh.vertices, mesh.indices, mesh.submeshes, mesh.lodErrors, mesh.meshlets,
+        mesh.materials, dependencySection.data()
+    };
+    header.sectionSize[SectionVertices] = mesh.numVertices * sizeof(PackedVertex);
+    header.sectionSize[SectionIndices] = static_cast<unsigned long long>(mesh.numIndices) * mesh.indexSize;
+    header.sectionSize[SectionSubmeshes] = static_cast<unsigned long long>(mesh.numLods) * mesh.numSubmeshes * sizeof(Submesh);
+    header.sectionSize[SectionLodErrors] = mesh.numLods * sizeof(float);
+    header.sectionSize[SectionMeshlets] = mesh.numMeshlets * sizeof(Meshlet);
+    header.sectionSize[SectionMaterials] = mesh.numMaterials * sizeof(PackedMaterial);
+    header.sectionSize[SectionDependencies] = dependencySection.size();
+
+    size_t offset = alignUp(sizeof(header));
+    for (int i = 0; i < NumSections; i++)
+    {
+        header.sectionOffset[i] = offset;
+        offset = alignUp(offset + static_cast<size_t>(header.sectionSize[i]));
+    }
+
+    // Write to a temporary file and swap it in so a failed write never
+    // leaves a truncated cache behind
+    std::string path = cachePath(sourcePath);
+    std::string tempPath = path + ".tmp";
+    FILE *out = fopen(tempPath.c_str(), "wb");
+    if (out == NULL)
+        return false;
+
+    static const char zeros[sectionAlignment] = { 0 };
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    size_t written = sizeof(header);
+    for (int i = 0; i < NumSections && ok; i++)
+    {
+        size_t padding = static_cast<size_t>(header.sectionOffset[i]) - written;
+        ok = fwrite(zeros, 1, padding, out) == padding;
+        size_t size = static_cast<size_t>(header.sectionSize[i]);
+        if (ok && size > 0)
+            ok = fwrite(sections[i], 1, size, out) == size;
+        written += padding + size;
+    }
+    ok = fclose(out) == 0 && ok;
+
+    if (ok)
+    {
+        remove(path.c_str());
+        ok = rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+        remove(tempPath.c_str());
+    return ok;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <common/mesh.hpp>
+#include <common/mappedfile.hpp>
+#include <common/vertexformat.hpp>
+#include <common/meshlet.hpp>
+
+// GPU ready vertex and index streams of a mesh. The pointers either point at
+// arrays owned by the caller or into a mapped cache file.
+struct MeshView
+{
+    const PackedVertex *vertices;
+    const void *indices;
+    unsigned int indexSize;     // 2 or 4 bytes
+    unsigned int numVertices;
+    unsigned int numIndices;
+    unsigned int numSubmeshes;  // per LOD
+    unsigned int numLods;
+    const Submesh *submeshes;   // numSubmeshes for each LOD, finest first
+    const float *lodErrors;     // simplification error of each LOD
+    unsigned int numMeshlets;
+    const Meshlet *meshlets;    // in index order, never crossing a submesh
+    unsigned int numMaterials;
+    const PackedMaterial *materials;    // indexed by Submesh::material
+    MeshBounds bounds;
+};
+
+// Binary cooked copy of a mesh stored next to its source as <source>.mesh.
+// Each stream is in its own 64 byte aligned section so it can be handed
+// straight to glBufferData from the mapping.
+class MeshCache
+{
+public:
+    // Bumped whenever the file layout changes
+    static const unsigned int version = 7;
+
+    MeshCache() : mesh() {}
+
+    // Path of the cache file for a source file
+    static std::string cachePath(const char *sourcePath);
+
+    // Map the cache for sourcePath, false if it is missing, from another
+    // version, was cooked with different options, doesn't match the
+    // source's size, time stamp or hash or any dependency has changed
+    bool open(const char *sourcePath, unsigned int options = 0);
+
+    // Unmap the cache, pointers from view() are no longer valid
+    void close();
+
+    const MeshView &view() const { return mesh; }
+
+    // Files other than the source the open cache was cooked from
+    const std::vector<std::string> &dependencies() const { return dependencyPaths; }
+
+    // Write a cooked mesh for sourcePath, options are the flags that
+    // changed how it was cooked. dependencies are other files read while
+    // cooking, such as material libraries, checked by size and time stamp.
+    static bool save(const char *sourcePath, const MeshView &mesh, unsigned int options = 0,
+                     const std::vector<std::string> &dependencies = std::vector<std::string>());
+
+private:
+    MappedFile file;
+    MeshView mesh;
+    std::vector<std::string> dependencyPaths;
+};
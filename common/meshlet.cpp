@@ -0,0 +1,183 @@
+#include <cmath>
+#include <algorithm>
+
+#include <common/meshlet.hpp>
+
+namespace
+{
+    // Ritter's bounding sphere, within a few percent of the smallest
+    void boundingSphere(const glm::vec3 *positions, const std::vector<unsigned int> &vertices,
+                        glm::vec3 &centre, float &radius)
+    {
+        // Start from the two points furthest apart along a sweep
+        glm::vec3 a = positions[vertices[0]];
+        glm::vec3 b = a;
+        for (size_t i = 0; i < vertices.size(); i++)
+            if (glm::length(positions[vertices[i]] - a) > glm::length(b - a))
+                b = positions[vertices[i]];
+        glm::vec3 c = b;
+        for (size_t i = 0; i < vertices.size(); i++)
+            if (glm::length(positions[vertices[i]] - b) > glm::length(c - b))
+                c = positions[vertices[i]];
+        centre = (b + c) * 0.5f;
+        radius = glm::length(c - b) * 0.5f;
+
+        // Grow it over any point left outside
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const glm::vec3 &p = positions[vertices[i]];
+            float distance = glm::length(p - centre);
+            if (distance > radius)
+            {
+                float grown = (radius + distance) * 0.5f;
+                centre += (p - centre) * ((grown - radius) / distance);
+                radius = grown;
+            }
+        }
+    }
+
+    void finishMeshlet(const unsigned int *indices, const glm::vec3 *positions,
+                       const std::vector<unsigned int> &vertices, Meshlet &meshlet)
+    {
+        boundingSphere(positions, vertices, meshlet.centre, meshlet.radius);
+
+        // Cone around the average triangle normal, too wide to ever be
+        // entirely backfacing once it reaches 90 degrees
+        const unsigned int *triangles = indices + meshlet.firstIndex;
+        glm::vec3 axis(0.0f);
+        for (unsigned int i = 0; i < meshlet.numIndices; i += 3)
+        {
+            const glm::vec3 &a = positions[triangles[i]];
+            glm::vec3 n = glm::cross(positions[triangles[i + 1]] - a, positions[triangles[i + 2]] - a);
+            float length = glm::length(n);
+            if (length > 0.0f)
+                axis += n / length;
+        }
+
+        meshlet.coneAxis = glm::vec3(0.0f);
+        meshlet.coneCutoff = 1.0f;
+        float axisLength = glm::length(axis);
+        if (axisLength == 0.0f)
+            return;
+        axis /= axisLength;
+
+        float minDot = 1.0f;
+        for (unsigned int i = 0; i < meshlet.numIndices; i += 3)
+        {
+            const glm::vec3 &a = positions[triangles[i]];
+            glm::vec3 n = glm::cross(positions[triangles[i + 1]] - a, positions[triangles[i + 2]] - a);
+            float length = glm::length(n);
+            if (length > 0.0f)
+                minDot = std::min(minDot, glm::dot(axis, n / length));
+        }
+        if (minDot <= 0.0f)
+            return;
+
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+}
+
+void buildMeshlets(const unsigned int *indices, unsigned int firstIndex, unsigned int numIndices,
+                   const glm::vec3 *positions, size_t numVertices,
+                   std::vector<Meshlet> &meshlets)
+{
+    // Meshlet each vertex was last added to, so shared vertices count once
+    std::vector<unsigned int> owner(numVertices, 0);
+    std::vector<unsigned int> vertices;
+    unsigned int current = 1;
+
+    Meshlet meshlet = Meshlet();
+    meshlet.firstIndex = firstIndex;
+    for (unsigned int i = firstIndex; i + 3 <= firstIndex + numIndices; i += 3)
+    {
+        unsigned int added = 0;
+        for (int k = 0; k < 3; k++)
+            if (owner[indices[i + k]] != current &&
+                (k < 1 || indices[i + k] != indices[i]) &&
+                (k < 2 || indices[i + k] != indices[i + 1]))
+                added++;
+
+        if (meshlet.numVertices + added > maxMeshletVertices ||
+            meshlet.numIndices / 3 + 1 > maxMeshletTriangles)
+        {
+            finishMeshlet(indices, positions, vertices, meshlet);
+            meshlets.push_back(meshlet);
+            meshlet = Meshlet();
+            meshlet.firstIndex = i;
+            vertices.clear();
+            current++;
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[i + k];
+            if (owner[v] != current)
+            {
+                owner[v] = current;
+                vertices.push_back(v);
+            }
+        }
+        meshlet.numVertices = static_cast<unsigned int>(vertices.size());
+        meshlet.numIndices += 3;
+    }
+
+    if (meshlet.numIndices > 0)
+    {
+        finishMeshlet(indices, positions, vertices, meshlet);
+        meshlets.push_back(meshlet);
+    }
+}
+
+size_t cullMeshlets(const Meshlet *meshlets, size_t count,
+                    const glm::mat4 &modelViewProjection, const glm::vec3 &cameraPosition,
+                    bool cullBackfaces, std::vector<IndexRange> &ranges)
+{
+    // Frustum planes in object space (Gribb and Hartmann), normalised so
+    // the sphere radius can be compared against the plane distance
+    const glm::mat4 &m = modelViewProjection;
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    glm::vec4 planes[6];
+    for (int i = 0; i < 3; i++)
+    {
+        planes[i * 2] = rows[3] + rows[i];
+        planes[i * 2 + 1] = rows[3] - rows[i];
+    }
+    for (int i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const Meshlet &meshlet = meshlets[i];
+
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++)
+            outside = glm::dot(glm::vec3(planes[p]), meshlet.centre) + planes[p].w < -meshlet.radius;
+        if (outside)
+            continue;
+
+        // Backfacing if every direction from the camera into the sphere
+        // is within 90 degrees of every normal in the cone
+        if (cullBackfaces)
+        {
+            glm::vec3 view = meshlet.centre - cameraPosition;
+            if (glm::dot(view, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(view) + meshlet.radius)
+                continue;
+        }
+
+        if (!ranges.empty() && ranges.back().firstIndex + ranges.back().numIndices == meshlet.firstIndex)
+        {
+            ranges.back().numIndices += meshlet.numIndices;
+        }
+        else
+        {
+            IndexRange range = { meshlet.firstIndex, meshlet.numIndices };
+            ranges.push_back(range);
+        }
+        kept++;
+    }
+    return kept;
+}
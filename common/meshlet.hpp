@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// Most vertices and triangles in a meshlet, sized for mesh shader groups
+const unsigned int maxMeshletVertices = 64;
+const unsigned int maxMeshletTriangles = 124;
+
+// A run of consecutive triangles in the index buffer with the bounds used
+// to cull it. The cone holds every triangle normal, the meshlet is
+// entirely backfacing when seen from inside the negated cone.
+struct Meshlet
+{
+    unsigned int firstIndex;
+    unsigned int numIndices;
+    unsigned int numVertices;
+    float coneCutoff;           // sine of the cone angle, 1 never culls
+    glm::vec3 centre;
+    float radius;
+    glm::vec3 coneAxis;
+    unsigned int padding;
+};
+
+// Contiguous range of indices left after culling
+struct IndexRange
+{
+    unsigned int firstIndex;
+    unsigned int numIndices;
+};
+
+// Splits indices[firstIndex, firstIndex + numIndices) into meshlets in
+// triangle order and appends them to meshlets. Cache optimised orders keep
+// neighbouring triangles together so no reordering is done.
+void buildMeshlets(const unsigned int *indices, unsigned int firstIndex, unsigned int numIndices,
+                   const glm::vec3 *positions, size_t numVertices,
+                   std::vector<Meshlet> &meshlets);
+
+// Appends the meshlets that are inside the frustum of modelViewProjection,
+// and optionally not backfacing from cameraPosition in object space, to
+// ranges. Neighbouring visible meshlets are merged into one range. Returns
+// the number of meshlets kept.
+size_t cullMeshlets(const Meshlet *meshlets, size_t count,
+                    const glm::mat4 &modelViewProjection, const glm::vec3 &cameraPosition,
+                    bool cullBackfaces, std::vector<IndexRange> &ranges);
@@ -0,0 +1,318 @@
+#include <algorithm>
+
+#include <common/meshoptimiser.hpp>
+
+namespace
+{
+    // FIFO post-transform cache keyed on the time each vertex entered it
+    class CacheSimulator
+    {
+    public:
+        CacheSimulator(size_t numVertices, unsigned int cacheSize)
+            : entered(numVertices, 0), cacheSize(cacheSize), time(cacheSize + 1)
+        {
+        }
+
+        // Returns true on a miss
+        bool access(unsigned int vertex)
+        {
+            if (time - entered[vertex] > cacheSize)
+            {
+                entered[vertex] = time++;
+                return true;
+            }
+            return false;
+        }
+
+        // Empties the cache
+        void flush()
+        {
+            time += cacheSize + 1;
+        }
+
+    private:
+        std::vector<unsigned long long> entered;
+        unsigned long long cacheSize;
+        unsigned long long time;
+    };
+
+    // Triangles using each vertex, stored as offsets into one array
+    struct TriangleAdjacency
+    {
+        std::vector<unsigned int> offsets;
+        std::vector<unsigned int> triangles;
+
+        TriangleAdjacency(const unsigned int *indices, size_t numIndices, size_t numVertices)
+            : offsets(numVertices + 1, 0), triangles(numIndices)
+        {
+            for (size_t i = 0; i < numIndices; i++)
+                offsets[indices[i] + 1]++;
+            for (size_t v = 0; v < numVertices; v++)
+                offsets[v + 1] += offsets[v];
+
+            std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < numIndices; i++)
+                triangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+    };
+
+    struct Cluster
+    {
+        size_t first;
+        size_t count;
+        float sortKey;
+    };
+}
+
+VertexCacheStats analyseVertexCache(const unsigned int *indices, size_t numIndices,
+                                    size_t numVertices, unsigned int cacheSize)
+{
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if (numIndices < 3)
+        return stats;
+
+    CacheSimulator cache(numVertices, cacheSize);
+    std::vector<bool> used(numVertices, false);
+    size_t misses = 0;
+    size_t numUsed = 0;
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        if (cache.access(indices[i]))
+            misses++;
+        if (!used[indices[i]])
+        {
+            used[indices[i]] = true;
+            numUsed++;
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) / (numIndices / 3);
+    stats.atvr = static_cast<float>(misses) / numUsed;
+    return stats;
+}
+
+void optimiseVertexCache(unsigned int *indices, size_t numIndices, size_t numVertices,
+                         unsigned int cacheSize)
+{
+    size_t numTriangles = numIndices / 3;
+    if (numTriangles == 0)
+        return;
+
+    TriangleAdjacency adjacency(indices, numIndices, numVertices);
+    std::vector<unsigned int> live(numVertices);
+    for (size_t v = 0; v < numVertices; v++)
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+    std::vector<unsigned int> output;
+    output.reserve(numIndices);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<unsigned long long> cacheTime(numVertices, 0);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    unsigned long long time = cacheSize + 1;
+    size_t cursor = 0;
+
+    long long fan = indices[0];
+    while (fan >= 0)
+    {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int j = adjacency.offsets[fan]; j < adjacency.offsets[fan + 1]; j++)
+        {
+            unsigned int t = adjacency.triangles[j];
+            if (emitted[t])
+                continue;
+
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // Next fan is the candidate that entered the cache longest ago and
+        // would still be in it after its remaining triangles are emitted
+        long long next = -1;
+        unsigned long long best = 0;
+        for (size_t j = 0; j < candidates.size(); j++)
+        {
+            unsigned int v = candidates[j];
+            if (live[v] == 0)
+                continue;
+            unsigned long long priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > best)
+            {
+                best = priority;
+                next = v;
+            }
+        }
+
+        // Otherwise fall back to recently used vertices, then to any vertex
+        // with triangles left
+        if (next < 0)
+        {
+            while (!deadEnd.empty() && next < 0)
+            {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    next = v;
+            }
+            while (next < 0 && cursor < numVertices)
+            {
+                if (live[cursor] > 0)
+                    next = static_cast<long long>(cursor);
+                cursor++;
+            }
+        }
+        fan = next;
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimiseOverdraw(unsigned int *indices, size_t numIndices,
+                      const glm::vec3 *positions, size_t numVertices,
+                      float threshold, unsigned int cacheSize)
+{
+    size_t numTriangles = numIndices / 3;
+    if (numTriangles < 2)
+        return;
+
+    // Hard boundaries where the cache order restarts, every vertex a miss
+    std::vector<size_t> hard;
+    CacheSimulator cache(numVertices, cacheSize);
+    for (size_t t = 0; t < numTriangles; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+            misses += cache.access(indices[t * 3 + k]);
+        if (t == 0 || misses == 3)
+            hard.push_back(t);
+    }
+    hard.push_back(numTriangles);
+
+    // Split hard clusters further wherever doing so keeps the cost within
+    // threshold of the cluster's own ACMR
+    std::vector<Cluster> clusters;
+    CacheSimulator clusterCache(numVertices, cacheSize);
+    for (size_t h = 0; h + 1 < hard.size(); h++)
+    {
+        size_t begin = hard[h];
+        size_t end = hard[h + 1];
+
+        clusterCache.flush();
+        size_t clusterMisses = 0;
+        for (size_t t = begin; t < end; t++)
+            for (int k = 0; k < 3; k++)
+                clusterMisses += clusterCache.access(indices[t * 3 + k]);
+        float limit = threshold * clusterMisses / (end - begin);
+
+        clusterCache.flush();
+        size_t start = begin;
+        size_t misses = 0;
+        for (size_t t = begin; t < end; t++)
+        {
+            for (int k = 0; k < 3; k++)
+                misses += clusterCache.access(indices[t * 3 + k]);
+            if (t + 1 == end || static_cast<float>(misses) / (t + 1 - start) <= limit)
+            {
+                Cluster cluster = { start, t + 1 - start, 0.0f };
+                clusters.push_back(cluster);
+                clusterCache.flush();
+                start = t + 1;
+                misses = 0;
+            }
+        }
+    }
+
+    // Area weighted centroid of the whole mesh
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < numTriangles; t++)
+    {
+        const glm::vec3 &a = positions[indices[t * 3]];
+        const glm::vec3 &b = positions[indices[t * 3 + 1]];
+        const glm::vec3 &c = positions[indices[t * 3 + 2]];
+        float area = glm::length(glm::cross(b - a, c - a));
+        meshCentroid += (a + b + c) * (area / 3.0f);
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Clusters facing away from the centre are likely to occlude the rest
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[i].first; t < clusters[i].first + clusters[i].count; t++)
+        {
+            const glm::vec3 &a = positions[indices[t * 3]];
+            const glm::vec3 &b = positions[indices[t * 3 + 1]];
+            const glm::vec3 &c = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float triangleArea = glm::length(n);
+            centroid += (a + b + c) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        if (area > 0.0f)
+            centroid /= area;
+        float length = glm::length(normal);
+        if (length > 0.0f)
+            normal /= length;
+        clusters[i].sortKey = glm::dot(centroid - meshCentroid, normal);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> output;
+    output.reserve(numTriangles * 3);
+    for (size_t i = 0; i < clusters.size(); i++)
+        output.insert(output.end(), indices + clusters[i].first * 3,
+                      indices + (clusters[i].first + clusters[i].count) * 3);
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimiseVertexFetch(std::vector<unsigned int> &indices,
+                         std::vector<glm::vec3> &vertices,
+                         std::vector<glm::vec2> &uvs,
+                         std::vector<glm::vec3> &normals)
+{
+    const unsigned int unused = 0xffffffffu;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    unsigned int numUsed = 0;
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int &target = remap[indices[i]];
+        if (target == unused)
+            target = numUsed++;
+        indices[i] = target;
+    }
+
+    std::vector<glm::vec3> newVertices(numUsed);
+    std::vector<glm::vec2> newUVs(numUsed);
+    std::vector<glm::vec3> newNormals(numUsed);
+    for (size_t v = 0; v < remap.size(); v++)
+    {
+        if (remap[v] == unused)
+            continue;
+        newVertices[remap[v]] = vertices[v];
+        newUVs[remap[v]] = uvs[v];
+        newNormals[remap[v]] = normals[v];
+    }
+    vertices.swap(newVertices);
+    uvs.swap(newUVs);
+    normals.swap(newNormals);
+}
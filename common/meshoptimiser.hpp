@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// Post-transform vertex cache efficiency of an index list
+struct VertexCacheStats
+{
+    float acmr;     // average cache misses per triangle, 0.5 is the ideal
+    float atvr;     // average transforms per vertex, 1.0 is the ideal
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries over the
+// triangles, no GPU needed
+VertexCacheStats analyseVertexCache(const unsigned int *indices, size_t numIndices,
+                                    size_t numVertices, unsigned int cacheSize = 16);
+
+// Reorders triangles for vertex cache locality (Tipsify, Sander et al. 2007)
+void optimiseVertexCache(unsigned int *indices, size_t numIndices, size_t numVertices,
+                         unsigned int cacheSize = 16);
+
+// View independent overdraw pass. Splits an already cache optimised index
+// list into clusters that cost at most threshold times the cluster ACMR,
+// then draws outward facing clusters first.
+void optimiseOverdraw(unsigned int *indices, size_t numIndices,
+                      const glm::vec3 *positions, size_t numVertices,
+                      float threshold = 1.05f, unsigned int cacheSize = 16);
+
+// Renumbers vertices in the order the index list first uses them so vertex
+// fetch reads memory front to back. Unreferenced vertices are dropped.
+void optimiseVertexFetch(std::vector<unsigned int> &indices,
+                         std::vector<glm::vec3> &vertices,
+                         std::vector<glm::vec2> &uvs,
+                         std::vector<glm::vec3> &normals);
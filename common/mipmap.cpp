@@ -0,0 +1,296 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <common/mipmap.hpp>
+
+namespace
+{
+    // Rows of output a job works on
+    const int bandRows = 8;
+
+    // Byte to float conversions, and the linear values halfway between
+    // consecutive sRGB bytes so converting back rounds exactly. The guess
+    // table starts that search within a step or two of the answer.
+    const int guessSteps = 4096;
+    struct ConversionTables
+    {
+        float linear[256];
+        float srgbToLinear[256];
+        float srgbThresholds[255];
+        unsigned char srgbGuess[guessSteps + 1];
+    };
+
+    float decodeSRGB(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    const ConversionTables &conversionTables()
+    {
+        struct Builder
+        {
+            ConversionTables tables;
+            Builder()
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    tables.linear[i] = i / 255.0f;
+                    tables.srgbToLinear[i] = decodeSRGB(i / 255.0f);
+                }
+                for (int i = 0; i < 255; i++)
+                    tables.srgbThresholds[i] = decodeSRGB((i + 0.5f) / 255.0f);
+                for (int i = 0; i <= guessSteps; i++)
+                    tables.srgbGuess[i] = static_cast<unsigned char>(
+                        std::upper_bound(tables.srgbThresholds, tables.srgbThresholds + 255, static_cast<float>(i) / guessSteps) -
+                        tables.srgbThresholds);
+            }
+        };
+        static const Builder builder;
+        return builder.tables;
+    }
+
+    inline unsigned char linearToByte(float v)
+    {
+        return static_cast<unsigned char>(std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f));
+    }
+
+    inline unsigned char linearToSRGBByte(const ConversionTables &tables, float v)
+    {
+        v = std::min(std::max(v, 0.0f), 1.0f);
+        int byte = tables.srgbGuess[static_cast<int>(v * guessSteps)];
+        while (byte < 255 && v >= tables.srgbThresholds[byte])
+            byte++;
+        while (byte > 0 && v < tables.srgbThresholds[byte - 1])
+            byte--;
+        return static_cast<unsigned char>(byte);
+    }
+
+    // Bytes to the values of the linear table, a row at a time
+    void bytesToLinear(const ConversionTables &tables, const unsigned char *bytes, float *out, size_t count)
+    {
+        size_t i = 0;
+#ifdef MIP_SSE2
+        // Divided rather than scaled by 1/255 so the values match the table
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 maximum = _mm_set1_ps(255.0f);
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+            __m128i low = _mm_unpacklo_epi8(b, zero), high = _mm_unpackhi_epi8(b, zero);
+            _mm_storeu_ps(out + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), maximum));
+            _mm_storeu_ps(out + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), maximum));
+            _mm_storeu_ps(out + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), maximum));
+            _mm_storeu_ps(out + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), maximum));
+        }
+#endif
+        for (; i < count; i++)
+            out[i] = tables.linear[bytes[i]];
+    }
+
+    // linearToByte of a row
+    void linearToBytes(const float *values, unsigned char *out, size_t count)
+    {
+        size_t i = 0;
+#ifdef MIP_SSE2
+        const __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps();
+        __m128i quad[4];
+        for (; i + 16 <= count; i += 16)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + i + j * 4), scale), half);
+                quad[j] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, zero), scale));
+            }
+            __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(quad[0], quad[1]), _mm_packs_epi32(quad[2], quad[3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), bytes);
+        }
+#endif
+        for (; i < count; i++)
+            out[i] = linearToByte(values[i]);
+    }
+
+    // Sum of two rows of floats
+    void addRows(const float *a, const float *b, float *out, size_t count)
+    {
+        size_t i = 0;
+#ifdef MIP_SSE2
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#endif
+        for (; i < count; i++)
+            out[i] = a[i] + b[i];
+    }
+
+    // Quarter of the sum of horizontal pairs of a summed row, in place
+    void averagePairs(const float *sums, int width, int nextWidth, int components, float *out)
+    {
+        int x = 0;
+#ifdef MIP_SSE2
+        if (components == 4)
+        {
+            const __m128 quarter = _mm_set1_ps(0.25f);
+            for (; x < nextWidth; x++)
+            {
+                int x1 = std::min(x * 2 + 1, width - 1);
+                __m128 sum = _mm_add_ps(_mm_loadu_ps(sums + x * 8), _mm_loadu_ps(sums + x1 * 4));
+                _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, quarter));
+            }
+        }
+#endif
+        for (; x < nextWidth; x++)
+        {
+            int x0 = x * 2, x1 = std::min(x * 2 + 1, width - 1);
+            for (int c = 0; c < components; c++)
+                out[x * components + c] = (sums[x0 * components + c] + sums[x1 * components + c]) * 0.25f;
+        }
+    }
+
+    // Box filter of rows [begin, end) of the next level in linear light
+    void downsampleRows(const unsigned char *pixels, int width, int height, int components, MipFilter filter,
+                        unsigned char *out, int begin, int end)
+    {
+        const ConversionTables &tables = conversionTables();
+        int nextWidth = std::max(width / 2, 1);
+        size_t rowValues = static_cast<size_t>(width) * components;
+
+        // Colour channels of sRGB images are linearised, alpha never is
+        const float *toFloat[4];
+        bool srgb[4];
+        for (int c = 0; c < 4; c++)
+        {
+            bool alpha = (components == 2 && c == 1) || (components == 4 && c == 3);
+            srgb[c] = filter == MIP_SRGB && !alpha;
+            toFloat[c] = srgb[c] ? tables.srgbToLinear : tables.linear;
+        }
+
+        // Rows with no sRGB or normal channels convert a whole row at once
+        bool linearIn = filter != MIP_SRGB;
+        bool linearOut = linearIn && !(filter == MIP_NORMAL && components >= 3);
+
+        std::vector<float> row0(rowValues), row1(rowValues), averaged(static_cast<size_t>(nextWidth) * components);
+        for (int y = begin; y < end; y++)
+        {
+            const unsigned char *src0 = pixels + std::min(y * 2, height - 1) * rowValues;
+            const unsigned char *src1 = pixels + std::min(y * 2 + 1, height - 1) * rowValues;
+            if (linearIn)
+            {
+                bytesToLinear(tables, src0, row0.data(), rowValues);
+                bytesToLinear(tables, src1, row1.data(), rowValues);
+            }
+            else
+            {
+                for (size_t i = 0; i < rowValues; i++)
+                {
+                    int c = static_cast<int>(i % components);
+                    row0[i] = toFloat[c][src0[i]];
+                    row1[i] = toFloat[c][src1[i]];
+                }
+            }
+            addRows(row0.data(), row1.data(), row0.data(), rowValues);
+            averagePairs(row0.data(), width, nextWidth, components, averaged.data());
+
+            unsigned char *dst = out + static_cast<size_t>(y) * nextWidth * components;
+            if (linearOut)
+            {
+                linearToBytes(averaged.data(), dst, averaged.size());
+                continue;
+            }
+            for (int x = 0; x < nextWidth; x++)
+            {
+                const float *value = &averaged[static_cast<size_t>(x) * components];
+                unsigned char *pixel = dst + static_cast<size_t>(x) * components;
+                if (filter == MIP_NORMAL && components >= 3)
+                {
+                    // The average of unit vectors is shorter, put it back on
+                    // the sphere. Flat if they cancel out.
+                    float n[3];
+                    for (int c = 0; c < 3; c++)
+                        n[c] = value[c] * 2.0f - 1.0f;
+                    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (length < 1e-6f)
+                    {
+                        n[0] = n[1] = 0.0f;
+                        n[2] = length = 1.0f;
+                    }
+                    for (int c = 0; c < 3; c++)
+                        pixel[c] = linearToByte((n[c] / length) * 0.5f + 0.5f);
+                    if (components == 4)
+                        pixel[3] = linearToByte(value[3]);
+                    continue;
+                }
+                for (int c = 0; c < components; c++)
+                    pixel[c] = srgb[c] ? linearToSRGBByte(tables, value[c]) : linearToByte(value[c]);
+            }
+        }
+    }
+}
+
+unsigned int mipLevelCount(int width, int height)
+{
+    unsigned int levels = 1;
+    for (int size = std::max(width, height); size > 1; size >>= 1)
+        levels++;
+    return levels;
+}
+
+size_t levelBytes(BlockFormat format, int components, int width, int height)
+{
+    if (format == BLOCK_NONE)
+        return static_cast<size_t>(width) * height * components;
+    return compressedSize(format, width, height);
+}
+
+void downsampleLevel(const unsigned char *pixels, int width, int height, int components, MipFilter filter,
+                     unsigned char *out, ThreadPool &pool)
+{
+    int nextHeight = std::max(height / 2, 1);
+    int bands = (nextHeight + bandRows - 1) / bandRows;
+    if (bands == 1)
+    {
+        downsampleRows(pixels, width, height, components, filter, out, 0, nextHeight);
+        return;
+    }
+    pool.parallelFor(bands, [&](size_t band)
+    {
+        int begin = static_cast<int>(band) * bandRows;
+        downsampleRows(pixels, width, height, components, filter, out, begin, std::min(begin + bandRows, nextHeight));
+    });
+}
+
+size_t MipChain::bytes() const
+{
+    size_t total = 0;
+    for (unsigned int i = 0; i < numLevels(); i++)
+        total += levelSize(i);
+    return total;
+}
+
+void generateMipChain(const unsigned char *pixels, int width, int height, int components, MipFilter filter,
+                      MipChain &chain, ThreadPool &pool)
+{
+    chain = MipChain();
+    chain.width = width;
+    chain.height = height;
+    chain.components = components;
+
+    // Levels one after another in data
+    unsigned int levels = mipLevelCount(width, height);
+    size_t offset = 0;
+    for (unsigned int i = 0; i < levels; i++)
+    {
+        chain.levelOffsets.push_back(offset);
+        offset += chain.levelSize(i);
+    }
+    chain.data.resize(offset);
+
+    memcpy(chain.data.data(), pixels, chain.levelSize(0));
+    for (unsigned int i = 1; i < levels; i++)
+        downsampleLevel(chain.level(i - 1), chain.levelWidth(i - 1), chain.levelHeight(i - 1), components, filter,
+                        &chain.data[chain.levelOffsets[i]], pool);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+#include <common/blockcompression.hpp>
+#include <common/threadpool.hpp>
+#include <common/mappedfile.hpp>
+
+// How the levels of a mip chain are averaged
+enum MipFilter
+{
+    MIP_LINEAR,     // plain average, for masks and data
+    MIP_SRGB,       // colour averaged in linear light, alpha plainly
+    MIP_NORMAL      // tangent space normals averaged and renormalised
+};
+
+// Levels of a full chain down to 1x1
+unsigned int mipLevelCount(int width, int height);
+
+// Bytes of one level, 8-bit pixels of components channels for BLOCK_NONE
+size_t levelBytes(BlockFormat format, int components, int width, int height);
+
+// Full mip chain in one format. BLOCK_NONE holds 8-bit pixels of components
+// channels. The levels are either in data or, for chains read from a
+// texture container, in its mapping.
+struct MipChain
+{
+    BlockFormat format;
+    int width;
+    int height;
+    int components;
+    std::vector<size_t> levelOffsets;   // of each level in data or the mapping
+    std::vector<unsigned char> data;
+    std::shared_ptr<MappedFile> mapping;
+    double psnr;                        // of the top level, block formats only
+
+    MipChain() : format(BLOCK_NONE), width(0), height(0), components(0), psnr(0.0) {}
+
+    unsigned int numLevels() const { return static_cast<unsigned int>(levelOffsets.size()); }
+    int levelWidth(unsigned int level) const { return width >> level > 1 ? width >> level : 1; }
+    int levelHeight(unsigned int level) const { return height >> level > 1 ? height >> level : 1; }
+    size_t levelSize(unsigned int level) const { return levelBytes(format, components, levelWidth(level), levelHeight(level)); }
+    const unsigned char *level(unsigned int level) const
+    {
+        const char *base = mapping ? mapping->data() : reinterpret_cast<const char*>(data.data());
+        return reinterpret_cast<const unsigned char*>(base) + levelOffsets[level];
+    }
+
+    // Bytes of every level together
+    size_t bytes() const;
+};
+
+// Halves a level of 8-bit pixels with a 2x2 box, odd edges repeat the last
+// row and column. Rows are spread over pool.
+void downsampleLevel(const unsigned char *pixels, int width, int height, int components, MipFilter filter,
+                     unsigned char *out, ThreadPool &pool = ThreadPool::shared());
+
+// Uncompressed chain of 8-bit pixels down to 1x1, level 0 is a copy
+void generateMipChain(const unsigned char *pixels, int width, int height, int components, MipFilter filter,
+                      MipChain &chain, ThreadPool &pool = ThreadPool::shared());
@@ -3,208 +3,578 @@
 #include <string>
 #include <cstring>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <map>
 
 #include <GL/glew.h>
+#include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
 #include "model.hpp"
-#include "stb_image.hpp"
+#include "camera.hpp"
+#include "mappedfile.hpp"
+#include "objparser.hpp"
+#include "mesh.hpp"
+#include "meshcache.hpp"
+#include "meshoptimiser.hpp"
+#include "vertexformat.hpp"
+#include "simplify.hpp"
+#include "meshlet.hpp"
+#include "tangents.hpp"
 
-Model::Model(const char *path)
+namespace
 {
-    // Load object
-    bool res = loadObj(path, vertices, uvs, normals);
+    // Uniform buffer binding point of the MaterialTable block
+    const unsigned int materialBinding = 0;
     
-    // Setup buffers
-    setupBuffers();
+    // Table of the built in constants for draws without a model, see
+    // Model::bindDefaultMaterials
+    unsigned int defaultMaterialBuffer = 0;
+    
+    // Constants the fragment shader used before materials existed, for
+    // faces without a known material
+    PackedMaterial packMaterial(const ObjMaterial *material)
+    {
+        PackedMaterial packed;
+        packed.ambient = glm::vec4(1.0f);
+        packed.diffuse = glm::vec4(1.0f);
+        packed.specular = glm::vec4(1.0f, 1.0f, 1.0f, 32.0f);
+        if (material != NULL)
+        {
+            packed.ambient = glm::vec4(material->ka, 1.0f);
+            packed.diffuse = glm::vec4(material->kd, material->d);
+            packed.specular = glm::vec4(material->ks, std::max(material->Ns, 1.0f));
+        }
+        return packed;
+    }
+}
+
+Model::Model()
+    : VAO(0), vertexBuffer(0), elementBuffer(0), materialBuffer(0), materialProgram(0),
+      materialIndexLocation(-1), positionScaleLocation(-1), positionOffsetLocation(-1),
+      indexType(GL_UNSIGNED_INT), numLods(1), pendingMesh(), uploaded(false)
+{
+    layerLocations[0] = layerLocations[1] = layerLocations[2] = -1;
+}
+
+Model::Model(const char *path, unsigned int flags, unsigned int lodLevels)
+    : VAO(0), vertexBuffer(0), elementBuffer(0), materialBuffer(0), materialProgram(0),
+      materialIndexLocation(-1), positionScaleLocation(-1), positionOffsetLocation(-1),
+      indexType(GL_UNSIGNED_INT), numLods(1), pendingMesh(), uploaded(false)
+{
+    layerLocations[0] = layerLocations[1] = layerLocations[2] = -1;
+    load(path, flags, lodLevels);
+    upload();
+}
+
+bool Model::load(const char *path, unsigned int flags, unsigned int lodLevels)
+{
+    // Use the cooked mesh if it is up to date, its streams are uploaded
+    // straight from the mapping
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned int options = flags | (lodLevels << 16);
+    if (cache.open(path, options))
+    {
+        const MeshView &mesh = cache.view();
+        bounds = mesh.bounds;
+        submeshes.assign(mesh.submeshes, mesh.submeshes + mesh.numLods * mesh.numSubmeshes);
+        lodErrors.assign(mesh.lodErrors, mesh.lodErrors + mesh.numLods);
+        meshlets.assign(mesh.meshlets, mesh.meshlets + mesh.numMeshlets);
+        materials.assign(mesh.materials, mesh.materials + mesh.numMaterials);
+        pendingMesh = mesh;
+        
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("Loaded cached file %s, %u triangles in %.1f ms\n",
+               MeshCache::cachePath(path).c_str(), mesh.numIndices / 3, seconds * 1000.0);
+        return true;
+    }
+    
+    // Load object, one submesh per material
+    std::vector<std::string> materialFiles;
+    bool res = loadObj(path, vertices, uvs, normals, indices, submeshes, materials, materialFiles);
+    lodErrors.assign(1, 0.0f);
+    if (res && (flags & MODEL_LOD))
+        buildLods(lodLevels);
+    if (res && (flags & MODEL_OPTIMISE) && !indices.empty())
+        optimise();
+    if (res && (flags & MODEL_MESHLETS))
+        buildAllMeshlets();
+    bounds = computeBounds(vertices.data(), vertices.size());
+    
+    // Tangents from the full detail triangles, the LODs share its vertices
+    size_t numFullIndices = 0;
+    for (size_t i = 0; i < submeshes.size() / lodErrors.size(); i++)
+        numFullIndices = std::max<size_t>(numFullIndices, submeshes[i].firstIndex + submeshes[i].numIndices);
+    tangents.resize(vertices.size());
+    generateTangents(indices.data(), numFullIndices, vertices.data(), uvs.data(), normals.data(),
+                     vertices.size(), tangents.data());
+    
+    // Pack the vertices into the shared 16 byte format
+    packedVertices.resize(vertices.size());
+    packVertices(vertices.data(), uvs.data(), normals.data(), tangents.data(), vertices.size(), bounds,
+                 packedVertices.data());
+    
+    // Indices are stored as 16-bit when every vertex fits
+    MeshView &mesh = pendingMesh;
+    mesh.vertices = packedVertices.data();
+    mesh.numVertices = static_cast<unsigned int>(vertices.size());
+    mesh.numIndices = static_cast<unsigned int>(indices.size());
+    mesh.numLods = static_cast<unsigned int>(lodErrors.size());
+    mesh.numSubmeshes = static_cast<unsigned int>(submeshes.size()) / mesh.numLods;
+    mesh.submeshes = submeshes.data();
+    mesh.lodErrors = lodErrors.data();
+    mesh.numMeshlets = static_cast<unsigned int>(meshlets.size());
+    mesh.meshlets = meshlets.data();
+    mesh.numMaterials = static_cast<unsigned int>(materials.size());
+    mesh.materials = materials.data();
+    mesh.bounds = bounds;
+    if (vertices.size() <= 65536)
+    {
+        shortIndices.assign(indices.begin(), indices.end());
+        mesh.indices = shortIndices.data();
+        mesh.indexSize = sizeof(unsigned short);
+    }
+    else
+    {
+        mesh.indices = indices.data();
+        mesh.indexSize = sizeof(unsigned int);
+    }
+    
+    // Cook the mesh for the next run
+    if (res && !MeshCache::save(path, mesh, options, materialFiles))
+        printf("Couldn't write %s\n", MeshCache::cachePath(path).c_str());
+    return res;
+}
+
+void Model::upload()
+{
+    if (uploaded)
+        return;
+    
+    // Setup buffers, then let go of the packed streams or the mapping
+    setupBuffers(pendingMesh);
+    uploaded = true;
+    pendingMesh = MeshView();
+    cache.close();
+    std::vector<PackedVertex>().swap(packedVertices);
+    std::vector<unsigned short>().swap(shortIndices);
+}
+
+unsigned int Model::selectLod(const glm::mat4 &model, const Camera &camera,
+                              float viewportHeight, float maxPixelError) const
+{
+    // Distance from the camera to the bounding sphere in world space
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+                           std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    glm::vec3 centre = glm::vec3(model * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    float radius = 0.5f * glm::length(bounds.max - bounds.min) * scale;
+    float distance = std::max(glm::length(camera.getPosition() - centre) - radius, 0.0f);
+    
+    // Errors only grow with the LOD so the first one too coarse ends the search
+    unsigned int lod = 0;
+    for (unsigned int i = 1; i < numLods; i++)
+    {
+        if (lodSwitchDistance(lodErrors[i] * scale, camera.getZoom(), viewportHeight, maxPixelError) > distance)
+            break;
+        lod = i;
+    }
+    return lod;
 }
 
-void Model::draw(unsigned int &shaderID)
+void Model::bindMaterial(unsigned int &shaderID)
 {
-    // Send material properties to the shader
-    glUniform1f(glGetUniformLocation(shaderID, "ka"), ka);
-    glUniform1f(glGetUniformLocation(shaderID, "kd"), kd);
-    glUniform1f(glGetUniformLocation(shaderID, "ks"), ks);
-    glUniform1f(glGetUniformLocation(shaderID, "Ns"), Ns);
+    // Point the shader's material table at this model's. The block binding
+    // and uniform locations only change with the program, or with the
+    // textures for their samplers.
+    if (materialProgram != shaderID)
+    {
+        materialProgram = shaderID;
+        unsigned int block = glGetUniformBlockIndex(shaderID, "MaterialTable");
+        if (block != GL_INVALID_INDEX)
+            glUniformBlockBinding(shaderID, block, materialBinding);
+        materialIndexLocation = glGetUniformLocation(shaderID, "materialIndex");
+        positionScaleLocation = glGetUniformLocation(shaderID, "positionScale");
+        positionOffsetLocation = glGetUniformLocation(shaderID, "positionOffset");
+        layerLocations[0] = glGetUniformLocation(shaderID, "diffuseLayer");
+        layerLocations[1] = glGetUniformLocation(shaderID, "normalLayer");
+        layerLocations[2] = glGetUniformLocation(shaderID, "specularLayer");
+        textureLocations.clear();
+    }
+    if (textureLocations.size() != textures.size())
+    {
+        textureLocations.resize(textures.size());
+        for (size_t i = 0; i < textures.size(); i++)
+            textureLocations[i] = glGetUniformLocation(shaderID, (textures[i].type + "Map").c_str());
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, materialBinding, materialBuffer);
+    
+    // Send the range the packed positions are quantised to
+    glUniform3fv(positionScaleLocation, 1, &positionScale(bounds)[0]);
+    glUniform3fv(positionOffsetLocation, 1, &positionOffset(bounds)[0]);
+    
+    // Model textures stay plain 2D textures, only the room's maps are in
+    // arrays. Zero layers make the shader sample the maps bound here.
+    for (int i = 0; i < 3; i++)
+        glUniform2f(layerLocations[i], 0.0f, 0.0f);
     
     // Bind the textures
-    unsigned int diffuseNum = 0;
-    unsigned int normalNum = 0;
     for (unsigned int i = 0; i < textures.size(); i++)
     {
-        // Bind texture
-        std::string name = textures[i].type;
         glActiveTexture(GL_TEXTURE0 + i);
-        glUniform1i(glGetUniformLocation(shaderID, (name + "Map").c_str()), i);
+        glUniform1i(textureLocations[i], i);
         glBindTexture(GL_TEXTURE_2D, textures[i].id);
     }
+}
+
+void Model::bindDefaultMaterials(unsigned int shaderID)
+{
+    // The whole array the shader declares has to be backed even though only
+    // materialIndex -1 reads it, a smaller buffer is undefined
+    if (defaultMaterialBuffer == 0)
+    {
+        std::vector<PackedMaterial> table(maxMaterials, packMaterial(NULL));
+        glGenBuffers(1, &defaultMaterialBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, defaultMaterialBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, table.size() * sizeof(PackedMaterial), table.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    unsigned int block = glGetUniformBlockIndex(shaderID, "MaterialTable");
+    if (block != GL_INVALID_INDEX)
+        glUniformBlockBinding(shaderID, block, materialBinding);
+    glBindBufferBase(GL_UNIFORM_BUFFER, materialBinding, defaultMaterialBuffer);
+}
+
+void Model::deleteDefaultMaterials()
+{
+    glDeleteBuffers(1, &defaultMaterialBuffer);
+    defaultMaterialBuffer = 0;
+}
+
+void Model::draw(unsigned int &shaderID, unsigned int lod)
+{
+    if (!uploaded)
+        return;
+    
+    bindMaterial(shaderID);
+    
+    // Draw the triangles of each submesh of the LOD
+    lod = std::min(lod, numLods - 1);
+    size_t numSubmeshes = submeshes.size() / numLods;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    glBindVertexArray(VAO);
+    for (size_t i = lod * numSubmeshes; i < (lod + 1) * numSubmeshes; i++)
+    {
+        glUniform1i(materialIndexLocation, static_cast<GLint>(submeshes[i].material));
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(submeshes[i].numIndices), indexType,
+                       (void*)(submeshes[i].firstIndex * indexSize));
+    }
+    glBindVertexArray(0);
+}
+
+size_t Model::drawCulled(unsigned int &shaderID, const glm::mat4 &model,
+                         const glm::mat4 &viewProjection, const Camera &camera,
+                         unsigned int lod, bool cullBackfaces)
+{
+    if (!uploaded)
+        return 0;
+    
+    if (meshlets.empty())
+    {
+        draw(shaderID, lod);
+        return 0;
+    }
+    
+    // Cull in object space, plane side tests don't change under the model
+    // matrix so the camera is moved into the model instead
+    glm::mat4 modelViewProjection = viewProjection * model;
+    glm::vec3 cameraPosition = glm::vec3(glm::inverse(model) * glm::vec4(camera.getPosition(), 1.0f));
     
-    // Draw the triangles
+    bindMaterial(shaderID);
     glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<unsigned int>(vertices.size()));
+    
+    // Meshlets are in index order so each submesh's are a contiguous run,
+    // its visible ranges are drawn together with its material
+    lod = std::min(lod, numLods - 1);
+    size_t numSubmeshes = submeshes.size() / numLods;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    auto byIndex = [](const Meshlet &m, unsigned int index) { return m.firstIndex < index; };
+    const Meshlet *data = meshlets.data();
+    size_t kept = 0;
+    for (size_t i = lod * numSubmeshes; i < (lod + 1) * numSubmeshes; i++)
+    {
+        const Meshlet *first = std::lower_bound(data, data + meshlets.size(), submeshes[i].firstIndex, byIndex);
+        const Meshlet *stop = std::lower_bound(first, data + meshlets.size(),
+                                               submeshes[i].firstIndex + submeshes[i].numIndices, byIndex);
+        visibleRanges.clear();
+        kept += cullMeshlets(first, stop - first, modelViewProjection, cameraPosition,
+                             cullBackfaces, visibleRanges);
+        if (visibleRanges.empty())
+            continue;
+        
+        drawCounts.resize(visibleRanges.size());
+        drawOffsets.resize(visibleRanges.size());
+        for (size_t j = 0; j < visibleRanges.size(); j++)
+        {
+            drawCounts[j] = static_cast<GLsizei>(visibleRanges[j].numIndices);
+            drawOffsets[j] = (const void*)(visibleRanges[j].firstIndex * indexSize);
+        }
+        glUniform1i(materialIndexLocation, static_cast<GLint>(submeshes[i].material));
+        glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(),
+                            static_cast<GLsizei>(drawCounts.size()));
+    }
     glBindVertexArray(0);
+    return kept;
+}
+
+void Model::buildLods(unsigned int lodLevels)
+{
+    // Each level is simplified from the one before, all of them index the
+    // same vertices and are appended to the index list
+    size_t numSubmeshes = submeshes.size();
+    for (unsigned int level = 1; level <= lodLevels; level++)
+    {
+        std::vector<Submesh> lodSubmeshes;
+        float lodError = lodErrors.back();
+        size_t before = indices.size();
+        for (size_t i = 0; i < numSubmeshes; i++)
+        {
+            const Submesh &previous = submeshes[submeshes.size() - numSubmeshes + i];
+            size_t target = (submeshes[i].numIndices >> level) / 3 * 3;
+            float error;
+            std::vector<unsigned int> simplified = simplifyMesh(&indices[previous.firstIndex], previous.numIndices,
+                                                                vertices.data(), vertices.size(), target, error);
+            
+            Submesh lodSubmesh = previous;
+            lodSubmesh.firstIndex = static_cast<unsigned int>(indices.size());
+            lodSubmesh.numIndices = static_cast<unsigned int>(simplified.size());
+            lodSubmeshes.push_back(lodSubmesh);
+            lodError = std::max(lodError, error);
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+        }
+        
+        // Stop once the simplifier can't remove any more
+        size_t added = indices.size() - before;
+        size_t previousSize = 0;
+        for (size_t i = submeshes.size() - numSubmeshes; i < submeshes.size(); i++)
+            previousSize += submeshes[i].numIndices;
+        if (added >= previousSize)
+        {
+            indices.resize(before);
+            break;
+        }
+        
+        submeshes.insert(submeshes.end(), lodSubmeshes.begin(), lodSubmeshes.end());
+        lodErrors.push_back(lodError);
+    }
 }
 
-void Model::setupBuffers()
+void Model::optimise()
+{
+    // Triangle order for the post-transform cache, then clusters for
+    // overdraw, for every submesh of every LOD. Then vertex order for fetch.
+    for (size_t i = 0; i < submeshes.size(); i++)
+    {
+        unsigned int *range = &indices[submeshes[i].firstIndex];
+        optimiseVertexCache(range, submeshes[i].numIndices, vertices.size());
+        optimiseOverdraw(range, submeshes[i].numIndices, vertices.data(), vertices.size());
+    }
+    optimiseVertexFetch(indices, vertices, uvs, normals);
+}
+
+void Model::buildAllMeshlets()
+{
+    // Meshlets never cross a submesh so every draw range is whole meshlets
+    for (size_t i = 0; i < submeshes.size(); i++)
+        buildMeshlets(indices.data(), submeshes[i].firstIndex, submeshes[i].numIndices,
+                      vertices.data(), vertices.size(), meshlets);
+}
+
+void Model::setupBuffers(const MeshView &mesh)
 {
     // Create and bind the Vertex Array Object (VAO)
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
     
-    // Create Vertex Buffer Object
-    unsigned int vertexBuffer;
+    // Create interleaved Vertex Buffer Object
     glGenBuffers(1, &vertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-    
-    // Create uv buffer
-    unsigned int uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-    
-    // Create normal buffer
-    unsigned int normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-    
-    // Bind the vertex buffer
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glBufferData(GL_ARRAY_BUFFER, mesh.numVertices * sizeof(PackedVertex), mesh.vertices, GL_STATIC_DRAW);
     
-    // Bind the uv buffer
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    // Create element buffer
+    glGenBuffers(1, &elementBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.numIndices * mesh.indexSize, mesh.indices, GL_STATIC_DRAW);
+    indexType = mesh.indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    numLods = mesh.numLods;
     
-    // Bind the normal buffer
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    // Material table, the whole array the shader declares is allocated
+    std::vector<PackedMaterial> table(maxMaterials, packMaterial(NULL));
+    std::copy(mesh.materials, mesh.materials + std::min(mesh.numMaterials, maxMaterials), table.begin());
+    glGenBuffers(1, &materialBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, table.size() * sizeof(PackedMaterial), table.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    materialProgram = 0;
+    materialIndexLocation = -1;
+    
+    // Position, normal, uv and tangent attributes
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    packedVertexFormat().apply();
     
-     // Bind the VAO
+     // Unbind the VAO, the element buffer binding stays recorded in it
     glBindVertexArray(0);
 }
 
 void Model::deleteBuffers()
 {
+    if (!uploaded)
+        return;
+    uploaded = false;
     glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
+    glDeleteBuffers(1, &elementBuffer);
+    glDeleteBuffers(1, &materialBuffer);
     glDeleteVertexArrays(1, &VAO);
 }
 
 bool Model::loadObj(const char *path,
                     std::vector<glm::vec3> &outVertices,
                     std::vector<glm::vec2> &outUVs,
-                    std::vector<glm::vec3> &outNormals)
+                    std::vector<glm::vec3> &outNormals,
+                    std::vector<unsigned int> &outIndices,
+                    std::vector<Submesh> &outSubmeshes,
+                    std::vector<PackedMaterial> &outMaterials,
+                    std::vector<std::string> &outMaterialFiles)
 {
     
     printf("Loading file %s\n", path);
     
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> tempVertices;
-    std::vector<glm::vec2> tempUVs;
-    std::vector<glm::vec3> tempNormals;
+    // Memory map the .obj file
+    MappedFile file;
+    if (!file.open(path))
+    {
+        printf("Impossible to open the file %s. Check paths and directories.\n", path);
+        return false;
+    }
     
-    FILE *file = fopen(path, "r");
-    if (file==NULL)
+    // Parse the attributes and face indices, large files are split across
+    // all cores
+    ObjData obj;
+    if (!parseObj(file.data(), file.size(), obj, 0))
     {
-        printf("Impossible to open the file. Check paths and directories.");
-        getchar();
+        printf("File can't be read by loadObj().\n");
         return false;
     }
     
-    while (true)
+    // Weld identical corners into unique vertices, faces without uvs or
+    // normals get zero uvs and the face normal
+    size_t numCorners = obj.corners.size();
+    VertexWelder welder(outVertices, outUVs, outNormals);
+    welder.reserve(std::max(obj.positions.size(), numCorners / 6));
+    outIndices.resize(numCorners);
+    for (size_t i = 0; i < numCorners; i += 3)
     {
-        // Read the first word of the line
-        char lineHeader[128];
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-        {
-            // If end of file reached exit the loop
-            break;
-        }
+        const ObjCorner *corner = &obj.corners[i];
+        glm::vec3 position[3];
+        for (int j = 0; j < 3; j++)
+            position[j] = obj.positions[corner[j].v];
         
-        if (strcmp(lineHeader, "v") == 0)
-        {
-            // Read vertices
-            glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            tempVertices.push_back(vertex);
-        }
-        else if (strcmp(lineHeader, "vt") == 0)
-        {
-            // Read texture co-ordinates
-            glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
-            tempUVs.push_back(uv);
-        }
-        else if (strcmp(lineHeader, "vn") == 0)
+        glm::vec3 faceNormal = glm::cross(position[1] - position[0], position[2] - position[0]);
+        float length = glm::length(faceNormal);
+        if (length > 0.0f)
+            faceNormal /= length;
+        
+        for (int j = 0; j < 3; j++)
         {
-            // Read vertex normals
-            glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-            tempNormals.push_back(normal);
+            glm::vec2 uv = corner[j].vt >= 0 ? obj.uvs[corner[j].vt] : glm::vec2(0.0f);
+            glm::vec3 normal = corner[j].vn >= 0 ? obj.normals[corner[j].vn] : faceNormal;
+            outIndices[i + j] = welder.add(position[j], uv, normal);
         }
-        else if (strcmp(lineHeader, "f") == 0)
+    }
+    
+    // Material libraries are relative to the .obj
+    std::string directory(path);
+    size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+    std::vector<ObjMaterial> library;
+    for (size_t i = 0; i < obj.materialLibraries.size(); i++)
+    {
+        std::string mtlPath = directory + obj.materialLibraries[i];
+        if (loadMtlFile(mtlPath.c_str(), library))
+            outMaterialFiles.push_back(mtlPath);
+        else
+            printf("Couldn't read material library %s\n", mtlPath.c_str());
+    }
+    
+    // Number the materials in order of first use, faces before any usemtl
+    // or naming a missing material get the default constants
+    std::map<std::string, unsigned int> materialIndices;
+    std::vector<unsigned int> triangleMaterials(numCorners / 3, 0);
+    outMaterials.clear();
+    for (size_t u = 0; u <= obj.materialUses.size(); u++)
+    {
+        size_t begin = u == 0 ? 0 : obj.materialUses[u - 1].firstCorner;
+        size_t end = u < obj.materialUses.size() ? obj.materialUses[u].firstCorner : numCorners;
+        if (begin >= end)
+            continue;
+        
+        std::string name = u == 0 ? std::string() : obj.materialUses[u - 1].name;
+        std::map<std::string, unsigned int>::iterator found = materialIndices.find(name);
+        unsigned int material;
+        if (found != materialIndices.end())
+            material = found->second;
+        else if (outMaterials.size() == maxMaterials)
         {
-            // Read vertex indices
-            std::string vertex1, vertex2, vertex3;
-            unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n",
-                                 &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                                 &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                                 &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-            
-            // Check for error
-            if (matches != 9)
-            {
-                printf("File can't be read by loadObj().\n");
-                fclose(file);
-                return false;
-            }
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            uvIndices    .push_back(uvIndex[0]);
-            uvIndices    .push_back(uvIndex[1]);
-            uvIndices    .push_back(uvIndex[2]);
-            normalIndices.push_back(normalIndex[0]);
-            normalIndices.push_back(normalIndex[1]);
-            normalIndices.push_back(normalIndex[2]);
+            printf("More than %u materials, %s uses the first\n", maxMaterials, name.c_str());
+            material = 0;
+            materialIndices[name] = material;
         }
         else
         {
-            // Remove comment line
-            char commentBuffer[1000];
-            fgets(commentBuffer, 1000, file);
+            const ObjMaterial *source = NULL;
+            for (size_t i = 0; i < library.size() && source == NULL; i++)
+                if (library[i].name == name)
+                    source = &library[i];
+            if (source == NULL && !name.empty())
+                printf("Material %s not found\n", name.c_str());
+            material = static_cast<unsigned int>(outMaterials.size());
+            outMaterials.push_back(packMaterial(source));
+            materialIndices[name] = material;
         }
+        
+        for (size_t t = begin / 3; t < end / 3; t++)
+            triangleMaterials[t] = material;
     }
     
-    // For each vertex of the triangle
-    for (unsigned int i = 0; i < vertexIndices.size(); i++)
+    // Group the triangles by material into one contiguous submesh each,
+    // keeping file order within a material
+    std::vector<unsigned int> materialStart(outMaterials.size() + 1, 0);
+    for (size_t t = 0; t < triangleMaterials.size(); t++)
+        materialStart[triangleMaterials[t] + 1] += 3;
+    for (size_t m = 0; m < outMaterials.size(); m++)
+        materialStart[m + 1] += materialStart[m];
+    
+    outSubmeshes.clear();
+    for (size_t m = 0; m < outMaterials.size(); m++)
     {
-        // Get the indices of its attributes
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
-        
-        // Get the attributes
-        glm::vec3 vertex = tempVertices[vertexIndex - 1];
-        glm::vec2 uv = tempUVs[uvIndex - 1];
-        glm::vec3 normal = tempNormals[normalIndex - 1];
-        
-        // Copy the attributes to the buffers
-        outVertices.push_back(vertex);
-        outUVs.push_back(uv);
-        outNormals.push_back(normal);
+        Submesh submesh = { materialStart[m], materialStart[m + 1] - materialStart[m],
+                            static_cast<unsigned int>(m), 0 };
+        if (submesh.numIndices > 0)
+            outSubmeshes.push_back(submesh);
     }
     
-    // Close .obj file
-    fclose(file);
+    if (outSubmeshes.size() > 1)
+    {
+        std::vector<unsigned int> grouped(numCorners);
+        for (size_t t = 0; t < triangleMaterials.size(); t++)
+        {
+            unsigned int &next = materialStart[triangleMaterials[t]];
+            for (int j = 0; j < 3; j++)
+                grouped[next + j] = outIndices[t * 3 + j];
+            next += 3;
+        }
+        outIndices.swap(grouped);
+    }
     
     return true;
 }
@@ -212,44 +582,14 @@ bool Model::loadObj(const char *path,
 void Model::addTexture(const char *path, const std::string type)
 {
     Texture texture;
-    texture.id = loadTexture(path);
+    texture.handle = loadTexture(path);
+    texture.id = texture.handle.id();
     texture.type = type;
     textures.push_back(texture);
 }
 
-unsigned int Model::loadTexture(const char *path)
+TextureHandle Model::loadTexture(const char *path)
 {
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, numComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &numComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (numComponents == 1)
-            format = GL_RED;
-        else if (numComponents == 3)
-            format = GL_RGB;
-        else if (numComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture " << path << " failed to load." << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    // Shared with every other model, model textures have never been flipped
+    return TextureCache::shared().load(path, false);
 }
@@ -7,29 +7,85 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <common/mesh.hpp>
+#include <common/meshcache.hpp>
+#include <common/meshlet.hpp>
+#include <common/texturecache.hpp>
+
+//load time processing flags, part of the cooked mesh key
+enum ModelFlags
+{
+    MODEL_OPTIMISE = 1 << 0,    //reorder for vertex cache, overdraw and fetch
+    MODEL_LOD      = 1 << 1,    //build a simplified LOD chain
+    MODEL_MESHLETS = 1 << 2     //split into meshlets for drawCulled()
+};
+
+class Camera;
+
 //texture structure
 struct Texture
 {
     unsigned int id;
     std::string type;
+    TextureHandle handle;   //keeps id in the texture cache
 };
 
 class Model
 {
 public:
-    //model attributes 
+    //model attributes, one entry per unique vertex. These stay empty when
+    //the model is loaded from its cooked .mesh file.
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec2> uvs;
     std::vector<glm::vec3> normals;
-    std::vector<Texture>   textures;
+    std::vector<glm::vec4> tangents;   //xyz tangent, w bitangent sign
+    std::vector<unsigned int> indices;
+    std::vector<Submesh>   submeshes;
+    std::vector<float>     lodErrors;
+    std::vector<Meshlet>   meshlets;
+    std::vector<PackedMaterial> materials;
+    MeshBounds bounds;
+    std::vector<Texture>   textures;   //bound to units 0 up, not in texture arrays
     unsigned int textureID;
-    float ka, kd, ks, Ns;
     
     
-    Model(const char *path);
+    //lodLevels is the number of LODs below the full mesh, each with half
+    //the triangles of the one before
+    Model(const char *path, unsigned int flags = MODEL_OPTIMISE | MODEL_LOD | MODEL_MESHLETS,
+          unsigned int lodLevels = 3);
+    
+    
+    //empty model for load() and upload(), draws nothing until uploaded
+    Model();
+    
+    
+    //loading in two steps so the file work can run on another thread.
+    //load() only touches memory and files, upload() creates the buffers
+    //and has to run on the thread with the GL context.
+    bool load(const char *path, unsigned int flags = MODEL_OPTIMISE | MODEL_LOD | MODEL_MESHLETS,
+              unsigned int lodLevels = 3);
+    void upload();
+    bool isUploaded() const { return uploaded; }
+    
+    
+    //number of levels of detail including the full mesh
+    unsigned int getNumLods() const { return numLods; }
+    
+    
+    //coarsest LOD whose error projects to at most maxPixelError pixels
+    unsigned int selectLod(const glm::mat4 &model, const Camera &camera,
+                           float viewportHeight, float maxPixelError = 1.0f) const;
     
   
-    void draw(unsigned int &shaderID);
+    void draw(unsigned int &shaderID, unsigned int lod = 0);
+    
+    
+    //draw only the meshlets of the LOD inside the view frustum. Backface
+    //culling is optional as the renderer draws with GL_CULL_FACE disabled
+    //and only suits closed meshes. Returns the number of meshlets drawn.
+    size_t drawCulled(unsigned int &shaderID, const glm::mat4 &model,
+                      const glm::mat4 &viewProjection, const Camera &camera,
+                      unsigned int lod = 0, bool cullBackfaces = false);
     
     
     void addTexture(const char *path, const std::string type);
@@ -37,23 +93,65 @@ public:
     
     void deleteBuffers();
     
+    
+    //binds a table of the built in material constants to the shader's
+    //MaterialTable, for draws that aren't models and set materialIndex -1.
+    //Made on first use on the thread with the GL context.
+    static void bindDefaultMaterials(unsigned int shaderID);
+    static void deleteDefaultMaterials();
+    
 private:
     
     //array buffers, loading obj files and loading textures
     unsigned int VAO;
     unsigned int vertexBuffer;
-    unsigned int uvBuffer;
-    unsigned int normalBuffer;
+    unsigned int elementBuffer;
+    unsigned int materialBuffer;
+    unsigned int materialProgram;
+    int materialIndexLocation;
+    int positionScaleLocation;
+    int positionOffsetLocation;
+    int layerLocations[3];              //diffuse, normal and specular
+    std::vector<int> textureLocations;  //sampler of each texture
+    unsigned int indexType;
+    unsigned int numLods;
+    std::vector<IndexRange> visibleRanges;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    
+    
+    //streams waiting for upload(), either mapped from the cache or packed
+    MeshCache cache;
+    MeshView pendingMesh;
+    std::vector<PackedVertex> packedVertices;
+    std::vector<unsigned short> shortIndices;
+    bool uploaded;
     
     
     bool loadObj(const char *path,
                  std::vector<glm::vec3> &inVertices,
                  std::vector<glm::vec2> &inUVs,
-                 std::vector<glm::vec3> &inNormals);
+                 std::vector<glm::vec3> &inNormals,
+                 std::vector<unsigned int> &inIndices,
+                 std::vector<Submesh> &inSubmeshes,
+                 std::vector<PackedMaterial> &inMaterials,
+                 std::vector<std::string> &inMaterialFiles);
     
    
-    void setupBuffers();
+    void buildLods(unsigned int lodLevels);
+    
+    
+    void optimise();
+    
+    
+    void buildAllMeshlets();
+    
+    
+    void bindMaterial(unsigned int &shaderID);
+    
+    
+    void setupBuffers(const MeshView &mesh);
     
     
-    unsigned int loadTexture(const char *path);
+    TextureHandle loadTexture(const char *path);
 };
@@ -0,0 +1,633 @@
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <stdio.h>
+
+#include <common/objparser.hpp>
+#include <common/mappedfile.hpp>
+#include <common/threadpool.hpp>
+
+namespace
+{
+    // Exact powers of ten representable as doubles
+    const double powersOfTen[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    inline bool isDigit(char c)
+    {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    inline const char *skipBlanks(const char *p, const char *end)
+    {
+        while (p < end && isBlank(*p))
+            p++;
+        return p;
+    }
+
+    inline const char *skipLine(const char *p, const char *end)
+    {
+        const char *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        return eol ? eol + 1 : end;
+    }
+
+    // Locale independent replacement for strtof, returns the end of the
+    // number or p if there isn't one
+    const char *parseFloat(const char *p, const char *end, float &value)
+    {
+        const char *start = p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+
+        // Only the first 19 significant digits fit in the mantissa, the rest
+        // only move the decimal point
+        unsigned long long mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+        while (p < end && isDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    digits++;
+            }
+            else
+                exponent++;
+            any = true;
+            p++;
+        }
+        if (p < end && *p == '.')
+        {
+            p++;
+            while (p < end && isDigit(*p))
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa)
+                        digits++;
+                    exponent--;
+                }
+                any = true;
+                p++;
+            }
+        }
+        if (!any)
+            return start;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char *q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+'))
+            {
+                negativeExponent = *q == '-';
+                q++;
+            }
+            if (q < end && isDigit(*q))
+            {
+                int e = 0;
+                while (q < end && isDigit(*q))
+                {
+                    if (e < 10000)
+                        e = e * 10 + (*q - '0');
+                    q++;
+                }
+                exponent += negativeExponent ? -e : e;
+                p = q;
+            }
+        }
+
+        double result = static_cast<double>(mantissa);
+        if (exponent < 0)
+            result = exponent >= -22 ? result / powersOfTen[-exponent] : result * pow(10.0, exponent);
+        else if (exponent > 0)
+            result = exponent <= 22 ? result * powersOfTen[exponent] : result * pow(10.0, exponent);
+
+        value = static_cast<float>(negative ? -result : result);
+        return p;
+    }
+
+    // True if the line at p starts with keyword followed by a blank
+    inline bool isKeyword(const char *p, const char *end, const char *keyword, size_t length)
+    {
+        return static_cast<size_t>(end - p) > length && memcmp(p, keyword, length) == 0 &&
+               isBlank(p[length]);
+    }
+
+    // Rest of the line without surrounding blanks, names may contain spaces
+    inline std::string parseName(const char *p, const char *end)
+    {
+        p = skipBlanks(p, end);
+        const char *q = p;
+        while (q < end && *q != '\n' && *q != '\r')
+            q++;
+        while (q > p && isBlank(q[-1]))
+            q--;
+        return std::string(p, q);
+    }
+
+    // Parses a signed integer, returns p if there isn't one or it doesn't
+    // fit in an int
+    inline const char *parseInt(const char *p, const char *end, int &value)
+    {
+        const char *start = p;
+        bool negative = false;
+        if (p < end && *p == '-')
+        {
+            negative = true;
+            p++;
+        }
+        if (p >= end || !isDigit(*p))
+            return start;
+
+        int result = 0;
+        while (p < end && isDigit(*p))
+        {
+            int digit = *p - '0';
+            if (result > (INT_MAX - digit) / 10)
+                return start;
+            result = result * 10 + digit;
+            p++;
+        }
+        value = negative ? -result : result;
+        return p;
+    }
+
+    // Reads up to count floats from the rest of the line, missing values are zero
+    inline const char *parseFloats(const char *p, const char *end, float *values, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            values[i] = 0.0f;
+            p = parseFloat(skipBlanks(p, end), end, values[i]);
+        }
+        return p;
+    }
+
+    // OBJ indices are 1-based, negative indices count back from the last
+    // element read so far. Returns -2 for the invalid index 0 and for
+    // negative indices reaching back past the first element.
+    inline int resolveIndex(int index, size_t count)
+    {
+        if (index > 0)
+            return index - 1;
+        if (index < 0 && static_cast<long long>(count) + index >= 0)
+            return static_cast<int>(count) + index;
+        return -2;
+    }
+
+    struct ObjCounts
+    {
+        size_t positions;
+        size_t uvs;
+        size_t normals;
+        size_t corners;
+    };
+
+    // A newline aligned range of the file, offsets are the counts of all the
+    // chunks before it and so where its output goes in the final arrays
+    struct ObjChunk
+    {
+        const char *begin;
+        const char *end;
+        ObjCounts counts;
+        ObjCounts offsets;
+        std::vector<std::string> materialLibraries;
+        std::vector<ObjMaterialUse> materialUses;
+    };
+
+    // Chunks below this size aren't worth handing to another thread
+    const size_t minChunkSize = 1 << 20;
+
+    // Counts the whitespace separated corners on a face line, stopping at a
+    // comment the same way parseFace does
+    inline size_t countCorners(const char *&p, const char *end)
+    {
+        size_t n = 0;
+        while (true)
+        {
+            p = skipBlanks(p, end);
+            if (p >= end || *p == '\n' || *p == '\r' || *p == '#')
+                break;
+            n++;
+            while (p < end && !isBlank(*p) && *p != '\n' && *p != '\r')
+                p++;
+        }
+        return n;
+    }
+
+    // Quick pass over the text counting the attributes and triangle corners
+    // so every array can be allocated once
+    ObjCounts countObj(const char *p, const char *end)
+    {
+        ObjCounts counts = { 0, 0, 0, 0 };
+        while (p < end)
+        {
+            p = skipBlanks(p, end);
+            if (end - p >= 2 && p[0] == 'v')
+            {
+                if (isBlank(p[1]))
+                    counts.positions++;
+                else if (p[1] == 't')
+                    counts.uvs++;
+                else if (p[1] == 'n')
+                    counts.normals++;
+            }
+            else if (end - p >= 2 && p[0] == 'f' && isBlank(p[1]))
+            {
+                p++;
+                size_t n = countCorners(p, end);
+                if (n >= 3)
+                    counts.corners += 3 * (n - 2);
+            }
+            p = skipLine(p, end);
+        }
+        return counts;
+    }
+
+    // Parses one face line into fan triangulated corners written to out.
+    // counts holds the number of attributes read before this line, which
+    // negative indices are relative to.
+    bool parseFace(const char *&p, const char *end, const ObjCounts &counts,
+                   ObjCorner *out, size_t &numCorners, size_t maxCorners)
+    {
+        ObjCorner first = { 0, 0, 0 };
+        ObjCorner previous = { 0, 0, 0 };
+        int n = 0;
+
+        while (true)
+        {
+            p = skipBlanks(p, end);
+            if (p >= end || *p == '\n' || *p == '\r' || *p == '#')
+                break;
+
+            ObjCorner corner = { 0, -1, -1 };
+            int index = 0;
+            const char *q = parseInt(p, end, index);
+            if (q == p)
+                return false;
+            corner.v = resolveIndex(index, counts.positions);
+            p = q;
+
+            if (p < end && *p == '/')
+            {
+                p++;
+                q = parseInt(p, end, index);
+                if (q != p)
+                {
+                    corner.vt = resolveIndex(index, counts.uvs);
+                    p = q;
+                }
+                if (p < end && *p == '/')
+                {
+                    p++;
+                    q = parseInt(p, end, index);
+                    if (q == p)
+                        return false;
+                    corner.vn = resolveIndex(index, counts.normals);
+                    p = q;
+                }
+            }
+            if (corner.v < 0 || corner.vt < -1 || corner.vn < -1)
+                return false;
+
+            if (n == 0)
+                first = corner;
+            else if (n >= 2)
+            {
+                if (numCorners + 3 > maxCorners)
+                    return false;
+                out[numCorners++] = first;
+                out[numCorners++] = previous;
+                out[numCorners++] = corner;
+            }
+            previous = corner;
+            n++;
+        }
+        return n >= 3;
+    }
+
+    // Parses a chunk straight into its slots of the final arrays
+    bool parseChunk(ObjChunk &chunk, ObjData &obj)
+    {
+        const char *p = chunk.begin;
+        const char *end = chunk.end;
+
+        // Running totals including all earlier chunks
+        ObjCounts read = chunk.offsets;
+        ObjCounts last = chunk.offsets;
+        last.positions += chunk.counts.positions;
+        last.uvs += chunk.counts.uvs;
+        last.normals += chunk.counts.normals;
+        last.corners += chunk.counts.corners;
+
+        while (p < end)
+        {
+            p = skipBlanks(p, end);
+            if (end - p >= 2 && p[0] == 'v')
+            {
+                if (isBlank(p[1]))
+                {
+                    // Read vertices
+                    if (read.positions == last.positions)
+                        return false;
+                    p = parseFloats(p + 2, end, &obj.positions[read.positions++].x, 3);
+                }
+                else if (p[1] == 't')
+                {
+                    // Read texture co-ordinates
+                    if (read.uvs == last.uvs)
+                        return false;
+                    p = parseFloats(p + 2, end, &obj.uvs[read.uvs++].x, 2);
+                }
+                else if (p[1] == 'n')
+                {
+                    // Read vertex normals
+                    if (read.normals == last.normals)
+                        return false;
+                    p = parseFloats(p + 2, end, &obj.normals[read.normals++].x, 3);
+                }
+            }
+            else if (end - p >= 2 && p[0] == 'f' && isBlank(p[1]))
+            {
+                // Read vertex indices
+                p++;
+                if (!parseFace(p, end, read, &obj.corners[0], read.corners, last.corners))
+                    return false;
+            }
+
+            else if (isKeyword(p, end, "usemtl", 6))
+            {
+                ObjMaterialUse use = { parseName(p + 6, end), read.corners };
+                chunk.materialUses.push_back(use);
+            }
+            else if (isKeyword(p, end, "mtllib", 6))
+            {
+                // Several files may follow on one line
+                const char *q = p + 6;
+                while (true)
+                {
+                    q = skipBlanks(q, end);
+                    const char *nameEnd = q;
+                    while (nameEnd < end && !isBlank(*nameEnd) && *nameEnd != '\n' && *nameEnd != '\r')
+                        nameEnd++;
+                    if (nameEnd == q)
+                        break;
+                    chunk.materialLibraries.push_back(std::string(q, nameEnd));
+                    q = nameEnd;
+                }
+            }
+
+            // Anything else (comments, groups, objects) is skipped
+            p = skipLine(p, end);
+        }
+
+        // The counting pass and the parse must agree
+        return read.positions == last.positions && read.uvs == last.uvs &&
+               read.normals == last.normals && read.corners == last.corners;
+    }
+
+    // Forward references can only be checked once everything has been read
+    bool checkIndices(const ObjData &obj, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const ObjCorner &c = obj.corners[i];
+            if (static_cast<size_t>(c.v) >= obj.positions.size() ||
+                (c.vt >= 0 && static_cast<size_t>(c.vt) >= obj.uvs.size()) ||
+                (c.vn >= 0 && static_cast<size_t>(c.vn) >= obj.normals.size()))
+                return false;
+        }
+        return true;
+    }
+}
+
+bool parseObj(const char *text, size_t size, ObjData &obj, unsigned int numThreads, ThreadPool &pool)
+{
+    if (numThreads == 0 || numThreads > pool.size())
+        numThreads = pool.size();
+
+    // Split the text into newline aligned chunks, a few per thread so
+    // uneven chunks still balance out
+    size_t numChunks = 1;
+    if (numThreads > 1)
+        numChunks = std::max<size_t>(1, std::min<size_t>(numThreads * 4, size / minChunkSize));
+
+    std::vector<ObjChunk> chunks(numChunks);
+    const char *p = text;
+    const char *end = text + size;
+    for (size_t i = 0; i < numChunks; i++)
+    {
+        chunks[i].begin = p;
+        if (i + 1 == numChunks)
+            p = end;
+        else
+        {
+            p = std::max(p, text + size / numChunks * (i + 1));
+            p = p < end ? skipLine(p, end) : end;
+        }
+        chunks[i].end = p;
+    }
+
+    // Count each chunk, then prefix sum the counts into output offsets
+    if (numChunks == 1)
+        chunks[0].counts = countObj(chunks[0].begin, chunks[0].end);
+    else
+        pool.parallelFor(numChunks, [&chunks](size_t i)
+        {
+            chunks[i].counts = countObj(chunks[i].begin, chunks[i].end);
+        });
+
+    ObjCounts total = { 0, 0, 0, 0 };
+    for (size_t i = 0; i < numChunks; i++)
+    {
+        chunks[i].offsets = total;
+        total.positions += chunks[i].counts.positions;
+        total.uvs += chunks[i].counts.uvs;
+        total.normals += chunks[i].counts.normals;
+        total.corners += chunks[i].counts.corners;
+    }
+
+    obj.positions.assign(total.positions, glm::vec3(0.0f));
+    obj.uvs.assign(total.uvs, glm::vec2(0.0f));
+    obj.normals.assign(total.normals, glm::vec3(0.0f));
+    obj.corners.resize(total.corners);
+
+    // Parse every chunk into its own slice of the arrays
+    bool ok = true;
+    if (numChunks == 1)
+        ok = parseChunk(chunks[0], obj) && checkIndices(obj, 0, total.corners);
+    else
+    {
+        std::vector<char> chunkOk(numChunks, 0);
+        pool.parallelFor(numChunks, [&chunks, &chunkOk, &obj](size_t i)
+        {
+            chunkOk[i] = parseChunk(chunks[i], obj);
+        });
+        pool.parallelFor(numChunks, [&chunks, &chunkOk, &obj](size_t i)
+        {
+            size_t first = chunks[i].offsets.corners;
+            chunkOk[i] = chunkOk[i] && checkIndices(obj, first, first + chunks[i].counts.corners);
+        });
+        for (size_t i = 0; i < numChunks; i++)
+            ok = ok && chunkOk[i];
+    }
+
+    // Material lines in file order
+    obj.materialLibraries.clear();
+    obj.materialUses.clear();
+    for (size_t i = 0; i < numChunks; i++)
+    {
+        obj.materialLibraries.insert(obj.materialLibraries.end(), chunks[i].materialLibraries.begin(),
+                                     chunks[i].materialLibraries.end());
+        obj.materialUses.insert(obj.materialUses.end(), chunks[i].materialUses.begin(),
+                                chunks[i].materialUses.end());
+    }
+
+    return ok;
+}
+
+bool loadObjFile(const char *path, ObjData &obj, unsigned int numThreads)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    return parseObj(file.data(), file.size(), obj, numThreads);
+}
+
+bool streamObj(const char *text, size_t size, ObjReader &reader)
+{
+    const char *p = text;
+    const char *end = text + size;
+    ObjCounts read = { 0, 0, 0, 0 };
+    std::vector<ObjCorner> corners;
+    const size_t progressInterval = 16 << 20;
+    size_t nextProgress = progressInterval;
+    while (p < end)
+    {
+        if (static_cast<size_t>(p - text) >= nextProgress)
+        {
+            reader.progress(p - text);
+            nextProgress += progressInterval;
+        }
+
+        p = skipBlanks(p, end);
+        if (end - p >= 2 && p[0] == 'v')
+        {
+            if (isBlank(p[1]))
+            {
+                glm::vec3 position;
+                p = parseFloats(p + 2, end, &position.x, 3);
+                reader.position(position);
+                read.positions++;
+            }
+            else if (p[1] == 't')
+            {
+                glm::vec2 uv;
+                p = parseFloats(p + 2, end, &uv.x, 2);
+                reader.uv(uv);
+                read.uvs++;
+            }
+            else if (p[1] == 'n')
+            {
+                glm::vec3 normal;
+                p = parseFloats(p + 2, end, &normal.x, 3);
+                reader.normal(normal);
+                read.normals++;
+            }
+        }
+        else if (end - p >= 2 && p[0] == 'f' && isBlank(p[1]))
+        {
+            p++;
+            const char *q = p;
+            size_t n = countCorners(q, end);
+            corners.resize(3 * std::max<size_t>(n, 3));
+            size_t numCorners = 0;
+            if (!parseFace(p, end, read, &corners[0], numCorners, corners.size()) ||
+                !reader.triangles(&corners[0], numCorners))
+                return false;
+        }
+        p = skipLine(p, end);
+    }
+    reader.progress(size);
+    return true;
+}
+
+bool parseMtl(const char *text, size_t size, std::vector<ObjMaterial> &materials)
+{
+    const char *p = text;
+    const char *end = text + size;
+    ObjMaterial *material = NULL;
+    size_t first = materials.size();
+    while (p < end)
+    {
+        p = skipBlanks(p, end);
+        if (isKeyword(p, end, "newmtl", 6))
+        {
+            // Defaults for anything the entry leaves out
+            ObjMaterial m;
+            m.name = parseName(p + 6, end);
+            m.ka = glm::vec3(1.0f);
+            m.kd = glm::vec3(1.0f);
+            m.ks = glm::vec3(1.0f);
+            m.Ns = 32.0f;
+            m.d = 1.0f;
+            materials.push_back(m);
+            material = &materials.back();
+        }
+        else if (material != NULL)
+        {
+            if (isKeyword(p, end, "Ka", 2))
+                parseFloats(p + 2, end, &material->ka.x, 3);
+            else if (isKeyword(p, end, "Kd", 2))
+                parseFloats(p + 2, end, &material->kd.x, 3);
+            else if (isKeyword(p, end, "Ks", 2))
+                parseFloats(p + 2, end, &material->ks.x, 3);
+            else if (isKeyword(p, end, "Ns", 2))
+                parseFloats(p + 2, end, &material->Ns, 1);
+            else if (isKeyword(p, end, "d", 1))
+                parseFloats(p + 1, end, &material->d, 1);
+            else if (isKeyword(p, end, "Tr", 2))
+            {
+                float transparency = 0.0f;
+                parseFloats(p + 2, end, &transparency, 1);
+                material->d = 1.0f - transparency;
+            }
+            else if (isKeyword(p, end, "map_Kd", 6))
+                material->diffuseMap = parseName(p + 6, end);
+            else if (isKeyword(p, end, "map_Ks", 6))
+                material->specularMap = parseName(p + 6, end);
+            else if (isKeyword(p, end, "map_Bump", 8) || isKeyword(p, end, "map_bump", 8))
+                material->normalMap = parseName(p + 8, end);
+            else if (isKeyword(p, end, "bump", 4) || isKeyword(p, end, "norm", 4))
+                material->normalMap = parseName(p + 4, end);
+        }
+        p = skipLine(p, end);
+    }
+    return materials.size() > first;
+}
+
+bool loadMtlFile(const char *path, std::vector<ObjMaterial> &materials)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    return parseMtl(file.data(), file.size(), materials);
+}
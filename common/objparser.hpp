@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include <common/threadpool.hpp>
+
+// Indices of one face corner into the position, uv and normal arrays. uv and
+// normal are -1 when the face doesn't reference them (v and v//vn faces).
+struct ObjCorner
+{
+    int v;
+    int vt;
+    int vn;
+};
+
+// A usemtl line, the material applies to every corner from firstCorner up
+// to the next one
+struct ObjMaterialUse
+{
+    std::string name;
+    size_t firstCorner;
+};
+
+// Contents of an OBJ file, faces are fan triangulated into three corners each
+struct ObjData
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjCorner> corners;
+    std::vector<std::string> materialLibraries;     // mtllib files in order
+    std::vector<ObjMaterialUse> materialUses;       // usemtl lines in order
+};
+
+// One newmtl entry of an MTL file. Maps are paths as written in the file.
+struct ObjMaterial
+{
+    std::string name;
+    glm::vec3 ka;
+    glm::vec3 kd;
+    glm::vec3 ks;
+    float Ns;
+    float d;                    // dissolve, 1 is opaque
+    std::string diffuseMap;     // map_Kd
+    std::string specularMap;    // map_Ks
+    std::string normalMap;      // map_Bump, bump or norm
+};
+
+// Parse OBJ text held in memory. Accepts v, v/vt, v//vn and v/vt/vn corners,
+// polygons with any number of corners and negative (relative) indices.
+// Large files are split into newline aligned chunks parsed on up to
+// numThreads threads of pool (0 for all of them), the result is the same as
+// parsing on one thread.
+bool parseObj(const char *text, size_t size, ObjData &obj, unsigned int numThreads = 1,
+              ThreadPool &pool = ThreadPool::shared());
+
+// Memory map and parse an OBJ file
+bool loadObjFile(const char *path, ObjData &obj, unsigned int numThreads = 1);
+
+// Receives the contents of an OBJ file in file order from streamObj
+class ObjReader
+{
+public:
+    virtual ~ObjReader() {}
+    virtual void position(const glm::vec3 &/*position*/) {}
+    virtual void uv(const glm::vec2 &/*uv*/) {}
+    virtual void normal(const glm::vec3 &/*normal*/) {}
+
+    // One fan triangulated polygon, three corners per triangle. Returning
+    // false stops the parse.
+    virtual bool triangles(const ObjCorner */*corners*/, size_t /*numCorners*/) { return true; }
+
+    // Called every few megabytes with how far into the text the parse is
+    virtual void progress(size_t /*bytesRead*/) {}
+};
+
+// Parse OBJ text in one serial pass without keeping any of it, for files
+// too large to hold in memory. Negative indices are resolved but indices
+// past the attributes read so far are left for the reader to check.
+bool streamObj(const char *text, size_t size, ObjReader &reader);
+
+// Parse MTL text held in memory, appending its materials
+bool parseMtl(const char *text, size_t size, std::vector<ObjMaterial> &materials);
+
+// Memory map and parse an MTL file
+bool loadMtlFile(const char *path, std::vector<ObjMaterial> &materials);
@@ -0,0 +1,208 @@
+#include <cstring>
+#include <algorithm>
+
+#include <common/pagetable.hpp>
+#include <common/mipmap.hpp>
+
+PageTable::PageTable(int pagesX, int pagesY, int numSlots)
+    : slotCount(numSlots), frame(0)
+{
+    memset(&counters, 0, sizeof(counters));
+    unsigned int numLevels = mipLevelCount(pagesX, pagesY);
+    for (unsigned int i = 0; i < numLevels; i++)
+    {
+        Level level;
+        level.pagesX = std::max(pagesX >> i, 1);
+        level.pagesY = std::max(pagesY >> i, 1);
+        PageTableEntry none = { 0, 0, 0 };
+        level.entries.assign(static_cast<size_t>(level.pagesX) * level.pagesY, none);
+        level.dirty = true;
+        levels.push_back(level);
+    }
+
+    // Lowest slots are handed out first
+    for (int slot = numSlots - 1; slot >= 0; slot--)
+        freeSlots.push_back(slot);
+}
+
+void PageTable::beginFrame()
+{
+    frame++;
+    requested.clear();
+    missing.clear();
+    request(numLevels() - 1, 0, 0);
+}
+
+void PageTable::request(int level, int x, int y)
+{
+    if (level < 0 || level >= numLevels() || x < 0 || y < 0 || x >= levels[level].pagesX || y >= levels[level].pagesY)
+        return;
+
+    // A page's ancestors are its fallbacks, they are kept too. Once one is
+    // already requested so are the rest above it.
+    for (; level < numLevels(); level++, x >>= 1, y >>= 1)
+    {
+        unsigned int k = key(level, x, y);
+        if (!requested.insert(k).second)
+            return;
+        std::unordered_map<unsigned int, Page>::iterator page = pages.find(k);
+        if (page == pages.end())
+        {
+            missing.push_back(k);
+            continue;
+        }
+        page->second.lastUsed = frame;
+        if (!page->second.loading)
+            lru.splice(lru.begin(), lru, page->second.lru);
+    }
+}
+
+std::vector<PageLoad> PageTable::update(size_t maxLoads)
+{
+    // Coarse pages first, they cover the most of the screen and are the
+    // fallbacks of the fine ones
+    std::stable_sort(missing.begin(), missing.end(), [](unsigned int a, unsigned int b) { return (a >> 24) > (b >> 24); });
+
+    std::vector<PageLoad> loads;
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        if (loads.size() == maxLoads)
+            break;
+        if (freeSlots.empty() && !evictOne())
+        {
+            counters.dropped += missing.size() - i;
+            break;
+        }
+
+        PageLoad load;
+        load.level = static_cast<int>(missing[i] >> 24);
+        load.x = static_cast<int>(missing[i] & 0xfff);
+        load.y = static_cast<int>((missing[i] >> 12) & 0xfff);
+        load.slot = freeSlots.back();
+        freeSlots.pop_back();
+
+        Page page;
+        page.slot = load.slot;
+        page.loading = true;
+        page.lastUsed = frame;
+        pages[missing[i]] = page;
+        loads.push_back(load);
+    }
+
+    // What didn't fit is asked for again by the next frame's feedback
+    missing.clear();
+    return loads;
+}
+
+void PageTable::pageLoaded(int level, int x, int y)
+{
+    std::unordered_map<unsigned int, Page>::iterator page = pages.find(key(level, x, y));
+    if (page == pages.end() || !page->second.loading)
+        return;
+    page->second.loading = false;
+    lru.push_front(page->first);
+    page->second.lru = lru.begin();
+    map(level, x, y, page->second.slot);
+    counters.loads++;
+}
+
+void PageTable::pageFailed(int level, int x, int y)
+{
+    std::unordered_map<unsigned int, Page>::iterator page = pages.find(key(level, x, y));
+    if (page == pages.end() || !page->second.loading)
+        return;
+    freeSlots.push_back(page->second.slot);
+    pages.erase(page);
+}
+
+bool PageTable::isResident(int level, int x, int y) const
+{
+    std::unordered_map<unsigned int, Page>::const_iterator page = pages.find(key(level, x, y));
+    return page != pages.end() && !page->second.loading;
+}
+
+const PageTableEntry &PageTable::entry(int level, int x, int y) const
+{
+    return levels[level].entries[static_cast<size_t>(y) * levels[level].pagesX + x];
+}
+
+PageTableStats PageTable::stats() const
+{
+    PageTableStats stats = counters;
+    stats.resident = lru.size();
+    stats.loading = pages.size() - lru.size();
+    return stats;
+}
+
+unsigned int PageTable::key(int level, int x, int y)
+{
+    return static_cast<unsigned int>(level) << 24 | static_cast<unsigned int>(y) << 12 | static_cast<unsigned int>(x);
+}
+
+bool PageTable::evictOne()
+{
+    // Least recently used first, pages this frame still needs stay.
+    // Pages loaded this frame can sit in front of older ones, so this
+    // isn't always the very back.
+    for (std::list<unsigned int>::reverse_iterator i = lru.rbegin(); i != lru.rend(); ++i)
+    {
+        std::unordered_map<unsigned int, Page>::iterator page = pages.find(*i);
+        if (page->second.lastUsed == frame)
+            continue;
+        unsigned int k = page->first;
+        unmap(static_cast<int>(k >> 24), static_cast<int>(k & 0xfff), static_cast<int>((k >> 12) & 0xfff));
+        freeSlots.push_back(page->second.slot);
+        lru.erase(page->second.lru);
+        pages.erase(page);
+        counters.evictions++;
+        return true;
+    }
+    return false;
+}
+
+void PageTable::map(int level, int x, int y, int slot)
+{
+    // Every entry under the page that falls back to something coarser
+    for (int l = level; l >= 0; l--)
+    {
+        Level &target = levels[l];
+        int span = 1 << (level - l);
+        int x1 = std::min((x + 1) * span, target.pagesX), y1 = std::min((y + 1) * span, target.pagesY);
+        for (int py = y * span; py < y1; py++)
+            for (int px = x * span; px < x1; px++)
+            {
+                PageTableEntry &e = target.entries[static_cast<size_t>(py) * target.pagesX + px];
+                if (!e.valid || e.level > level)
+                {
+                    e.slot = static_cast<unsigned short>(slot);
+                    e.level = static_cast<unsigned char>(level);
+                    e.valid = 1;
+                }
+            }
+        target.dirty = true;
+    }
+}
+
+void PageTable::unmap(int level, int x, int y)
+{
+    // Entries that used the page fall back to their parent's, which is
+    // already fixed when going down from the page's own level
+    for (int l = level; l >= 0; l--)
+    {
+        Level &target = levels[l];
+        int span = 1 << (level - l);
+        int x1 = std::min((x + 1) * span, target.pagesX), y1 = std::min((y + 1) * span, target.pagesY);
+        for (int py = y * span; py < y1; py++)
+            for (int px = x * span; px < x1; px++)
+            {
+                PageTableEntry &e = target.entries[static_cast<size_t>(py) * target.pagesX + px];
+                if (!e.valid || e.level != level)
+                    continue;
+                if (l + 1 < numLevels())
+                    e = entry(l + 1, px >> 1, py >> 1);
+                else
+                    e.valid = 0;
+            }
+        target.dirty = true;
+    }
+}
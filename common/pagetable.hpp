@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+
+// Where a page of the virtual texture is read from. Every page of every
+// level has one, pointing at the finest resident page covering it.
+struct PageTableEntry
+{
+    unsigned short slot;            // in the physical cache
+    unsigned char level;            // of the page in that slot
+    unsigned char valid;            // 0 until some covering page is resident
+};
+
+// Page picked by update() to be read into slot
+struct PageLoad
+{
+    int level;
+    int x;
+    int y;
+    int slot;
+};
+
+struct PageTableStats
+{
+    size_t resident;
+    size_t loading;
+    size_t loads;
+    size_t evictions;
+    size_t dropped;                 // requests left for later with no slot free
+};
+
+// CPU side of a virtual texture: which pages of which levels are in the
+// slots of the physical cache. Requests from a frame's feedback keep pages
+// and their ancestors alive, update() hands out slots for missing pages,
+// coarsest first, evicting the least recently used pages nothing asked
+// for this frame. The indirection levels are kept up to date as pages come
+// and go. No GL, so the replacement can be driven without a context.
+class PageTable
+{
+public:
+    // Level 0 is pagesX by pagesY pages, each level above halves that down
+    // to a single page. Both have to be powers of two so every page has
+    // exactly one parent.
+    PageTable(int pagesX, int pagesY, int numSlots);
+
+    int numLevels() const { return static_cast<int>(levels.size()); }
+    int levelPagesX(int level) const { return levels[level].pagesX; }
+    int levelPagesY(int level) const { return levels[level].pagesY; }
+    int numSlots() const { return slotCount; }
+
+    // Starts collecting the requests of a new frame. The single page of
+    // the top level is always requested so something is always resident.
+    void beginFrame();
+
+    // Page wanted this frame, out of range pages are ignored
+    void request(int level, int x, int y);
+
+    // Up to maxLoads of this frame's missing pages, coarsest first, each
+    // given a slot. Pages evicted for them are unmapped straight away.
+    std::vector<PageLoad> update(size_t maxLoads);
+
+    // The page given out by update() is in its slot now, or could not be
+    // read and its slot is free again
+    void pageLoaded(int level, int x, int y);
+    void pageFailed(int level, int x, int y);
+
+    bool isResident(int level, int x, int y) const;
+    const PageTableEntry &entry(int level, int x, int y) const;
+
+    // Entries of a level, pagesX a row, bottom row first
+    const std::vector<PageTableEntry> &levelEntries(int level) const { return levels[level].entries; }
+
+    // Whether a level's entries changed since the flag was last cleared
+    bool isDirty(int level) const { return levels[level].dirty; }
+    void clearDirty(int level) { levels[level].dirty = false; }
+
+    PageTableStats stats() const;
+
+private:
+    struct Level
+    {
+        int pagesX;
+        int pagesY;
+        std::vector<PageTableEntry> entries;
+        bool dirty;
+    };
+
+    struct Page
+    {
+        int slot;
+        bool loading;
+        unsigned long long lastUsed;    // frame it was last requested
+        std::list<unsigned int>::iterator lru;
+    };
+
+    std::vector<Level> levels;
+    int slotCount;
+    std::vector<int> freeSlots;
+    std::unordered_map<unsigned int, Page> pages;
+    std::list<unsigned int> lru;        // resident pages, most recently used first
+    std::unordered_set<unsigned int> requested;
+    std::vector<unsigned int> missing;  // requested this frame and not in pages
+    unsigned long long frame;
+    PageTableStats counters;
+
+    static unsigned int key(int level, int x, int y);
+    bool evictOne();
+    void map(int level, int x, int y, int slot);
+    void unmap(int level, int x, int y);
+};
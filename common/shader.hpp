@@ -4,8 +4,9 @@
 #include <GLFW/glfw3.h>
 
 #include <vector>
-#include <fstream>
-#include <sstream>
+#include <string>
+
+#include <common/mappedfile.hpp>
 
 unsigned int LoadShaders(const char *vertex_file_path,
                          const char *fragment_file_path)
@@ -15,14 +16,11 @@ unsigned int LoadShaders(const char *vertex_file_path,
     unsigned int VertexShaderID   = glCreateShader(GL_VERTEX_SHADER);
     unsigned int FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
-    // Read the Vertex Shader code from the file
+    // Read the Vertex Shader code from the file, or the asset pack
     std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if(VertexShaderStream.is_open()){
-        std::stringstream sstr;
-        sstr << VertexShaderStream.rdbuf();
-        VertexShaderCode = sstr.str();
-        VertexShaderStream.close();
+    MappedFile VertexShaderFile;
+    if(VertexShaderFile.open(vertex_file_path)){
+        VertexShaderCode.assign(VertexShaderFile.data(), VertexShaderFile.size());
     }
     else
     {
@@ -34,13 +32,10 @@ unsigned int LoadShaders(const char *vertex_file_path,
 
     // Read the Fragment Shader code from the file
     std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if(FragmentShaderStream.is_open())
+    MappedFile FragmentShaderFile;
+    if(FragmentShaderFile.open(fragment_file_path))
     {
-        std::stringstream sstr;
-        sstr << FragmentShaderStream.rdbuf();
-        FragmentShaderCode = sstr.str();
-        FragmentShaderStream.close();
+        FragmentShaderCode.assign(FragmentShaderFile.data(), FragmentShaderFile.size());
     }
 
     GLint Result = GL_FALSE;
@@ -0,0 +1,406 @@
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+#include <iterator>
+
+#include <common/simplify.hpp>
+
+namespace
+{
+    // Sum of weighted squared distances to a set of planes,
+    // Q(p) = p'Ap + 2b.p + c
+    struct Quadric
+    {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+        double weight;
+
+        Quadric() : a00(0), a01(0), a02(0), a11(0), a12(0), a22(0),
+                    b0(0), b1(0), b2(0), c(0), weight(0) {}
+
+        void addPlane(const glm::vec3 &n, float d, double w)
+        {
+            a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+            a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+            b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric &q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02;
+            a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+        }
+
+        double evaluate(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z +
+                            a11 * y * y + 2 * a12 * y * z + a22 * z * z +
+                            2 * (b0 * x + b1 * y + b2 * z) + c;
+            return std::max(result, 0.0);
+        }
+    };
+
+    struct Collapse
+    {
+        float cost;
+        unsigned int from;
+        unsigned int to;
+        unsigned int fromVersion;
+        unsigned int toVersion;
+
+        bool operator>(const Collapse &other) const { return cost > other.cost; }
+    };
+
+    // Open borders are held in place much more strongly than surfaces
+    const double borderWeight = 10.0;
+
+    struct PositionKey
+    {
+        unsigned int bits[3];
+
+        bool operator==(const PositionKey &other) const
+        {
+            return memcmp(bits, other.bits, sizeof(bits)) == 0;
+        }
+    };
+
+    struct PositionKeyHash
+    {
+        size_t operator()(const PositionKey &key) const
+        {
+            return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+        }
+    };
+
+    class Simplifier
+    {
+    public:
+        Simplifier(const unsigned int *indices, size_t numIndices,
+                   const glm::vec3 *positions, size_t numVertices);
+
+        // Collapses edges until at most targetIndices indices remain
+        std::vector<unsigned int> run(size_t targetIndices, float &error);
+
+    private:
+        std::vector<unsigned int> positionOf;       // wedge -> welded position
+        std::vector<glm::vec3> points;              // welded position -> point
+        std::vector<unsigned int> triangles;        // wedges, 3 per triangle
+        std::vector<bool> alive;
+        std::vector<std::vector<unsigned int> > trianglesOf;
+        std::vector<Quadric> quadrics;
+        std::vector<unsigned int> version;
+        std::vector<bool> removed;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > queue;
+        size_t numAlive;
+
+        unsigned int corner(unsigned int t, int k) const { return positionOf[triangles[t * 3 + k]]; }
+        bool hasPosition(unsigned int t, unsigned int p) const
+        {
+            return corner(t, 0) == p || corner(t, 1) == p || corner(t, 2) == p;
+        }
+
+        void pushEdges(unsigned int p);
+        float cost(unsigned int from, unsigned int to) const;
+        bool isBorderEdge(unsigned int a, unsigned int b) const;
+        bool isBorderVertex(unsigned int p) const;
+        bool tryCollapse(unsigned int from, unsigned int to);
+    };
+
+    Simplifier::Simplifier(const unsigned int *indices, size_t numIndices,
+                           const glm::vec3 *positions, size_t numVertices)
+        : positionOf(numVertices), triangles(indices, indices + numIndices),
+          alive(numIndices / 3, true), numAlive(numIndices / 3)
+    {
+        // Weld wedges by position so seams share one topological vertex
+        std::unordered_map<PositionKey, unsigned int, PositionKeyHash> welded;
+        for (size_t i = 0; i < numVertices; i++)
+        {
+            PositionKey key;
+            memcpy(key.bits, &positions[i], sizeof(key.bits));
+            std::pair<std::unordered_map<PositionKey, unsigned int, PositionKeyHash>::iterator, bool> result =
+                welded.insert(std::make_pair(key, static_cast<unsigned int>(points.size())));
+            if (result.second)
+                points.push_back(positions[i]);
+            positionOf[i] = result.first->second;
+        }
+
+        size_t numPoints = points.size();
+        trianglesOf.resize(numPoints);
+        quadrics.resize(numPoints);
+        version.assign(numPoints, 0);
+        removed.assign(numPoints, false);
+
+        // Area weighted plane of every triangle
+        for (unsigned int t = 0; t < numAlive; t++)
+        {
+            const glm::vec3 &a = points[corner(t, 0)];
+            const glm::vec3 &b = points[corner(t, 1)];
+            const glm::vec3 &c = points[corner(t, 2)];
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float area = glm::length(n);
+            if (area > 0.0f)
+                n /= area;
+            for (int k = 0; k < 3; k++)
+            {
+                trianglesOf[corner(t, k)].push_back(t);
+                quadrics[corner(t, k)].addPlane(n, -glm::dot(n, a), area * 0.5);
+            }
+        }
+
+        // Planes through each border edge perpendicular to its triangle
+        for (unsigned int t = 0; t < numAlive; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int p0 = corner(t, k);
+                unsigned int p1 = corner(t, (k + 1) % 3);
+                if (!isBorderEdge(p0, p1))
+                    continue;
+
+                const glm::vec3 &a = points[p0];
+                const glm::vec3 &b = points[p1];
+                glm::vec3 faceNormal = glm::cross(b - a, points[corner(t, (k + 2) % 3)] - a);
+                glm::vec3 n = glm::cross(b - a, faceNormal);
+                float length = glm::length(n);
+                if (length == 0.0f)
+                    continue;
+                n /= length;
+                double w = borderWeight * glm::dot(b - a, b - a);
+                quadrics[p0].addPlane(n, -glm::dot(n, a), w);
+                quadrics[p1].addPlane(n, -glm::dot(n, a), w);
+            }
+        }
+
+        for (unsigned int p = 0; p < numPoints; p++)
+            pushEdges(p);
+    }
+
+    float Simplifier::cost(unsigned int from, unsigned int to) const
+    {
+        Quadric q = quadrics[from];
+        q.add(quadrics[to]);
+        return static_cast<float>(q.weight > 0.0 ? q.evaluate(points[to]) / q.weight : 0.0);
+    }
+
+    void Simplifier::pushEdges(unsigned int p)
+    {
+        for (size_t i = 0; i < trianglesOf[p].size(); i++)
+        {
+            unsigned int t = trianglesOf[p][i];
+            if (!alive[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int q = corner(t, k);
+                if (q == p)
+                    continue;
+                Collapse outward = { cost(p, q), p, q, version[p], version[q] };
+                Collapse inward = { cost(q, p), q, p, version[q], version[p] };
+                queue.push(outward);
+                queue.push(inward);
+            }
+        }
+    }
+
+    bool Simplifier::isBorderEdge(unsigned int a, unsigned int b) const
+    {
+        int shared = 0;
+        for (size_t i = 0; i < trianglesOf[a].size(); i++)
+        {
+            unsigned int t = trianglesOf[a][i];
+            if (alive[t] && hasPosition(t, b))
+                shared++;
+        }
+        return shared == 1;
+    }
+
+    bool Simplifier::isBorderVertex(unsigned int p) const
+    {
+        for (size_t i = 0; i < trianglesOf[p].size(); i++)
+        {
+            unsigned int t = trianglesOf[p][i];
+            if (!alive[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+                if (corner(t, k) != p && isBorderEdge(p, corner(t, k)))
+                    return true;
+        }
+        return false;
+    }
+
+    bool Simplifier::tryCollapse(unsigned int from, unsigned int to)
+    {
+        // Borders may only shrink along themselves
+        if (isBorderVertex(from) && !isBorderEdge(from, to))
+            return false;
+
+        // Each wedge of from has to map onto one wedge of to, taken from the
+        // triangles on the edge. This keeps uv and normal seams intact.
+        std::vector<std::pair<unsigned int, unsigned int> > wedgeMap;
+        std::vector<unsigned int> neighbours[2];
+        size_t numShared = 0;
+        for (size_t i = 0; i < trianglesOf[from].size(); i++)
+        {
+            unsigned int t = trianglesOf[from][i];
+            if (!alive[t] || !hasPosition(t, to))
+                continue;
+            numShared++;
+
+            unsigned int fromWedge = 0, toWedge = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                if (corner(t, k) == from)
+                    fromWedge = triangles[t * 3 + k];
+                else if (corner(t, k) == to)
+                    toWedge = triangles[t * 3 + k];
+            }
+            for (size_t j = 0; j < wedgeMap.size(); j++)
+                if (wedgeMap[j].first == fromWedge && wedgeMap[j].second != toWedge)
+                    return false;
+            wedgeMap.push_back(std::make_pair(fromWedge, toWedge));
+        }
+        if (numShared == 0)
+            return false;
+
+        // Link condition, the ends may only share the neighbours across the
+        // collapsing triangles or the mesh becomes non-manifold
+        for (int side = 0; side < 2; side++)
+        {
+            unsigned int p = side == 0 ? from : to;
+            for (size_t i = 0; i < trianglesOf[p].size(); i++)
+            {
+                unsigned int t = trianglesOf[p][i];
+                if (!alive[t])
+                    continue;
+                for (int k = 0; k < 3; k++)
+                    if (corner(t, k) != from && corner(t, k) != to)
+                        neighbours[side].push_back(corner(t, k));
+            }
+            std::sort(neighbours[side].begin(), neighbours[side].end());
+            neighbours[side].erase(std::unique(neighbours[side].begin(), neighbours[side].end()),
+                                   neighbours[side].end());
+        }
+        std::vector<unsigned int> common;
+        std::set_intersection(neighbours[0].begin(), neighbours[0].end(),
+                              neighbours[1].begin(), neighbours[1].end(),
+                              std::back_inserter(common));
+        if (common.size() != numShared)
+            return false;
+
+        // Every remaining triangle needs a wedge to move to and must not flip
+        for (size_t i = 0; i < trianglesOf[from].size(); i++)
+        {
+            unsigned int t = trianglesOf[from][i];
+            if (!alive[t] || hasPosition(t, to))
+                continue;
+
+            int k = corner(t, 0) == from ? 0 : corner(t, 1) == from ? 1 : 2;
+            bool mapped = false;
+            for (size_t j = 0; j < wedgeMap.size(); j++)
+                mapped = mapped || wedgeMap[j].first == triangles[t * 3 + k];
+            if (!mapped)
+                return false;
+
+            const glm::vec3 &b = points[corner(t, (k + 1) % 3)];
+            const glm::vec3 &c = points[corner(t, (k + 2) % 3)];
+            glm::vec3 before = glm::cross(b - points[from], c - points[from]);
+            glm::vec3 after = glm::cross(b - points[to], c - points[to]);
+            if (glm::dot(before, after) <= 0.0f)
+                return false;
+        }
+
+        // Move the triangles across and drop the ones on the edge
+        std::vector<unsigned int> merged;
+        for (size_t i = 0; i < trianglesOf[to].size(); i++)
+            if (alive[trianglesOf[to][i]])
+                merged.push_back(trianglesOf[to][i]);
+        for (size_t i = 0; i < trianglesOf[from].size(); i++)
+        {
+            unsigned int t = trianglesOf[from][i];
+            if (!alive[t])
+                continue;
+            if (hasPosition(t, to))
+            {
+                alive[t] = false;
+                numAlive--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int &wedge = triangles[t * 3 + k];
+                if (positionOf[wedge] != from)
+                    continue;
+                for (size_t j = 0; j < wedgeMap.size(); j++)
+                    if (wedgeMap[j].first == wedge)
+                    {
+                        wedge = wedgeMap[j].second;
+                        break;
+                    }
+            }
+            merged.push_back(t);
+        }
+        trianglesOf[to].swap(merged);
+        trianglesOf[from].clear();
+
+        quadrics[to].add(quadrics[from]);
+        removed[from] = true;
+        version[to]++;
+        pushEdges(to);
+        return true;
+    }
+
+    std::vector<unsigned int> Simplifier::run(size_t targetIndices, float &error)
+    {
+        double worst = 0.0;
+        while (numAlive * 3 > targetIndices && !queue.empty())
+        {
+            Collapse c = queue.top();
+            queue.pop();
+            if (removed[c.from] || removed[c.to])
+                continue;
+
+            // A newer entry was queued when an end last changed
+            if (c.fromVersion != version[c.from] || c.toVersion != version[c.to])
+                continue;
+
+            if (tryCollapse(c.from, c.to))
+                worst = std::max(worst, static_cast<double>(c.cost));
+        }
+        error = static_cast<float>(std::sqrt(worst));
+
+        std::vector<unsigned int> result;
+        result.reserve(numAlive * 3);
+        for (size_t t = 0; t < alive.size(); t++)
+            if (alive[t])
+                result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+        return result;
+    }
+}
+
+std::vector<unsigned int> simplifyMesh(const unsigned int *indices, size_t numIndices,
+                                       const glm::vec3 *positions, size_t numVertices,
+                                       size_t targetIndices, float &error)
+{
+    error = 0.0f;
+    if (numIndices <= targetIndices)
+        return std::vector<unsigned int>(indices, indices + numIndices);
+
+    Simplifier simplifier(indices, numIndices, positions, numVertices);
+    return simplifier.run(targetIndices, error);
+}
+
+float lodSwitchDistance(float error, float fovDegrees, float viewportHeight, float maxPixelError)
+{
+    // Pixels per object unit at distance d is viewportHeight / (2 d tan(fov / 2))
+    float projection = viewportHeight / (2.0f * std::tan(glm::radians(fovDegrees) * 0.5f));
+    return error * projection / maxPixelError;
+}
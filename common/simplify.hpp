@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// Reduces an indexed triangle list to about targetIndices indices by
+// collapsing edges in order of quadric error (Garland and Heckbert). Vertices
+// only ever collapse onto other existing vertices, so the result indexes the
+// same vertex buffer. Vertices sharing a position but not a uv or normal
+// (seams) only move along the seam, and open borders only move along the
+// border. error is set to the largest error introduced, in the units of the
+// positions.
+std::vector<unsigned int> simplifyMesh(const unsigned int *indices, size_t numIndices,
+                                       const glm::vec3 *positions, size_t numVertices,
+                                       size_t targetIndices, float &error);
+
+// Distance at which an error in object units projects to maxPixelError
+// pixels for a vertical field of view and viewport height
+float lodSwitchDistance(float error, float fovDegrees, float viewportHeight, float maxPixelError);
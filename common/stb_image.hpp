@@ -273,6 +273,11 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// PNGs are inflated by a fast loop and unfiltered with SSE2 where it can.
+// Defining STBI_PNG_REFERENCE keeps to the one symbol at a time inflate
+// and the scalar unfilter loops instead, which the fast paths are tested
+// against.
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -533,6 +538,23 @@ STBIDEF int   stbi_zlib_decode_buffer(char *obuffer, int olen, const char *ibuff
 STBIDEF char *stbi_zlib_decode_noheader_malloc(const char *buffer, int len, int *outlen);
 STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const char *ibuffer, int ilen);
 
+// Band decoding - an image a band of rows at a time, top row first, into
+// memory the caller owns, so an image too big to hold whole never is.
+// Only baseline JPEGs and non-interlaced 8-bit PNGs can be streamed; open
+// returns NULL for anything else as well as for errors, and the image can
+// still be loaded whole. Channels are the file's, as with desired_channels
+// 0, and the flip flags don't apply.
+
+typedef struct stbi_band stbi_band;
+
+STBIDEF stbi_band *stbi_band_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file);
+// decodes up to max_rows rows, one after another; returns how many, 0 at
+// the end of the image or on an error
+STBIDEF int        stbi_band_read(stbi_band *band, stbi_uc *rows, int max_rows);
+// bytes of the buffer read so far, the decoder never looks behind them
+STBIDEF int        stbi_band_input_offset(stbi_band *band);
+STBIDEF void       stbi_band_close(stbi_band *band);
+
 
 #ifdef __cplusplus
 }
@@ -749,7 +771,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -760,7 +782,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -1621,7 +1643,7 @@ stbi_inline static stbi_uc stbi__get8(stbi__context *s)
    return 0;
 }
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_HDR) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_HDR) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
 stbi_inline static int stbi__at_eof(stbi__context *s)
@@ -1992,6 +2014,7 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int mcu_rows;   // rows of MCUs the planes hold, 0 for all of them
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
@@ -2945,67 +2968,77 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
-{
-   stbi__jpeg_reset(z);
-   if (!z->progressive) {
-      if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
+// Decodes MCU row j of a baseline scan into row slot of the MCU rows the
+// planes hold, which is j unless they only hold a few. Returns 0 on an
+// error, 2 when a restart marker is missing and the scan has to stop, so we
+// get corrupt data rather than no data, and 1 otherwise.
+static int stbi__jpeg_decode_mcu_row(stbi__jpeg *z, int j, int slot)
+{
+   STBI_SIMD_ALIGN(short, data[64]);
+   if (z->scan_n == 1) {
+      int i,row;
+      int n = z->order[0];
+      // non-interleaved data, we just need to process one block at a time,
+      // in trivial scanline order
+      // number of blocks to do just depends on how many actual "pixels" this
+      // component has, independent of interleaved MCU blocking and such
+      int w = (z->img_comp[n].x+7) >> 3;
+      int h = (z->img_comp[n].y+7) >> 3;
+      int v = z->img_comp[n].v;
+      for (row=0; row < v && j*v + row < h; ++row) {
+         stbi_uc *out = z->img_comp[n].data + z->img_comp[n].w2*(slot*v + row)*8;
+         for (i=0; i < w; ++i) {
+            int ha = z->img_comp[n].ha;
+            if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+            z->idct_block_kernel(out+i*8, z->img_comp[n].w2, data);
+            // every data block is an MCU, so countdown the restart interval
+            if (--z->todo <= 0) {
+               if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+               if (!STBI__RESTART(z->marker)) return 2;
+               stbi__jpeg_reset(z);
             }
          }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
+      }
+   } else { // interleaved
+      int i,k,x,y;
+      for (i=0; i < z->img_mcu_x; ++i) {
+         // scan an interleaved mcu... process scan_n components in order
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            // scan out an mcu's worth of this component; that's just determined
+            // by the basic H and V specified for the component
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x)*8;
+                  int y2 = (slot*z->img_comp[n].v + y)*8;
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                }
             }
          }
-         return 1;
+         // after all interleaved components, that's an interleaved MCU,
+         // so now count down the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+            if (!STBI__RESTART(z->marker)) return 2;
+            stbi__jpeg_reset(z);
+         }
+      }
+   }
+   return 1;
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+   stbi__jpeg_reset(z);
+   if (!z->progressive) {
+      int j;
+      for (j=0; j < z->img_mcu_y; ++j) {
+         int r = stbi__jpeg_decode_mcu_row(z, j, j);
+         if (r != 1) return r == 2;
       }
+      return 1;
    } else {
       if (z->scan_n == 1) {
          int i,j;
@@ -3295,6 +3328,7 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    if (scan != STBI__SCAN_load) return 1;
 
    if (!stbi__mad3sizes_valid(s->img_x, s->img_y, s->img_n, 0)) return stbi__err("too large", "Image too large to decode");
+   if (z->mcu_rows && z->progressive) return stbi__err("progressive", "JPEG not supported: progressive in bands");
 
    for (i=0; i < s->img_n; ++i) {
       if (z->img_comp[i].h > h_max) h_max = z->img_comp[i].h;
@@ -3333,7 +3367,7 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
-      z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+      z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->mcu_rows ? z->mcu_rows * z->img_comp[i].v * 8 : z->img_comp[i].h2, 15);
       if (z->img_comp[i].raw_data == NULL)
          return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
       // align blocks for idct using mmx/sse
@@ -3854,6 +3888,49 @@ typedef struct
    int ypos;    // which pre-expansion row we're on
 } stbi__resample;
 
+static int stbi__jpeg_init_resample(stbi__jpeg *z, int k, stbi__resample *r)
+{
+   // allocate line buffer big enough for upsampling off the edges
+   // with upsample factor of 4
+   z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+   if (!z->img_comp[k].linebuf) return 0;
+
+   r->hs      = z->img_h_max / z->img_comp[k].h;
+   r->vs      = z->img_v_max / z->img_comp[k].v;
+   r->ystep   = r->vs >> 1;
+   r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+   r->ypos    = 0;
+   r->line0   = r->line1 = z->img_comp[k].data;
+
+   if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+   else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+   else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+   else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+   else                               r->resample = stbi__resample_row_generic;
+   return 1;
+}
+
+// Resamples the next output row of component k and steps down the plane
+static stbi_uc *stbi__jpeg_resample_next(stbi__jpeg *z, int k, stbi__resample *r)
+{
+   int y_bot = r->ystep >= (r->vs >> 1);
+   stbi_uc *out = r->resample(z->img_comp[k].linebuf,
+                              y_bot ? r->line1 : r->line0,
+                              y_bot ? r->line0 : r->line1,
+                              r->w_lores, r->hs);
+   if (++r->ystep >= r->vs) {
+      r->ystep = 0;
+      r->line0 = r->line1;
+      if (++r->ypos < z->img_comp[k].y) {
+         r->line1 += z->img_comp[k].w2;
+         // planes holding a few MCU rows are gone round and round
+         if (z->mcu_rows && r->line1 == z->img_comp[k].data + z->img_comp[k].w2 * z->img_comp[k].v * 8 * z->mcu_rows)
+            r->line1 = z->img_comp[k].data;
+      }
+   }
+   return out;
+}
+
 // fast 0..255 * 0..255 => 0..255 rounded multiplication
 static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
 {
@@ -3861,6 +3938,89 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// Colour converts one row of resampled components into n channels
+static void stbi__jpeg_convert_row(stbi__jpeg *z, stbi_uc *out, stbi_uc *coutput[4], int n, int is_rgb)
+{
+   unsigned int i;
+   if (n >= 3) {
+      stbi_uc *y = coutput[0];
+      if (z->s->img_n == 3) {
+         if (is_rgb) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = y[i];
+               out[1] = coutput[1][i];
+               out[2] = coutput[2][i];
+               out[3] = 255;
+               out += n;
+            }
+         } else {
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+         }
+      } else if (z->s->img_n == 4) {
+         if (z->app14_color_transform == 0) { // CMYK
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               out[0] = stbi__blinn_8x8(coutput[0][i], m);
+               out[1] = stbi__blinn_8x8(coutput[1][i], m);
+               out[2] = stbi__blinn_8x8(coutput[2][i], m);
+               out[3] = 255;
+               out += n;
+            }
+         } else if (z->app14_color_transform == 2) { // YCCK
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               out[0] = stbi__blinn_8x8(255 - out[0], m);
+               out[1] = stbi__blinn_8x8(255 - out[1], m);
+               out[2] = stbi__blinn_8x8(255 - out[2], m);
+               out += n;
+            }
+         } else { // YCbCr + alpha?  Ignore the fourth channel for now
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+         }
+      } else
+         for (i=0; i < z->s->img_x; ++i) {
+            out[0] = out[1] = out[2] = y[i];
+            out[3] = 255; // not used if n==3
+            out += n;
+         }
+   } else {
+      if (is_rgb) {
+         if (n == 1)
+            for (i=0; i < z->s->img_x; ++i)
+               *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+         else {
+            for (i=0; i < z->s->img_x; ++i, out += 2) {
+               out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+               out[1] = 255;
+            }
+         }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+         for (i=0; i < z->s->img_x; ++i) {
+            stbi_uc m = coutput[3][i];
+            stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+            stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+            stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+            out[0] = stbi__compute_y(r, g, b);
+            out[1] = 255;
+            out += n;
+         }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+         for (i=0; i < z->s->img_x; ++i) {
+            out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+            out[1] = 255;
+            out += n;
+         }
+      } else {
+         stbi_uc *y = coutput[0];
+         if (n == 1)
+            for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+         else
+            for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+      }
+   }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3889,33 +4049,14 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
+      unsigned int j;
       stbi_uc *output;
       stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
       stbi__resample res_comp[4];
 
-      for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
-      }
+      for (k=0; k < decode_n; ++k)
+         if (!stbi__jpeg_init_resample(z, k, &res_comp[k])) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
       // can't error after this so, this is safe
       output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
@@ -3924,97 +4065,9 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       // now go ahead and resample
       for (j=0; j < z->s->img_y; ++j) {
          stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
-         }
+         for (k=0; k < decode_n; ++k)
+            coutput[k] = stbi__jpeg_resample_next(z, k, &res_comp[k]);
+         stbi__jpeg_convert_row(z, out, coutput, n, is_rgb);
       }
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
@@ -4305,53 +4358,273 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
-static int stbi__parse_huffman_block(stbi__zbuf *a)
+// Fast path for the bulk of a huffman block. Bits come from a 64-bit
+// buffer refilled a word at a time, so one refill covers a whole
+// length/distance pair, and a 2048 entry table decodes two short
+// literals at once. It runs only while at least 8 input bytes and
+// STBI__ZFAST_MARGIN output bytes are left, so it never needs the
+// end-of-stream padding or a realloc; the byte at a time loop below
+// takes over for those and for everything it can't resolve. It also
+// keeps count of the bits stbi__fill_bits would be holding, and hands
+// back exactly that state, so a truncated or corrupt stream fails or
+// pads in the same place it always did.
+#define STBI__ZMULTI_BITS   11
+#define STBI__ZMULTI_MASK   ((1 << STBI__ZMULTI_BITS) - 1)
+#define STBI__ZFAST_MARGIN  (258 + 8)   // longest match, plus a wide copy's overrun
+
+typedef unsigned long long stbi__zbits;
+
+#ifndef STBI_PNG_REFERENCE
+// table entry: bits 0-4 bits used, 5-6 number of literals (0 means a
+// length or end symbol in bits 8-16), literals in bits 8-15 and 16-23
+// with the first one's length in bits 24-28, 0 for codes longer than
+// the table
+static void stbi__zbuild_multi(const stbi__zhuffman *z, stbi__uint32 *multi)
+{
+   stbi__uint32 single[1 << STBI__ZMULTI_BITS];
+   int i,s;
+   memset(single, 0, sizeof(single));
+   // canonical codes of each length, in the order zbuild_huffman stored them
+   for (s=1; s <= STBI__ZMULTI_BITS; ++s) {
+      int c, first = z->firstsymbol[s], count = (z->maxcode[s] >> (16-s)) - z->firstcode[s];
+      for (c=0; c < count; ++c) {
+         int j = stbi__bit_reverse(z->firstcode[s] + c, s);
+         stbi__uint32 e = (stbi__uint32) s | ((stbi__uint32) z->value[first + c] << 8);
+         for (; j < (1 << STBI__ZMULTI_BITS); j += (1 << s))
+            single[j] = e;
+      }
+   }
+   for (i=0; i < (1 << STBI__ZMULTI_BITS); ++i) {
+      stbi__uint32 e = single[i], e2;
+      stbi__uint32 sym = e >> 8, len = e & 31;
+      if (!e || sym >= 256) {
+         multi[i] = e;
+         continue;
+      }
+      multi[i] = len | (1 << 5) | (sym << 8) | (len << 24);
+      e2 = single[i >> len];
+      if (e2 && (e2 >> 8) < 256 && len + (e2 & 31) <= STBI__ZMULTI_BITS)
+         multi[i] = (len + (e2 & 31)) | (2 << 5) | (sym << 8) | ((e2 >> 8) << 16) | (len << 24);
+   }
+}
+
+// Same as stbi__zhuffman_decode on bits already in a register
+stbi_inline static int stbi__zdecode_bits(const stbi__zhuffman *z, stbi__zbits bits, int *used)
 {
-   char *zout = a->zout;
-   for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
-      if (z < 256) {
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
-         if (zout >= a->zout_end) {
-            if (!stbi__zexpand(a, zout, 1)) return 0;
-            zout = a->zout;
+   int b,s,k;
+   b = z->fast[bits & STBI__ZFAST_MASK];
+   if (b) {
+      *used = b >> 9;
+      return b & 511;
+   }
+   k = stbi__bit_reverse((int) (bits & 0xffff), 16);
+   for (s=STBI__ZFAST_BITS+1; ; ++s)
+      if (k < z->maxcode[s])
+         break;
+   if (s >= 16) return -1;
+   b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
+   if (b >= STBI__ZNSYMS) return -1;
+   if (z->size[b] != s) return -1;
+   *used = s;
+   return z->value[b];
+}
+
+// 8 bytes little-endian, a single load where that's the native order
+stbi_inline static stbi__zbits stbi__zload64(const stbi_uc *p)
+{
+#if defined(STBI__X64_TARGET) || defined(STBI__X86_TARGET) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+   stbi__zbits v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   stbi__zbits v = 0;
+   int i;
+   for (i=7; i >= 0; --i)
+      v = (v << 8) | p[i];
+   return v;
+#endif
+}
+
+// What stbi__fill_bits does to num_bits when fewer than n are left
+#define STBI__ZTRACK_FILL(track, n)  if ((track) < (n)) (track) += ((24 - (track)) & ~7) + 8
+
+// returns 1 when the margins run out, 2 at the end of the block, 0 on error
+static int stbi__parse_huffman_fast(stbi__zbuf *a, const stbi__uint32 *multi)
+{
+   stbi_uc *in = a->zbuffer;
+   stbi_uc *out = (stbi_uc *) a->zout;
+   stbi_uc *in_limit = a->zbuffer_end - 8;
+   stbi_uc *out_limit = (stbi_uc *) a->zout_end - STBI__ZFAST_MARGIN;
+   stbi__zbits bits = a->code_buffer;
+   int num_bits = a->num_bits, track = a->num_bits, result = 1;
+
+   while (in <= in_limit && out <= out_limit) {
+      stbi__uint32 e;
+      int z,used,len,dist,extra;
+      stbi_uc *p;
+      // at least 56 bits: the longest length code, its extra bits, the
+      // longest distance code and its extra bits are 48
+      bits |= stbi__zload64(in) << num_bits;
+      in += (63 - num_bits) >> 3;
+      num_bits |= 56;
+
+      e = multi[bits & STBI__ZMULTI_MASK];
+      if (e & (3 << 5)) {
+         used = e & 31;
+         bits >>= used;
+         num_bits -= used;
+         STBI__ZTRACK_FILL(track, 16);
+         if (e & (2 << 5)) {
+            track -= e >> 24;
+            STBI__ZTRACK_FILL(track, 16);
+            track -= used - (e >> 24);
+         } else {
+            track -= used;
          }
-         *zout++ = (char) z;
+         out[0] = (stbi_uc) (e >> 8);
+         out[1] = (stbi_uc) (e >> 16);   // harmless when there's only one
+         out += (e >> 5) & 3;
+         continue;
+      }
+      if (e) {
+         z = e >> 8;
+         used = e & 31;
       } else {
-         stbi_uc *p;
-         int len,dist;
-         if (z == 256) {
-            a->zout = zout;
-            if (a->hit_zeof_once && a->num_bits < 16) {
-               // The first time we hit zeof, we inserted 16 extra zero bits into our bit
-               // buffer so the decoder can just do its speculative decoding. But if we
-               // actually consumed any of those bits (which is the case when num_bits < 16),
-               // the stream actually read past the end so it is malformed.
-               return stbi__err("unexpected end","Corrupt PNG");
-            }
-            return 1;
-         }
-         if (z >= 286) return stbi__err("bad huffman code","Corrupt PNG"); // per DEFLATE, length codes 286 and 287 must not appear in compressed data
-         z -= 257;
-         len = stbi__zlength_base[z];
-         if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
-         z = stbi__zhuffman_decode(a, &a->z_distance);
-         if (z < 0 || z >= 30) return stbi__err("bad huffman code","Corrupt PNG"); // per DEFLATE, distance codes 30 and 31 must not appear in compressed data
-         dist = stbi__zdist_base[z];
-         if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
-         if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
-         if (len > a->zout_end - zout) {
-            if (!stbi__zexpand(a, zout, len)) return 0;
-            zout = a->zout;
-         }
-         p = (stbi_uc *) (zout - dist);
-         if (dist == 1) { // run of one byte; common in images.
-            stbi_uc v = *p;
-            if (len) { do *zout++ = v; while (--len); }
-         } else {
-            if (len) { do *zout++ = *p++; while (--len); }
+         z = stbi__zdecode_bits(&a->z_length, bits, &used);
+         if (z < 0) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      }
+      bits >>= used;
+      num_bits -= used;
+      STBI__ZTRACK_FILL(track, 16);
+      track -= used;
+      if (z < 256) {
+         *out++ = (stbi_uc) z;
+         continue;
+      }
+      if (z == 256) { result = 2; break; }
+      if (z >= 286) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      z -= 257;
+      len = stbi__zlength_base[z];
+      extra = stbi__zlength_extra[z];
+      if (extra) {
+         len += (int) (bits & ((1 << extra) - 1));
+         bits >>= extra;
+         num_bits -= extra;
+         STBI__ZTRACK_FILL(track, extra);
+         track -= extra;
+      }
+      z = stbi__zdecode_bits(&a->z_distance, bits, &used);
+      STBI__ZTRACK_FILL(track, 16);
+      if (z < 0 || z >= 30) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      bits >>= used;
+      num_bits -= used;
+      track -= used;
+      dist = stbi__zdist_base[z];
+      extra = stbi__zdist_extra[z];
+      if (extra) {
+         dist += (int) (bits & ((1 << extra) - 1));
+         bits >>= extra;
+         num_bits -= extra;
+         STBI__ZTRACK_FILL(track, extra);
+         track -= extra;
+      }
+      if (out - (stbi_uc *) a->zout_start < dist) { result = stbi__err("bad dist","Corrupt PNG"); break; }
+      p = out - dist;
+      if (dist >= 8) {
+         // whole words, the overrun lands in the margin and is overwritten
+         stbi_uc *end = out + len;
+         do {
+            memcpy(out, p, 8);
+            out += 8;
+            p += 8;
+         } while (out < end);
+         out = end;
+      } else if (dist == 1) {
+         memset(out, *p, len);
+         out += len;
+      } else {
+         do *out++ = *p++; while (--len);
+      }
+   }
+
+   // give back the whole bytes stbi__fill_bits wouldn't have read yet
+   in -= (num_bits - track) >> 3;
+   a->zbuffer = in;
+   a->code_buffer = (stbi__uint32) (bits & (((stbi__zbits) 1 << track) - 1));
+   a->num_bits = track;
+   a->zout = (char *) out;
+   return result;
+}
+#endif // STBI_PNG_REFERENCE
+
+// One symbol the careful way, growing the output if it has to. Returns 0
+// on an error, 2 at the end of the block and 1 otherwise.
+static int stbi__parse_huffman_symbol(stbi__zbuf *a)
+{
+   char *zout = a->zout;
+   int z = stbi__zhuffman_decode(a, &a->z_length);
+   if (z < 256) {
+      if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
+      if (zout >= a->zout_end) {
+         if (!stbi__zexpand(a, zout, 1)) return 0;
+         zout = a->zout;
+      }
+      *zout++ = (char) z;
+   } else {
+      stbi_uc *p;
+      int len,dist;
+      if (z == 256) {
+         if (a->hit_zeof_once && a->num_bits < 16) {
+            // The first time we hit zeof, we inserted 16 extra zero bits into our bit
+            // buffer so the decoder can just do its speculative decoding. But if we
+            // actually consumed any of those bits (which is the case when num_bits < 16),
+            // the stream actually read past the end so it is malformed.
+            return stbi__err("unexpected end","Corrupt PNG");
          }
+         return 2;
+      }
+      if (z >= 286) return stbi__err("bad huffman code","Corrupt PNG"); // per DEFLATE, length codes 286 and 287 must not appear in compressed data
+      z -= 257;
+      len = stbi__zlength_base[z];
+      if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
+      z = stbi__zhuffman_decode(a, &a->z_distance);
+      if (z < 0 || z >= 30) return stbi__err("bad huffman code","Corrupt PNG"); // per DEFLATE, distance codes 30 and 31 must not appear in compressed data
+      dist = stbi__zdist_base[z];
+      if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
+      if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+      if (len > a->zout_end - zout) {
+         if (!stbi__zexpand(a, zout, len)) return 0;
+         zout = a->zout;
+      }
+      p = (stbi_uc *) (zout - dist);
+      if (dist == 1) { // run of one byte; common in images.
+         stbi_uc v = *p;
+         if (len) { do *zout++ = v; while (--len); }
+      } else {
+         if (len) { do *zout++ = *p++; while (--len); }
+      }
+   }
+   a->zout = zout;
+   return 1;
+}
+
+static int stbi__parse_huffman_block(stbi__zbuf *a)
+{
+#ifndef STBI_PNG_REFERENCE
+   stbi__uint32 multi[1 << STBI__ZMULTI_BITS];
+   stbi__zbuild_multi(&a->z_length, multi);
+#endif
+   for(;;) {
+      int z;
+#ifndef STBI_PNG_REFERENCE
+      if (!a->hit_zeof_once) {
+         z = stbi__parse_huffman_fast(a, multi);
+         if (z != 1) return z == 2;
       }
+#endif
+      z = stbi__parse_huffman_symbol(a);
+      if (z != 1) return z == 2;
    }
 }
 
@@ -4666,6 +4939,143 @@ static int stbi__paeth(int a, int b, int c)
    return t1;
 }
 
+#if defined(STBI_SSE2) && !defined(STBI_PNG_REFERENCE)
+// One pixel of 3 or 4 bytes in the low lanes. The loads stay inside the
+// row, a 3 byte pixel isn't read as 4.
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int n)
+{
+   int v;
+   if (n == 4)
+      memcpy(&v, p, 4);
+   else
+      v = p[0] | (p[1] << 8) | (p[2] << 16);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int n)
+{
+   int x = _mm_cvtsi128_si32(v);
+   if (n == 4) {
+      memcpy(p, &x, 4);
+   } else {
+      p[0] = (stbi_uc) x;
+      p[1] = (stbi_uc) (x >> 8);
+      p[2] = (stbi_uc) (x >> 16);
+   }
+}
+
+stbi_inline static __m128i stbi__abs_epi16(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+// Sub, Avg and Paeth of 8-bit RGB and RGBA rows a pixel at a time with all
+// the channels in one register, and Up 16 bytes at a time. Each pixel
+// depends on the one before, so there's no going wider than a pixel; the
+// win is doing its channels together without branches. Returns 0 for rows
+// left to the scalar loops. Same results as those, byte for byte.
+static int stbi__png_unfilter_sse2(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int filter_bytes)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a = zero, b, c = zero, x;
+   int k = 0;
+   if (filter == STBI__F_up) {
+      for (; k + 16 <= nk; k += 16)
+         _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(_mm_loadu_si128((const __m128i *) (raw + k)),
+                                                              _mm_loadu_si128((const __m128i *) (prior + k))));
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+   if (filter_bytes != 3 && filter_bytes != 4)
+      return 0;
+   switch (filter) {
+   case STBI__F_sub:
+      for (; k < nk; k += filter_bytes) {
+         a = _mm_add_epi8(stbi__png_load_pixel(raw + k, filter_bytes), a);
+         stbi__png_store_pixel(cur + k, a, filter_bytes);
+      }
+      return 1;
+   case STBI__F_avg:
+      for (; k < nk; k += filter_bytes) {
+         // _mm_avg_epu8 rounds up, take the carry back off to round down
+         b = stbi__png_load_pixel(prior + k, filter_bytes);
+         x = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+         a = _mm_add_epi8(stbi__png_load_pixel(raw + k, filter_bytes), x);
+         stbi__png_store_pixel(cur + k, a, filter_bytes);
+      }
+      return 1;
+   case STBI__F_paeth:
+      // a, b and c widened to 16 bits. pa = |b-c|, pb = |a-c| and
+      // pc = |a+b-2c| are the spec's distances from the estimate a+b-c, and
+      // ties go to a then b, like stbi__paeth.
+      for (; k < nk; k += filter_bytes) {
+         __m128i pa,pb,pc,smallest,nearest;
+         b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + k, filter_bytes), zero);
+         pa = _mm_sub_epi16(b, c);
+         pb = _mm_sub_epi16(a, c);
+         pc = stbi__abs_epi16(_mm_add_epi16(pa, pb));
+         pa = stbi__abs_epi16(pa);
+         pb = stbi__abs_epi16(pb);
+         smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+         nearest = _mm_cmpeq_epi16(smallest, pb);
+         nearest = _mm_or_si128(_mm_and_si128(nearest, b), _mm_andnot_si128(nearest, c));
+         pa = _mm_cmpeq_epi16(smallest, pa);
+         nearest = _mm_or_si128(_mm_and_si128(pa, a), _mm_andnot_si128(pa, nearest));
+         x = _mm_add_epi8(stbi__png_load_pixel(raw + k, filter_bytes), _mm_packus_epi16(nearest, nearest));
+         stbi__png_store_pixel(cur + k, x, filter_bytes);
+         a = _mm_unpacklo_epi8(x, zero);
+         c = b;
+      }
+      return 1;
+   }
+   return 0;
+}
+#endif
+
+// Unfilters a row of nk bytes into cur, prior being the row above
+static void stbi__png_unfilter_row(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int filter_bytes, int sse2)
+{
+   int k;
+#if defined(STBI_SSE2) && !defined(STBI_PNG_REFERENCE)
+   if (sse2 && stbi__png_unfilter_sse2(filter, cur, prior, raw, nk, filter_bytes))
+      return;
+#else
+   STBI_NOTUSED(sse2);
+#endif
+   switch (filter) {
+   case STBI__F_none:
+      memcpy(cur, raw, nk);
+      break;
+   case STBI__F_sub:
+      memcpy(cur, raw, filter_bytes);
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
+      break;
+   case STBI__F_up:
+      for (k = 0; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      break;
+   case STBI__F_avg:
+      for (k = 0; k < filter_bytes; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
+      break;
+   case STBI__F_paeth:
+      for (k = 0; k < filter_bytes; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
+      break;
+   case STBI__F_avg_first:
+      memcpy(cur, raw, filter_bytes);
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1));
+      break;
+   }
+}
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // adds an extra all-255 alpha channel
@@ -4700,12 +5110,12 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    stbi__uint32 img_len, img_width_bytes;
    stbi_uc *filter_buf;
    int all_ok = 1;
-   int k;
    int img_n = s->img_n; // copy it into a local for later
 
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   int sse2 = 0;
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4733,6 +5143,10 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       width = img_width_bytes;
    }
 
+#ifdef STBI_SSE2
+   sse2 = stbi__sse2_available();
+#endif
+
    for (j=0; j < y; ++j) {
       // cur/prior filter buffers alternate
       stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
@@ -4741,6 +5155,15 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       int nk = width * filter_bytes;
       int filter = *raw++;
 
+#ifndef STBI_PNG_REFERENCE
+      // 8-bit rows that need no expanding are unfiltered straight into the
+      // output, the row above being the prior one
+      if (depth == 8 && img_n == out_n) {
+         cur = dest;
+         if (j) prior = dest - stride;
+      }
+#endif
+
       // check filter type
       if (filter > 4) {
          all_ok = stbi__err("invalid filter","Corrupt PNG");
@@ -4751,37 +5174,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       if (j == 0) filter = first_row_filter[filter];
 
       // perform actual filtering
-      switch (filter) {
-      case STBI__F_none:
-         memcpy(cur, raw, nk);
-         break;
-      case STBI__F_sub:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
-         break;
-      case STBI__F_up:
-         for (k = 0; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
-         break;
-      case STBI__F_avg:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
-         break;
-      case STBI__F_paeth:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
-         break;
-      case STBI__F_avg_first:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1));
-         break;
-      }
+      stbi__png_unfilter_row(filter, cur, prior, raw, nk, filter_bytes, sse2);
 
       raw += nk;
 
@@ -4819,10 +5212,10 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          if (img_n != out_n)
             stbi__create_png_alpha_expand8(dest, dest, x, img_n);
       } else if (depth == 8) {
-         if (img_n == out_n)
-            memcpy(dest, cur, x*img_n);
-         else
+         if (img_n != out_n)
             stbi__create_png_alpha_expand8(dest, cur, x, img_n);
+         else if (cur != dest)  // otherwise already unfiltered in place
+            memcpy(dest, cur, x*img_n);
       } else if (depth == 16) {
          // convert the image data from big-endian to platform-native
          stbi__uint16 *dest16 = (stbi__uint16*)dest;
@@ -5337,6 +5730,459 @@ static int stbi__png_is16(stbi__context *s)
 }
 #endif
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// band decoding
+//
+// JPEG planes only hold the MCU rows around the one being resampled, as
+// its first and last rows blend with the rows above and below. PNG is
+// inflated into a window of the last 32KB of output, all a match can reach
+// back to, with room after it for a few rows, and the IDAT chunks are
+// copied into a small input buffer as the inflate needs them.
+
+#define STBI__BAND_MCU_ROWS  3
+#define STBI__BAND_ZWINDOW   32768
+#define STBI__BAND_ZROOM     (256*1024)
+#define STBI__BAND_ZINPUT    (64*1024)
+#define STBI__BAND_ZMARGIN   1024     // input kept for a block header, room kept for a match
+
+struct stbi_band
+{
+   stbi__context s;
+   int comp;
+   stbi__uint32 row;          // next one handed out
+   int failed;
+
+#ifndef STBI_NO_JPEG
+   stbi__jpeg *jpeg;
+   stbi__resample res_comp[4];
+   stbi_uc *jpeg_row;         // converted with a byte to spare, the converters write one past
+   int is_rgb;
+   int mcu_rows_decoded;
+   int stopped;               // scan ended early, the rest of the image is whatever is left
+#endif
+
+#ifndef STBI_NO_PNG
+   stbi__zbuf z;
+   stbi__uint32 multi[1 << STBI__ZMULTI_BITS];
+   stbi_uc *input;
+   char *window;
+   char *raw_row;             // next filtered row in the window
+   stbi_uc *filter_buf;       // this row and the one above unfiltered
+   stbi__uint32 idat_left;    // of the chunk being copied
+   int input_final;           // every IDAT is in the input buffer
+   int block;                 // 0 between blocks, 1 in a Huffman block, 2 in a stored one
+   int stored_left;
+   int final_block;
+   int inflated;              // the final block is done
+   int img_n, sse2;
+   int pal_img_n, has_trans;
+   stbi_uc palette[1024], tc[3];
+#endif
+};
+
+static void stbi__band_free(stbi_band *b)
+{
+#ifndef STBI_NO_JPEG
+   if (b->jpeg) {
+      stbi__cleanup_jpeg(b->jpeg);
+      STBI_FREE(b->jpeg);
+   }
+   STBI_FREE(b->jpeg_row);
+#endif
+#ifndef STBI_NO_PNG
+   STBI_FREE(b->input);
+   STBI_FREE(b->window);
+   STBI_FREE(b->filter_buf);
+#endif
+   STBI_FREE(b);
+}
+
+#ifndef STBI_NO_JPEG
+static int stbi__band_jpeg_open(stbi_band *b)
+{
+   int k,m;
+   stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!z) return stbi__err("outofmem", "Out of memory");
+   memset(z, 0, sizeof(stbi__jpeg));
+   b->jpeg = z;
+   z->s = &b->s;
+   z->mcu_rows = STBI__BAND_MCU_ROWS;
+   stbi__setup_jpeg(z);
+   if (!stbi__decode_jpeg_header(z, STBI__SCAN_load)) return 0;
+
+   // tables up to the first scan, which has to hold every component
+   m = stbi__get_marker(z);
+   while (!stbi__SOS(m)) {
+      if (stbi__EOI(m) || stbi__DNL(m)) return stbi__err("no SOS", "Corrupt JPEG");
+      if (!stbi__process_marker(z, m)) return 0;
+      m = stbi__get_marker(z);
+   }
+   if (!stbi__process_scan_header(z)) return 0;
+   if (z->scan_n != z->s->img_n) return stbi__err("scan per component", "JPEG not supported: non-interleaved in bands");
+   stbi__jpeg_reset(z);
+
+   b->comp = z->s->img_n >= 3 ? 3 : 1;
+   b->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+   for (k=0; k < z->s->img_n; ++k)
+      if (!stbi__jpeg_init_resample(z, k, &b->res_comp[k])) return stbi__err("outofmem", "Out of memory");
+   b->jpeg_row = (stbi_uc *) stbi__malloc_mad2(b->comp, z->s->img_x, 1);
+   if (!b->jpeg_row) return stbi__err("outofmem", "Out of memory");
+   return 1;
+}
+
+static int stbi__band_jpeg_row(stbi_band *b, stbi_uc *out)
+{
+   stbi__jpeg *z = b->jpeg;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   int k, need = (int) (b->row / z->img_mcu_h) + 2;
+   if (need > z->img_mcu_y) need = z->img_mcu_y;
+   while (b->mcu_rows_decoded < need) {
+      if (!b->stopped) {
+         int r = stbi__jpeg_decode_mcu_row(z, b->mcu_rows_decoded, b->mcu_rows_decoded % STBI__BAND_MCU_ROWS);
+         if (r == 0) return 0;
+         b->stopped = r == 2;
+      }
+      ++b->mcu_rows_decoded;
+   }
+   for (k=0; k < z->s->img_n; ++k)
+      coutput[k] = stbi__jpeg_resample_next(z, k, &b->res_comp[k]);
+   stbi__jpeg_convert_row(z, b->jpeg_row, coutput, b->comp, b->is_rgb);
+   memcpy(out, b->jpeg_row, (size_t) b->comp * z->s->img_x);
+   return 1;
+}
+#endif
+
+#ifndef STBI_NO_PNG
+// Tops the input buffer up from the IDAT chunks
+static int stbi__band_png_refill(stbi_band *b)
+{
+   int left = (int) (b->z.zbuffer_end - b->z.zbuffer);
+   memmove(b->input, b->z.zbuffer, left);
+   while (left < STBI__BAND_ZINPUT && !b->input_final) {
+      int n;
+      if (b->idat_left == 0) {
+         stbi__pngchunk c;
+         stbi__get32be(&b->s); // CRC of the last one
+         c = stbi__get_chunk_header(&b->s);
+         if (c.type != STBI__PNG_TYPE('I','D','A','T'))
+            b->input_final = 1;
+         else
+            b->idat_left = c.length;
+         continue;
+      }
+      n = STBI__BAND_ZINPUT - left;
+      if ((stbi__uint32) n > b->idat_left) n = (int) b->idat_left;
+      if (!stbi__getn(&b->s, b->input + left, n)) return stbi__err("outofdata","Corrupt PNG");
+      left += n;
+      b->idat_left -= n;
+   }
+   b->z.zbuffer = b->input;
+   b->z.zbuffer_end = b->input + left;
+   return 1;
+}
+
+// Huffman codes until the block ends or the window or the input run low.
+// Returns 0 on an error, 2 at the end of the block and 1 otherwise.
+static int stbi__band_png_huffman(stbi_band *b)
+{
+   stbi__zbuf *a = &b->z;
+   for (;;) {
+      int z;
+#ifndef STBI_PNG_REFERENCE
+      if (!a->hit_zeof_once) {
+         // the fast path stops short of the input kept back for later
+         stbi_uc *end = a->zbuffer_end;
+         if (!b->input_final) a->zbuffer_end -= STBI__BAND_ZMARGIN;
+         z = a->zbuffer < a->zbuffer_end ? stbi__parse_huffman_fast(a, b->multi) : 1;
+         a->zbuffer_end = end;
+         if (z != 1) return z;
+      }
+#endif
+      if (a->zout_end - a->zout < 258) return 1;
+      if (!b->input_final && a->zbuffer_end - a->zbuffer < STBI__BAND_ZMARGIN) return 1;
+      z = stbi__parse_huffman_symbol(a);
+      if (z != 1) return z;
+   }
+}
+
+// Inflates some more into the window, like stbi__parse_zlib a piece at a time
+static int stbi__band_png_inflate(stbi_band *b)
+{
+   stbi__zbuf *a = &b->z;
+   if (b->block == 0) {
+      int type;
+      if (b->final_block) {
+         b->inflated = 1;
+         return 1;
+      }
+      b->final_block = stbi__zreceive(a,1);
+      type = stbi__zreceive(a,2);
+      if (type == 0) {
+         stbi_uc header[4];
+         int k = 0;
+         if (a->num_bits & 7)
+            stbi__zreceive(a, a->num_bits & 7); // discard
+         // drain the bit-packed data into header
+         while (a->num_bits > 0) {
+            header[k++] = (stbi_uc) (a->code_buffer & 255);
+            a->code_buffer >>= 8;
+            a->num_bits -= 8;
+         }
+         if (a->num_bits < 0) return stbi__err("zlib corrupt","Corrupt PNG");
+         while (k < 4)
+            header[k++] = stbi__zget8(a);
+         b->stored_left = header[1] * 256 + header[0];
+         if (header[3] * 256 + header[2] != (b->stored_left ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
+         b->block = 2;
+      } else if (type == 3) {
+         return stbi__err("bad block type","Corrupt PNG");
+      } else {
+         if (type == 1) {
+            // use fixed code lengths
+            if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
+            if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+         } else {
+            if (!stbi__compute_huffman_codes(a)) return 0;
+         }
+#ifndef STBI_PNG_REFERENCE
+         stbi__zbuild_multi(&a->z_length, b->multi);
+#endif
+         b->block = 1;
+      }
+   } else if (b->block == 1) {
+      int r = stbi__band_png_huffman(b);
+      if (r == 0) return 0;
+      if (r == 2) b->block = 0;
+   } else {
+      int n = b->stored_left;
+      if (n > a->zbuffer_end - a->zbuffer) n = (int) (a->zbuffer_end - a->zbuffer);
+      if (n > a->zout_end - a->zout) n = (int) (a->zout_end - a->zout);
+      if (n == 0 && b->input_final) return stbi__err("read past buffer","Corrupt PNG");
+      memcpy(a->zout, a->zbuffer, n);
+      a->zbuffer += n;
+      a->zout += n;
+      b->stored_left -= n;
+      if (b->stored_left == 0) b->block = 0;
+   }
+   return 1;
+}
+
+static int stbi__band_png_open(stbi_band *b)
+{
+   stbi__png p;
+   stbi__uint32 i, pal_len = 0, nk;
+   int k, depth = 0, color = 0, interlace = 0, is_iphone = 0;
+
+   // the chunks up to the first IDAT are checked, then read again for
+   // what the rows need
+   p.s = &b->s;
+   if (!stbi__parse_png_file(&p, STBI__SCAN_header, 0)) return 0;
+   stbi__rewind(&b->s);
+   stbi__check_png_header(&b->s);
+   for (;;) {
+      stbi__pngchunk c;
+      if (stbi__at_eof(&b->s)) return stbi__err("no IDAT","Corrupt PNG");
+      c = stbi__get_chunk_header(&b->s);
+      if (c.type == STBI__PNG_TYPE('I','D','A','T')) {
+         b->idat_left = c.length;
+         break;
+      }
+      switch (c.type) {
+         case STBI__PNG_TYPE('C','g','B','I'):
+            is_iphone = 1;
+            stbi__skip(&b->s, c.length);
+            break;
+         case STBI__PNG_TYPE('I','H','D','R'):
+            stbi__skip(&b->s, 8);
+            depth = stbi__get8(&b->s);
+            color = stbi__get8(&b->s);
+            stbi__skip(&b->s, 2);
+            interlace = stbi__get8(&b->s);
+            b->img_n = color == 3 ? 1 : (color & 2 ? 3 : 1) + (color & 4 ? 1 : 0);
+            break;
+         case STBI__PNG_TYPE('P','L','T','E'):
+            if (c.length > 256*3 || c.length % 3 != 0) return stbi__err("invalid PLTE","Corrupt PNG");
+            pal_len = c.length / 3;
+            for (i=0; i < pal_len; ++i) {
+               b->palette[i*4+0] = stbi__get8(&b->s);
+               b->palette[i*4+1] = stbi__get8(&b->s);
+               b->palette[i*4+2] = stbi__get8(&b->s);
+               b->palette[i*4+3] = 255;
+            }
+            break;
+         case STBI__PNG_TYPE('t','R','N','S'):
+            if (color == 3) {
+               if (pal_len == 0) return stbi__err("tRNS before PLTE","Corrupt PNG");
+               if (c.length > pal_len) return stbi__err("bad tRNS len","Corrupt PNG");
+               b->pal_img_n = 4;
+               for (i=0; i < c.length; ++i)
+                  b->palette[i*4+3] = stbi__get8(&b->s);
+            } else {
+               if (!(b->img_n & 1)) return stbi__err("tRNS with alpha","Corrupt PNG");
+               if (c.length != (stbi__uint32) b->img_n*2) return stbi__err("bad tRNS len","Corrupt PNG");
+               b->has_trans = 1;
+               for (k=0; k < b->img_n; ++k)
+                  b->tc[k] = (stbi_uc) (stbi__get16be(&b->s) & 255);
+            }
+            break;
+         default:
+            stbi__skip(&b->s, c.length);
+            break;
+      }
+      stbi__get32be(&b->s); // CRC
+   }
+
+   if (depth != 8 || interlace || is_iphone) return stbi__err("not streamable", "PNG not supported: only 8-bit non-interlaced in bands");
+   if (color == 3) {
+      if (pal_len == 0) return stbi__err("no PLTE","Corrupt PNG");
+      b->comp = b->pal_img_n = b->pal_img_n ? b->pal_img_n : 3;
+   } else {
+      b->comp = b->img_n + b->has_trans;
+   }
+
+   nk = b->s.img_x * b->img_n;
+   b->filter_buf = (stbi_uc *) stbi__malloc_mad2(nk, 2, 0);
+   b->input = (stbi_uc *) stbi__malloc(STBI__BAND_ZINPUT);
+   b->window = (char *) stbi__malloc_mad2(1, nk + 1, STBI__BAND_ZWINDOW + STBI__BAND_ZROOM);
+   if (!b->filter_buf || !b->input || !b->window) return stbi__err("outofmem", "Out of memory");
+   b->z.zout_start = b->z.zout = b->raw_row = b->window;
+   b->z.zout_end = b->window + nk + 1 + STBI__BAND_ZWINDOW + STBI__BAND_ZROOM;
+   b->z.z_expandable = 0;
+   b->z.zbuffer = b->z.zbuffer_end = b->input;
+   if (!stbi__band_png_refill(b)) return 0;
+   if (!stbi__parse_zlib_header(&b->z)) return 0;
+   b->z.num_bits = 0;
+   b->z.code_buffer = 0;
+   b->z.hit_zeof_once = 0;
+#ifdef STBI_SSE2
+   b->sse2 = stbi__sse2_available();
+#endif
+   return 1;
+}
+
+static int stbi__band_png_row(stbi_band *b, stbi_uc *out)
+{
+   stbi__zbuf *a = &b->z;
+   stbi__uint32 i, x = b->s.img_x;
+   int nk = (int) x * b->img_n;
+   int filter,k;
+   stbi_uc *cur = b->filter_buf + (b->row & 1)*nk;
+   stbi_uc *prior = b->filter_buf + (~b->row & 1)*nk;
+
+   while (a->zout - b->raw_row < nk + 1) {
+      if (b->inflated) return stbi__err("not enough pixels","Corrupt PNG");
+      if (a->zout_end - a->zout < STBI__BAND_ZMARGIN) {
+         // slide the window down to the last 32KB and the part of the row
+         // already out, whichever goes back further
+         int keep = (int) (a->zout - b->window) - STBI__BAND_ZWINDOW;
+         if (keep > b->raw_row - b->window) keep = (int) (b->raw_row - b->window);
+         memmove(b->window, b->window + keep, a->zout - b->window - keep);
+         a->zout -= keep;
+         b->raw_row -= keep;
+      }
+      if (!b->input_final && a->zbuffer_end - a->zbuffer < STBI__BAND_ZMARGIN)
+         if (!stbi__band_png_refill(b)) return 0;
+      if (!stbi__band_png_inflate(b)) return 0;
+   }
+
+   filter = (stbi_uc) *b->raw_row;
+   if (filter > 4) return stbi__err("invalid filter","Corrupt PNG");
+   if (b->row == 0) filter = first_row_filter[filter];
+   stbi__png_unfilter_row(filter, cur, prior, (stbi_uc *) b->raw_row + 1, nk, b->img_n, b->sse2);
+   b->raw_row += nk + 1;
+
+   if (b->pal_img_n) {
+      for (i=0; i < x; ++i) {
+         const stbi_uc *c = b->palette + cur[i]*4;
+         for (k=0; k < b->pal_img_n; ++k)
+            *out++ = c[k];
+      }
+   } else if (b->has_trans) {
+      stbi__create_png_alpha_expand8(out, cur, x, b->img_n);
+      if (b->img_n == 1) {
+         for (i=0; i < x; ++i)
+            out[i*2+1] = (out[i*2] == b->tc[0] ? 0 : 255);
+      } else {
+         for (i=0; i < x; ++i)
+            if (out[i*4] == b->tc[0] && out[i*4+1] == b->tc[1] && out[i*4+2] == b->tc[2])
+               out[i*4+3] = 0;
+      }
+   } else {
+      memcpy(out, cur, nk);
+   }
+   return 1;
+}
+#endif
+
+static int stbi__band_open(stbi_band *b)
+{
+#ifndef STBI_NO_JPEG
+   if (stbi__jpeg_test(&b->s)) return stbi__band_jpeg_open(b);
+#endif
+#ifndef STBI_NO_PNG
+   if (stbi__png_test(&b->s)) return stbi__band_png_open(b);
+#endif
+   return stbi__err("unknown image type", "Image not of a type that can be decoded in bands");
+}
+
+STBIDEF stbi_band *stbi_band_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   stbi_band *b = (stbi_band *) stbi__malloc(sizeof(stbi_band));
+   if (!b) {
+      stbi__err("outofmem", "Out of memory");
+      return NULL;
+   }
+   memset(b, 0, sizeof(stbi_band));
+   stbi__start_mem(&b->s, buffer, len);
+   if (!stbi__band_open(b)) {
+      stbi__band_free(b);
+      return NULL;
+   }
+   *x = b->s.img_x;
+   *y = b->s.img_y;
+   if (comp) *comp = b->comp;
+   return b;
+}
+
+STBIDEF int stbi_band_read(stbi_band *b, stbi_uc *rows, int max_rows)
+{
+   int n = 0;
+   size_t stride = (size_t) b->comp * b->s.img_x;
+   while (n < max_rows && b->row < b->s.img_y && !b->failed) {
+      stbi_uc *out = rows + stride * n;
+      int ok;
+#ifndef STBI_NO_JPEG
+      if (b->jpeg)
+         ok = stbi__band_jpeg_row(b, out);
+      else
+#endif
+#ifndef STBI_NO_PNG
+         ok = stbi__band_png_row(b, out);
+#else
+         ok = 0;
+      STBI_NOTUSED(out);
+#endif
+      if (!ok) {
+         b->failed = 1;
+         break;
+      }
+      ++b->row;
+      ++n;
+   }
+   return n;
+}
+
+STBIDEF int stbi_band_input_offset(stbi_band *b)
+{
+   return (int) (b->s.img_buffer - b->s.img_buffer_original);
+}
+
+STBIDEF void stbi_band_close(stbi_band *b)
+{
+   if (b) stbi__band_free(b);
+}
+
 // Microsoft/Windows BMP image
 
 #ifndef STBI_NO_BMP
@@ -0,0 +1,663 @@
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <common/streamingmesh.hpp>
+#include <common/model.hpp>
+#include <common/objparser.hpp>
+#include <common/vertexformat.hpp>
+#include <common/tangents.hpp>
+
+namespace
+{
+    const char streamingMagic[4] = { 'C', 'G', 'S', 'C' };
+    const unsigned int streamingVersion = 2;
+    const size_t chunkAlignment = 64;
+
+    // Fixed size header at the start of the file, the chunk table is at
+    // tableOffset after all the chunk data
+    struct StreamingFileHeader
+    {
+        char magic[4];
+        unsigned int version;
+        unsigned long long numChunks;
+        unsigned long long tableOffset;
+        unsigned int maxVertices;       // in any one chunk
+        unsigned int maxIndexBytes;
+        float boundsMin[3];
+        float boundsMax[3];
+    };
+
+    // Triangle corner as binned to disk, before welding
+    struct StreamVertex
+    {
+        glm::vec3 position;
+        glm::vec2 uv;
+        glm::vec3 normal;
+    };
+
+    // Part of a cell's triangles written out when its bucket filled
+    struct SpillBlock
+    {
+        unsigned int cell;
+        unsigned int numCorners;
+        unsigned long long offset;
+    };
+
+    // Buffered sequential writer that knows how much it has written
+    class FileWriter
+    {
+    public:
+        FileWriter() : out(NULL), written(0), ok(false) {}
+        ~FileWriter() { close(); }
+
+        bool open(const std::string &path, size_t bufferSize)
+        {
+            out = fopen(path.c_str(), "wb");
+            buffer.clear();
+            buffer.reserve(bufferSize);
+            written = 0;
+            ok = out != NULL;
+            return ok;
+        }
+
+        void write(const void *data, size_t size)
+        {
+            if (buffer.size() + size > buffer.capacity())
+                flush();
+            if (size > buffer.capacity())
+                ok = ok && fwrite(data, 1, size, out) == size;
+            else
+                buffer.insert(buffer.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+            written += size;
+        }
+
+        void pad(size_t alignment)
+        {
+            static const char zeros[chunkAlignment] = { 0 };
+            write(zeros, static_cast<size_t>((alignment - written % alignment) % alignment));
+        }
+
+        bool close()
+        {
+            if (out == NULL)
+                return ok;
+            flush();
+            ok = fclose(out) == 0 && ok;
+            out = NULL;
+            return ok;
+        }
+
+        unsigned long long offset() const { return written; }
+
+    private:
+        FILE *out;
+        std::vector<char> buffer;
+        unsigned long long written;
+        bool ok;
+
+        void flush()
+        {
+            if (!buffer.empty() && out != NULL)
+                ok = ok && fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+            buffer.clear();
+        }
+    };
+
+    // First pass, copies the attributes out to flat files and measures the mesh
+    class AttributeSpiller : public ObjReader
+    {
+    public:
+        FileWriter positions;
+        FileWriter uvs;
+        FileWriter normals;
+        MeshBounds bounds;
+        size_t numPositions;
+        size_t numUVs;
+        size_t numNormals;
+        unsigned long long numTriangles;
+        MappedFile &source;
+
+        explicit AttributeSpiller(MappedFile &source)
+            : numPositions(0), numUVs(0), numNormals(0), numTriangles(0), source(source)
+        {
+            bounds.min = glm::vec3(INFINITY);
+            bounds.max = glm::vec3(-INFINITY);
+        }
+
+        void position(const glm::vec3 &p)
+        {
+            positions.write(&p, sizeof(p));
+            bounds.min = glm::min(bounds.min, p);
+            bounds.max = glm::max(bounds.max, p);
+            numPositions++;
+        }
+
+        void uv(const glm::vec2 &t)
+        {
+            uvs.write(&t, sizeof(t));
+            numUVs++;
+        }
+
+        void normal(const glm::vec3 &n)
+        {
+            normals.write(&n, sizeof(n));
+            numNormals++;
+        }
+
+        bool triangles(const ObjCorner */*corners*/, size_t numCorners)
+        {
+            numTriangles += numCorners / 3;
+            return true;
+        }
+
+        void progress(size_t bytesRead)
+        {
+            source.release(0, bytesRead);
+        }
+    };
+
+    // Second pass, sorts every triangle into the grid cell of its centroid
+    class TriangleBinner : public ObjReader
+    {
+    public:
+        std::vector<std::vector<StreamVertex> > buckets;
+        std::vector<SpillBlock> blocks;
+        bool valid;
+
+        TriangleBinner(MappedFile &source, MappedFile &positions, MappedFile &uvs, MappedFile &normals,
+                       size_t numPositions, size_t numUVs, size_t numNormals,
+                       const MeshBounds &bounds, const glm::ivec3 &gridSize,
+                       size_t bucketCorners, FileWriter &spill)
+            : buckets(gridSize.x * gridSize.y * gridSize.z), valid(true),
+              source(source), positionFile(positions), uvFile(uvs), normalFile(normals),
+              numPositions(numPositions), numUVs(numUVs), numNormals(numNormals),
+              origin(bounds.min), gridSize(gridSize), bucketCorners(bucketCorners), spill(spill)
+        {
+            cellScale = glm::vec3(gridSize) / glm::max(bounds.max - bounds.min, glm::vec3(1e-20f));
+            this->positions = reinterpret_cast<const glm::vec3*>(positions.data());
+            this->uvs = reinterpret_cast<const glm::vec2*>(uvs.data());
+            this->normals = reinterpret_cast<const glm::vec3*>(normals.data());
+            for (size_t i = 0; i < buckets.size(); i++)
+                buckets[i].reserve(bucketCorners);
+        }
+
+        bool triangles(const ObjCorner *corners, size_t numCorners)
+        {
+            for (size_t i = 0; i < numCorners; i += 3)
+            {
+                const ObjCorner *corner = &corners[i];
+                for (int j = 0; j < 3; j++)
+                {
+                    if (static_cast<size_t>(corner[j].v) >= numPositions ||
+                        (corner[j].vt >= 0 && static_cast<size_t>(corner[j].vt) >= numUVs) ||
+                        (corner[j].vn >= 0 && static_cast<size_t>(corner[j].vn) >= numNormals))
+                    {
+                        valid = false;
+                        return false;
+                    }
+                }
+
+                // Same fallbacks as Model::loadObj
+                StreamVertex v[3];
+                for (int j = 0; j < 3; j++)
+                    v[j].position = positions[corner[j].v];
+                glm::vec3 faceNormal = glm::cross(v[1].position - v[0].position, v[2].position - v[0].position);
+                float length = glm::length(faceNormal);
+                if (length > 0.0f)
+                    faceNormal /= length;
+                for (int j = 0; j < 3; j++)
+                {
+                    v[j].uv = corner[j].vt >= 0 ? uvs[corner[j].vt] : glm::vec2(0.0f);
+                    v[j].normal = corner[j].vn >= 0 ? normals[corner[j].vn] : faceNormal;
+                }
+
+                glm::vec3 centroid = (v[0].position + v[1].position + v[2].position) / 3.0f;
+                glm::ivec3 cell = glm::clamp(glm::ivec3((centroid - origin) * cellScale),
+                                             glm::ivec3(0), gridSize - 1);
+                unsigned int index = (cell.z * gridSize.y + cell.y) * gridSize.x + cell.x;
+                std::vector<StreamVertex> &bucket = buckets[index];
+                bucket.insert(bucket.end(), v, v + 3);
+                if (bucket.size() + 3 > bucketCorners)
+                {
+                    SpillBlock block = { index, static_cast<unsigned int>(bucket.size()), spill.offset() };
+                    spill.write(bucket.data(), bucket.size() * sizeof(StreamVertex));
+                    blocks.push_back(block);
+                    bucket.clear();
+                }
+            }
+            return true;
+        }
+
+        // Attribute pages are looked up at random, drop them with the text
+        // so neither grows past the budget
+        void progress(size_t bytesRead)
+        {
+            source.release(0, bytesRead);
+            positionFile.release(0, positionFile.size());
+            uvFile.release(0, uvFile.size());
+            normalFile.release(0, normalFile.size());
+        }
+
+    private:
+        MappedFile &source;
+        MappedFile &positionFile;
+        MappedFile &uvFile;
+        MappedFile &normalFile;
+        const glm::vec3 *positions;
+        const glm::vec2 *uvs;
+        const glm::vec3 *normals;
+        size_t numPositions;
+        size_t numUVs;
+        size_t numNormals;
+        glm::vec3 origin;
+        glm::vec3 cellScale;
+        glm::ivec3 gridSize;
+        size_t bucketCorners;
+        FileWriter &spill;
+    };
+
+    // Welds and packs one piece of a cell and appends it to out
+    void writeChunk(const std::vector<StreamVertex> &corners, FileWriter &out,
+                    std::vector<StreamingChunk> &table, StreamingFileHeader &header)
+    {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        std::vector<unsigned int> indices(corners.size());
+        VertexWelder welder(vertices, uvs, normals);
+        welder.reserve(corners.size() / 4);
+        for (size_t i = 0; i < corners.size(); i++)
+            indices[i] = welder.add(corners[i].position, corners[i].uv, corners[i].normal);
+
+        StreamingChunk chunk = StreamingChunk();
+        chunk.bounds = computeBounds(vertices.data(), vertices.size());
+        chunk.numVertices = static_cast<unsigned int>(vertices.size());
+        chunk.numIndices = static_cast<unsigned int>(indices.size());
+        chunk.indexSize = vertices.size() <= 65536 ? sizeof(unsigned short) : sizeof(unsigned int);
+
+        std::vector<glm::vec4> tangents(vertices.size());
+        generateTangents(indices.data(), indices.size(), vertices.data(), uvs.data(), normals.data(),
+                         vertices.size(), tangents.data());
+
+        std::vector<PackedVertex> packed(vertices.size());
+        packVertices(vertices.data(), uvs.data(), normals.data(), tangents.data(), vertices.size(),
+                     chunk.bounds, packed.data());
+        out.pad(chunkAlignment);
+        chunk.vertexOffset = out.offset();
+        out.write(packed.data(), packed.size() * sizeof(PackedVertex));
+
+        out.pad(chunkAlignment);
+        chunk.indexOffset = out.offset();
+        if (chunk.indexSize == sizeof(unsigned short))
+        {
+            std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            out.write(shortIndices.data(), shortIndices.size() * sizeof(unsigned short));
+        }
+        else
+            out.write(indices.data(), indices.size() * sizeof(unsigned int));
+
+        table.push_back(chunk);
+        header.maxVertices = std::max(header.maxVertices, chunk.numVertices);
+        header.maxIndexBytes = std::max(header.maxIndexBytes, chunk.numIndices * chunk.indexSize);
+    }
+
+    void removeTemporaries(const std::string &base)
+    {
+        remove((base + ".positions.tmp").c_str());
+        remove((base + ".uvs.tmp").c_str());
+        remove((base + ".normals.tmp").c_str());
+        remove((base + ".triangles.tmp").c_str());
+    }
+}
+
+bool importStreamingMesh(const char *objPath, const char *outPath,
+                         size_t memoryBudget, unsigned int trianglesPerChunk)
+{
+    MappedFile source;
+    if (!source.open(objPath))
+        return false;
+
+    // Pass 1, attributes out to disk and the size of the mesh
+    std::string base(outPath);
+    const size_t writeBuffer = 1 << 20;
+    AttributeSpiller spiller(source);
+    if (!spiller.positions.open(base + ".positions.tmp", writeBuffer) ||
+        !spiller.uvs.open(base + ".uvs.tmp", writeBuffer) ||
+        !spiller.normals.open(base + ".normals.tmp", writeBuffer))
+    {
+        removeTemporaries(base);
+        return false;
+    }
+    bool ok = streamObj(source.data(), source.size(), spiller);
+    ok = spiller.positions.close() && ok;
+    ok = spiller.uvs.close() && ok;
+    ok = spiller.normals.close() && ok;
+    if (!ok || spiller.numTriangles == 0)
+    {
+        removeTemporaries(base);
+        return false;
+    }
+
+    MappedFile positions, uvs, normals;
+    positions.open((base + ".positions.tmp").c_str(), MAPPED_RANDOM);
+    if (spiller.numUVs > 0)
+        uvs.open((base + ".uvs.tmp").c_str(), MAPPED_RANDOM);
+    if (spiller.numNormals > 0)
+        normals.open((base + ".normals.tmp").c_str(), MAPPED_RANDOM);
+
+    // Grid with about trianglesPerChunk in each cell, roughly cubic cells.
+    // Half the budget goes on the cell buckets, so it also caps the cells.
+    const size_t minBucketBytes = 16 << 10;
+    size_t maxCells = std::max<size_t>(1, memoryBudget / 2 / minBucketBytes);
+    size_t targetCells = static_cast<size_t>(std::min<unsigned long long>(
+        maxCells, (spiller.numTriangles + trianglesPerChunk - 1) / trianglesPerChunk));
+    glm::vec3 extent = spiller.bounds.max - spiller.bounds.min;
+    extent = glm::max(extent, glm::vec3(std::max(extent.x, std::max(extent.y, extent.z)) * 1e-3f + 1e-20f));
+    float cellSize = std::cbrt(extent.x * extent.y * extent.z / std::max<size_t>(targetCells, 1));
+    glm::ivec3 gridSize = glm::clamp(glm::ivec3(glm::ceil(extent / cellSize)), glm::ivec3(1), glm::ivec3(64));
+    while (static_cast<size_t>(gridSize.x) * gridSize.y * gridSize.z > maxCells)
+        gridSize = glm::max(gridSize - 1, glm::ivec3(1));
+    size_t numCells = static_cast<size_t>(gridSize.x) * gridSize.y * gridSize.z;
+    size_t bucketCorners = std::max<size_t>(3, memoryBudget / 2 / numCells / sizeof(StreamVertex) / 3 * 3);
+
+    // Pass 2, bin the triangles, full buckets spill to one shared file
+    FileWriter spill;
+    if (!spill.open(base + ".triangles.tmp", writeBuffer))
+    {
+        removeTemporaries(base);
+        return false;
+    }
+    TriangleBinner binner(source, positions, uvs, normals, spiller.numPositions, spiller.numUVs,
+                          spiller.numNormals, spiller.bounds, gridSize, bucketCorners, spill);
+    ok = streamObj(source.data(), source.size(), binner) && binner.valid;
+    ok = spill.close() && ok;
+    source.close();
+    positions.close();
+    uvs.close();
+    normals.close();
+    if (!ok)
+    {
+        removeTemporaries(base);
+        return false;
+    }
+
+    MappedFile spilled;
+    if (!binner.blocks.empty())
+        spilled.open((base + ".triangles.tmp").c_str());
+
+    // Pass 3, each cell in pieces of at most two chunks worth of triangles
+    std::string tempPath = base + ".tmp";
+    FileWriter out;
+    StreamingFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, streamingMagic, 4);
+    header.version = streamingVersion;
+    for (int i = 0; i < 3; i++)
+    {
+        header.boundsMin[i] = spiller.bounds.min[i];
+        header.boundsMax[i] = spiller.bounds.max[i];
+    }
+    if (!out.open(tempPath, writeBuffer))
+    {
+        removeTemporaries(base);
+        return false;
+    }
+    out.write(&header, sizeof(header));
+
+    std::vector<std::vector<unsigned int> > cellBlocks(numCells);
+    for (size_t i = 0; i < binner.blocks.size(); i++)
+        cellBlocks[binner.blocks[i].cell].push_back(static_cast<unsigned int>(i));
+
+    size_t pieceCorners = static_cast<size_t>(trianglesPerChunk) * 2 * 3;
+    std::vector<StreamingChunk> table;
+    std::vector<StreamVertex> piece;
+    for (size_t cell = 0; cell < numCells; cell++)
+    {
+        piece.clear();
+        for (size_t b = 0; b <= cellBlocks[cell].size(); b++)
+        {
+            // Spilled blocks first, then what is left in the bucket
+            const StreamVertex *corners;
+            size_t count;
+            if (b < cellBlocks[cell].size())
+            {
+                const SpillBlock &block = binner.blocks[cellBlocks[cell][b]];
+                corners = reinterpret_cast<const StreamVertex*>(spilled.data() + block.offset);
+                count = block.numCorners;
+            }
+            else
+            {
+                corners = binner.buckets[cell].data();
+                count = binner.buckets[cell].size();
+            }
+
+            for (size_t i = 0; i < count; i += 3)
+            {
+                piece.insert(piece.end(), corners + i, corners + i + 3);
+                if (piece.size() >= pieceCorners)
+                {
+                    writeChunk(piece, out, table, header);
+                    piece.clear();
+                }
+            }
+            if (b < cellBlocks[cell].size())
+            {
+                const SpillBlock &block = binner.blocks[cellBlocks[cell][b]];
+                spilled.release(static_cast<size_t>(block.offset), block.numCorners * sizeof(StreamVertex));
+            }
+        }
+        if (!piece.empty())
+            writeChunk(piece, out, table, header);
+        std::vector<StreamVertex>().swap(binner.buckets[cell]);
+    }
+
+    out.pad(chunkAlignment);
+    header.tableOffset = out.offset();
+    header.numChunks = table.size();
+    out.write(table.data(), table.size() * sizeof(StreamingChunk));
+    ok = out.close();
+    spilled.close();
+    removeTemporaries(base);
+
+    // The header goes in last, the file only becomes valid once complete
+    FILE *file = ok ? fopen(tempPath.c_str(), "r+b") : NULL;
+    ok = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = file != NULL && fclose(file) == 0 && ok;
+    if (ok)
+    {
+        remove(outPath);
+        ok = rename(tempPath.c_str(), outPath) == 0;
+    }
+    if (!ok)
+        remove(tempPath.c_str());
+
+    printf("Imported %s: %llu triangles into %zu chunks on a %dx%dx%d grid\n", objPath,
+           spiller.numTriangles, table.size(), gridSize.x, gridSize.y, gridSize.z);
+    return ok;
+}
+
+const StreamingChunk *readStreamingChunks(const MappedFile &file, size_t &numChunks,
+                                          unsigned int &maxVertices, unsigned int &maxIndexBytes)
+{
+    if (file.size() < sizeof(StreamingFileHeader))
+        return NULL;
+    StreamingFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, streamingMagic, 4) != 0 || header.version != streamingVersion ||
+        header.tableOffset % chunkAlignment != 0 || header.tableOffset > file.size() ||
+        header.numChunks > (file.size() - header.tableOffset) / sizeof(StreamingChunk))
+        return NULL;
+
+    const StreamingChunk *chunks = reinterpret_cast<const StreamingChunk*>(file.data() + header.tableOffset);
+    for (size_t i = 0; i < header.numChunks; i++)
+    {
+        if (chunks[i].vertexOffset + chunks[i].numVertices * sizeof(PackedVertex) > file.size() ||
+            chunks[i].indexOffset + static_cast<unsigned long long>(chunks[i].numIndices) * chunks[i].indexSize > file.size())
+            return NULL;
+    }
+    numChunks = static_cast<size_t>(header.numChunks);
+    maxVertices = header.maxVertices;
+    maxIndexBytes = header.maxIndexBytes;
+    return chunks;
+}
+
+StreamingModel::StreamingModel()
+    : chunks(NULL), numChunks(0), VAO(0), vertexBuffer(0), elementBuffer(0),
+      slotVertices(0), slotIndexBytes(0), numSlots(0)
+{
+}
+
+StreamingModel::~StreamingModel()
+{
+    close();
+}
+
+bool StreamingModel::open(const char *path, size_t gpuBudget)
+{
+    close();
+    unsigned int maxVertices = 0, maxIndexBytes = 0;
+    if (file.open(path, MAPPED_RANDOM))
+        chunks = readStreamingChunks(file, numChunks, maxVertices, maxIndexBytes);
+    if (chunks == NULL)
+    {
+        close();
+        return false;
+    }
+
+    // Every slot fits the largest chunk, index slots stay 4 byte aligned
+    slotVertices = maxVertices;
+    slotIndexBytes = (maxIndexBytes + 3) & ~static_cast<size_t>(3);
+    size_t slotBytes = std::max<size_t>(slotVertices * sizeof(PackedVertex) + slotIndexBytes, 1);
+    numSlots = static_cast<unsigned int>(std::max<size_t>(1, std::min(numChunks, gpuBudget / slotBytes)));
+    slotChunk.assign(numSlots, -1);
+    chunkSlot.assign(numChunks, -1);
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<size_t>(numSlots) * slotVertices * sizeof(PackedVertex), NULL, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &elementBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, numSlots * slotIndexBytes, NULL, GL_DYNAMIC_DRAW);
+    packedVertexFormat().apply();
+    glBindVertexArray(0);
+
+    printf("Streaming %s: %zu chunks, %u GPU slots of %zu KB\n", path, numChunks, numSlots, slotBytes >> 10);
+    return true;
+}
+
+void StreamingModel::close()
+{
+    if (VAO != 0)
+    {
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &elementBuffer);
+        glDeleteVertexArrays(1, &VAO);
+    }
+    VAO = vertexBuffer = elementBuffer = 0;
+    file.close();
+    chunks = NULL;
+    numChunks = 0;
+    numSlots = 0;
+    slotChunk.clear();
+    chunkSlot.clear();
+}
+
+void StreamingModel::update(const glm::vec3 &cameraPosition, unsigned int maxUploads)
+{
+    if (numChunks == 0)
+        return;
+
+    // The numSlots chunks nearest the camera are the ones to keep
+    nearest.resize(numChunks);
+    for (size_t i = 0; i < numChunks; i++)
+    {
+        glm::vec3 closest = glm::clamp(cameraPosition, chunks[i].bounds.min, chunks[i].bounds.max);
+        nearest[i] = std::make_pair(glm::length(closest - cameraPosition), static_cast<unsigned int>(i));
+    }
+    std::nth_element(nearest.begin(), nearest.begin() + (numSlots - 1), nearest.end());
+    std::sort(nearest.begin(), nearest.begin() + numSlots);
+    float cutoff = nearest[numSlots - 1].first;
+
+    // Free the slots of chunks that fell out of the set
+    std::vector<bool> wanted(numChunks, false);
+    for (unsigned int i = 0; i < numSlots; i++)
+        wanted[nearest[i].second] = true;
+    for (unsigned int s = 0; s < numSlots; s++)
+    {
+        if (slotChunk[s] >= 0 && !wanted[slotChunk[s]])
+        {
+            chunkSlot[slotChunk[s]] = -1;
+            slotChunk[s] = -1;
+        }
+    }
+
+    // Upload the nearest missing chunks straight from the mapping, then
+    // let their pages go
+    unsigned int uploads = 0;
+    unsigned int freeSlot = 0;
+    for (unsigned int i = 0; i < numSlots && uploads < maxUploads && nearest[i].first <= cutoff; i++)
+    {
+        unsigned int chunk = nearest[i].second;
+        if (chunkSlot[chunk] >= 0)
+            continue;
+        while (slotChunk[freeSlot] >= 0)
+            freeSlot++;
+
+        const StreamingChunk &c = chunks[chunk];
+        size_t vertexBytes = c.numVertices * sizeof(PackedVertex);
+        size_t indexBytes = c.numIndices * c.indexSize;
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, static_cast<size_t>(freeSlot) * slotVertices * sizeof(PackedVertex),
+                        vertexBytes, file.data() + c.vertexOffset);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, freeSlot * slotIndexBytes, indexBytes, file.data() + c.indexOffset);
+        file.release(static_cast<size_t>(c.vertexOffset), vertexBytes);
+        file.release(static_cast<size_t>(c.indexOffset), indexBytes);
+
+        slotChunk[freeSlot] = static_cast<int>(chunk);
+        chunkSlot[chunk] = static_cast<int>(freeSlot);
+        uploads++;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamingModel::draw(unsigned int &shaderID)
+{
+    if (VAO == 0)
+        return;
+
+    // Streamed meshes have no materials, each chunk has its own packing range
+    glUniform1i(glGetUniformLocation(shaderID, "materialIndex"), -1);
+    Model::bindDefaultMaterials(shaderID);
+    int scaleLocation = glGetUniformLocation(shaderID, "positionScale");
+    int offsetLocation = glGetUniformLocation(shaderID, "positionOffset");
+
+    glBindVertexArray(VAO);
+    for (unsigned int s = 0; s < numSlots; s++)
+    {
+        if (slotChunk[s] < 0)
+            continue;
+        const StreamingChunk &c = chunks[slotChunk[s]];
+        glUniform3fv(scaleLocation, 1, &positionScale(c.bounds)[0]);
+        glUniform3fv(offsetLocation, 1, &positionOffset(c.bounds)[0]);
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(c.numIndices),
+                                 c.indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                                 (void*)(s * slotIndexBytes), static_cast<GLint>(s * slotVertices));
+    }
+    glBindVertexArray(0);
+}
+
+size_t StreamingModel::getNumResident() const
+{
+    size_t resident = 0;
+    for (size_t s = 0; s < slotChunk.size(); s++)
+        resident += slotChunk[s] >= 0;
+    return resident;
+}
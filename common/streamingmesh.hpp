@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include <common/mesh.hpp>
+#include <common/mappedfile.hpp>
+
+// One spatial chunk of a streaming mesh file. Its vertices are packed
+// against its own bounds and its indices are 16-bit when they fit.
+struct StreamingChunk
+{
+    MeshBounds bounds;
+    unsigned long long vertexOffset;    // from the start of the file
+    unsigned long long indexOffset;
+    unsigned int numVertices;
+    unsigned int numIndices;
+    unsigned int indexSize;
+    unsigned int padding;
+};
+
+// Converts an OBJ of any size into spatially partitioned chunks in outPath
+// without holding the mesh in memory. Attributes are spilled to temporary
+// files next to outPath and triangles are binned into a grid of chunks of
+// about trianglesPerChunk, staying within memoryBudget bytes of buffers.
+bool importStreamingMesh(const char *objPath, const char *outPath,
+                         size_t memoryBudget = 256 << 20,
+                         unsigned int trianglesPerChunk = 1 << 16);
+
+// Chunk table of a mapped file from importStreamingMesh, NULL if the file
+// isn't one or a chunk lies outside it. maxVertices and maxIndexBytes are
+// of the largest chunk, for sizing buffers.
+const StreamingChunk *readStreamingChunks(const MappedFile &file, size_t &numChunks,
+                                          unsigned int &maxVertices, unsigned int &maxIndexBytes);
+
+// Draws a streaming mesh file by paging the chunks nearest the camera into
+// a fixed pool of GPU slots. The file stays mapped rather than read, so the
+// only memory it holds is page cache the OS can drop.
+class StreamingModel
+{
+public:
+    StreamingModel();
+    ~StreamingModel();
+
+    // Map a file from importStreamingMesh and create a GPU pool of about
+    // gpuBudget bytes, at least one chunk
+    bool open(const char *path, size_t gpuBudget = 128 << 20);
+    void close();
+
+    // Make the chunks nearest cameraPosition (model space) resident,
+    // uploading at most maxUploads chunks a call
+    void update(const glm::vec3 &cameraPosition, unsigned int maxUploads = 4);
+
+    // Draw every resident chunk with the packed vertex shader
+    void draw(unsigned int &shaderID);
+
+    size_t getNumChunks() const { return numChunks; }
+    size_t getNumResident() const;
+
+private:
+    MappedFile file;
+    const StreamingChunk *chunks;
+    size_t numChunks;
+
+    // Vertex and element buffers split into numSlots equal slots
+    unsigned int VAO;
+    unsigned int vertexBuffer;
+    unsigned int elementBuffer;
+    unsigned int slotVertices;
+    size_t slotIndexBytes;
+    unsigned int numSlots;
+    std::vector<int> slotChunk;     // chunk in each slot, -1 when free
+    std::vector<int> chunkSlot;     // slot of each chunk, -1 when not resident
+    std::vector<std::pair<float, unsigned int> > nearest;
+
+    StreamingModel(const StreamingModel &);
+    StreamingModel &operator=(const StreamingModel &);
+};
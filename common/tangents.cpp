@@ -0,0 +1,103 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <common/tangents.hpp>
+
+namespace
+{
+    // Triangles or vertices handed to a job at a time
+    const size_t batchSize = 16384;
+
+    inline glm::vec3 projectOntoPlane(const glm::vec3 &v, const glm::vec3 &normal)
+    {
+        return v - normal * glm::dot(normal, v);
+    }
+
+    inline glm::vec3 safeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : glm::vec3(0.0f);
+    }
+
+    // Any unit vector perpendicular to n, for vertices without a uv frame
+    glm::vec3 perpendicular(const glm::vec3 &n)
+    {
+        glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return safeNormalize(projectOntoPlane(axis, n));
+    }
+}
+
+void generateTangents(const unsigned int *indices, size_t numIndices,
+                      const glm::vec3 *positions, const glm::vec2 *uvs, const glm::vec3 *normals,
+                      size_t numVertices, glm::vec4 *tangents, ThreadPool &pool)
+{
+    // Each corner's weighted tangent with its signed weight in w, computed
+    // per triangle so no two jobs write the same element
+    size_t numTriangles = numIndices / 3;
+    std::vector<glm::vec4> corners(numTriangles * 3);
+    pool.parallelFor((numTriangles + batchSize - 1) / batchSize, [&](size_t batch)
+    {
+        size_t end = std::min(numTriangles, (batch + 1) * batchSize);
+        for (size_t t = batch * batchSize; t < end; t++)
+        {
+            const unsigned int *triangle = &indices[t * 3];
+            const glm::vec3 &p0 = positions[triangle[0]];
+            glm::vec3 d1 = positions[triangle[1]] - p0;
+            glm::vec3 d2 = positions[triangle[2]] - p0;
+            glm::vec2 t1 = uvs[triangle[1]] - uvs[triangle[0]];
+            glm::vec2 t2 = uvs[triangle[2]] - uvs[triangle[0]];
+
+            // Tangent is the direction of increasing u, flipped when the uv
+            // winding is mirrored
+            float signedArea = t1.x * t2.y - t1.y * t2.x;
+            float sign = signedArea > 0.0f ? 1.0f : -1.0f;
+            glm::vec3 tangent = signedArea != 0.0f ? safeNormalize(d1 * t2.y - d2 * t1.y) * sign : glm::vec3(0.0f);
+
+            for (int k = 0; k < 3; k++)
+            {
+                const glm::vec3 &n = normals[triangle[k]];
+                const glm::vec3 &p = positions[triangle[k]];
+                glm::vec3 e1 = safeNormalize(projectOntoPlane(positions[triangle[(k + 1) % 3]] - p, n));
+                glm::vec3 e2 = safeNormalize(projectOntoPlane(positions[triangle[(k + 2) % 3]] - p, n));
+                float angle = std::acos(std::min(std::max(glm::dot(e1, e2), -1.0f), 1.0f));
+
+                glm::vec3 projected = safeNormalize(projectOntoPlane(tangent, n));
+                corners[t * 3 + k] = glm::vec4(projected * angle, projected != glm::vec3(0.0f) ? angle * sign : 0.0f);
+            }
+        }
+    });
+
+    // Corners of each vertex, counting sort by vertex index
+    std::vector<unsigned int> first(numVertices + 1, 0);
+    for (size_t i = 0; i < numTriangles * 3; i++)
+        first[indices[i] + 1]++;
+    for (size_t v = 0; v < numVertices; v++)
+        first[v + 1] += first[v];
+    std::vector<unsigned int> vertexCorners(numTriangles * 3);
+    std::vector<unsigned int> next(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < numTriangles * 3; i++)
+        vertexCorners[next[indices[i]]++] = static_cast<unsigned int>(i);
+
+    pool.parallelFor((numVertices + batchSize - 1) / batchSize, [&](size_t batch)
+    {
+        size_t end = std::min(numVertices, (batch + 1) * batchSize);
+        for (size_t v = batch * batchSize; v < end; v++)
+        {
+            // Mirrored corners would cancel out unmirrored ones, only the
+            // side with more weight counts
+            glm::vec4 sums[2] = { glm::vec4(0.0f), glm::vec4(0.0f) };
+            for (unsigned int c = first[v]; c < first[v + 1]; c++)
+            {
+                const glm::vec4 &corner = corners[vertexCorners[c]];
+                sums[corner.w < 0.0f] += glm::vec4(glm::vec3(corner), std::fabs(corner.w));
+            }
+            int side = sums[1].w > sums[0].w ? 1 : 0;
+
+            glm::vec3 tangent = safeNormalize(glm::vec3(sums[side]));
+            if (tangent == glm::vec3(0.0f))
+                tangent = perpendicular(normals[v]);
+            tangents[v] = glm::vec4(tangent, side == 1 ? -1.0f : 1.0f);
+        }
+    });
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include <common/threadpool.hpp>
+
+// Per vertex tangents in the MikkTSpace convention. xyz is the unit tangent
+// in the plane of the vertex normal and w is the bitangent sign, so the
+// bitangent is w * cross(normal, tangent) and normal maps baked against
+// MikkTSpace decode without seams. Each corner contributes its triangle's
+// uv tangent projected onto the vertex normal and weighted by the corner
+// angle. Vertices shared by mirrored and unmirrored triangles keep the side
+// with more total angle, MikkTSpace would split them. Triangles are processed
+// in parallel on pool.
+void generateTangents(const unsigned int *indices, size_t numIndices,
+                      const glm::vec3 *positions, const glm::vec2 *uvs, const glm::vec3 *normals,
+                      size_t numVertices, glm::vec4 *tangents,
+                      ThreadPool &pool = ThreadPool::shared());
@@ -1,47 +1,13 @@
 #define STB_IMAGE_IMPLEMENTATION
+#include <common/decodearena.hpp>
 #include <common/stb_image.hpp>
+#include <common/texturecache.hpp>
 
 unsigned int loadTexture(const char *path)
 {
-    //creates and binds textures
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    
-    //load texture image
-    int width, height, nChannels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load(path, &width, &height, &nChannels, 0);
-    
-    if (data)
-    {
-        //colour channels
-        GLenum format;
-        if (nChannels == 1)
-            format = GL_RED;
-        else if (nChannels == 3)
-            format = GL_RGB;
-        else if (nChannels == 4)
-            format = GL_RGBA;
-        
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-                     GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        
-        // Set texture wrapping options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        
-    }
-    else
-    {
-        printf("Texture %s failed to load.\n", path);
-    }
-
-    //frees the image from the memory
-    stbi_image_free(data);
-    
-    return textureID;
+    //goes through the shared cache, only the name is returned so the
+    //texture is kept for the rest of the program
+    TextureHandle texture = TextureCache::shared().load(path);
+    TextureCache::shared().pin(texture);
+    return texture.id();
 }
\ No newline at end of file
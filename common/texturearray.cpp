@@ -0,0 +1,304 @@
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <common/texturearray.hpp>
+#include <common/texturecook.hpp>
+#include <common/blockcompression.hpp>
+
+namespace
+{
+    bool isPowerOfTwo(int value)
+    {
+        return value > 0 && (value & (value - 1)) == 0;
+    }
+
+    // Power of two steps from size up to target, -1 if there are none
+    int tilingSteps(int size, int target)
+    {
+        int steps = 0;
+        for (; size < target; size *= 2)
+            steps++;
+        return size == target ? steps : -1;
+    }
+
+    // Texels or whole blocks of one level repeated over a bigger one, units
+    // being bytes of a texel or of a block
+    void tileUnits(const unsigned char *source, int sourceX, int sourceY, size_t unitBytes,
+                   unsigned char *out, int outX, int outY)
+    {
+        size_t rowBytes = static_cast<size_t>(sourceX) * unitBytes;
+        for (int y = 0; y < outY; y++)
+        {
+            const unsigned char *row = source + static_cast<size_t>(y % sourceY) * rowBytes;
+            unsigned char *dst = out + static_cast<size_t>(y) * outX * unitBytes;
+            for (int x = 0; x < outX; x += sourceX)
+                memcpy(dst + static_cast<size_t>(x) * unitBytes, row, rowBytes);
+        }
+    }
+}
+
+bool tileMipChain(const MipChain &source, int width, int height, MipChain &tiled, ThreadPool &pool)
+{
+    int steps = tilingSteps(source.width, width);
+    if (steps < 0 || steps != tilingSteps(source.height, height) ||
+        (steps > 0 && (!isPowerOfTwo(source.width) || !isPowerOfTwo(source.height))))
+        return false;
+    if (steps == 0)
+    {
+        tiled = source;
+        return true;
+    }
+
+    tiled = MipChain();
+    tiled.format = source.format;
+    tiled.width = width;
+    tiled.height = height;
+    tiled.components = source.components;
+    tiled.psnr = source.psnr;
+    unsigned int levels = mipLevelCount(width, height);
+    size_t offset = 0;
+    for (unsigned int i = 0; i < levels; i++)
+    {
+        tiled.levelOffsets.push_back(offset);
+        offset += tiled.levelSize(i);
+    }
+    tiled.data.resize(offset);
+
+    // Levels past the end of the source's chain repeat its 1x1
+    std::vector<unsigned char> rgba;
+    for (unsigned int i = 0; i < levels; i++)
+    {
+        unsigned int level = std::min(i, source.numLevels() - 1);
+        int sourceWidth = source.levelWidth(level), sourceHeight = source.levelHeight(level);
+        int tiledWidth = tiled.levelWidth(i), tiledHeight = tiled.levelHeight(i);
+        unsigned char *out = &tiled.data[tiled.levelOffsets[i]];
+        if (source.format == BLOCK_NONE)
+            tileUnits(source.level(level), sourceWidth, sourceHeight, source.components, out, tiledWidth, tiledHeight);
+        else if (sourceWidth % 4 == 0 && sourceHeight % 4 == 0)
+            tileUnits(source.level(level), sourceWidth / 4, sourceHeight / 4, blockBytes(source.format),
+                      out, tiledWidth / 4, tiledHeight / 4);
+        else
+        {
+            // Smaller than a block, the block holds a pattern of it
+            std::vector<unsigned char> decoded(static_cast<size_t>(sourceWidth) * sourceHeight * 4);
+            decompressBlocks(source.level(level), sourceWidth, sourceHeight, source.format, decoded.data());
+            rgba.resize(static_cast<size_t>(tiledWidth) * tiledHeight * 4);
+            tileUnits(decoded.data(), sourceWidth, sourceHeight, 4, rgba.data(), tiledWidth, tiledHeight);
+            compressBlocks(rgba.data(), tiledWidth, tiledHeight, source.format, out, pool);
+        }
+    }
+    return true;
+}
+
+TextureArrayPacker::TextureArrayPacker(int maxTiling, ThreadPool &pool, TextureCache &textures)
+    : pool(pool), textures(textures), maxTiling(std::max(maxTiling, 1)), totalBytes(0), built(false)
+{
+}
+
+TextureArrayPacker::~TextureArrayPacker()
+{
+    for (size_t i = 0; i < entries.size(); i++)
+        if (entries[i].loading.valid())
+            entries[i].loading.wait();
+}
+
+size_t TextureArrayPacker::load(const std::vector<std::string> &paths, bool flip)
+{
+    size_t first = entries.size();
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        Entry entry;
+        entry.path = paths[i];
+        TextureCache *cache = &textures;
+        std::string path = paths[i];
+        entry.loading = pool.submit([cache, path, flip]()
+        {
+            DecodedImage image;
+            if (!cache->decode(path.c_str(), flip, image))
+                image.levels.reset();
+            return image;
+        });
+        entries.push_back(std::move(entry));
+    }
+    built = false;
+    return first;
+}
+
+size_t TextureArrayPacker::add(const std::shared_ptr<MipChain> &levels)
+{
+    Entry entry;
+    entry.levels = levels;
+    entries.push_back(std::move(entry));
+    built = false;
+    return entries.size() - 1;
+}
+
+bool TextureArrayPacker::update()
+{
+    if (built)
+        return true;
+    for (size_t i = 0; i < entries.size(); i++)
+        if (entries[i].loading.valid() &&
+            entries[i].loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (!entries[i].loading.valid())
+            continue;
+        DecodedImage image = entries[i].loading.get();
+        entries[i].levels = image.levels;
+        if (!entries[i].levels)
+            printf("Texture %s failed to load, it won't be in an array.\n", entries[i].path.c_str());
+    }
+    release();
+    build();
+    built = true;
+    return true;
+}
+
+void TextureArrayPacker::release()
+{
+    if (!arrays.empty())
+        glDeleteTextures(static_cast<GLsizei>(arrays.size()), arrays.data());
+    arrays.clear();
+    layers.clear();
+    totalBytes = 0;
+    built = false;
+}
+
+void TextureArrayPacker::build()
+{
+    // Biggest first, so an array takes the size of its first texture and
+    // the smaller ones tile up to it
+    std::vector<size_t> order;
+    for (size_t i = 0; i < entries.size(); i++)
+        if (entries[i].levels)
+            order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b)
+    {
+        const MipChain &x = *entries[a].levels, &y = *entries[b].levels;
+        return static_cast<long long>(x.width) * x.height > static_cast<long long>(y.width) * y.height;
+    });
+
+    struct Group
+    {
+        const MipChain *first;
+        std::vector<size_t> members;
+    };
+    std::vector<Group> groups;
+    int maxSteps = tilingSteps(1, maxTiling) >= 0 ? tilingSteps(1, maxTiling) : 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const MipChain &levels = *entries[order[i]].levels;
+        size_t g = 0;
+        for (; g < groups.size(); g++)
+        {
+            const MipChain &first = *groups[g].first;
+            if (first.format != levels.format || first.components != levels.components)
+                continue;
+            int steps = tilingSteps(levels.width, first.width);
+            if (steps < 0 || steps != tilingSteps(levels.height, first.height) || steps > maxSteps)
+                continue;
+            if (steps == 0 || (isPowerOfTwo(levels.width) && isPowerOfTwo(levels.height)))
+                break;
+        }
+        if (g == groups.size())
+        {
+            Group group;
+            group.first = &levels;
+            groups.push_back(group);
+        }
+        groups[g].members.push_back(order[i]);
+    }
+
+    TextureLayer missing = { 0, 0, 0.0f };
+    layers.assign(entries.size(), missing);
+    for (size_t g = 0; g < groups.size(); g++)
+    {
+        // A texture that can't be tiled is left out, like one that failed
+        // to load
+        const MipChain &first = *groups[g].first;
+        std::vector<std::shared_ptr<MipChain> > chains;
+        std::vector<size_t> members;
+        for (size_t i = 0; i < groups[g].members.size(); i++)
+        {
+            const Entry &entry = entries[groups[g].members[i]];
+            std::shared_ptr<MipChain> tiled = std::make_shared<MipChain>();
+            if (!tileMipChain(*entry.levels, first.width, first.height, *tiled, pool))
+            {
+                printf("Texture %s can't be tiled to %dx%d, it won't be in an array.\n",
+                       entry.path.c_str(), first.width, first.height);
+                continue;
+            }
+            totalBytes += tiled->bytes();
+            chains.push_back(tiled);
+            members.push_back(groups[g].members[i]);
+        }
+        if (chains.empty())
+            continue;
+
+        unsigned int array = upload(chains);
+        arrays.push_back(array);
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            TextureLayer &layer = layers[members[i]];
+            layer.array = array;
+            layer.layer = static_cast<int>(i);
+            layer.uvScale = static_cast<float>(entries[members[i]].levels->width) / first.width;
+        }
+    }
+}
+
+unsigned int TextureArrayPacker::upload(const std::vector<std::shared_ptr<MipChain> > &chains)
+{
+    const MipChain &first = *chains[0];
+    bool compressed = first.format != BLOCK_NONE;
+    unsigned int internalFormat, format;
+    textureGLFormats(first.format, first.components, internalFormat, format);
+    unsigned int numLevels = first.numLevels();
+    GLsizei numLayers = static_cast<GLsizei>(chains.size());
+
+    // Same as uploadTexture, a layer at a time
+    unsigned int array;
+    glGenTextures(1, &array);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    bool immutable = GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    if (immutable)
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, internalFormat, first.width, first.height, numLayers);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int level = 0; level < numLevels; level++)
+    {
+        int width = first.levelWidth(level);
+        int height = first.levelHeight(level);
+        GLsizei size = static_cast<GLsizei>(first.levelSize(level));
+        if (!immutable && compressed)
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, width, height, numLayers, 0,
+                                   size * numLayers, NULL);
+        else if (!immutable)
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, width, height, numLayers, 0,
+                         format, GL_UNSIGNED_BYTE, NULL);
+        for (GLsizei layer = 0; layer < numLayers; layer++)
+        {
+            if (compressed)
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, internalFormat,
+                                          size, chains[layer]->level(level));
+            else
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE,
+                                chains[layer]->level(level));
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return array;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <future>
+#include <cstddef>
+
+#include <common/mipmap.hpp>
+#include <common/imagedecoder.hpp>
+#include <common/threadpool.hpp>
+#include <common/texturecache.hpp>
+
+// Where a packed texture ended up. Sample the array at uv * uvScale in the
+// layer, an array of 0 means the texture couldn't be loaded.
+struct TextureLayer
+{
+    unsigned int array;             // GL_TEXTURE_2D_ARRAY name
+    int layer;
+    float uvScale;
+};
+
+// Repeats source across a width by height chain, a power of two times each
+// way. Levels too small to copy whole blocks of are decoded, tiled and
+// encoded again. Same as building the chain of the tiled image, for
+// repeating textures, without touching most of the pixels.
+bool tileMipChain(const MipChain &source, int width, int height, MipChain &tiled, ThreadPool &pool = ThreadPool::shared());
+
+// Packs textures into GL_TEXTURE_2D_ARRAY layers so surfaces that use
+// different textures of the same format share one bind. Textures of one
+// format whose sizes are a power of two apart, up to maxTiling, share an
+// array with the smaller ones tiled up to its size. Those have to be
+// textures that repeat, which is everything the coursework draws.
+// Textures are cooked like the texture cache's, on the pool, and the
+// arrays built on the GL thread once all of them are in.
+class TextureArrayPacker
+{
+public:
+    explicit TextureArrayPacker(int maxTiling = 2, ThreadPool &pool = ThreadPool::shared(),
+                                TextureCache &textures = TextureCache::shared());
+
+    // Waits for loads still running. The arrays have to be released on the
+    // GL thread before.
+    ~TextureArrayPacker();
+
+    // Starts cooking paths on the pool, returns the index of the first
+    size_t load(const std::vector<std::string> &paths, bool flip = true);
+
+    // Adds a chain already in memory, returns its index
+    size_t add(const std::shared_ptr<MipChain> &levels);
+
+    // Builds the arrays once every load has finished, again if textures
+    // were added since. Returns whether they are built.
+    bool update();
+
+    bool isBuilt() const { return built; }
+    TextureLayer layer(size_t index) const { return layers[index]; }
+    size_t numArrays() const { return arrays.size(); }
+    unsigned long long bytes() const { return totalBytes; }
+
+    // Deletes the arrays
+    void release();
+
+private:
+    struct Entry
+    {
+        std::string path;
+        std::future<DecodedImage> loading;
+        std::shared_ptr<MipChain> levels;
+    };
+
+    ThreadPool &pool;
+    TextureCache &textures;
+    int maxTiling;
+    std::vector<Entry> entries;
+    std::vector<TextureLayer> layers;
+    std::vector<unsigned int> arrays;
+    unsigned long long totalBytes;
+    bool built;
+
+    void build();
+    unsigned int upload(const std::vector<std::shared_ptr<MipChain> > &chains);
+
+    TextureArrayPacker(const TextureArrayPacker &);
+    TextureArrayPacker &operator=(const TextureArrayPacker &);
+};
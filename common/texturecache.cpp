@@ -0,0 +1,479 @@
+#include <cstring>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <common/texturecache.hpp>
+#include <common/assetloader.hpp>
+#include <common/texturecook.hpp>
+#include <common/textureupload.hpp>
+#include <common/mappedfile.hpp>
+#include <common/hash.hpp>
+
+namespace
+{
+    // Failures are remembered here between runs, in the working directory
+    // like the shaders
+    const char *defaultFailureList = "texturecache.failures";
+}
+
+TextureCache::TextureCache(const char *failureListPath)
+    : failureListPath(failureListPath != NULL ? failureListPath : ""), failuresChanged(false),
+      compression(true), formatsDetected(false), supportedFormats(0), uploader(nullptr)
+{
+    memset(&counters, 0, sizeof(counters));
+    if (failureListPath == NULL)
+        return;
+
+    // One failure a line: missing, size, modified time, path
+    FILE *file = fopen(failureListPath, "r");
+    if (file == NULL)
+        return;
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        int missing = 0;
+        int length = 0;
+        FailureRecord record;
+        if (sscanf(line, "%d %llu %lld %n", &missing, &record.size, &record.modified, &length) < 3)
+            continue;
+        std::string path(line + length);
+        while (!path.empty() && (path[path.size() - 1] == '\n' || path[path.size() - 1] == '\r'))
+            path.erase(path.size() - 1);
+        record.missing = missing != 0;
+        if (!path.empty())
+            failed[path] = record;
+    }
+    fclose(file);
+}
+
+TextureCache::~TextureCache()
+{
+    // GL may be gone by now, textures are left to the context
+    if (!failuresChanged || failureListPath.empty())
+        return;
+    FILE *file = fopen(failureListPath.c_str(), "w");
+    if (file == NULL)
+        return;
+    for (std::map<std::string, FailureRecord>::const_iterator i = failed.begin(); i != failed.end(); ++i)
+        fprintf(file, "%d %llu %lld %s\n", i->second.missing ? 1 : 0, i->second.size, i->second.modified, i->first.c_str());
+    fclose(file);
+}
+
+TextureCache &TextureCache::shared()
+{
+    static TextureCache cache(defaultFailureList);
+    return cache;
+}
+
+void TextureCache::setUploader(TextureUploader *streaming)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uploader = streaming;
+}
+
+void TextureCache::setCompression(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    compression = enabled;
+}
+
+TextureHandle TextureCache::load(const char *path, bool flip)
+{
+    detectFormats();
+    std::string pathKey = key(path, flip);
+    unsigned long long size = 0;
+    long long modified = 0;
+    bool exists = getFileInfo(path, size, modified);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bool missing;
+        if (isKnownFailure(path, missing))
+        {
+            counters.failureHits++;
+            return getFallback();
+        }
+        std::shared_ptr<TextureEntry> entry = exists ? findByPath(pathKey, size, modified) : nullptr;
+        if (entry)
+        {
+            countHit(*entry, false);
+            return makeHandle(entry);
+        }
+    }
+
+    // Decoding is skipped if another path already has the same contents
+    std::shared_ptr<TextureEntry> existing;
+    DecodedImage image;
+    bool decoded = decodeFile(path, flip, image, existing);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!decoded)
+    {
+        printf("Texture %s failed to load, using the fallback.\n", path);
+        addFailure(path, !image.found, image.size, image.modified);
+        counters.failures++;
+        return getFallback();
+    }
+
+    PathRecord record = { image.size, image.modified, std::weak_ptr<TextureEntry>() };
+    if (existing)
+    {
+        countHit(*existing, true);
+        record.entry = existing;
+        paths[pathKey] = record;
+        return makeHandle(existing);
+    }
+
+    std::shared_ptr<TextureEntry> entry = createPlaceholder();
+    upload(entry, image);
+    entries.push_back(entry);
+    record.entry = entry;
+    paths[pathKey] = record;
+    contents[contentKey(image.hash, flip)] = entry;
+    return makeHandle(entry);
+}
+
+std::vector<TextureHandle> TextureCache::loadBatch(const std::vector<std::string> &paths, bool flip,
+                                                  ThreadPool &pool)
+{
+    // Only what isn't cached, loading or known to fail goes to the pool
+    std::vector<TextureHandle> textures(paths.size());
+    std::vector<std::string> decodePaths;
+    std::vector<size_t> decodeSlots;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        bool needsLoad;
+        textures[i] = reserve(paths[i].c_str(), flip, needsLoad);
+        if (needsLoad)
+        {
+            decodePaths.push_back(paths[i]);
+            decodeSlots.push_back(i);
+        }
+    }
+
+    decodeImages(decodePaths, flip, pool, [&](size_t index, DecodedImage &image)
+    {
+        complete(decodePaths[index].c_str(), flip, textures[decodeSlots[index]], image);
+    },
+    [this](const char *path, bool flip, DecodedImage &image)
+    {
+        return decode(path, flip, image);
+    });
+    return textures;
+}
+
+void TextureCache::pin(const TextureHandle &texture)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (texture.isValid())
+        pinned.push_back(texture);
+}
+
+TextureHandle TextureCache::reserve(const char *path, bool flip, bool &needsLoad)
+{
+    detectFormats();
+    needsLoad = false;
+    std::string pathKey = key(path, flip);
+    unsigned long long size = 0;
+    long long modified = 0;
+    bool exists = getFileInfo(path, size, modified);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    bool missing;
+    if (isKnownFailure(path, missing))
+    {
+        counters.failureHits++;
+        return getFallback();
+    }
+    if (!exists)
+    {
+        printf("Texture %s is missing, using the fallback.\n", path);
+        addFailure(path, true, 0, 0);
+        counters.failures++;
+        return getFallback();
+    }
+
+    // A load of the same path already in flight counts as a hit too
+    std::shared_ptr<TextureEntry> entry = findByPath(pathKey, size, modified);
+    if (entry)
+    {
+        countHit(*entry, false);
+        return makeHandle(entry);
+    }
+
+    entry = createPlaceholder();
+    entries.push_back(entry);
+    PathRecord record = { size, modified, entry };
+    paths[pathKey] = record;
+    needsLoad = true;
+    return makeHandle(entry);
+}
+
+bool TextureCache::decode(const char *path, bool flip, DecodedImage &image)
+{
+    detectFormats();
+    return cookTexture(path, flip, cookFormats(), image);
+}
+
+void TextureCache::complete(const char *path, bool flip, const TextureHandle &texture, const DecodedImage &image)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!texture.entry || texture.entry->id == 0)
+        return;
+
+    // The placeholder stays black, later loads of the path get the fallback
+    std::string pathKey = key(path, flip);
+    if (!image.levels)
+    {
+        printf("Texture %s failed to load, using the fallback.\n", path);
+        addFailure(path, !image.found, image.size, image.modified);
+        counters.failures++;
+        paths.erase(pathKey);
+        texture.entry->pending = false;
+        return;
+    }
+
+    upload(texture.entry, image);
+    PathRecord record = { image.size, image.modified, texture.entry };
+    paths[pathKey] = record;
+    contents[contentKey(image.hash, flip)] = texture.entry;
+}
+
+TextureHandle TextureCache::fallback()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return getFallback();
+}
+
+size_t TextureCache::collect()
+{
+    // The cache's own reference is the only one left
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t deleted = 0;
+    for (size_t i = 0; i < entries.size(); )
+    {
+        if (entries[i].use_count() == 1)
+        {
+            if (uploader != nullptr)
+                uploader->cancel(entries[i]->id);
+            glDeleteTextures(1, &entries[i]->id);
+            entries[i] = entries.back();
+            entries.pop_back();
+            deleted++;
+        }
+        else
+            i++;
+    }
+    return deleted;
+}
+
+void TextureCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (uploader != nullptr)
+            uploader->cancel(entries[i]->id);
+        glDeleteTextures(1, &entries[i]->id);
+        entries[i]->id = 0;
+    }
+    entries.clear();
+    paths.clear();
+    contents.clear();
+    pinned.clear();
+    fallbackTexture = TextureHandle();
+}
+
+TextureCacheStats TextureCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void TextureCache::printStats() const
+{
+    TextureCacheStats s = stats();
+    printf("Texture cache: %zu hits (%zu by contents, %zu known failures), %zu decoded (%zu compressed), %zu failed, "
+           "%.1f MB uploaded, saved %.1f MB and %.1f ms of decoding\n",
+           s.hits, s.contentHits, s.failureHits, s.decodes, s.compressed, s.failures,
+           s.bytesUploaded / 1048576.0, s.bytesSaved / 1048576.0, s.decodeMillisecondsSaved);
+}
+
+void TextureCache::detectFormats()
+{
+    // Needs the GL context, so it waits for the first load
+    std::lock_guard<std::mutex> lock(mutex);
+    if (formatsDetected)
+        return;
+    formatsDetected = true;
+    supportedFormats = blockFormatBit(BLOCK_BC4) | blockFormatBit(BLOCK_BC5);
+    if (GLEW_EXT_texture_compression_s3tc)
+        supportedFormats |= blockFormatBit(BLOCK_BC1) | blockFormatBit(BLOCK_BC3);
+    if (GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc)
+        supportedFormats |= blockFormatBit(BLOCK_BC7);
+}
+
+unsigned int TextureCache::cookFormats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return compression ? supportedFormats : 0;
+}
+
+std::string TextureCache::key(const char *path, bool flip)
+{
+    return std::string(path) + (flip ? "\n1" : "\n0");
+}
+
+unsigned long long TextureCache::contentKey(unsigned long long hash, bool flip)
+{
+    // Flipped and unflipped uploads of one file are different textures
+    return flip ? hash ^ 0x9e3779b97f4a7c15ull : hash;
+}
+
+bool TextureCache::isKnownFailure(const char *path, bool &missing)
+{
+    std::map<std::string, FailureRecord>::iterator i = failed.find(path);
+    if (i == failed.end())
+        return false;
+
+    // Forgotten as soon as the file appears or changes
+    unsigned long long size = 0;
+    long long modified = 0;
+    bool exists = getFileInfo(path, size, modified);
+    missing = i->second.missing;
+    if (missing ? !exists : exists && size == i->second.size && modified == i->second.modified)
+        return true;
+    failed.erase(i);
+    failuresChanged = true;
+    return false;
+}
+
+void TextureCache::addFailure(const char *path, bool missing, unsigned long long size, long long modified)
+{
+    FailureRecord record = { missing, size, modified };
+    failed[path] = record;
+    failuresChanged = true;
+}
+
+bool TextureCache::decodeFile(const char *path, bool flip, DecodedImage &image,
+                              std::shared_ptr<TextureEntry> &existing)
+{
+    image = DecodedImage();
+    image.found = getFileInfo(path, image.size, image.modified);
+    MappedFile file;
+    if (!image.found || !file.open(path) || file.size() == 0)
+        return false;
+    image.hash = hashBytes(file.data(), file.size());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<unsigned long long, std::weak_ptr<TextureEntry> >::iterator i =
+            contents.find(contentKey(image.hash, flip));
+        if (i != contents.end())
+        {
+            existing = i->second.lock();
+            if (existing && existing->id != 0)
+                return true;
+            existing.reset();
+        }
+    }
+
+    file.close();
+    return cookTexture(path, flip, cookFormats(), image);
+}
+
+std::shared_ptr<TextureEntry> TextureCache::findByPath(const std::string &pathKey,
+                                                       unsigned long long size, long long modified)
+{
+    std::map<std::string, PathRecord>::iterator i = paths.find(pathKey);
+    if (i == paths.end())
+        return nullptr;
+    std::shared_ptr<TextureEntry> entry = i->second.entry.lock();
+    if (!entry || entry->id == 0 || i->second.size != size || i->second.modified != modified)
+    {
+        paths.erase(i);
+        return nullptr;
+    }
+    return entry;
+}
+
+void TextureCache::countHit(const TextureEntry &entry, bool byContent)
+{
+    counters.hits++;
+    if (byContent)
+        counters.contentHits++;
+    if (!entry.pending)
+    {
+        counters.bytesSaved += entry.bytes;
+        counters.decodeMillisecondsSaved += entry.decodeMilliseconds;
+    }
+}
+
+void TextureCache::upload(const std::shared_ptr<TextureEntry> &entry, const DecodedImage &image)
+{
+    entry->bytes = image.levels->bytes();
+    if (image.levels->format != BLOCK_NONE)
+        counters.compressed++;
+    entry->hash = image.hash;
+    entry->width = image.width;
+    entry->height = image.height;
+    entry->components = image.components;
+    entry->decodeMilliseconds = image.decodeMilliseconds;
+    if (uploader != nullptr)
+    {
+        // Pending until the last band is sent, the entry may be gone by then
+        std::weak_ptr<TextureEntry> weak = entry;
+        uploader->upload(entry->id, image.levels, [this, weak]()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::shared_ptr<TextureEntry> uploaded = weak.lock();
+            if (uploaded)
+                uploaded->pending = false;
+        });
+    }
+    else
+    {
+        uploadTexture(entry->id, *image.levels);
+        entry->pending = false;
+    }
+
+    counters.decodes++;
+    counters.bytesUploaded += entry->bytes;
+    counters.decodeMilliseconds += image.decodeMilliseconds;
+}
+
+std::shared_ptr<TextureEntry> TextureCache::createPlaceholder()
+{
+    // 1x1 black, which the fragment shader lights with its own colours
+    std::shared_ptr<TextureEntry> entry = std::make_shared<TextureEntry>();
+    entry->width = entry->height = 1;
+    entry->components = 4;
+    entry->bytes = 4;
+    entry->pending = true;
+
+    const unsigned char black[4] = { 0, 0, 0, 255 };
+    glGenTextures(1, &entry->id);
+    glBindTexture(GL_TEXTURE_2D, entry->id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, black);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return entry;
+}
+
+TextureHandle TextureCache::getFallback()
+{
+    if (!fallbackTexture.entry || fallbackTexture.entry->id == 0)
+    {
+        fallbackTexture.entry = createPlaceholder();
+        fallbackTexture.entry->pending = false;
+        entries.push_back(fallbackTexture.entry);
+    }
+    return fallbackTexture;
+}
+
+TextureHandle TextureCache::makeHandle(const std::shared_ptr<TextureEntry> &entry)
+{
+    TextureHandle handle;
+    handle.entry = entry;
+    return handle;
+}
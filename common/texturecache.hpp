@@ -0,0 +1,169 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstddef>
+
+#include <common/imagedecoder.hpp>
+#include <common/threadpool.hpp>
+
+class TextureUploader;
+
+// One texture held by the cache
+struct TextureEntry
+{
+    unsigned int id;                // GL name, 0 once the cache is cleared
+    unsigned long long hash;        // of the file contents
+    int width;
+    int height;
+    int components;
+    unsigned long long bytes;       // uploaded including mipmaps
+    double decodeMilliseconds;
+    bool pending;                   // placeholder until an async load or streamed upload completes
+};
+
+// Reference counted use of a cached texture. The texture stays cached while
+// any handle to it is alive.
+class TextureHandle
+{
+public:
+    TextureHandle() {}
+
+    unsigned int id() const { return entry ? entry->id : 0; }
+    bool isValid() const { return entry != nullptr; }
+    bool isPending() const { return entry && entry->pending; }
+
+private:
+    friend class TextureCache;
+    std::shared_ptr<TextureEntry> entry;
+};
+
+struct TextureCacheStats
+{
+    size_t hits;                    // by path or by identical contents
+    size_t contentHits;             // of those, a different path with the same contents
+    size_t failureHits;             // known missing or broken, given the fallback
+    size_t decodes;
+    size_t compressed;              // of those, block compressed
+    size_t failures;
+    unsigned long long bytesUploaded;
+    unsigned long long bytesSaved;
+    double decodeMilliseconds;
+    double decodeMillisecondsSaved;
+};
+
+// Textures shared by every loader, keyed by path and by a hash of the file
+// contents so one image is decoded and uploaded once however many models use
+// it. Files that are missing or fail to decode are remembered, across runs
+// too, until they change on disk, and get a shared 1x1 black fallback that
+// the shaders treat as absent. Textures are cooked to a mip chain built on
+// the CPU, block compressed when compression is on and the GL supports a
+// suitable format, and kept next to the source, see cookTexture. Uploads can
+// be streamed over several frames, see setUploader. Every call that touches
+// GL has to be made on the GL thread, decode() is the only one safe on
+// workers.
+class TextureCache
+{
+public:
+    // failureListPath is where failures are kept between runs, NULL for
+    // none. It is read here and written by the destructor.
+    explicit TextureCache(const char *failureListPath = NULL);
+    ~TextureCache();
+
+    // Cache used by loadTexture, Model and AssetLoader
+    static TextureCache &shared();
+
+    // Block compress textures loaded from now on, on by default. Textures
+    // already cached stay as they are.
+    void setCompression(bool enabled);
+
+    // Stream uploads through uploader from now on, NULL to upload each
+    // texture whole when it is loaded. Streamed textures stay pending until
+    // the uploader has sent their finest level. The uploader has to outlive
+    // the cache's textures or be unset first.
+    void setUploader(TextureUploader *uploader);
+
+    // Decode and upload path unless it is cached, flipped bottom row first
+    // for OpenGL when flip is set
+    TextureHandle load(const char *path, bool flip = true);
+
+    // Load a set of textures at once. Decoding fans out over pool and each
+    // image is uploaded here as soon as it is done. The handles are in the
+    // order of paths.
+    std::vector<TextureHandle> loadBatch(const std::vector<std::string> &paths, bool flip = true,
+                                         ThreadPool &pool = ThreadPool::shared());
+
+    // Keep a texture for the rest of the program, for callers that only
+    // hold on to the GL name
+    void pin(const TextureHandle &texture);
+
+    // Async loading in three steps. reserve() returns the cached texture,
+    // or a new 1x1 placeholder and sets needsLoad. decode() runs on any
+    // thread and complete() uploads its result into the placeholder.
+    TextureHandle reserve(const char *path, bool flip, bool &needsLoad);
+    bool decode(const char *path, bool flip, DecodedImage &image);
+    void complete(const char *path, bool flip, const TextureHandle &texture, const DecodedImage &image);
+
+    // The 1x1 black texture given for missing files
+    TextureHandle fallback();
+
+    // Delete textures no handle refers to any more
+    size_t collect();
+
+    // Delete every texture, handles that are still alive get id 0
+    void clear();
+
+    TextureCacheStats stats() const;
+    void printStats() const;
+
+private:
+    struct PathRecord
+    {
+        unsigned long long size;
+        long long modified;
+        std::weak_ptr<TextureEntry> entry;
+    };
+
+    struct FailureRecord
+    {
+        bool missing;
+        unsigned long long size;
+        long long modified;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<TextureEntry> > entries;
+    std::map<std::string, PathRecord> paths;
+    std::unordered_map<unsigned long long, std::weak_ptr<TextureEntry> > contents;
+    std::map<std::string, FailureRecord> failed;
+    std::vector<TextureHandle> pinned;
+    TextureHandle fallbackTexture;
+    TextureCacheStats counters;
+    std::string failureListPath;
+    bool failuresChanged;
+    bool compression;
+    bool formatsDetected;
+    unsigned int supportedFormats;  // blockFormatBit of each
+    TextureUploader *uploader;
+
+    void detectFormats();
+    unsigned int cookFormats() const;
+    static std::string key(const char *path, bool flip);
+    static unsigned long long contentKey(unsigned long long hash, bool flip);
+    bool isKnownFailure(const char *path, bool &missing);
+    void addFailure(const char *path, bool missing, unsigned long long size, long long modified);
+    bool decodeFile(const char *path, bool flip, DecodedImage &image, std::shared_ptr<TextureEntry> &existing);
+    std::shared_ptr<TextureEntry> findByPath(const std::string &pathKey, unsigned long long size, long long modified);
+    void countHit(const TextureEntry &entry, bool byContent);
+    void upload(const std::shared_ptr<TextureEntry> &entry, const DecodedImage &image);
+    std::shared_ptr<TextureEntry> createPlaceholder();
+    TextureHandle getFallback();
+    static TextureHandle makeHandle(const std::shared_ptr<TextureEntry> &entry);
+
+    TextureCache(const TextureCache &);
+    TextureCache &operator=(const TextureCache &);
+};
@@ -0,0 +1,386 @@
+#include <chrono>
+#include <cctype>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <common/texturecook.hpp>
+#include <common/mappedfile.hpp>
+#include <common/hash.hpp>
+
+namespace
+{
+    const char textureMagic[4] = { 'C', 'G', 'T', 'X' };
+    const unsigned int maxLevels = 16;
+
+    // Sections start on page boundaries so a level can be handed to GL
+    // straight from the mapping and its pages dropped on their own
+    const size_t sectionAlignment = 4096;
+
+    // Fixed size header in the first page, offsets are from the start of
+    // the file
+    struct TextureFileHeader
+    {
+        char magic[4];
+        unsigned int version;
+        unsigned long long sourceSize;  // all zero for containers without a source
+        long long sourceModified;
+        unsigned long long sourceHash;
+        unsigned int format;
+        unsigned int glInternalFormat;
+        unsigned int glFormat;
+        unsigned int flip;
+        int width;
+        int height;
+        int components;
+        unsigned int numLevels;
+        unsigned int kind;              // the format was chosen from these two
+        unsigned int hasAlpha;
+        double psnr;
+        unsigned long long levelOffset[maxLevels];
+        unsigned long long levelSize[maxLevels];
+    };
+
+    inline size_t alignSection(size_t offset)
+    {
+        return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+    }
+
+    bool containsWord(const std::string &name, const char *word)
+    {
+        return name.find(word) != std::string::npos;
+    }
+
+    // Widens 1 to 4 channel pixels to RGBA, grey goes to all three colours
+    std::vector<unsigned char> expandToRGBA(const unsigned char *pixels, int width, int height, int components)
+    {
+        size_t count = static_cast<size_t>(width) * height;
+        std::vector<unsigned char> rgba(count * 4);
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char *src = pixels + i * components;
+            unsigned char *dst = &rgba[i * 4];
+            if (components < 3)
+            {
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = components == 2 ? src[1] : 255;
+            }
+            else
+            {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+                dst[3] = components == 4 ? src[3] : 255;
+            }
+        }
+        return rgba;
+    }
+
+    bool containsAlpha(const unsigned char *pixels, int width, int height, int components)
+    {
+        if (components != 2 && components != 4)
+            return false;
+        size_t count = static_cast<size_t>(width) * height;
+        for (size_t i = 0; i < count; i++)
+            if (pixels[i * components + components - 1] != 255)
+                return true;
+        return false;
+    }
+
+    unsigned long long hashFile(const char *path)
+    {
+        MappedFile source;
+        if (!source.open(path))
+            return 0;
+        return hashBytes(source.data(), source.size());
+    }
+}
+
+TextureKind textureKindFromPath(const char *path, int components)
+{
+    std::string name(path);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    size_t slash = name.find_last_of("/\\");
+    if (slash != std::string::npos)
+        name.erase(0, slash + 1);
+
+    if (containsWord(name, "normal"))
+        return TEXTURE_NORMAL;
+    if (components == 1 || containsWord(name, "specular") || containsWord(name, "rough") ||
+        containsWord(name, "_ao"))
+        return TEXTURE_MASK;
+    return TEXTURE_COLOUR;
+}
+
+MipFilter mipFilterForKind(TextureKind kind)
+{
+    static const MipFilter filters[] = { MIP_SRGB, MIP_LINEAR, MIP_NORMAL };
+    return filters[kind];
+}
+
+BlockFormat chooseBlockFormat(TextureKind kind, bool hasAlpha, unsigned int supportedFormats)
+{
+    BlockFormat preferred[2] = { BLOCK_NONE, BLOCK_NONE };
+    switch (kind)
+    {
+    case TEXTURE_NORMAL:
+        preferred[0] = BLOCK_BC5;
+        break;
+    case TEXTURE_MASK:
+        preferred[0] = BLOCK_BC4;
+        break;
+    default:
+        preferred[0] = BLOCK_BC7;
+        preferred[1] = hasAlpha ? BLOCK_BC3 : BLOCK_BC1;
+        break;
+    }
+    for (int i = 0; i < 2; i++)
+        if (preferred[i] != BLOCK_NONE && (supportedFormats & blockFormatBit(preferred[i])))
+            return preferred[i];
+    return BLOCK_NONE;
+}
+
+std::string cookedTexturePath(const char *sourcePath, bool flip)
+{
+    return std::string(sourcePath) + (flip ? ".flip.ctex" : ".ctex");
+}
+
+void compressMipChain(const MipChain &source, BlockFormat format, MipChain &compressed, ThreadPool &pool)
+{
+    compressed = MipChain();
+    compressed.format = format;
+    compressed.width = source.width;
+    compressed.height = source.height;
+    compressed.components = blockFormatChannels(format);
+    size_t offset = 0;
+    for (unsigned int i = 0; i < source.numLevels(); i++)
+    {
+        compressed.levelOffsets.push_back(offset);
+        offset += compressed.levelSize(i);
+    }
+    compressed.data.resize(offset);
+
+    for (unsigned int i = 0; i < source.numLevels(); i++)
+    {
+        int width = source.levelWidth(i), height = source.levelHeight(i);
+        std::vector<unsigned char> rgba = expandToRGBA(source.level(i), width, height, source.components);
+        compressBlocks(rgba.data(), width, height, format, &compressed.data[compressed.levelOffsets[i]], pool);
+        if (i == 0)
+        {
+            std::vector<unsigned char> decoded(rgba.size());
+            decompressBlocks(compressed.level(0), width, height, format, decoded.data());
+            compressed.psnr = computePSNR(rgba.data(), decoded.data(), width, height, blockFormatChannels(format));
+        }
+    }
+}
+
+void textureGLFormats(BlockFormat format, int components, unsigned int &internalFormat, unsigned int &pixelFormat)
+{
+    static const GLenum blockFormats[] = {
+        GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+        GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+        GL_COMPRESSED_RED_RGTC1,
+        GL_COMPRESSED_RG_RGTC2,
+        GL_COMPRESSED_RGBA_BPTC_UNORM
+    };
+    static const GLenum sizedFormats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    static const GLenum pixelFormats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    internalFormat = format != BLOCK_NONE ? blockFormats[format] : sizedFormats[components - 1];
+    pixelFormat = pixelFormats[components - 1];
+}
+
+bool isTextureContainer(const char *path)
+{
+    size_t length = strlen(path);
+    return length >= 5 && strcmp(path + length - 5, ".ctex") == 0;
+}
+
+namespace
+{
+    // Maps a container and checks it against its source, sourcePath is
+    // NULL for containers used without one
+    bool loadTextureContainer(const char *path, unsigned int supportedFormats, DecodedImage &image,
+                              unsigned long long sourceSize, long long sourceModified, const char *sourcePath, bool flip)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+        if (!file->open(path) || file->size() < sizeof(TextureFileHeader))
+            return false;
+
+        // A container cooked for other formats than the GL has now, say
+        // uncompressed before compression was turned on, is stale. One
+        // without a source can only be used as it is.
+        TextureFileHeader header;
+        memcpy(&header, file->data(), sizeof(header));
+        if (memcmp(header.magic, textureMagic, 4) != 0 || header.version != textureContainerVersion ||
+            header.kind > TEXTURE_NORMAL || header.format > BLOCK_NONE ||
+            header.numLevels != mipLevelCount(header.width, header.height) || header.numLevels > maxLevels ||
+            header.width <= 0 || header.height <= 0 || header.components < 1 || header.components > 4)
+            return false;
+        BlockFormat format = static_cast<BlockFormat>(header.format);
+        if (sourcePath != NULL)
+        {
+            if (header.sourceSize != sourceSize || header.flip != (flip ? 1u : 0u) ||
+                chooseBlockFormat(static_cast<TextureKind>(header.kind), header.hasAlpha != 0, supportedFormats) != format)
+                return false;
+        }
+        else if (format != BLOCK_NONE && !(supportedFormats & blockFormatBit(format)))
+            return false;
+
+        unsigned int internalFormat, pixelFormat;
+        textureGLFormats(format, header.components, internalFormat, pixelFormat);
+        if (header.glInternalFormat != internalFormat || header.glFormat != pixelFormat)
+            return false;
+
+        // Every level has to be the size its dimensions give, aligned and
+        // inside the file
+        std::shared_ptr<MipChain> levels = std::make_shared<MipChain>();
+        levels->format = format;
+        levels->width = header.width;
+        levels->height = header.height;
+        levels->components = header.components;
+        levels->psnr = header.psnr;
+        for (unsigned int i = 0; i < header.numLevels; i++)
+        {
+            if (header.levelSize[i] != levels->levelSize(i) || header.levelOffset[i] % sectionAlignment != 0 ||
+                header.levelOffset[i] + header.levelSize[i] > file->size())
+                return false;
+            levels->levelOffsets.push_back(static_cast<size_t>(header.levelOffset[i]));
+        }
+
+        if (sourcePath != NULL && header.sourceModified != sourceModified && header.sourceHash != hashFile(sourcePath))
+            return false;
+
+        // Fault the levels in here so the upload on the GL thread doesn't
+        // wait on the disk
+        levels->mapping = file;
+        volatile unsigned char touched = 0;
+        for (unsigned int i = 0; i < header.numLevels; i++)
+            for (size_t offset = 0; offset < header.levelSize[i]; offset += sectionAlignment)
+                touched ^= levels->level(i)[offset];
+        (void)touched;
+
+        image.levels = levels;
+        image.hash = sourcePath != NULL ? header.sourceHash : hashBytes(file->data(), file->size());
+        image.width = header.width;
+        image.height = header.height;
+        image.components = header.components;
+        image.decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+}
+
+bool loadCookedTexture(const char *sourcePath, bool flip, unsigned int supportedFormats, DecodedImage &image)
+{
+    image = DecodedImage();
+    image.found = getFileInfo(sourcePath, image.size, image.modified);
+    if (!image.found)
+        return false;
+    if (isTextureContainer(sourcePath))
+        return loadTextureContainer(sourcePath, supportedFormats, image, 0, 0, NULL, flip);
+
+    std::string path = cookedTexturePath(sourcePath, flip);
+    return loadTextureContainer(path.c_str(), supportedFormats, image, image.size, image.modified, sourcePath, flip);
+}
+
+bool saveCookedTexture(const char *sourcePath, bool flip, const DecodedImage &image, TextureKind kind, bool hasAlpha)
+{
+    const MipChain *levels = image.levels.get();
+    if (levels == NULL || levels->numLevels() == 0 || levels->numLevels() > maxLevels)
+        return false;
+
+    TextureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, textureMagic, 4);
+    header.version = textureContainerVersion;
+    header.sourceSize = image.size;
+    header.sourceModified = image.modified;
+    header.sourceHash = image.hash;
+    header.format = levels->format;
+    textureGLFormats(levels->format, levels->components, header.glInternalFormat, header.glFormat);
+    header.flip = flip ? 1 : 0;
+    header.width = levels->width;
+    header.height = levels->height;
+    header.components = levels->components;
+    header.numLevels = levels->numLevels();
+    header.kind = kind;
+    header.hasAlpha = hasAlpha ? 1 : 0;
+    header.psnr = levels->psnr;
+    size_t offset = alignSection(sizeof(header));
+    for (unsigned int i = 0; i < header.numLevels; i++)
+    {
+        header.levelOffset[i] = offset;
+        header.levelSize[i] = levels->levelSize(i);
+        offset = alignSection(offset + levels->levelSize(i));
+    }
+
+    // Written aside and swapped in, like the mesh cache
+    std::string path = cookedTexturePath(sourcePath, flip);
+    std::string tempPath = path + ".tmp";
+    FILE *out = fopen(tempPath.c_str(), "wb");
+    if (out == NULL)
+        return false;
+    static const char zeros[sectionAlignment] = { 0 };
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    size_t written = sizeof(header);
+    for (unsigned int i = 0; i < header.numLevels && ok; i++)
+    {
+        size_t padding = static_cast<size_t>(header.levelOffset[i]) - written;
+        size_t size = levels->levelSize(i);
+        ok = fwrite(zeros, 1, padding, out) == padding && fwrite(levels->level(i), 1, size, out) == size;
+        written += padding + size;
+    }
+    ok = fclose(out) == 0 && ok;
+
+    if (ok)
+    {
+        remove(path.c_str());
+        ok = rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+        remove(tempPath.c_str());
+    return ok;
+}
+
+bool cookTexture(const char *sourcePath, bool flip, unsigned int supportedFormats, DecodedImage &image,
+                 ThreadPool &pool)
+{
+    if (loadCookedTexture(sourcePath, flip, supportedFormats, image))
+        return true;
+    if (isTextureContainer(sourcePath))
+        return false;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!decodeImageFile(sourcePath, flip, image))
+        return false;
+    TextureKind kind = textureKindFromPath(sourcePath, image.components);
+    bool hasAlpha = containsAlpha(image.pixels.get(), image.width, image.height, image.components);
+    BlockFormat format = chooseBlockFormat(kind, hasAlpha, supportedFormats);
+
+    std::shared_ptr<MipChain> levels = std::make_shared<MipChain>();
+    generateMipChain(image.pixels.get(), image.width, image.height, image.components, mipFilterForKind(kind),
+                     *levels, pool);
+    image.pixels.reset();
+    if (format != BLOCK_NONE)
+    {
+        std::shared_ptr<MipChain> compressed = std::make_shared<MipChain>();
+        compressMipChain(*levels, format, *compressed, pool);
+        levels = compressed;
+    }
+    image.levels = levels;
+    image.components = levels->components;
+    image.decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!saveCookedTexture(sourcePath, flip, image, kind, hasAlpha))
+        printf("Couldn't write the cooked copy of %s\n", sourcePath);
+    if (format != BLOCK_NONE)
+        printf("Cooked %s as %s, %dx%d, %u levels, PSNR %.1f dB in %.0f ms\n", sourcePath, blockFormatName(format),
+               image.width, image.height, levels->numLevels(), levels->psnr, image.decodeMilliseconds);
+    else
+        printf("Cooked %s uncompressed, %dx%d, %u levels in %.0f ms\n", sourcePath,
+               image.width, image.height, levels->numLevels(), image.decodeMilliseconds);
+    return true;
+}
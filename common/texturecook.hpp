@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+
+#include <common/blockcompression.hpp>
+#include <common/mipmap.hpp>
+#include <common/imagedecoder.hpp>
+#include <common/threadpool.hpp>
+
+// What a texture holds, which decides the block format it is cooked to
+enum TextureKind
+{
+    TEXTURE_COLOUR,     // diffuse, BC7 or BC1/BC3
+    TEXTURE_MASK,       // specular and other single channel maps, BC4
+    TEXTURE_NORMAL      // tangent space normal, BC5 with z rebuilt in the shader
+};
+
+// Guesses the kind from the file name, single channel images are masks
+TextureKind textureKindFromPath(const char *path, int components);
+
+// Colour is filtered in linear light, normals are renormalised
+MipFilter mipFilterForKind(TextureKind kind);
+
+// Bit of a format in a mask of formats the GL supports
+inline unsigned int blockFormatBit(BlockFormat format) { return 1u << format; }
+
+// Best supported format for a kind, BLOCK_NONE to keep it uncompressed
+BlockFormat chooseBlockFormat(TextureKind kind, bool hasAlpha, unsigned int supportedFormats);
+
+// Bumped whenever the container layout or how textures are cooked changes
+const unsigned int textureContainerVersion = 3;
+
+// Cooked copy of a texture stored next to its source, one per flip. It is
+// a container holding the mip chain in its final GL format, each level in
+// its own page aligned section so it can be uploaded straight from a
+// mapping of the file.
+std::string cookedTexturePath(const char *sourcePath, bool flip);
+
+// True for paths of texture containers, which are loaded as they are
+bool isTextureContainer(const char *path);
+
+// GL internal and pixel transfer formats a chain is uploaded with
+void textureGLFormats(BlockFormat format, int components, unsigned int &internalFormat, unsigned int &pixelFormat);
+
+// Block compresses every level of an uncompressed chain and measures the
+// PSNR of the top level
+void compressMipChain(const MipChain &source, BlockFormat format, MipChain &compressed,
+                      ThreadPool &pool = ThreadPool::shared());
+
+// Maps the cooked chain of sourcePath into image.levels, false if it is
+// missing, stale or cooked for other formats than supportedFormats gives.
+// sourcePath can also be a container itself. Nothing is decoded or copied.
+bool loadCookedTexture(const char *sourcePath, bool flip, unsigned int supportedFormats, DecodedImage &image);
+
+// Writes image.levels for the source described by image, kind and hasAlpha
+// are what its format was chosen from
+bool saveCookedTexture(const char *sourcePath, bool flip, const DecodedImage &image, TextureKind kind, bool hasAlpha);
+
+// Maps the cooked chain, or decodes the source, builds its mip chain on
+// the CPU, compresses it if a supported format suits and saves it. With
+// no supported formats the chain stays uncompressed. Safe on any thread,
+// the work is spread over pool.
+bool cookTexture(const char *sourcePath, bool flip, unsigned int supportedFormats, DecodedImage &image,
+                 ThreadPool &pool = ThreadPool::shared());
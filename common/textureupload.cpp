@@ -0,0 +1,317 @@
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <common/textureupload.hpp>
+#include <common/texturecook.hpp>
+#include <common/assetloader.hpp>
+
+namespace
+{
+    // Bands start on this boundary in the ring
+    const size_t bandAlignment = 64;
+
+    inline GLsync toSync(void *fence)
+    {
+        return reinterpret_cast<GLsync>(fence);
+    }
+}
+
+TextureUploader::TextureUploader(size_t ringBytes, size_t frameBudget, ThreadPool &pool)
+    : pool(pool), buffer(0), mapped(nullptr), ringBytes(ringBytes), frameBudget(std::min(frameBudget, ringBytes / 2)),
+      head(0), numPartial(0)
+{
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+    {
+        // Mapped once for good, coherent so copies need no flush
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringBytes, NULL, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringBytes, flags));
+    }
+    else
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, ringBytes, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureUploader::~TextureUploader()
+{
+    for (size_t i = 0; i < bands.size(); i++)
+    {
+        if (bands[i].copied.valid())
+            bands[i].copied.wait();
+        if (bands[i].fence != nullptr)
+            glDeleteSync(toSync(bands[i].fence));
+    }
+    if (mapped != nullptr)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void TextureUploader::upload(unsigned int textureID, const std::shared_ptr<MipChain> &levels,
+                             const std::function<void()> &done)
+{
+    // Storage for the whole chain now, only the coarsest level is sampled
+    // until more arrive
+    allocateTextureStorage(textureID, *levels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels->numLevels() - 1);
+
+    std::shared_ptr<PendingUpload> upload = std::make_shared<PendingUpload>();
+    upload->texture = textureID;
+    upload->levels = levels;
+    upload->done = done;
+    upload->level = static_cast<int>(levels->numLevels()) - 1;
+    upload->row = 0;
+    upload->cancelled = false;
+    uploads.push_back(upload);
+}
+
+void TextureUploader::cancel(unsigned int textureID)
+{
+    for (size_t i = 0; i < uploads.size(); )
+    {
+        if (uploads[i]->texture == textureID)
+        {
+            uploads[i]->cancelled = true;
+            uploads.erase(uploads.begin() + i);
+        }
+        else
+            i++;
+    }
+
+    // Bands already copied are skipped when their turn comes
+    for (size_t i = 0; i < bands.size(); i++)
+    {
+        PendingUpload &upload = *bands[i].upload;
+        if (upload.texture == textureID && !upload.cancelled && upload.level >= 0)
+        {
+            upload.cancelled = true;
+            numPartial--;
+        }
+    }
+}
+
+size_t TextureUploader::update()
+{
+    reclaim(false);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Copies finished since last frame go first, then new bands up to the
+    // budget. Bands copied on this thread go out straight away.
+    sendReady(false);
+    size_t spent = 0;
+    while (!uploads.empty() && spent < frameBudget)
+    {
+        size_t size = startBand(uploads.front());
+        if (size == 0)
+            break;
+        spent += size;
+    }
+    sendReady(false);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return pending();
+}
+
+void TextureUploader::finish()
+{
+    while (pending() > 0)
+    {
+        update();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        sendReady(true);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        reclaim(true);
+    }
+}
+
+bool TextureUploader::allocate(size_t size, size_t &offset)
+{
+    size = (size + bandAlignment - 1) & ~(bandAlignment - 1);
+    if (bands.empty())
+        head = 0;
+    if (size > ringBytes)
+        return false;
+
+    // Free space is [head, tail) or, once head has passed tail, [head, end)
+    // and [0, tail). head never catches up with tail so full and empty
+    // can't be confused.
+    size_t tail = bands.empty() ? ringBytes : bands.front().offset;
+    if (bands.empty() || head > tail)
+    {
+        if (head + size <= ringBytes)
+        {
+            offset = head;
+            head += size;
+            return true;
+        }
+        if (!bands.empty() && size < tail)
+        {
+            offset = 0;
+            head = size;
+            return true;
+        }
+        return false;
+    }
+    if (head + size < tail)
+    {
+        offset = head;
+        head += size;
+        return true;
+    }
+    return false;
+}
+
+void TextureUploader::reclaim(bool wait)
+{
+    while (!bands.empty())
+    {
+        Band &band = bands.front();
+        if (band.fence != nullptr)
+        {
+            GLenum status = glClientWaitSync(toSync(band.fence), wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                             wait ? 1000000000ull : 0);
+            while (wait && status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(toSync(band.fence), GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            if (status == GL_TIMEOUT_EXPIRED)
+                return;
+            glDeleteSync(toSync(band.fence));
+        }
+        else if (!band.upload->cancelled)
+            return;
+        else if (band.copied.valid())
+        {
+            // Cancelled, the worker may still be writing into the ring
+            if (!wait && band.copied.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return;
+            band.copied.wait();
+        }
+        bands.pop_front();
+    }
+}
+
+size_t TextureUploader::startBand(const std::shared_ptr<PendingUpload> &upload)
+{
+    const MipChain &levels = *upload->levels;
+    unsigned int level = static_cast<unsigned int>(upload->level);
+    int width = levels.levelWidth(level);
+    int height = levels.levelHeight(level);
+
+    // Block formats go in rows of 4x4 blocks
+    bool compressed = levels.format != BLOCK_NONE;
+    int unitRows = compressed ? 4 : 1;
+    size_t unitBytes = compressed ? ((width + 3) / 4) * blockBytes(levels.format)
+                                  : static_cast<size_t>(width) * levels.components;
+    int totalUnits = (height + unitRows - 1) / unitRows;
+    int firstUnit = upload->row / unitRows;
+    int units = std::min(static_cast<int>(std::max(frameBudget / unitBytes, static_cast<size_t>(1))),
+                         totalUnits - firstUnit);
+
+    Band band;
+    band.upload = upload;
+    band.level = level;
+    band.row = upload->row;
+    band.rows = std::min(units * unitRows, height - upload->row);
+    band.size = units * unitBytes;
+    band.fence = nullptr;
+    band.sent = false;
+    if (!allocate(band.size, band.offset))
+        return 0;
+
+    const unsigned char *source = levels.level(level) + firstUnit * unitBytes;
+    if (mapped != nullptr)
+    {
+        // The chain stays alive with the band until the copy is done
+        unsigned char *destination = mapped + band.offset;
+        size_t size = band.size;
+        std::shared_ptr<MipChain> keep = upload->levels;
+        band.copied = pool.submit([destination, source, size, keep]() { memcpy(destination, source, size); });
+    }
+    else
+    {
+        void *destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, band.offset, band.size,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (destination != NULL)
+            memcpy(destination, source, band.size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    upload->row += band.rows;
+    band.lastOfLevel = upload->row >= height;
+    if (band.lastOfLevel)
+    {
+        upload->level--;
+        upload->row = 0;
+        if (upload->level < 0)
+        {
+            // Every band is started, the upload lives on in them
+            upload->level = 0;
+            uploads.pop_front();
+            numPartial++;
+        }
+    }
+    size_t size = band.size;
+    bands.push_back(std::move(band));
+    return size;
+}
+
+void TextureUploader::sendReady(bool wait)
+{
+    // In ring order, so a level's bands go out before the base level moves
+    for (size_t i = 0; i < bands.size(); i++)
+    {
+        Band &band = bands[i];
+        if (band.sent || band.upload->cancelled)
+            continue;
+        if (band.copied.valid())
+        {
+            if (!wait && band.copied.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return;
+            band.copied.get();
+        }
+        send(band);
+    }
+}
+
+void TextureUploader::send(Band &band)
+{
+    PendingUpload &upload = *band.upload;
+    const MipChain &levels = *upload.levels;
+    unsigned int internalFormat, format;
+    textureGLFormats(levels.format, levels.components, internalFormat, format);
+    int width = levels.levelWidth(band.level);
+    const void *offset = reinterpret_cast<const void*>(band.offset);
+
+    glBindTexture(GL_TEXTURE_2D, upload.texture);
+    if (levels.format != BLOCK_NONE)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, band.level, 0, band.row, width, band.rows, internalFormat,
+                                  static_cast<GLsizei>(band.size), offset);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, band.level, 0, band.row, width, band.rows, format, GL_UNSIGNED_BYTE, offset);
+    band.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    band.sent = true;
+
+    if (band.lastOfLevel)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, band.level);
+        if (band.level == 0)
+        {
+            // Marks the upload finished so a later cancel leaves it alone
+            upload.level = -1;
+            numPartial--;
+            if (upload.done)
+                upload.done();
+        }
+    }
+}
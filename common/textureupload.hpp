@@ -0,0 +1,91 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <future>
+#include <functional>
+#include <cstddef>
+
+#include <common/mipmap.hpp>
+#include <common/threadpool.hpp>
+
+// Streams mip chains into textures through a ring of pixel unpack buffer
+// memory so no single upload stalls a frame. Each frame update() sends at
+// most a byte budget, coarsest level first, with large levels split into
+// bands of rows, and GL_TEXTURE_BASE_LEVEL follows the finest complete
+// level so a texture sharpens as it arrives. Where the buffer can be
+// persistently mapped, workers copy the pixels straight into it, otherwise
+// the GL thread maps each band. Fences keep ring memory from being
+// reused before the GL has read it. Everything but the copies runs on the
+// GL thread.
+class TextureUploader
+{
+public:
+    explicit TextureUploader(size_t ringBytes = 32 << 20, size_t frameBudget = 8 << 20,
+                             ThreadPool &pool = ThreadPool::shared());
+
+    // Waits for copies still running and releases the buffer
+    ~TextureUploader();
+
+    // Queue levels for textureID, allocating its storage now. done runs on
+    // the GL thread once the last band has been sent.
+    void upload(unsigned int textureID, const std::shared_ptr<MipChain> &levels,
+                const std::function<void()> &done = std::function<void()>());
+
+    // Drop what is left of a texture's upload, for textures being deleted
+    void cancel(unsigned int textureID);
+
+    // Send up to the frame budget, returns the number of textures not done
+    size_t update();
+
+    // Send everything that is left, waiting for ring space as needed
+    void finish();
+
+    size_t pending() const { return uploads.size() + numPartial; }
+    bool isPersistent() const { return mapped != nullptr; }
+
+private:
+    struct PendingUpload
+    {
+        unsigned int texture;
+        std::shared_ptr<MipChain> levels;
+        std::function<void()> done;
+        int level;              // being split into bands, from the coarsest
+        int row;                // next row of it, in pixels
+        bool cancelled;
+    };
+
+    // A piece of the ring holding rows of one level
+    struct Band
+    {
+        std::shared_ptr<PendingUpload> upload;
+        unsigned int level;
+        int row;
+        int rows;
+        size_t offset;
+        size_t size;
+        std::future<void> copied;   // not valid when copied on the GL thread
+        void *fence;                // GLsync once sent
+        bool sent;
+        bool lastOfLevel;
+    };
+
+    ThreadPool &pool;
+    unsigned int buffer;
+    unsigned char *mapped;          // persistent mapping, or NULL
+    size_t ringBytes;
+    size_t frameBudget;
+    size_t head;
+    std::deque<Band> bands;         // oldest first, the ring is freed in this order
+    std::deque<std::shared_ptr<PendingUpload> > uploads;
+    size_t numPartial;              // uploads with all bands started but not all sent
+
+    bool allocate(size_t size, size_t &offset);
+    void reclaim(bool wait);
+    size_t startBand(const std::shared_ptr<PendingUpload> &upload);
+    void sendReady(bool wait);
+    void send(Band &band);
+
+    TextureUploader(const TextureUploader &);
+    TextureUploader &operator=(const TextureUploader &);
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <utility>
+
+// Fixed set of worker threads running queued jobs in FIFO order
+class ThreadPool
+{
+public:
+    // numThreads of 0 uses one thread per hardware core
+    explicit ThreadPool(unsigned int numThreads = 0);
+    ~ThreadPool();
+
+    // Number of worker threads
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    // Queue a job, the future holds its result once it has run
+    template <typename F>
+    std::future<decltype(std::declval<F>()())> submit(F job)
+    {
+        typedef decltype(std::declval<F>()()) Result;
+        std::shared_ptr<std::packaged_task<Result()> > task =
+            std::make_shared<std::packaged_task<Result()> >(job);
+        std::future<Result> result = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return result;
+    }
+
+    // Run body(i) for every i in [0, count) and wait for all of them. The
+    // calling thread takes part, so this is safe to call from a job.
+    void parallelFor(size_t count, const std::function<void(size_t)> &body);
+
+    // Pool shared by the loaders, created on first use
+    static ThreadPool &shared();
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    void enqueue(std::function<void()> job);
+    void workerLoop();
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+};
@@ -0,0 +1,186 @@
+#include <cmath>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/gtc/packing.hpp>
+
+#include <common/vertexformat.hpp>
+
+namespace
+{
+    inline short toSnorm16(float x)
+    {
+        x = std::min(std::max(x, -1.0f), 1.0f);
+        return static_cast<short>(std::floor(x * 32767.0f + 0.5f));
+    }
+
+    inline float fromSnorm16(short x)
+    {
+        return std::max(x / 32767.0f, -1.0f);
+    }
+
+    // Folds the unit sphere onto the [-1, 1] square
+    glm::vec2 encodeOctahedral(glm::vec3 n)
+    {
+        float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+        if (sum == 0.0f)
+            return glm::vec2(0.0f, 0.0f);
+        n /= sum;
+        glm::vec2 e(n.x, n.y);
+        if (n.z < 0.0f)
+        {
+            e.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+            e.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return e;
+    }
+
+    // Same decode as decodeOctahedral in the vertex shader
+    glm::vec3 decodeOctahedral(glm::vec2 e)
+    {
+        glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+        float t = std::max(-n.z, 0.0f);
+        n.x += n.x >= 0.0f ? -t : t;
+        n.y += n.y >= 0.0f ? -t : t;
+        return glm::normalize(n);
+    }
+
+    // Orthonormal basis around a unit normal (Duff et al.), continuous
+    // except where n.z changes sign. Same as tangentBasis in the shader.
+    void tangentBasis(const glm::vec3 &n, glm::vec3 &b1, glm::vec3 &b2)
+    {
+        float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+        float a = -1.0f / (sign + n.z);
+        float b = n.x * n.y * a;
+        b1 = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+        b2 = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+    }
+
+    const float twoPi = 6.28318530718f;
+
+    // Angle of the tangent in the basis of the decoded normal
+    unsigned short encodeTangent(const glm::vec3 &normal, const glm::vec4 &tangent)
+    {
+        glm::vec3 b1, b2;
+        tangentBasis(normal, b1, b2);
+        float angle = std::atan2(glm::dot(glm::vec3(tangent), b2), glm::dot(glm::vec3(tangent), b1));
+        if (angle < 0.0f)
+            angle += twoPi;
+        unsigned int code = static_cast<unsigned int>(std::floor(angle / twoPi * 32768.0f + 0.5f)) & 0x7fff;
+        return static_cast<unsigned short>(code | (tangent.w < 0.0f ? 0x8000 : 0));
+    }
+
+    glm::vec4 decodeTangent(const glm::vec3 &normal, unsigned short code)
+    {
+        glm::vec3 b1, b2;
+        tangentBasis(normal, b1, b2);
+        float angle = (code & 0x7fff) / 32768.0f * twoPi;
+        return glm::vec4(b1 * std::cos(angle) + b2 * std::sin(angle), (code & 0x8000) ? -1.0f : 1.0f);
+    }
+}
+
+void VertexFormat::apply() const
+{
+    for (size_t i = 0; i < attributes.size(); i++)
+    {
+        const VertexAttribute &a = attributes[i];
+        glEnableVertexAttribArray(a.location);
+        glVertexAttribPointer(a.location, a.components, a.type,
+                              a.normalized ? GL_TRUE : GL_FALSE, stride,
+                              (void*)(size_t)a.offset);
+    }
+}
+
+const VertexFormat &packedVertexFormat()
+{
+    static VertexFormat format;
+    if (format.attributes.empty())
+    {
+        VertexAttribute position = { 0, 3, GL_UNSIGNED_SHORT, true, offsetof(PackedVertex, position) };
+        VertexAttribute normal = { 1, 2, GL_SHORT, true, offsetof(PackedVertex, normal) };
+        VertexAttribute uv = { 2, 2, GL_HALF_FLOAT, false, offsetof(PackedVertex, uv) };
+        VertexAttribute tangent = { 3, 1, GL_UNSIGNED_SHORT, true, offsetof(PackedVertex, tangent) };
+        format.stride = sizeof(PackedVertex);
+        format.attributes.push_back(position);
+        format.attributes.push_back(normal);
+        format.attributes.push_back(uv);
+        format.attributes.push_back(tangent);
+    }
+    return format;
+}
+
+glm::vec3 positionScale(const MeshBounds &bounds)
+{
+    // Flat meshes still need a non-zero scale to divide by
+    return glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+}
+
+glm::vec3 positionOffset(const MeshBounds &bounds)
+{
+    return bounds.min;
+}
+
+void packVertices(const glm::vec3 *positions, const glm::vec2 *uvs, const glm::vec3 *normals,
+                  const glm::vec4 *tangents, size_t count, const MeshBounds &bounds, PackedVertex *out)
+{
+    glm::vec3 scale = positionScale(bounds);
+    glm::vec3 offset = positionOffset(bounds);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 p = glm::clamp((positions[i] - offset) / scale, 0.0f, 1.0f);
+        for (int k = 0; k < 3; k++)
+            out[i].position[k] = static_cast<unsigned short>(std::floor(p[k] * 65535.0f + 0.5f));
+
+        glm::vec2 n = encodeOctahedral(normals[i]);
+        out[i].normal[0] = toSnorm16(n.x);
+        out[i].normal[1] = toSnorm16(n.y);
+
+        // Against the normal the shader will see, not the float one
+        out[i].tangent = 0;
+        if (tangents != NULL)
+            out[i].tangent = encodeTangent(decodeOctahedral(glm::vec2(fromSnorm16(out[i].normal[0]),
+                                                                      fromSnorm16(out[i].normal[1]))), tangents[i]);
+
+        out[i].uv[0] = glm::packHalf1x16(uvs[i].x);
+        out[i].uv[1] = glm::packHalf1x16(uvs[i].y);
+    }
+}
+
+PackingError measurePackingError(const PackedVertex *packed,
+                                 const glm::vec3 *positions, const glm::vec2 *uvs,
+                                 const glm::vec3 *normals, const glm::vec4 *tangents, size_t count,
+                                 const MeshBounds &bounds)
+{
+    PackingError error = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glm::vec3 scale = positionScale(bounds);
+    glm::vec3 offset = positionOffset(bounds);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 p;
+        for (int k = 0; k < 3; k++)
+            p[k] = packed[i].position[k] / 65535.0f * scale[k] + offset[k];
+        error.position = std::max(error.position, glm::length(p - positions[i]));
+
+        glm::vec3 n = decodeOctahedral(glm::vec2(fromSnorm16(packed[i].normal[0]),
+                                                 fromSnorm16(packed[i].normal[1])));
+        float length = glm::length(normals[i]);
+        if (length > 0.0f)
+        {
+            float cosine = std::min(std::max(glm::dot(n, normals[i] / length), -1.0f), 1.0f);
+            error.normalDegrees = std::max(error.normalDegrees, glm::degrees(std::acos(cosine)));
+        }
+
+        // A flipped sign counts as 180 degrees
+        if (tangents != NULL)
+        {
+            glm::vec4 t = decodeTangent(n, packed[i].tangent);
+            float cosine = std::min(std::max(glm::dot(glm::vec3(t), glm::vec3(tangents[i])), -1.0f), 1.0f);
+            float degrees = t.w == tangents[i].w ? glm::degrees(std::acos(cosine)) : 180.0f;
+            error.tangentDegrees = std::max(error.tangentDegrees, degrees);
+        }
+
+        glm::vec2 uv(glm::unpackHalf1x16(packed[i].uv[0]), glm::unpackHalf1x16(packed[i].uv[1]));
+        error.uv = std::max(error.uv, glm::length(uv - uvs[i]));
+    }
+    return error;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include <common/mesh.hpp>
+
+// One attribute of an interleaved vertex
+struct VertexAttribute
+{
+    unsigned int location;
+    int components;
+    unsigned int type;          // GL component type
+    bool normalized;
+    unsigned int offset;
+};
+
+// Layout of an interleaved vertex buffer
+struct VertexFormat
+{
+    unsigned int stride;
+    std::vector<VertexAttribute> attributes;
+
+    // Sets the attribute pointers of the bound VAO for the bound array buffer
+    void apply() const;
+};
+
+// 16 byte vertex shared by every mesh. The position is 16-bit unorm within
+// the mesh bounds, the normal is octahedral encoded in two snorm16 and the
+// uv is two half floats. The tangent is an angle around the normal, from a
+// basis both sides build from the decoded normal, in the low 15 bits with
+// the bitangent sign in the top bit. The vertex shader decodes all four.
+struct PackedVertex
+{
+    unsigned short position[3];
+    unsigned short tangent;
+    short normal[2];
+    unsigned short uv[2];
+};
+
+// Format of PackedVertex: position at location 0, normal 1, uv 2 and
+// tangent 3
+const VertexFormat &packedVertexFormat();
+
+// Packs float vertices quantising positions against bounds. tangents are
+// from generateTangents and can be NULL, which packs an arbitrary tangent.
+void packVertices(const glm::vec3 *positions, const glm::vec2 *uvs, const glm::vec3 *normals,
+                  const glm::vec4 *tangents, size_t count, const MeshBounds &bounds, PackedVertex *out);
+
+// Values for the positionScale and positionOffset shader uniforms
+glm::vec3 positionScale(const MeshBounds &bounds);
+glm::vec3 positionOffset(const MeshBounds &bounds);
+
+// Largest differences between packed and float vertices
+struct PackingError
+{
+    float position;             // world units
+    float normalDegrees;
+    float uv;
+    float tangentDegrees;
+};
+
+PackingError measurePackingError(const PackedVertex *packed,
+                                 const glm::vec3 *positions, const glm::vec2 *uvs,
+                                 const glm::vec3 *normals, const glm::vec4 *tangents, size_t count,
+                                 const MeshBounds &bounds);
@@ -0,0 +1,718 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <algorithm>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <common/virtualtexture.hpp>
+#include <common/imagedecoder.hpp>
+#include <common/mipmap.hpp>
+
+namespace
+{
+    const char pageFileMagic[4] = { 'C', 'G', 'V', 'T' };
+
+    // Pages start after the header's page
+    const size_t pageDataOffset = 4096;
+
+    // Page coordinates go through 8-bit channels in the feedback and the
+    // page table
+    const int maxPagesPerSide = 256;
+
+    const int storedPageSize = virtualPageSize + 2 * virtualPageBorder;
+    const size_t pageBytes = static_cast<size_t>(storedPageSize) * storedPageSize * 4;
+
+    struct PageFileHeader
+    {
+        char magic[4];
+        unsigned int version;
+        unsigned long long sourceSize;
+        long long sourceModified;
+        int pagesX;                     // of level 0, powers of two
+        int pagesY;
+        int pageSize;
+        int border;
+    };
+
+    int nextPowerOfTwo(int value)
+    {
+        int power = 1;
+        while (power < value)
+            power *= 2;
+        return power;
+    }
+
+    // Pages of every level before level, level 0 first
+    size_t firstPage(int pagesX, int pagesY, int level)
+    {
+        size_t pages = 0;
+        for (int i = 0; i < level; i++)
+            pages += static_cast<size_t>(std::max(pagesX >> i, 1)) * std::max(pagesY >> i, 1);
+        return pages;
+    }
+
+    bool readHeader(const char *data, size_t size, PageFileHeader &header)
+    {
+        if (size < sizeof(header))
+            return false;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, pageFileMagic, 4) != 0 || header.version != virtualPageFileVersion ||
+            header.pageSize != virtualPageSize || header.border != virtualPageBorder ||
+            header.pagesX < 1 || header.pagesY < 1 || header.pagesX > maxPagesPerSide || header.pagesY > maxPagesPerSide ||
+            header.pagesX != nextPowerOfTwo(header.pagesX) || header.pagesY != nextPowerOfTwo(header.pagesY))
+            return false;
+        int numLevels = static_cast<int>(mipLevelCount(header.pagesX, header.pagesY));
+        return size >= pageDataOffset + firstPage(header.pagesX, header.pagesY, numLevels) * pageBytes;
+    }
+    // Rows of the source decoded at a time
+    const int cookBandRows = 64;
+
+    bool seekFile(FILE *file, unsigned long long offset)
+    {
+#ifdef _WIN32
+        return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+        return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+    }
+
+    // Pages of one level, written a row of pages at a time as the rows of
+    // the level come in, top of the image first. Pages wrap around the
+    // edges like the room's repeating UVs and the level is scaled to the
+    // page grid, so a row of pages is complete once the rows of its
+    // borders are in too. The top and bottom rows of pages wait for each
+    // other's.
+    class PageLevelWriter
+    {
+    public:
+        PageLevelWriter(FILE *file, size_t firstPage, int pagesX, int pagesY, int sourceWidth, int sourceHeight,
+                        int components)
+            : file(file), firstPage(firstPage), pagesX(pagesX), pagesY(pagesY), sourceWidth(sourceWidth), sourceHeight(sourceHeight),
+              components(components), virtualWidth(pagesX * virtualPageSize), virtualHeight(pagesY * virtualPageSize)
+        {
+            for (int x = 0; x < virtualWidth; x++)
+                columns.push_back(static_cast<int>(static_cast<long long>(x) * sourceWidth / virtualWidth));
+        }
+
+        // count rows of the level, the first of them first rows from the top
+        bool addRows(const unsigned char *rows, int first, int count, ThreadPool &pool)
+        {
+            // Pages hold the level bottom row first like every other
+            // texture, a row going to every virtual row that scales to it
+            struct Target
+            {
+                const unsigned char *row;
+                unsigned char *out;
+            };
+            std::vector<Target> targets;
+            std::vector<int> touched;
+            size_t rowBytes = static_cast<size_t>(sourceWidth) * components;
+            for (int i = 0; i < count; i++)
+            {
+                long long sy = sourceHeight - 1 - (first + i);
+                int begin = static_cast<int>((sy * virtualHeight + sourceHeight - 1) / sourceHeight);
+                int end = static_cast<int>(((sy + 1) * virtualHeight + sourceHeight - 1) / sourceHeight);
+                for (int vy = begin; vy < end; vy++)
+                {
+                    // Its own row of pages, and the border of the one below
+                    // or above
+                    int pageY = vy / virtualPageSize, y = vy % virtualPageSize;
+                    Target target = { rows + i * rowBytes, stripRow(pageY, y + virtualPageBorder, touched) };
+                    targets.push_back(target);
+                    if (y < virtualPageBorder)
+                    {
+                        target.out = stripRow((pageY + pagesY - 1) % pagesY, y + virtualPageSize + virtualPageBorder, touched);
+                        targets.push_back(target);
+                    }
+                    else if (y >= virtualPageSize - virtualPageBorder)
+                    {
+                        target.out = stripRow((pageY + 1) % pagesY, y - virtualPageSize + virtualPageBorder, touched);
+                        targets.push_back(target);
+                    }
+                }
+            }
+
+            pool.parallelFor(targets.size(), [&](size_t i)
+            {
+                expandRow(targets[i].row, targets[i].out);
+            });
+
+            for (size_t i = 0; i < touched.size(); i++)
+            {
+                std::map<int, Strip>::iterator strip = strips.find(touched[i]);
+                if (strip->second.filled < storedPageSize)
+                    continue;
+                if (!writeStrip(strip->first, strip->second, pool))
+                    return false;
+                strips.erase(strip);
+            }
+            return true;
+        }
+
+    private:
+        // Stored rows of a row of pages at virtual width, borders included
+        struct Strip
+        {
+            std::vector<unsigned char> pixels;
+            int filled;
+        };
+
+        FILE *file;
+        size_t firstPage;
+        int pagesX;
+        int pagesY;
+        int sourceWidth;
+        int sourceHeight;
+        int components;
+        int virtualWidth;
+        int virtualHeight;
+        std::vector<int> columns;       // source column of each virtual one
+        std::map<int, Strip> strips;
+        std::vector<unsigned char> pageRow;
+
+        unsigned char *stripRow(int pageY, int y, std::vector<int> &touched)
+        {
+            Strip &strip = strips[pageY];
+            if (strip.pixels.empty())
+            {
+                strip.pixels.resize(static_cast<size_t>(storedPageSize) * virtualWidth * 4);
+                strip.filled = 0;
+            }
+            strip.filled++;
+            if (std::find(touched.begin(), touched.end(), pageY) == touched.end())
+                touched.push_back(pageY);
+            return &strip.pixels[static_cast<size_t>(y) * virtualWidth * 4];
+        }
+
+        void expandRow(const unsigned char *row, unsigned char *out) const
+        {
+            for (int x = 0; x < virtualWidth; x++)
+            {
+                const unsigned char *texel = row + static_cast<size_t>(columns[x]) * components;
+                unsigned char *pixel = out + static_cast<size_t>(x) * 4;
+                if (components >= 3)
+                {
+                    pixel[0] = texel[0];
+                    pixel[1] = texel[1];
+                    pixel[2] = texel[2];
+                }
+                else
+                    pixel[0] = pixel[1] = pixel[2] = texel[0];
+                pixel[3] = components == 4 ? texel[3] : components == 2 ? texel[1] : 255;
+            }
+        }
+
+        // Cuts the strip into its pages, which are next to each other in
+        // the file
+        bool writeStrip(int pageY, const Strip &strip, ThreadPool &pool)
+        {
+            pageRow.resize(static_cast<size_t>(pagesX) * pageBytes);
+            pool.parallelFor(static_cast<size_t>(pagesX), [&](size_t pageX)
+            {
+                unsigned char *page = &pageRow[pageX * pageBytes];
+                int start = (static_cast<int>(pageX) * virtualPageSize - virtualPageBorder + virtualWidth) % virtualWidth;
+                for (int y = 0; y < storedPageSize; y++)
+                {
+                    const unsigned char *row = &strip.pixels[static_cast<size_t>(y) * virtualWidth * 4];
+                    unsigned char *out = page + static_cast<size_t>(y) * storedPageSize * 4;
+                    for (int x = 0, vx = start; x < storedPageSize; vx = 0)
+                    {
+                        int run = std::min(storedPageSize - x, virtualWidth - vx);
+                        memcpy(out + static_cast<size_t>(x) * 4, row + static_cast<size_t>(vx) * 4, static_cast<size_t>(run) * 4);
+                        x += run;
+                    }
+                }
+            });
+            unsigned long long offset = pageDataOffset + static_cast<unsigned long long>(firstPage + static_cast<size_t>(pageY) * pagesX) * pageBytes;
+            return seekFile(file, offset) && fwrite(pageRow.data(), 1, pageRow.size(), file) == pageRow.size();
+        }
+    };
+
+    // The mip chain of the source built a band at a time, each level from
+    // the rows of the one above as they come in, and handed to the writers
+    // of the page levels cut from it. Same levels as generateMipChain's of
+    // the flipped image: pairs of rows count from the bottom, so a level of
+    // odd height drops its top row rather than its bottom one.
+    class BandedMipChain
+    {
+    public:
+        BandedMipChain(int width, int height, int components, int numLevels)
+            : width(width), height(height), components(components), levels(numLevels)
+        {
+        }
+
+        void addWriter(int level, PageLevelWriter *writer)
+        {
+            levels[level].writers.push_back(writer);
+        }
+
+        // Rows of level 0, top first
+        bool addRows(const unsigned char *rows, int count, ThreadPool &pool)
+        {
+            return addLevelRows(0, rows, count, pool);
+        }
+
+    private:
+        struct Level
+        {
+            std::vector<PageLevelWriter*> writers;
+            std::vector<unsigned char> carried;     // top row of a pair still missing its bottom one
+            int received;
+
+            Level() : received(0) {}
+        };
+
+        int width;
+        int height;
+        int components;
+        std::vector<Level> levels;
+
+        int levelWidth(int level) const { return std::max(width >> level, 1); }
+        int levelHeight(int level) const { return std::max(height >> level, 1); }
+
+        bool addLevelRows(int level, const unsigned char *rows, int count, ThreadPool &pool)
+        {
+            Level &current = levels[level];
+            int first = current.received;
+            current.received += count;
+            for (size_t i = 0; i < current.writers.size(); i++)
+                if (!current.writers[i]->addRows(rows, first, count, pool))
+                    return false;
+            if (level + 1 == static_cast<int>(levels.size()))
+                return true;
+
+            int levelRows = levelHeight(level);
+            size_t rowBytes = static_cast<size_t>(levelWidth(level)) * components;
+            if (levelRows % 2 == 1 && levelRows > 1 && first == 0)
+            {
+                rows += rowBytes;
+                count--;
+            }
+
+            std::vector<unsigned char> joined;
+            if (!current.carried.empty() && count > 0)
+            {
+                joined.swap(current.carried);
+                joined.insert(joined.end(), rows, rows + count * rowBytes);
+                rows = joined.data();
+                count++;
+            }
+            if (levelRows > 1 && count % 2 == 1)
+                current.carried.assign(rows + (count - 1) * rowBytes, rows + count * rowBytes);
+
+            // A level one row high is averaged with itself
+            int pairs = levelRows == 1 ? count : count / 2;
+            if (pairs == 0)
+                return true;
+            std::vector<unsigned char> next(static_cast<size_t>(pairs) * levelWidth(level + 1) * components);
+            downsampleLevel(rows, levelWidth(level), levelRows == 1 ? 1 : pairs * 2, components, MIP_SRGB, next.data(), pool);
+            return addLevelRows(level + 1, next.data(), pairs, pool);
+        }
+    };
+}
+
+std::string virtualTexturePath(const char *sourcePath)
+{
+    return std::string(sourcePath) + ".vtex";
+}
+
+bool cookVirtualTexture(const char *sourcePath, ThreadPool &pool)
+{
+    unsigned long long size = 0;
+    long long modified = 0;
+    if (!getFileInfo(sourcePath, size, modified))
+        return false;
+
+    std::string path = virtualTexturePath(sourcePath);
+    {
+        MappedFile existing;
+        PageFileHeader header;
+        if (existing.open(path.c_str()) && readHeader(existing.data(), existing.size(), header) &&
+            header.sourceSize == size && header.sourceModified == modified)
+            return true;
+    }
+
+    // Rows come top first, a band at a time, and every level is built and
+    // paged as they do, so only a band and the rows of pages still missing
+    // rows are ever in memory
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BandDecoder source;
+    if (!source.open(sourcePath))
+        return false;
+    int width = source.width(), height = source.height(), components = source.components();
+
+    PageFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, pageFileMagic, 4);
+    header.version = virtualPageFileVersion;
+    header.sourceSize = size;
+    header.sourceModified = modified;
+    header.pagesX = nextPowerOfTwo((width + virtualPageSize - 1) / virtualPageSize);
+    header.pagesY = nextPowerOfTwo((height + virtualPageSize - 1) / virtualPageSize);
+    header.pageSize = virtualPageSize;
+    header.border = virtualPageBorder;
+    if (header.pagesX > maxPagesPerSide || header.pagesY > maxPagesPerSide)
+    {
+        printf("%s is too big for a virtual texture\n", sourcePath);
+        return false;
+    }
+
+    // Written aside and swapped in, like the texture containers. Pages go
+    // in as their rows complete, not in order.
+    std::string tempPath = path + ".tmp";
+    FILE *out = fopen(tempPath.c_str(), "wb");
+    if (out == NULL)
+        return false;
+    static const char zeros[pageDataOffset] = { 0 };
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(zeros, 1, pageDataOffset - sizeof(header), out) == pageDataOffset - sizeof(header);
+
+    // Page levels past the end of the image's chain are cut from its 1x1
+    int numLevels = static_cast<int>(mipLevelCount(header.pagesX, header.pagesY));
+    int chainLevels = std::min(numLevels, static_cast<int>(mipLevelCount(width, height)));
+    size_t numPages = firstPage(header.pagesX, header.pagesY, numLevels);
+    BandedMipChain chain(width, height, components, chainLevels);
+    std::vector<std::unique_ptr<PageLevelWriter> > writers;
+    for (int level = 0; level < numLevels; level++)
+    {
+        int chainLevel = std::min(level, chainLevels - 1);
+        writers.emplace_back(new PageLevelWriter(out, firstPage(header.pagesX, header.pagesY, level),
+                                                 std::max(header.pagesX >> level, 1), std::max(header.pagesY >> level, 1),
+                                                 std::max(width >> chainLevel, 1), std::max(height >> chainLevel, 1), components));
+        chain.addWriter(chainLevel, writers.back().get());
+    }
+
+    std::vector<unsigned char> band(static_cast<size_t>(width) * components * cookBandRows);
+    while (ok && source.rowsRead() < height)
+    {
+        int rows = source.read(band.data(), cookBandRows);
+        ok = rows > 0 && chain.addRows(band.data(), rows, pool);
+    }
+    if (!ok && source.failed())
+        printf("%s is corrupt after row %d\n", sourcePath, source.rowsRead());
+    source.close();
+    writers.clear();
+
+    ok = fclose(out) == 0 && ok;
+    if (ok)
+    {
+        remove(path.c_str());
+        ok = rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("Cooked %s into %zu pages of %d levels in %.0f ms\n", sourcePath, numPages, numLevels, milliseconds);
+    return true;
+}
+
+VirtualTexture::VirtualTexture(int slotsPerSide, int feedbackScale, ThreadPool &pool)
+    : pool(pool), slotsPerSide(std::min(std::max(slotsPerSide, 1), 256)), feedbackScale(std::max(feedbackScale, 1)),
+      physicalTexture(0), pageTableTexture(0), feedbackFramebuffer(0), feedbackColour(0), feedbackDepth(0),
+      feedbackIndex(0), feedbackWidth(0), feedbackHeight(0), savedFramebuffer(0)
+{
+    feedbackBuffers[0] = feedbackBuffers[1] = 0;
+    feedbackWritten[0] = feedbackWritten[1] = false;
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    close();
+}
+
+bool VirtualTexture::open(const char *sourcePath)
+{
+    close();
+    if (!cookVirtualTexture(sourcePath, pool))
+    {
+        printf("Virtual texture %s couldn't be opened\n", sourcePath);
+        return false;
+    }
+    return openCooked(sourcePath);
+}
+
+void VirtualTexture::openAsync(const char *sourcePath)
+{
+    close();
+    cookingPath = sourcePath;
+    ThreadPool *cookPool = &pool;
+    std::string path = sourcePath;
+    cooking = pool.submit([cookPool, path]() { return cookVirtualTexture(path.c_str(), *cookPool); });
+}
+
+bool VirtualTexture::openCooked(const char *sourcePath)
+{
+    std::string path = virtualTexturePath(sourcePath);
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    PageFileHeader header;
+    if (!file->open(path.c_str(), MAPPED_RANDOM) || !readHeader(file->data(), file->size(), header))
+    {
+        printf("Virtual texture %s couldn't be opened\n", sourcePath);
+        return false;
+    }
+
+    pageFile = file;
+    table.reset(new PageTable(header.pagesX, header.pagesY, slotsPerSide * slotsPerSide));
+    for (int level = 0; level < table->numLevels(); level++)
+        levelFirstPage.push_back(firstPage(header.pagesX, header.pagesY, level));
+
+    // The cache is filtered within a page only, the border takes care of
+    // the edges. Nothing is mipmapped, the page table picks the level.
+    int physicalSize = slotsPerSide * storedPageSize;
+    glGenTextures(1, &physicalTexture);
+    glBindTexture(GL_TEXTURE_2D, physicalTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, physicalSize, physicalSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // A texel per page, read with texelFetch
+    glGenTextures(1, &pageTableTexture);
+    glBindTexture(GL_TEXTURE_2D, pageTableTexture);
+    for (int level = 0; level < table->numLevels(); level++)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, table->levelPagesX(level), table->levelPagesY(level), 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, table->numLevels() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    uploadPageTable();
+    return true;
+}
+
+void VirtualTexture::close()
+{
+    // A cook still running finishes on its own, its page file is only
+    // opened by update()
+    cooking = std::future<bool>();
+    for (size_t i = 0; i < reads.size(); i++)
+        reads[i].pixels.wait();
+    reads.clear();
+    if (table == nullptr)
+        return;
+
+    glDeleteTextures(1, &physicalTexture);
+    glDeleteTextures(1, &pageTableTexture);
+    if (feedbackFramebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &feedbackFramebuffer);
+        glDeleteRenderbuffers(1, &feedbackColour);
+        glDeleteRenderbuffers(1, &feedbackDepth);
+        glDeleteBuffers(2, feedbackBuffers);
+    }
+    physicalTexture = pageTableTexture = feedbackFramebuffer = feedbackColour = feedbackDepth = 0;
+    feedbackBuffers[0] = feedbackBuffers[1] = 0;
+    feedbackWritten[0] = feedbackWritten[1] = false;
+    feedbackWidth = feedbackHeight = 0;
+    table.reset();
+    pageFile.reset();
+    levelFirstPage.clear();
+}
+
+void VirtualTexture::beginFeedback(int viewportWidth, int viewportHeight)
+{
+    int width = std::max(viewportWidth / feedbackScale, 1);
+    int height = std::max(viewportHeight / feedbackScale, 1);
+    if (feedbackFramebuffer == 0 || width != feedbackWidth || height != feedbackHeight)
+    {
+        if (feedbackFramebuffer == 0)
+        {
+            glGenFramebuffers(1, &feedbackFramebuffer);
+            glGenRenderbuffers(1, &feedbackColour);
+            glGenRenderbuffers(1, &feedbackDepth);
+            glGenBuffers(2, feedbackBuffers);
+        }
+        feedbackWidth = width;
+        feedbackHeight = height;
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackColour);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 4, NULL, GL_STREAM_READ);
+            feedbackWritten[i] = false;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColour);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+    }
+
+    // Alpha 0 is a pixel that wants no page
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::endFeedback()
+{
+    // Into a buffer, mapped by the update() of the next frame
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[feedbackIndex]);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedbackWritten[feedbackIndex] = true;
+    feedbackIndex ^= 1;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+void VirtualTexture::update(size_t maxLoads, size_t maxUploads)
+{
+    if (cooking.valid() && cooking.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        bool cooked = cooking.get();
+        if (!cooked)
+            printf("Virtual texture %s couldn't be opened\n", cookingPath.c_str());
+        else
+            openCooked(cookingPath.c_str());
+    }
+    if (table == nullptr)
+        return;
+
+    table->beginFrame();
+    readFeedback();
+
+    // Reads copy the page out of the mapping, so the disk is only touched
+    // on the workers
+    std::vector<PageLoad> loads = table->update(maxLoads);
+    for (size_t i = 0; i < loads.size(); i++)
+    {
+        PageRead read;
+        read.load = loads[i];
+        std::shared_ptr<MappedFile> file = pageFile;
+        size_t offset = pageOffset(loads[i]);
+        read.pixels = pool.submit([file, offset]()
+        {
+            const unsigned char *page = reinterpret_cast<const unsigned char*>(file->data()) + offset;
+            return std::vector<unsigned char>(page, page + pageBytes);
+        });
+        reads.push_back(std::move(read));
+    }
+
+    size_t uploads = 0;
+    glBindTexture(GL_TEXTURE_2D, physicalTexture);
+    for (size_t i = 0; i < reads.size() && uploads < maxUploads; )
+    {
+        if (reads[i].pixels.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            i++;
+            continue;
+        }
+        const PageLoad &load = reads[i].load;
+        std::vector<unsigned char> pixels = reads[i].pixels.get();
+        int slotX = load.slot % slotsPerSide, slotY = load.slot / slotsPerSide;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, slotX * storedPageSize, slotY * storedPageSize, storedPageSize, storedPageSize,
+                        GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        table->pageLoaded(load.level, load.x, load.y);
+        reads.erase(reads.begin() + i);
+        uploads++;
+    }
+    uploadPageTable();
+}
+
+void VirtualTexture::bind(unsigned int program, int pageTableUnit, int physicalUnit) const
+{
+    if (table == nullptr)
+        return;
+    glActiveTexture(GL_TEXTURE0 + pageTableUnit);
+    glBindTexture(GL_TEXTURE_2D, pageTableTexture);
+    glActiveTexture(GL_TEXTURE0 + physicalUnit);
+    glBindTexture(GL_TEXTURE_2D, physicalTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    // The feedback program has no samplers, the main one no bias
+    glUniform1i(glGetUniformLocation(program, "pageTable"), pageTableUnit);
+    glUniform1i(glGetUniformLocation(program, "physicalPages"), physicalUnit);
+    glUniform2f(glGetUniformLocation(program, "virtualPages"),
+                static_cast<float>(table->levelPagesX(0)), static_cast<float>(table->levelPagesY(0)));
+    glUniform1i(glGetUniformLocation(program, "virtualLevels"), table->numLevels());
+    glUniform1f(glGetUniformLocation(program, "pageSize"), static_cast<float>(virtualPageSize));
+    glUniform1f(glGetUniformLocation(program, "pageBorder"), static_cast<float>(virtualPageBorder));
+    glUniform1f(glGetUniformLocation(program, "physicalSize"), static_cast<float>(slotsPerSide * storedPageSize));
+    glUniform1f(glGetUniformLocation(program, "feedbackBias"), std::log2(static_cast<float>(feedbackScale)));
+}
+
+PageTableStats VirtualTexture::stats() const
+{
+    if (table == nullptr)
+    {
+        PageTableStats none;
+        memset(&none, 0, sizeof(none));
+        return none;
+    }
+    return table->stats();
+}
+
+size_t VirtualTexture::pageOffset(const PageLoad &load) const
+{
+    size_t page = levelFirstPage[load.level] + static_cast<size_t>(load.y) * table->levelPagesX(load.level) + load.x;
+    return pageDataOffset + page * pageBytes;
+}
+
+void VirtualTexture::readFeedback()
+{
+    // The buffer written a frame ago, the next one to be written
+    int index = feedbackIndex;
+    if (!feedbackWritten[index])
+        return;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[index]);
+    size_t pixels = static_cast<size_t>(feedbackWidth) * feedbackHeight;
+    const unsigned char *feedback = static_cast<const unsigned char*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixels * 4, GL_MAP_READ_BIT));
+    if (feedback != NULL)
+    {
+        // Neighbouring pixels mostly want the same page, the table drops
+        // repeats within a frame
+        for (size_t i = 0; i < pixels; i++)
+        {
+            const unsigned char *pixel = feedback + i * 4;
+            if (pixel[3] != 0)
+                table->request(pixel[2], pixel[0], pixel[1]);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedbackWritten[index] = false;
+}
+
+void VirtualTexture::uploadPageTable()
+{
+    // The slot as x and y in the cache, the level of the page in it
+    std::vector<unsigned char> texels;
+    glBindTexture(GL_TEXTURE_2D, pageTableTexture);
+    for (int level = 0; level < table->numLevels(); level++)
+    {
+        if (!table->isDirty(level))
+            continue;
+        const std::vector<PageTableEntry> &entries = table->levelEntries(level);
+        texels.resize(entries.size() * 4);
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            texels[i * 4 + 0] = static_cast<unsigned char>(entries[i].slot % slotsPerSide);
+            texels[i * 4 + 1] = static_cast<unsigned char>(entries[i].slot / slotsPerSide);
+            texels[i * 4 + 2] = entries[i].level;
+            texels[i * 4 + 3] = entries[i].valid ? 255 : 0;
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, table->levelPagesX(level), table->levelPagesY(level),
+                        GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        table->clearDirty(level);
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <future>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include <common/pagetable.hpp>
+#include <common/mappedfile.hpp>
+#include <common/threadpool.hpp>
+
+// Texels of a page inside its border, and the border copied around it from
+// the neighbouring pages so bilinear filtering never reads another slot
+const int virtualPageSize = 128;
+const int virtualPageBorder = 4;
+
+// Bumped whenever the page file layout or how pages are cooked changes
+const unsigned int virtualPageFileVersion = 1;
+
+// Page file cooked from a source image, next to it
+std::string virtualTexturePath(const char *sourcePath);
+
+// Tiles every mip level of sourcePath into RGBA pages with borders and
+// writes them to the page file, unless one for the same source is already
+// there. Level 0 is padded to a power of two pages each way by scaling the
+// image. The image is decoded, mipmapped and paged a band of rows at a
+// time, so it never has to fit in memory whole. Safe on any thread.
+bool cookVirtualTexture(const char *sourcePath, ThreadPool &pool = ThreadPool::shared());
+
+// Texture far bigger than it takes on the GPU. Only pages something on
+// screen needs are resident, in the slots of a physical cache texture, and
+// a page table texture with a level per mip level says which slot every
+// page is read from. A low resolution feedback pass writes the page and
+// level each pixel wants, update() reads it a frame later, loads the
+// missing pages on the pool and copies them into the cache. The shaders
+// sample through the page table, see sampleVirtual in fragmentShader.glsl.
+// Everything but the page reads runs on the GL thread.
+class VirtualTexture
+{
+public:
+    // slotsPerSide squared pages fit in the cache, the feedback is drawn at
+    // 1/feedbackScale of the viewport each way
+    explicit VirtualTexture(int slotsPerSide = 8, int feedbackScale = 8, ThreadPool &pool = ThreadPool::shared());
+
+    // Calls close()
+    ~VirtualTexture();
+
+    // Cooks the page file if needed, maps it and creates the textures
+    bool open(const char *sourcePath);
+
+    // Like open() but the cook runs on the pool, which can take seconds
+    // for a big image. update() maps the page file and creates the
+    // textures once it is done, isOpen() is false until then.
+    void openAsync(const char *sourcePath);
+    bool isOpening() const { return cooking.valid(); }
+
+    // Waits for page reads and deletes the GL objects, has to run before
+    // the context goes
+    void close();
+
+    bool isOpen() const { return table != nullptr; }
+
+    // Between these, draw the virtually textured surfaces with a program
+    // using feedbackShader.glsl, after bind() on it. The previous
+    // framebuffer and viewport are put back.
+    void beginFeedback(int viewportWidth, int viewportHeight);
+    void endFeedback();
+
+    // Requests the pages last frame's feedback asked for, starts reading
+    // up to maxLoads missing ones and copies up to maxUploads read pages
+    // into the cache
+    void update(size_t maxLoads = 8, size_t maxUploads = 8);
+
+    // Binds the page table and cache to two texture units and sets the
+    // uniforms of program, which has to be in use
+    void bind(unsigned int program, int pageTableUnit, int physicalUnit) const;
+
+    PageTableStats stats() const;
+
+private:
+    struct PageRead
+    {
+        PageLoad load;
+        std::future<std::vector<unsigned char> > pixels;
+    };
+
+    ThreadPool &pool;
+    int slotsPerSide;
+    int feedbackScale;
+    std::unique_ptr<PageTable> table;
+    std::shared_ptr<MappedFile> pageFile;
+    std::vector<size_t> levelFirstPage;
+    std::deque<PageRead> reads;
+    std::future<bool> cooking;          // openAsync's cook, until update() sees it done
+    std::string cookingPath;
+
+    unsigned int physicalTexture;
+    unsigned int pageTableTexture;
+    unsigned int feedbackFramebuffer;
+    unsigned int feedbackColour;
+    unsigned int feedbackDepth;
+    unsigned int feedbackBuffers[2];    // read back a frame late so nothing stalls
+    bool feedbackWritten[2];
+    int feedbackIndex;
+    int feedbackWidth;
+    int feedbackHeight;
+    int savedFramebuffer;
+    int savedViewport[4];
+
+    bool openCooked(const char *sourcePath);
+    size_t pageOffset(const PageLoad &load) const;
+    void readFeedback();
+    void uploadPageTable();
+
+    VirtualTexture(const VirtualTexture &);
+    VirtualTexture &operator=(const VirtualTexture &);
+};
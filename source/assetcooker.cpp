@@ -0,0 +1,645 @@
+//asset cooker. Cooks everything under the asset directories (../assets by
+//default, run from source/ like the coursework) into what the coursework
+//loads at runtime: block compressed, mipmapped texture containers for the
+//images, cooked meshes with their packed materials for the OBJ models and
+//page files for the virtual textures. Jobs run on every core.
+//
+//A manifest remembers the content hash of each job's source and the files
+//it depends on, the tool version and options it was cooked with and the
+//outputs it wrote, so a rerun only cooks what changed. Sources that were
+//touched but not changed only cost a hash.
+//
+//With --pack everything cooked, what it was cooked from and the --include
+//files (the coursework's shaders by default) are packed into one asset
+//pack the coursework mounts at startup.
+//
+//usage: asset_cooker [--force] [--uncompressed] [--no-bc7] [--threads n]
+//                    [--manifest file] [--virtual image]...
+//                    [--pack file [--include file]... [--store]] [directory or file]...
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/decodearena.hpp>
+#include <common/stb_image.hpp>
+
+#include <map>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <future>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+#include <common/model.hpp>
+#include <common/meshcache.hpp>
+#include <common/vertexformat.hpp>
+#include <common/texturecook.hpp>
+#include <common/virtualtexture.hpp>
+#include <common/threadpool.hpp>
+#include <common/mappedfile.hpp>
+#include <common/assetpack.hpp>
+#include <common/hash.hpp>
+
+namespace
+{
+    //bumped whenever the cooker changes what it writes in a way the
+    //format versions don't cover
+    const unsigned int cookerVersion = 1;
+
+    const char manifestHeader[] = "asset cook manifest 1";
+
+    //what the coursework loads, textures are flipped for GL
+    const bool textureFlip = true;
+    const unsigned int meshFlags = MODEL_OPTIMISE | MODEL_LOD | MODEL_MESHLETS;
+    const unsigned int meshLodLevels = 3;
+
+    enum JobKind
+    {
+        JOB_TEXTURE,
+        JOB_MESH,
+        JOB_VIRTUAL
+    };
+
+    const char *const jobKindNames[] = { "texture", "mesh", "virtual" };
+
+    struct ManifestFile
+    {
+        std::string path;
+        unsigned long long size;
+        long long modified;
+        unsigned long long hash;        //inputs only, outputs are checked by size and time
+    };
+
+    //one job as it was last cooked, the source is the first input
+    struct ManifestEntry
+    {
+        JobKind kind;
+        unsigned long long recipe;      //hash of the tool and format versions and options
+        std::vector<ManifestFile> inputs;
+        std::vector<ManifestFile> outputs;
+    };
+
+    struct CookJob
+    {
+        JobKind kind;
+        std::string source;
+        unsigned long long recipe;
+    };
+
+    enum JobOutcome
+    {
+        JOB_UP_TO_DATE,
+        JOB_COOKED,
+        JOB_FAILED
+    };
+
+    struct JobResult
+    {
+        JobOutcome outcome;
+        const char *reason;             //why it was cooked
+        std::vector<std::string> details;   //lines on what was built, printed after it
+        ManifestEntry entry;
+        double milliseconds;
+    };
+
+    struct CookOptions
+    {
+        bool force;
+        unsigned int formats;
+    };
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    //hashes a whole file, 0 if it can't be read
+    unsigned long long hashFile(const char *path)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return 0;
+        return hashBytes(file.data(), file.size());
+    }
+
+    bool hasExtension(const std::string &path, const char *extension)
+    {
+        size_t length = strlen(extension);
+        if (path.size() < length)
+            return false;
+        for (size_t i = 0; i < length; i++)
+            if (tolower(static_cast<unsigned char>(path[path.size() - length + i])) != extension[i])
+                return false;
+        return true;
+    }
+
+    bool isImage(const std::string &path)
+    {
+        static const char *const extensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+        for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+            if (hasExtension(path, extensions[i]))
+                return true;
+        return false;
+    }
+
+    bool isModel(const std::string &path)
+    {
+        return hasExtension(path, ".obj");
+    }
+
+    std::string jobKey(JobKind kind, const std::string &source)
+    {
+        return std::string(jobKindNames[kind]) + " " + source;
+    }
+
+    //everything besides the sources that decides what a job writes
+    unsigned long long jobRecipe(JobKind kind, const CookOptions &options)
+    {
+        char recipe[256];
+        if (kind == JOB_TEXTURE)
+            snprintf(recipe, sizeof(recipe), "cooker %u texture %u flip %d formats %x", cookerVersion,
+                     textureContainerVersion, textureFlip ? 1 : 0, options.formats);
+        else if (kind == JOB_MESH)
+            snprintf(recipe, sizeof(recipe), "cooker %u mesh %u options %x", cookerVersion,
+                     MeshCache::version, meshFlags | (meshLodLevels << 16));
+        else
+            snprintf(recipe, sizeof(recipe), "cooker %u virtual %u page %d border %d", cookerVersion,
+                     virtualPageFileVersion, virtualPageSize, virtualPageBorder);
+        return hashBytes(recipe, strlen(recipe));
+    }
+
+    std::string restOfLine(const char *text)
+    {
+        std::string rest(text);
+        while (!rest.empty() && (rest[rest.size() - 1] == '\n' || rest[rest.size() - 1] == '\r'))
+            rest.erase(rest.size() - 1);
+        return rest;
+    }
+
+    //one line for the job, then a line for each input and output:
+    //  job <kind> <recipe> <source>
+    //  in <size> <modified> <hash> <path>
+    //  out <size> <modified> <path>
+    //paths are last so they can hold spaces
+    std::map<std::string, ManifestEntry> readManifest(const char *path)
+    {
+        std::map<std::string, ManifestEntry> entries;
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+            return entries;
+        char line[4096];
+        if (fgets(line, sizeof(line), file) == NULL || strncmp(line, manifestHeader, strlen(manifestHeader)) != 0)
+        {
+            fclose(file);
+            return entries;
+        }
+
+        ManifestEntry *entry = NULL;
+        while (fgets(line, sizeof(line), file) != NULL)
+        {
+            char kind[16];
+            ManifestFile record;
+            int length = 0;
+            bool parsed = false;
+            if (sscanf(line, "job %15s %llx %n", kind, &record.hash, &length) == 2)
+            {
+                entry = NULL;
+                for (int i = JOB_TEXTURE; i <= JOB_VIRTUAL; i++)
+                {
+                    if (strcmp(kind, jobKindNames[i]) != 0)
+                        continue;
+                    entry = &entries[jobKey(static_cast<JobKind>(i), restOfLine(line + length))];
+                    entry->kind = static_cast<JobKind>(i);
+                    entry->recipe = record.hash;
+                }
+                continue;
+            }
+            if (entry == NULL)
+                continue;
+            if (sscanf(line, "in %llu %lld %llx %n", &record.size, &record.modified, &record.hash, &length) == 3)
+                parsed = true;
+            else if (sscanf(line, "out %llu %lld %n", &record.size, &record.modified, &length) == 2)
+            {
+                record.hash = 0;
+                parsed = true;
+            }
+            if (!parsed)
+                continue;
+            record.path = restOfLine(line + length);
+            (line[0] == 'i' ? entry->inputs : entry->outputs).push_back(record);
+        }
+        fclose(file);
+        return entries;
+    }
+
+    //written aside and swapped in, so an interrupted run leaves the old one
+    bool writeManifest(const char *path, const std::vector<JobResult> &results)
+    {
+        std::string tempPath = std::string(path) + ".tmp";
+        FILE *out = fopen(tempPath.c_str(), "w");
+        if (out == NULL)
+            return false;
+        bool ok = fprintf(out, "%s\n", manifestHeader) > 0;
+        for (size_t i = 0; i < results.size() && ok; i++)
+        {
+            //failed jobs are left out so the next run tries them again
+            const ManifestEntry &entry = results[i].entry;
+            if (results[i].outcome == JOB_FAILED || entry.inputs.empty())
+                continue;
+            ok = fprintf(out, "job %s %016llx %s\n", jobKindNames[entry.kind], entry.recipe, entry.inputs[0].path.c_str()) > 0;
+            for (size_t j = 0; j < entry.inputs.size() && ok; j++)
+                ok = fprintf(out, "in %llu %lld %016llx %s\n", entry.inputs[j].size, entry.inputs[j].modified,
+                             entry.inputs[j].hash, entry.inputs[j].path.c_str()) > 0;
+            for (size_t j = 0; j < entry.outputs.size() && ok; j++)
+                ok = fprintf(out, "out %llu %lld %s\n", entry.outputs[j].size, entry.outputs[j].modified,
+                             entry.outputs[j].path.c_str()) > 0;
+        }
+        ok = fclose(out) == 0 && ok;
+        if (ok)
+        {
+            remove(path);
+            ok = rename(tempPath.c_str(), path) == 0;
+        }
+        if (!ok)
+            remove(tempPath.c_str());
+        return ok;
+    }
+
+    //how far the last cook of a job still holds:
+    //  STALE    - rebuild from scratch
+    //  TOUCHED  - sources were touched but not changed, or outputs were
+    //             changed since; let the cook functions check their outputs
+    //  CURRENT  - nothing to do
+    enum Freshness
+    {
+        FRESHNESS_STALE,
+        FRESHNESS_TOUCHED,
+        FRESHNESS_CURRENT
+    };
+
+    Freshness checkEntry(const ManifestEntry &entry, unsigned long long recipe, ManifestEntry &updated, const char *&reason)
+    {
+        updated = entry;
+        if (entry.recipe != recipe)
+        {
+            reason = "tool version or options changed";
+            return FRESHNESS_STALE;
+        }
+        Freshness freshness = FRESHNESS_CURRENT;
+        for (size_t i = 0; i < updated.inputs.size(); i++)
+        {
+            ManifestFile &input = updated.inputs[i];
+            unsigned long long size;
+            long long modified;
+            if (!getFileInfo(input.path.c_str(), size, modified) || size != input.size)
+            {
+                reason = "source changed";
+                return FRESHNESS_STALE;
+            }
+            if (modified == input.modified)
+                continue;
+            if (hashFile(input.path.c_str()) != input.hash)
+            {
+                reason = "source changed";
+                return FRESHNESS_STALE;
+            }
+            input.modified = modified;
+            reason = "source touched";
+            freshness = FRESHNESS_TOUCHED;
+        }
+        for (size_t i = 0; i < entry.outputs.size(); i++)
+        {
+            unsigned long long size;
+            long long modified;
+            if (!getFileInfo(entry.outputs[i].path.c_str(), size, modified) ||
+                size != entry.outputs[i].size || modified != entry.outputs[i].modified)
+            {
+                reason = "output missing or changed";
+                return FRESHNESS_TOUCHED;
+            }
+        }
+        return freshness;
+    }
+
+    //triangles and error of each LOD of a cooked model, its meshlets and
+    //how far packing moved its vertices
+    std::vector<std::string> describeMesh(const Model &model)
+    {
+        std::vector<std::string> details(1);
+        size_t numSubmeshes = model.submeshes.size() / std::max<size_t>(model.lodErrors.size(), 1);
+        for (size_t lod = 0; lod < model.lodErrors.size(); lod++)
+        {
+            size_t numIndices = 0;
+            for (size_t i = 0; i < numSubmeshes; i++)
+                numIndices += model.submeshes[lod * numSubmeshes + i].numIndices;
+            char text[96];
+            if (lod == 0)
+                snprintf(text, sizeof(text), "%zu triangles", numIndices / 3);
+            else
+                snprintf(text, sizeof(text), ", LOD %zu %zu error %g", lod, numIndices / 3, model.lodErrors[lod]);
+            details[0] += text;
+        }
+        if (!model.meshlets.empty())
+        {
+            char text[96];
+            snprintf(text, sizeof(text), ", %zu meshlets of up to %u vertices and %u triangles",
+                     model.meshlets.size(), maxMeshletVertices, maxMeshletTriangles);
+            details[0] += text;
+        }
+
+        //the model keeps its unpacked vertices when it was cooked rather than mapped
+        if (!model.vertices.empty())
+        {
+            std::vector<PackedVertex> packed(model.vertices.size());
+            packVertices(model.vertices.data(), model.uvs.data(), model.normals.data(), model.tangents.data(),
+                         model.vertices.size(), model.bounds, packed.data());
+            PackingError error = measurePackingError(packed.data(), model.vertices.data(), model.uvs.data(),
+                                                     model.normals.data(), model.tangents.data(),
+                                                     model.vertices.size(), model.bounds);
+            char text[160];
+            snprintf(text, sizeof(text), "packed vertices max error position %g, normal %.3f degrees, uv %g, "
+                     "tangent %.3f degrees", error.position, error.normalDegrees, error.uv, error.tangentDegrees);
+            details.push_back(text);
+        }
+        return details;
+    }
+
+    //runs the engine's own cook of the job, which keeps outputs it finds
+    //valid, and gives the files it read and wrote
+    bool cookJob(const CookJob &job, const CookOptions &options, ThreadPool &pool,
+                 std::vector<std::string> &inputs, std::vector<std::string> &outputs, std::vector<std::string> &details)
+    {
+        const char *source = job.source.c_str();
+        inputs.push_back(job.source);
+        if (job.kind == JOB_TEXTURE)
+        {
+            DecodedImage image;
+            if (!cookTexture(source, textureFlip, options.formats, image, pool))
+                return false;
+            outputs.push_back(cookedTexturePath(source, textureFlip));
+        }
+        else if (job.kind == JOB_MESH)
+        {
+            //materials are packed into the cooked mesh, the libraries it
+            //read come back as its dependencies
+            Model model;
+            if (!model.load(source, meshFlags, meshLodLevels))
+                return false;
+            MeshCache cache;
+            if (!cache.open(source, meshFlags | (meshLodLevels << 16)))
+                return false;
+            inputs.insert(inputs.end(), cache.dependencies().begin(), cache.dependencies().end());
+            outputs.push_back(MeshCache::cachePath(source));
+            details = describeMesh(model);
+        }
+        else
+        {
+            if (!cookVirtualTexture(source, pool))
+                return false;
+            outputs.push_back(virtualTexturePath(source));
+        }
+        return true;
+    }
+
+    std::vector<std::string> outputPaths(const CookJob &job)
+    {
+        std::vector<std::string> paths;
+        if (job.kind == JOB_TEXTURE)
+            paths.push_back(cookedTexturePath(job.source.c_str(), textureFlip));
+        else if (job.kind == JOB_MESH)
+            paths.push_back(MeshCache::cachePath(job.source.c_str()));
+        else
+            paths.push_back(virtualTexturePath(job.source.c_str()));
+        return paths;
+    }
+
+    JobResult runJob(const CookJob &job, const ManifestEntry *previous, const CookOptions &options, ThreadPool &pool)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        JobResult result;
+        result.outcome = JOB_COOKED;
+        result.reason = options.force ? "forced" : "new";
+        result.milliseconds = 0.0;
+
+        Freshness freshness = FRESHNESS_STALE;
+        if (previous != NULL && !options.force)
+            freshness = checkEntry(*previous, job.recipe, result.entry, result.reason);
+        if (freshness == FRESHNESS_CURRENT)
+        {
+            result.outcome = JOB_UP_TO_DATE;
+            result.milliseconds = millisecondsSince(start);
+            return result;
+        }
+
+        //the cook functions keep outputs that look valid to them, which
+        //isn't enough once the sources, versions or options changed
+        if (freshness == FRESHNESS_STALE)
+        {
+            std::vector<std::string> stale = outputPaths(job);
+            for (size_t i = 0; i < stale.size(); i++)
+                remove(stale[i].c_str());
+        }
+
+        std::vector<std::string> inputs, outputs;
+        bool ok = cookJob(job, options, pool, inputs, outputs, result.details);
+        result.entry = ManifestEntry();
+        result.entry.kind = job.kind;
+        result.entry.recipe = job.recipe;
+        for (size_t i = 0; i < inputs.size() && ok; i++)
+        {
+            ManifestFile input;
+            input.path = inputs[i];
+            ok = getFileInfo(input.path.c_str(), input.size, input.modified);
+            input.hash = hashFile(input.path.c_str());
+            result.entry.inputs.push_back(input);
+        }
+        for (size_t i = 0; i < outputs.size() && ok; i++)
+        {
+            ManifestFile output;
+            output.path = outputs[i];
+            output.hash = 0;
+            ok = getFileInfo(output.path.c_str(), output.size, output.modified);
+            result.entry.outputs.push_back(output);
+        }
+        if (!ok)
+            result.outcome = JOB_FAILED;
+        result.milliseconds = millisecondsSince(start);
+        return result;
+    }
+
+    //a directory is searched, anything else is taken as a source. Returns
+    //whether it was a directory.
+    bool addSources(const std::string &path, const CookOptions &options, std::vector<CookJob> &jobs)
+    {
+        std::vector<std::string> files;
+        bool directory = listFiles(path.c_str(), files);
+        if (!directory)
+            files.push_back(path);
+        std::sort(files.begin(), files.end());
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            CookJob job;
+            job.source = files[i];
+            if (isImage(files[i]))
+                job.kind = JOB_TEXTURE;
+            else if (isModel(files[i]))
+                job.kind = JOB_MESH;
+            else
+                continue;
+            job.recipe = jobRecipe(job.kind, options);
+            jobs.push_back(job);
+        }
+        return directory;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    CookOptions options;
+    options.force = false;
+    options.formats = blockFormatBit(BLOCK_BC1) | blockFormatBit(BLOCK_BC3) | blockFormatBit(BLOCK_BC4) |
+                      blockFormatBit(BLOCK_BC5) | blockFormatBit(BLOCK_BC7);
+    unsigned int numThreads = 0;
+    std::string manifestPath;
+    std::vector<std::string> roots;
+    std::vector<std::string> virtualTextures;
+    std::string packPath;
+    std::vector<std::string> packIncludes;
+    bool packCompression = true;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--force") == 0)
+            options.force = true;
+        else if (strcmp(argv[i], "--uncompressed") == 0)
+            options.formats = 0;
+        else if (strcmp(argv[i], "--no-bc7") == 0)
+            options.formats &= ~blockFormatBit(BLOCK_BC7);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            numThreads = static_cast<unsigned int>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc)
+            manifestPath = argv[++i];
+        else if (strcmp(argv[i], "--virtual") == 0 && i + 1 < argc)
+            virtualTextures.push_back(argv[++i]);
+        else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+            packPath = argv[++i];
+        else if (strcmp(argv[i], "--include") == 0 && i + 1 < argc)
+            packIncludes.push_back(argv[++i]);
+        else if (strcmp(argv[i], "--store") == 0)
+            packCompression = false;
+        else if (argv[i][0] == '-')
+        {
+            printf("usage: %s [--force] [--uncompressed] [--no-bc7] [--threads n] [--manifest file]\n"
+                   "       [--virtual image]... [--pack file [--include file]... [--store]] [directory or file]...\n",
+                   argv[0]);
+            return 2;
+        }
+        else
+            roots.push_back(argv[i]);
+    }
+
+    //the coursework's assets, its virtually textured floor and shaders
+    if (roots.empty())
+    {
+        roots.push_back("../assets");
+        if (virtualTextures.empty())
+            virtualTextures.push_back("../assets/stones_diffuse.png");
+        if (packIncludes.empty())
+        {
+            packIncludes.push_back("vertexShader.glsl");
+            packIncludes.push_back("fragmentShader.glsl");
+            packIncludes.push_back("feedbackShader.glsl");
+        }
+    }
+    //the manifest goes in the first directory unless it says otherwise
+    std::vector<CookJob> jobs;
+    for (size_t i = 0; i < roots.size(); i++)
+        if (addSources(roots[i], options, jobs) && manifestPath.empty())
+            manifestPath = roots[i] + "/cook.manifest";
+    if (manifestPath.empty())
+        manifestPath = "cook.manifest";
+    for (size_t i = 0; i < virtualTextures.size(); i++)
+    {
+        CookJob job;
+        job.kind = JOB_VIRTUAL;
+        job.source = virtualTextures[i];
+        job.recipe = jobRecipe(JOB_VIRTUAL, options);
+        jobs.push_back(job);
+    }
+
+    //every job goes on the pool at once, the cooks spread their own work
+    //over it too
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unique_ptr<ThreadPool> ownPool;
+    if (numThreads > 0)
+        ownPool.reset(new ThreadPool(numThreads));
+    ThreadPool &pool = ownPool ? *ownPool : ThreadPool::shared();
+    std::map<std::string, ManifestEntry> manifest = readManifest(manifestPath.c_str());
+    printf("Cooking %zu jobs on %u threads, manifest %s with %zu entries\n", jobs.size(), pool.size(),
+           manifestPath.c_str(), manifest.size());
+
+    std::vector<std::future<JobResult> > running;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        std::map<std::string, ManifestEntry>::const_iterator found = manifest.find(jobKey(jobs[i].kind, jobs[i].source));
+        const ManifestEntry *previous = found != manifest.end() ? &found->second : NULL;
+        CookJob job = jobs[i];
+        running.push_back(pool.submit([job, previous, options, &pool]()
+        {
+            return runJob(job, previous, options, pool);
+        }));
+    }
+
+    std::vector<JobResult> results;
+    size_t counts[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < running.size(); i++)
+    {
+        JobResult result = running[i].get();
+        counts[result.outcome]++;
+        if (result.outcome == JOB_COOKED)
+        {
+            printf("  cooked   %-8s %s (%s) in %.0f ms\n", jobKindNames[jobs[i].kind], jobs[i].source.c_str(),
+                   result.reason, result.milliseconds);
+            for (size_t j = 0; j < result.details.size(); j++)
+                printf("           %s\n", result.details[j].c_str());
+        }
+        else if (result.outcome == JOB_FAILED)
+            printf("  FAILED   %-8s %s\n", jobKindNames[jobs[i].kind], jobs[i].source.c_str());
+        results.push_back(result);
+    }
+
+    if (!writeManifest(manifestPath.c_str(), results))
+        printf("Couldn't write %s\n", manifestPath.c_str());
+    printf("%zu cooked, %zu up to date, %zu failed in %.0f ms\n", counts[JOB_COOKED], counts[JOB_UP_TO_DATE],
+           counts[JOB_FAILED], millisecondsSince(start));
+    if (counts[JOB_FAILED] > 0)
+        return 1;
+
+    //the sources go in too, the loaders check cooked files against them
+    if (!packPath.empty())
+    {
+        std::chrono::steady_clock::time_point packStart = std::chrono::steady_clock::now();
+        std::vector<std::string> packed(packIncludes);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            for (size_t j = 0; j < results[i].entry.inputs.size(); j++)
+                packed.push_back(results[i].entry.inputs[j].path);
+            for (size_t j = 0; j < results[i].entry.outputs.size(); j++)
+                packed.push_back(results[i].entry.outputs[j].path);
+        }
+        std::sort(packed.begin(), packed.end());
+        packed.erase(std::unique(packed.begin(), packed.end()), packed.end());
+        if (!writeAssetPack(packPath.c_str(), packed, packCompression, pool))
+        {
+            printf("Couldn't write %s\n", packPath.c_str());
+            return 1;
+        }
+        unsigned long long size;
+        long long modified;
+        getFileInfo(packPath.c_str(), size, modified);
+        printf("Packed %zu files into %s, %.1f MB in %.0f ms\n", packed.size(), packPath.c_str(),
+               size / (1024.0 * 1024.0), millisecondsSince(packStart));
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+//asset pack test. Round trips random data through the LZ compressor, packs
+//the shaders, a few textures and a generated file that compresses into
+//several blocks, and checks every file reads back from the pack as it was
+//on disk. Then mounts broken copies of the pack: truncated ones and ones
+//with offsets or sizes that overflow must be refused, and a corrupt block
+//must fail to open rather than crash. Exits with 1 if anything fails, runs
+//from source/ without a GPU.
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+#include <common/assetpack.hpp>
+#include <common/mappedfile.hpp>
+#include <common/lzcompress.hpp>
+
+namespace
+{
+    const char *packPath = "asset_pack_test.pack";
+    const char *generatedPath = "asset_pack_test.txt";
+    const char *brokenPath = "asset_pack_test_broken.pack";
+
+    //where writeAssetPack puts the fields the broken packs change
+    const size_t headerBlockSize = 12;
+    const size_t headerNamesOffset = 16;
+    const size_t headerSize = 32;
+    const size_t entrySize = 56;
+    const size_t entryOffset = 8;
+    const size_t entrySizeField = 24;
+    const size_t entryNumBlocks = 48;
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    bool readFile(const char *path, std::vector<char> &data)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+        data.assign(file.data(), file.data() + file.size());
+        return true;
+    }
+
+    bool writeFile(const char *path, const std::vector<char> &data)
+    {
+        FILE *out = fopen(path, "wb");
+        if (out == NULL)
+            return false;
+        bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+        return fclose(out) == 0 && ok;
+    }
+
+    template<typename T> T readField(const std::vector<char> &data, size_t offset)
+    {
+        T value;
+        memcpy(&value, &data[offset], sizeof(T));
+        return value;
+    }
+
+    template<typename T> void writeField(std::vector<char> &data, size_t offset, T value)
+    {
+        memcpy(&data[offset], &value, sizeof(T));
+    }
+
+    //mounts a changed copy of the pack, true if it was taken
+    bool mountBroken(const std::vector<char> &pack)
+    {
+        unmountAssetPacks();
+        return writeFile(brokenPath, pack) && mountAssetPack(brokenPath);
+    }
+
+    void testCompression()
+    {
+        srand(1);
+        int mismatches = 0;
+        for (int test = 0; test < 2000; test++)
+        {
+            //runs of a small alphabet with noise, so there are matches and literals
+            size_t size = 1 + rand() % 5000;
+            int alphabet = 1 + rand() % 8;
+            std::vector<char> data(size);
+            for (size_t i = 0; i < size; i++)
+                data[i] = static_cast<char>(rand() % 4 == 0 ? rand() % 256 : 'a' + rand() % alphabet);
+
+            std::vector<char> compressed(lzCompressBound(size)), decompressed(size);
+            size_t compressedSize = lzCompress(data.data(), size, compressed.data());
+            if (!lzDecompress(compressed.data(), compressedSize, decompressed.data(), size) ||
+                memcmp(data.data(), decompressed.data(), size) != 0)
+                mismatches++;
+
+            //flipped bits and short blocks can decode to anything but mustn't crash
+            for (int flip = 0; flip < 4 && compressedSize != 0; flip++)
+            {
+                std::vector<char> corrupt(compressed.begin(), compressed.begin() + compressedSize);
+                corrupt[rand() % compressedSize] ^= static_cast<char>(1 << (rand() % 8));
+                lzDecompress(corrupt.data(), compressedSize - rand() % 2, decompressed.data(), size);
+            }
+        }
+        check(mismatches == 0, "LZ round trips of random data");
+    }
+}
+
+int main()
+{
+    testCompression();
+
+    //a megabyte of text, four compressed blocks
+    std::vector<char> generated;
+    for (int line = 0; generated.size() < 1024 * 1024; line++)
+    {
+        char text[64];
+        int length = sprintf(text, "line %d of the asset pack test\n", line % 1000);
+        generated.insert(generated.end(), text, text + length);
+    }
+    if (!writeFile(generatedPath, generated))
+    {
+        printf("Couldn't write %s\n", generatedPath);
+        return 1;
+    }
+
+    std::vector<std::string> paths;
+    paths.push_back("vertexShader.glsl");
+    paths.push_back("fragmentShader.glsl");
+    paths.push_back("../assets/crate.jpg");
+    paths.push_back("../assets/stones_diffuse.png");
+    paths.push_back(generatedPath);
+
+    std::vector<std::vector<char> > loose(paths.size());
+    std::vector<unsigned long long> sizes(paths.size());
+    std::vector<long long> times(paths.size());
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        if (!readFile(paths[i].c_str(), loose[i]) || !getFileInfo(paths[i].c_str(), sizes[i], times[i]))
+        {
+            printf("Couldn't read %s\n", paths[i].c_str());
+            remove(generatedPath);
+            return 1;
+        }
+    }
+
+    check(writeAssetPack(packPath, paths), "pack written");
+    //only the pack has it now
+    remove(generatedPath);
+    check(mountAssetPack(packPath), "pack mounted");
+
+    bool identical = true;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        std::vector<char> packed;
+        unsigned long long size;
+        long long modified;
+        identical = identical && readFile(paths[i].c_str(), packed) && packed == loose[i] &&
+                    getFileInfo(paths[i].c_str(), size, modified) && size == sizes[i] && modified == times[i];
+    }
+    check(identical, "files read back as they were packed");
+
+    MappedFile upper, backslash, missing;
+    check(upper.open("FRAGMENTSHADER.GLSL") && backslash.open(".\\vertexShader.glsl"), "case and slashes don't matter");
+    check(!missing.open("asset_pack_test_missing.txt"), "files not in the pack aren't found");
+    upper.close();
+    backslash.close();
+    unmountAssetPacks();
+
+    std::vector<char> pack;
+    if (!readFile(packPath, pack))
+    {
+        printf("Couldn't read %s back\n", packPath);
+        return 1;
+    }
+
+    //the generated file is the only one stored in more than one block
+    size_t entry = 0;
+    unsigned int numEntries = readField<unsigned int>(pack, 8);
+    for (unsigned int i = 0; i < numEntries; i++)
+    {
+        size_t offset = headerSize + i * entrySize;
+        if (readField<unsigned int>(pack, offset + entryNumBlocks) > 1)
+            entry = offset;
+    }
+    check(entry != 0, "generated file stored compressed");
+
+    if (entry != 0)
+    {
+        std::vector<char> broken(pack.begin(), pack.begin() + pack.size() / 2);
+        check(!mountBroken(broken), "truncated pack refused");
+
+        broken = pack;
+        writeField<unsigned long long>(broken, headerNamesOffset, ~0ull - 1);
+        check(!mountBroken(broken), "names past the end refused");
+
+        broken = pack;
+        writeField<unsigned long long>(broken, entry + entryOffset, ~0ull - 1);
+        check(!mountBroken(broken), "entry offset past the end refused");
+
+        //as many blocks as before, but each would decode to 64 MB
+        broken = pack;
+        unsigned int numBlocks = readField<unsigned int>(pack, entry + entryNumBlocks);
+        writeField<unsigned int>(broken, headerBlockSize, 64 * 1024 * 1024);
+        writeField<unsigned long long>(broken, entry + entrySizeField, numBlocks * 64ull * 1024 * 1024);
+        check(!mountBroken(broken), "entry larger than its blocks can decode to refused");
+
+        broken = pack;
+        writeField<unsigned int>(broken, entry + entryNumBlocks, numBlocks + 1);
+        check(!mountBroken(broken), "entry with the wrong number of blocks refused");
+
+        //a first block that claims to be one byte can't decode to a whole block
+        broken = pack;
+        writeField<unsigned int>(broken, static_cast<size_t>(readField<unsigned long long>(pack, entry + entryOffset)), 1);
+        MappedFile corrupt;
+        check(mountBroken(broken) && !corrupt.open(generatedPath), "corrupt block fails to open");
+    }
+
+    unmountAssetPacks();
+    remove(brokenPath);
+    remove(packPath);
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+//Band decode test. Reads generated PNGs of every colour type, depth and
+//interlacing, a few big enough to slide the inflate window along, and the
+//coursework's PNGs and JPEG a band of rows at a time, in bands of random
+//heights, and holds the rows against stbi_load's whole image. Formats that
+//can't be streamed have to be refused at open. PNGs with flipped bits or
+//cut short have to give what the whole image decode gives when that
+//succeeds, the palette ones aside as stbi_load reads its palette
+//uninitialised for indices past the end, and never read past the end of
+//the file. Exits with 1 if anything fails.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+
+#include <random>
+#include <vector>
+#include <cstring>
+#include <stdio.h>
+
+#include <source/testpng.hpp>
+
+namespace
+{
+    const char *assetPaths[] = {
+        "../assets/bricks_diffuse.png", "../assets/bricks_normal.png", "../assets/bricks_specular.png",
+        "../assets/stones_diffuse.png", "../assets/stones_normal.png", "../assets/stones_specular.png",
+        "../assets/crate.jpg"
+    };
+    //big enough to slide the 32KB window along many times
+    const TestPngSpec largeSpecs[] = {
+        { 1100, 400, 6, 8, false, false }, { 2000, 300, 2, 8, false, true }, { 700, 900, 0, 8, false, false },
+        { 1500, 500, 3, 8, false, true }, { 900, 600, 4, 8, false, false }
+    };
+    const int damagedCopies = 40;
+    const int maxBandRows = 40;
+
+    int failures = 0;
+    std::mt19937 generator(1);
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    //what stbi_load and the band decoder made of a file
+    struct Decoded
+    {
+        bool opened;
+        int width, height, channels;
+        std::vector<unsigned char> pixels;
+        bool readPastEnd;
+    };
+
+    Decoded decodeWhole(const std::vector<unsigned char> &file)
+    {
+        Decoded whole = Decoded();
+        unsigned char *pixels = stbi_load_from_memory(file.data(), static_cast<int>(file.size()),
+                                                      &whole.width, &whole.height, &whole.channels, 0);
+        whole.opened = pixels != NULL;
+        if (pixels)
+            whole.pixels.assign(pixels, pixels + static_cast<size_t>(whole.width) * whole.height * whole.channels);
+        stbi_image_free(pixels);
+        return whole;
+    }
+
+    //the rows until the end of the image or an error
+    Decoded decodeBands(const std::vector<unsigned char> &file)
+    {
+        Decoded bands = Decoded();
+        stbi_band *band = stbi_band_open_from_memory(file.data(), static_cast<int>(file.size()),
+                                                     &bands.width, &bands.height, &bands.channels);
+        bands.opened = band != NULL;
+        if (!band)
+            return bands;
+        size_t stride = static_cast<size_t>(bands.width) * bands.channels;
+        for (;;)
+        {
+            int rows = 1 + static_cast<int>(generator() % maxBandRows);
+            size_t first = bands.pixels.size();
+            bands.pixels.resize(first + stride * rows);
+            int read = stbi_band_read(band, bands.pixels.data() + first, rows);
+            bands.pixels.resize(first + stride * read);
+            bands.readPastEnd = bands.readPastEnd || stbi_band_input_offset(band) > static_cast<int>(file.size());
+            if (read == 0)
+                break;
+        }
+        stbi_band_close(band);
+        return bands;
+    }
+
+    bool sameImage(const Decoded &a, const Decoded &b)
+    {
+        return a.opened && b.opened && a.width == b.width && a.height == b.height &&
+               a.channels == b.channels && a.pixels == b.pixels;
+    }
+
+    bool streamable(const TestPngSpec &spec)
+    {
+        return spec.depth == 8 && !spec.interlaced;
+    }
+}
+
+int main()
+{
+    //PNGs written here
+    std::vector<TestPngSpec> specs = testPngSpecs();
+    specs.insert(specs.end(), largeSpecs, largeSpecs + sizeof(largeSpecs) / sizeof(largeSpecs[0]));
+    bool matched = true, refused = true, damagedMatched = true, damagedInside = true;
+    int streamed = 0, damaged = 0;
+    for (size_t i = 0; i < specs.size(); i++)
+    {
+        std::vector<unsigned char> png = testPng(specs[i], static_cast<unsigned int>(i));
+        Decoded whole = decodeWhole(png);
+        Decoded bands = decodeBands(png);
+        if (!streamable(specs[i]))
+        {
+            refused = refused && !bands.opened && whole.opened;
+            continue;
+        }
+        streamed++;
+        matched = matched && sameImage(whole, bands) && !bands.readPastEnd;
+
+        PngImageData data;
+        if (!pngImageData(png, data))
+        {
+            matched = false;
+            continue;
+        }
+        for (int j = 0; j < damagedCopies; j++, damaged++)
+        {
+            std::vector<unsigned char> copy = png;
+            size_t chunk = generator() % data.offsets.size();
+            if (data.sizes[chunk] == 0)
+                continue;
+            if (generator() % 3 == 0)
+                copy.resize(data.offsets[chunk] + generator() % data.sizes[chunk]);
+            else
+                copy[data.offsets[chunk] + generator() % data.sizes[chunk]] ^= static_cast<unsigned char>(1 << (generator() % 8));
+            whole = decodeWhole(copy);
+            bands = decodeBands(copy);
+            damagedInside = damagedInside && !bands.readPastEnd;
+            if (whole.opened && specs[i].colourType != 3)
+                damagedMatched = damagedMatched && sameImage(whole, bands);
+        }
+    }
+    printf("%d of %zu PNGs streamable, %d damaged copies\n", streamed, specs.size(), damaged);
+    check(matched, "generated PNGs read in bands match stbi_load");
+    check(refused, "PNGs interlaced or not of 8 bits refused");
+    check(damagedMatched, "damaged PNGs match stbi_load where it succeeds");
+    check(damagedInside, "damaged PNGs never read past the end");
+
+    //the coursework's
+    bool assetsFound = true, assetsMatched = true;
+    for (size_t i = 0; i < sizeof(assetPaths) / sizeof(assetPaths[0]); i++)
+    {
+        std::vector<unsigned char> file;
+        if (!readTestFile(assetPaths[i], file))
+        {
+            printf("%s couldn't be read\n", assetPaths[i]);
+            assetsFound = false;
+            continue;
+        }
+        Decoded bands = decodeBands(file);
+        assetsMatched = assetsMatched && sameImage(decodeWhole(file), bands) && !bands.readPastEnd;
+    }
+    check(assetsFound, "coursework images read");
+    check(assetsMatched, "coursework images read in bands match stbi_load");
+
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+//texture compression quality report. Compresses the coursework textures (or
+//the files given on the command line) to the format the cooker would pick
+//with every format available, decodes them back on the CPU and prints the
+//PSNR, size and time to build and encode the mip chain of each. Exits with
+//1 if any texture falls below the floor of its format, so quality
+//regressions show up without a GPU.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/decodearena.hpp>
+#include <common/stb_image.hpp>
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <stdio.h>
+
+#include <common/texturecook.hpp>
+#include <common/blockcompression.hpp>
+#include <common/mipmap.hpp>
+#include <common/imagedecoder.hpp>
+
+namespace
+{
+    //lowest acceptable PSNR in dB of each format, indexed by BlockFormat
+    const double minimumPSNR[] = { 32.0, 32.0, 36.0, 36.0, 36.0 };
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty())
+    {
+        const char *assets[] = {
+            "../assets/crate.jpg",
+            "../assets/stones_diffuse.png",
+            "../assets/stones_specular.png",
+            "../assets/bricks_diffuse.png",
+            "../assets/bricks_specular.png"
+        };
+        paths.assign(assets, assets + sizeof(assets) / sizeof(assets[0]));
+    }
+
+    unsigned int allFormats = 0;
+    for (int format = 0; format < BLOCK_NONE; format++)
+        allFormats |= blockFormatBit(static_cast<BlockFormat>(format));
+
+    int failures = 0;
+    unsigned long long rawBytes = 0, packedBytes = 0;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        DecodedImage image;
+        if (!decodeImageFile(paths[i].c_str(), true, image))
+        {
+            printf("%-32s couldn't be decoded\n", paths[i].c_str());
+            failures++;
+            continue;
+        }
+
+        //alpha only matters for the BC1/BC3 choice, which BC7 makes moot here
+        TextureKind kind = textureKindFromPath(paths[i].c_str(), image.components);
+        BlockFormat format = chooseBlockFormat(kind, false, allFormats);
+        MipChain levels, compressed;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        generateMipChain(image.pixels.get(), image.width, image.height, image.components, mipFilterForKind(kind), levels);
+        compressMipChain(levels, format, compressed);
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        unsigned long long raw = static_cast<unsigned long long>(image.width) * image.height * image.components * 4 / 3;
+        rawBytes += raw;
+        packedBytes += compressed.bytes();
+        bool passed = compressed.psnr >= minimumPSNR[format];
+        if (!passed)
+            failures++;
+        printf("%-32s %4dx%-4d %s %6.2f dB (min %.0f) %7.2f MB -> %6.2f MB %7.0f ms%s\n",
+               paths[i].c_str(), image.width, image.height, blockFormatName(format), compressed.psnr,
+               minimumPSNR[format], raw / 1048576.0, compressed.bytes() / 1048576.0, milliseconds,
+               passed ? "" : "  FAILED");
+    }
+
+    printf("%.1f MB of mipmapped textures compressed to %.1f MB, %d failed\n",
+           rawBytes / 1048576.0, packedBytes / 1048576.0, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -1,5 +1,8 @@
 ﻿#include <iostream>
 #include <cmath>
+#include <vector>
+#include <string>
+#include <memory>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -13,11 +16,22 @@
 #include <common/camera.hpp>
 #include <common/model.hpp>
 #include <common/light.hpp>
+#include <common/vertexformat.hpp>
+#include <common/assetloader.hpp>
+#include <common/textureupload.hpp>
+#include <common/virtualtexture.hpp>
+#include <common/texturearray.hpp>
+#include <common/tangents.hpp>
+#include <common/assetpack.hpp>
 
 void keyboardInput(GLFWwindow* window);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void checkCollisions(Camera& camera);
+unsigned int createPackedVAO(const float* posNormals, const float* uvs, size_t numVertices,
+    const unsigned int* indices, size_t numIndices,
+    MeshBounds& bounds, unsigned int& vbo, unsigned int& ebo);
+void bindSurfaceMaps(unsigned int shaderID, const TextureArrayPacker& maps, size_t first, unsigned int* boundArrays);
 
 Camera camera(glm::vec3(0.0f, 0.0f, 7.0f)); 
 float lastX = 1024.0f / 2.0f;
@@ -39,6 +53,14 @@ Light spotLight(
 
 const float LIGHT_SPEED = 2.0f;
 
+//normal mapping of the room, N cycles through the modes of the shader
+int normalMapping = 1;
+const char* const normalMappingNames[] = { "off", "vertex tangents", "derivative TBN" };
+
+//floor and ceiling diffuse through the virtual texture, V toggles it
+bool virtualTexturing = true;
+VirtualTexture* floorVirtual = NULL;
+
 int main()
 {
     if (!glfwInit())
@@ -187,78 +209,70 @@ int main()
         20,21,22, 22,23,20,
     };
 
-    //buffer setups
-    unsigned int cubeVAO, cubeVBO, cubeUVVBO, cubeEBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glBindVertexArray(cubeVAO);
-
-    glGenBuffers(1, &cubeVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &cubeUVVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeUVVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeUVs), cubeUVs, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &cubeEBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
-
-    // position attribute
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-
-    // normal attribute (offset by 3 floats)
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    glBindBuffer(GL_ARRAY_BUFFER, cubeUVVBO);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    glBindVertexArray(0);
-
-    unsigned int roomVAO, roomVBO, roomUVVBO, roomEBO;
-    glGenVertexArrays(1, &roomVAO);
-    glBindVertexArray(roomVAO);
-
-    glGenBuffers(1, &roomVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, roomVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(roomVertices), roomVertices, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &roomUVVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, roomUVVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(roomUVs), roomUVs, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &roomEBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, roomEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(roomIndices), roomIndices, GL_STATIC_DRAW);
-
-    // position attribute
-    glBindBuffer(GL_ARRAY_BUFFER, roomVBO);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-
-    // normal attribute (offset by 3 floats)
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    glBindBuffer(GL_ARRAY_BUFFER, roomUVVBO);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    glBindVertexArray(0);
-
-    //loads shaders and assets
+    //buffer setups, both meshes use the packed vertex format
+    unsigned int cubeVBO, cubeEBO, roomVBO, roomEBO;
+    MeshBounds cubeBounds, roomBounds;
+    unsigned int cubeVAO = createPackedVAO(cubeVertices, cubeUVs, 24, cubeIndices, 36,
+                                           cubeBounds, cubeVBO, cubeEBO);
+    unsigned int roomVAO = createPackedVAO(roomVertices, roomUVs, 24, roomIndices, 36,
+                                           roomBounds, roomVBO, roomEBO);
+
+    //a packed build reads shaders, textures and cooked files out of one
+    //mapped file, written by asset_cooker --pack. Without it, or for
+    //anything not in it, the loose files are read
+    if (mountAssetPack("../assets.pack"))
+        std::cout << "Reading assets from ../assets.pack\n";
+
+    //loads shaders, the textures decode in the background and show as
+    //placeholders until they are uploaded. Missing ones stay placeholders.
+    //Uploads stream in over a few frames, coarsest mip level first. The
+    //uploader goes before the context so it is held by pointer
+    std::unique_ptr<TextureUploader> uploader(new TextureUploader());
+    TextureCache::shared().setUploader(uploader.get());
+    AssetLoader loader;
     unsigned int shaderID = LoadShaders("vertexShader.glsl", "fragmentshader.glsl");
-    unsigned int crateTexture = loadTexture("../assets/crate.jpg");
-    unsigned int stoneDiffuse = loadTexture("../assets/stones_diffuse.png");
-    unsigned int stoneNormal = loadTexture("../assets/stones_normal.png");
-    unsigned int stoneSpecular = loadTexture("../assets/stones_specular.png");
-    unsigned int brickDiffuse = loadTexture("../assets/bricks_diffuse.png");
-    unsigned int brickNormal = loadTexture("../assets/bricks_normal.png");
-    unsigned int brickSpecular = loadTexture("../assets/bricks_specular.png");
+    TextureHandle crateTexture = loader.loadTexture("../assets/crate.jpg");
+    bool assetsLoaded = false;
+
+    //the room's maps go into texture arrays, a layer each, so the floor and
+    //walls share binds. Diffuse, normal and specular of each surface.
+    //Missing maps stay the plain placeholder and are reported once packed.
+    //The normal maps are derived from the diffuse maps' luminance.
+    TextureArrayPacker roomMaps;
+    std::vector<std::string> roomMapPaths;
+    roomMapPaths.push_back("../assets/stones_diffuse.png");
+    roomMapPaths.push_back("../assets/stones_normal.png");
+    roomMapPaths.push_back("../assets/stones_specular.png");
+    roomMapPaths.push_back("../assets/bricks_diffuse.png");
+    roomMapPaths.push_back("../assets/bricks_normal.png");
+    roomMapPaths.push_back("../assets/bricks_specular.png");
+    size_t floorMaps = roomMaps.load(roomMapPaths);
+    size_t wallMaps = floorMaps + 3;
+    TextureHandle placeholder = TextureCache::shared().fallback();
+
+    //array samplers have their own units, plain and array samplers can't
+    //share one
+    glUseProgram(shaderID);
+    glUniform1i(glGetUniformLocation(shaderID, "diffuseArray"), 5);
+    glUniform1i(glGetUniformLocation(shaderID, "normalArray"), 6);
+    glUniform1i(glGetUniformLocation(shaderID, "specularArray"), 7);
+
+    //the floor's diffuse map paged in on demand, the feedback program marks
+    //which pages and levels are on screen. Its pages are cooked in the
+    //background, the floor uses its plain map until they are ready
+    VirtualTexture virtualTexture;
+    virtualTexture.openAsync("../assets/stones_diffuse.png");
+    floorVirtual = &virtualTexture;
+    unsigned int feedbackID = LoadShaders("vertexShader.glsl", "feedbackShader.glsl");
+
+    //GPU time of the room draws per normal mapping mode. Two queries so the
+    //one being read is a frame old and never stalls
+    unsigned int roomQueries[2];
+    int queryMode[2] = { 0, 0 };
+    double roomMilliseconds[3] = { 0.0, 0.0, 0.0 };
+    int roomFrames[3] = { 0, 0, 0 };
+    unsigned int frame = 0;
+    glGenQueries(2, roomQueries);
 
     glm::mat4 projection = glm::perspective(glm::radians(camera.getZoom()), 1024.0f / 768.0f, 0.1f, 100.0f);
     spotLight.setDirection(glm::vec3(0.0f, -1.0f, 0.0f));
@@ -272,14 +286,57 @@ int main()
         float deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        //upload whatever has finished loading, a few ms a frame, and send
+        //the next bands of the textures streaming in
+        size_t loading = loader.update(4.0);
+        bool roomMapsBuilt = roomMaps.update();
+        if (uploader->update() == 0 && loading == 0 && roomMapsBuilt && !assetsLoaded)
+        {
+            assetsLoaded = true;
+            std::cout << "Room maps packed into " << roomMaps.numArrays() << " texture arrays, "
+                      << roomMaps.bytes() / 1048576.0 << " MB\n";
+            for (size_t i = 0; i < roomMapPaths.size(); i++)
+                if (roomMaps.layer(floorMaps + i).array == 0)
+                    std::cout << "Room map " << roomMapPaths[i] << " isn't in an array, drawing the placeholder\n";
+            std::cout << "Assets loaded after " << glfwGetTime() << " s\n";
+            TextureCache::shared().printStats();
+        }
+
         keyboardInput(window);
         camera.ProcessKeyboard(window, deltaTime);
         checkCollisions(camera);
 
+        glm::mat4 view = camera.getViewMatrix();
+        glm::mat4 roomModel = glm::mat4(1.0f);
+        glm::mat4 roomMVP = projection * view * roomModel;
+
+        //feedback of the virtually textured floor and ceiling, read back
+        //next frame when update() asks for the pages
+        bool virtualFloor = virtualTexturing && virtualTexture.isOpen();
+        if (virtualFloor)
+        {
+            virtualTexture.beginFeedback(1024, 768);
+            glUseProgram(feedbackID);
+            virtualTexture.bind(feedbackID, 3, 4);
+            glUniformMatrix4fv(glGetUniformLocation(feedbackID, "MVP"), 1, GL_FALSE, glm::value_ptr(roomMVP));
+            glUniformMatrix4fv(glGetUniformLocation(feedbackID, "model"), 1, GL_FALSE, glm::value_ptr(roomModel));
+            glUniform3fv(glGetUniformLocation(feedbackID, "positionScale"), 1, glm::value_ptr(positionScale(roomBounds)));
+            glUniform3fv(glGetUniformLocation(feedbackID, "positionOffset"), 1, glm::value_ptr(positionOffset(roomBounds)));
+            glBindVertexArray(roomVAO);
+            glDrawElements(GL_TRIANGLES, 12, GL_UNSIGNED_INT, (void*)0);
+            virtualTexture.endFeedback();
+        }
+        virtualTexture.update();
+
         glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(shaderID);
+        //the cube and room use the shader's built in material constants,
+        //the table still has to be backed by a buffer
+        glUniform1i(glGetUniformLocation(shaderID, "materialIndex"), -1);
+        Model::bindDefaultMaterials(shaderID);
+        glUniform1i(glGetUniformLocation(shaderID, "virtualDiffuse"), 0);
         //spotlight
         glUniform3fv(glGetUniformLocation(shaderID, "lightPos"), 1, glm::value_ptr(light.getPosition()));
         glUniform3fv(glGetUniformLocation(shaderID, "lightColor"), 1, glm::value_ptr(light.getColor()));
@@ -295,15 +352,17 @@ int main()
         glm::mat4 cubeModel = glm::mat4(1.0f);
         cubeModel = glm::scale(cubeModel, glm::vec3(0.7f));
         cubeModel = glm::rotate(cubeModel, currentFrame * 0.5f, glm::vec3(1, 1, 0));
-        glm::mat4 view = camera.getViewMatrix();
         glm::mat4 cubeMVP = projection * view * cubeModel;
 
         glUniformMatrix4fv(glGetUniformLocation(shaderID, "MVP"), 1, GL_FALSE, glm::value_ptr(cubeMVP));
         glUniformMatrix4fv(glGetUniformLocation(shaderID, "model"), 1, GL_FALSE, glm::value_ptr(cubeModel));
+        glUniform3fv(glGetUniformLocation(shaderID, "positionScale"), 1, glm::value_ptr(positionScale(cubeBounds)));
+        glUniform3fv(glGetUniformLocation(shaderID, "positionOffset"), 1, glm::value_ptr(positionOffset(cubeBounds)));
         glUniform1i(glGetUniformLocation(shaderID, "surfaceType"), 0);
+        glUniform1i(glGetUniformLocation(shaderID, "normalMapping"), 0);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, crateTexture);
+        glBindTexture(GL_TEXTURE_2D, crateTexture.id());
         glUniform1i(glGetUniformLocation(shaderID, "diffuseMap"), 0);
         glUniform1i(glGetUniformLocation(shaderID, "normalMap"), 0);
         glUniform1i(glGetUniformLocation(shaderID, "specularMap"), 0);
@@ -311,43 +370,68 @@ int main()
         glBindVertexArray(cubeVAO);
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 
-       
-        glm::mat4 roomModel = glm::mat4(1.0f);
-        glm::mat4 roomMVP = projection * view * roomModel;
 
         glUniformMatrix4fv(glGetUniformLocation(shaderID, "MVP"), 1, GL_FALSE, glm::value_ptr(roomMVP));
         glUniformMatrix4fv(glGetUniformLocation(shaderID, "model"), 1, GL_FALSE, glm::value_ptr(roomModel));
+        glUniform3fv(glGetUniformLocation(shaderID, "positionScale"), 1, glm::value_ptr(positionScale(roomBounds)));
+        glUniform3fv(glGetUniformLocation(shaderID, "positionOffset"), 1, glm::value_ptr(positionOffset(roomBounds)));
 
         glBindVertexArray(roomVAO);
-
-        //floor
-        glUniform1i(glGetUniformLocation(shaderID, "surfaceType"), 1);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, stoneDiffuse);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, stoneNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, stoneSpecular);
+        glUniform1i(glGetUniformLocation(shaderID, "normalMapping"), normalMapping);
+
+        if (frame >= 2)
+        {
+            GLuint64 nanoseconds;
+            int mode = queryMode[frame % 2];
+            glGetQueryObjectui64v(roomQueries[frame % 2], GL_QUERY_RESULT, &nanoseconds);
+            roomMilliseconds[mode] += nanoseconds * 1e-6;
+            if (++roomFrames[mode] == 240)
+            {
+                std::cout << "Room GPU time, normal mapping " << normalMappingNames[mode] << ": "
+                          << roomMilliseconds[mode] / roomFrames[mode] << " ms\n";
+                roomMilliseconds[mode] = 0.0;
+                roomFrames[mode] = 0;
+            }
+        }
+        queryMode[frame % 2] = normalMapping;
+        glBeginQuery(GL_TIME_ELAPSED, roomQueries[frame % 2]);
+
+        //the plain maps are only used by maps that aren't in an array
+        unsigned int boundArrays[3] = { 0, 0, 0 };
+        for (int unit = 0; unit < 3; unit++)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, placeholder.id());
+        }
         glUniform1i(glGetUniformLocation(shaderID, "diffuseMap"), 0);
         glUniform1i(glGetUniformLocation(shaderID, "normalMap"), 1);
         glUniform1i(glGetUniformLocation(shaderID, "specularMap"), 2);
+
+        //floor
+        glUniform1i(glGetUniformLocation(shaderID, "surfaceType"), 1);
+        bindSurfaceMaps(shaderID, roomMaps, floorMaps, boundArrays);
+        if (virtualFloor)
+        {
+            virtualTexture.bind(shaderID, 3, 4);
+            glUniform1i(glGetUniformLocation(shaderID, "virtualDiffuse"), 1);
+        }
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
 
         //ceiling
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)(6 * sizeof(unsigned int)));
+        glUniform1i(glGetUniformLocation(shaderID, "virtualDiffuse"), 0);
 
-        //walls
+        //walls, the same arrays as the floor where the maps share a format
         glUniform1i(glGetUniformLocation(shaderID, "surfaceType"), 2);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, brickDiffuse);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, brickNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, brickSpecular);
-        glUniform1i(glGetUniformLocation(shaderID, "diffuseMap"), 0);
-        glUniform1i(glGetUniformLocation(shaderID, "normalMap"), 1);
-        glUniform1i(glGetUniformLocation(shaderID, "specularMap"), 2);
+        bindSurfaceMaps(shaderID, roomMaps, wallMaps, boundArrays);
         glDrawElements(GL_TRIANGLES, 24, GL_UNSIGNED_INT, (void*)(12 * sizeof(unsigned int)));
+        glEndQuery(GL_TIME_ELAPSED);
+
+        //back to the plain maps for everything else
+        glUniform2f(glGetUniformLocation(shaderID, "diffuseLayer"), 0.0f, 0.0f);
+        glUniform2f(glGetUniformLocation(shaderID, "normalLayer"), 0.0f, 0.0f);
+        glUniform2f(glGetUniformLocation(shaderID, "specularLayer"), 0.0f, 0.0f);
+        frame++;
 
         //draw spotlight
         glm::mat4 spotModel = glm::translate(glm::mat4(1.0f), spotLight.getPosition());
@@ -356,10 +440,13 @@ int main()
 
         glUniformMatrix4fv(glGetUniformLocation(shaderID, "MVP"), 1, GL_FALSE, glm::value_ptr(spotMVP));
         glUniformMatrix4fv(glGetUniformLocation(shaderID, "model"), 1, GL_FALSE, glm::value_ptr(spotModel));
+        glUniform3fv(glGetUniformLocation(shaderID, "positionScale"), 1, glm::value_ptr(positionScale(cubeBounds)));
+        glUniform3fv(glGetUniformLocation(shaderID, "positionOffset"), 1, glm::value_ptr(positionOffset(cubeBounds)));
         glUniform1i(glGetUniformLocation(shaderID, "surfaceType"), 0);
+        glUniform1i(glGetUniformLocation(shaderID, "normalMapping"), 0);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, crateTexture);
+        glBindTexture(GL_TEXTURE_2D, crateTexture.id());
         glUniform1i(glGetUniformLocation(shaderID, "diffuseMap"), 0);
         glUniform1i(glGetUniformLocation(shaderID, "normalMap"), 0);
         glUniform1i(glGetUniformLocation(shaderID, "specularMap"), 0);
@@ -374,22 +461,23 @@ int main()
     }
 
     //cleanup of course
+    glDeleteQueries(2, roomQueries);
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &roomVAO);
     glDeleteBuffers(1, &cubeVBO);
-    glDeleteBuffers(1, &cubeUVVBO);
     glDeleteBuffers(1, &cubeEBO);
     glDeleteBuffers(1, &roomVBO);
-    glDeleteBuffers(1, &roomUVVBO);
     glDeleteBuffers(1, &roomEBO);
     glDeleteProgram(shaderID);
-    glDeleteTextures(1, &crateTexture);
-    glDeleteTextures(1, &stoneDiffuse);
-    glDeleteTextures(1, &stoneNormal);
-    glDeleteTextures(1, &stoneSpecular);
-    glDeleteTextures(1, &brickDiffuse);
-    glDeleteTextures(1, &brickNormal);
-    glDeleteTextures(1, &brickSpecular);
+    glDeleteProgram(feedbackID);
+    Model::deleteDefaultMaterials();
+    roomMaps.release();
+    placeholder = TextureHandle();
+    floorVirtual = NULL;
+    virtualTexture.close();
+    TextureCache::shared().clear();
+    TextureCache::shared().setUploader(NULL);
+    uploader.reset();
 
     glfwTerminate();
     return 0;
@@ -413,6 +501,30 @@ void keyboardInput(GLFWwindow* window)
         light.setPosition(light.getPosition() + glm::vec3(0, lightVelocity, 0));
     if (glfwGetKey(window, GLFW_KEY_PAGE_DOWN) == GLFW_PRESS)
         light.setPosition(light.getPosition() + glm::vec3(0, -lightVelocity, 0));
+
+    static bool normalKeyDown = false;
+    bool pressed = glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS;
+    if (pressed && !normalKeyDown)
+    {
+        normalMapping = (normalMapping + 1) % 3;
+        std::cout << "Normal mapping: " << normalMappingNames[normalMapping] << "\n";
+    }
+    normalKeyDown = pressed;
+
+    static bool virtualKeyDown = false;
+    pressed = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+    if (pressed && !virtualKeyDown)
+    {
+        virtualTexturing = !virtualTexturing;
+        std::cout << "Virtual texturing: " << (virtualTexturing ? "on" : "off") << "\n";
+        if (floorVirtual != NULL)
+        {
+            PageTableStats stats = floorVirtual->stats();
+            std::cout << stats.resident << " pages resident, " << stats.loads << " loaded, "
+                      << stats.evictions << " evicted\n";
+        }
+    }
+    virtualKeyDown = pressed;
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos)
@@ -455,4 +567,70 @@ void checkCollisions(Camera& camera)
     if (pos.z + radius > ROOM_DEPTH) pos.z = ROOM_DEPTH - radius;
 
     camera.setPosition(pos);
+}
+
+unsigned int createPackedVAO(const float* posNormals, const float* uvs, size_t numVertices,
+    const unsigned int* indices, size_t numIndices,
+    MeshBounds& bounds, unsigned int& vbo, unsigned int& ebo)
+{
+    //split the interleaved position/normal array
+    std::vector<glm::vec3> positions(numVertices), normals(numVertices);
+    std::vector<glm::vec2> texCoords(numVertices);
+    for (size_t i = 0; i < numVertices; i++)
+    {
+        positions[i] = glm::vec3(posNormals[i * 6], posNormals[i * 6 + 1], posNormals[i * 6 + 2]);
+        normals[i] = glm::vec3(posNormals[i * 6 + 3], posNormals[i * 6 + 4], posNormals[i * 6 + 5]);
+        texCoords[i] = glm::vec2(uvs[i * 2], uvs[i * 2 + 1]);
+    }
+
+    std::vector<glm::vec4> tangents(numVertices);
+    generateTangents(indices, numIndices, positions.data(), texCoords.data(), normals.data(),
+                     numVertices, tangents.data());
+
+    bounds = computeBounds(positions.data(), numVertices);
+    std::vector<PackedVertex> packed(numVertices);
+    packVertices(positions.data(), texCoords.data(), normals.data(), tangents.data(), numVertices, bounds,
+                 packed.data());
+
+    unsigned int vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+
+    packedVertexFormat().apply();
+
+    glBindVertexArray(0);
+    return vao;
+}
+
+void bindSurfaceMaps(unsigned int shaderID, const TextureArrayPacker& maps, size_t first, unsigned int* boundArrays)
+{
+    //diffuse, normal and specular at first onwards. Arrays already bound
+    //stay, a surface whose maps share arrays with the last only changes
+    //the layers
+    const char* const layerNames[] = { "diffuseLayer", "normalLayer", "specularLayer" };
+    for (int i = 0; i < 3; i++)
+    {
+        TextureLayer layer = maps.isBuilt() ? maps.layer(first + i) : TextureLayer();
+        if (layer.array == 0)
+        {
+            glUniform2f(glGetUniformLocation(shaderID, layerNames[i]), 0.0f, 0.0f);
+            continue;
+        }
+        if (boundArrays[i] != layer.array)
+        {
+            glActiveTexture(GL_TEXTURE5 + i);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, layer.array);
+            boundArrays[i] = layer.array;
+        }
+        glUniform2f(glGetUniformLocation(shaderID, layerNames[i]), static_cast<float>(layer.layer), layer.uvScale);
+    }
+    glActiveTexture(GL_TEXTURE0);
 }
\ No newline at end of file
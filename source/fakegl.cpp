@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cstring>
+
+#include <GL/glew.h>
+
+#include <common/assetloader.hpp>
+#include <source/fakegl.hpp>
+
+namespace
+{
+    //the one buffer there is, the uploader's ring
+    const GLuint ringName = 1;
+
+    FakeGL state = FakeGL();
+    unsigned int nextTexture = 1;
+    unsigned int boundTexture = 0;
+    GLuint boundBuffer = 0;
+    std::vector<unsigned char> ring;
+
+    //sub images read from the ring, which has to hold them until the
+    //fence sent after them completes
+    struct RingRead
+    {
+        size_t subImage;
+        size_t offset;
+        size_t fence;
+    };
+    std::vector<RingRead> reads;
+
+    //the GL is done reading what came before the signalled fences
+    void retireReads()
+    {
+        for (size_t i = 0; i < reads.size(); )
+        {
+            if (reads[i].fence > state.signalled)
+            {
+                i++;
+                continue;
+            }
+            const std::vector<unsigned char> &data = state.subImages[reads[i].subImage].data;
+            if (memcmp(ring.data() + reads[i].offset, data.data(), data.size()) != 0)
+                state.errors++;
+            reads[i] = reads.back();
+            reads.pop_back();
+        }
+    }
+
+    void checkBound()
+    {
+        if (state.textures.count(boundTexture) == 0)
+            state.errors++;
+    }
+
+    //pixels is an offset into the ring while it is bound
+    void recordSubImage(GLint level, GLint row, GLsizei rows, size_t size, const void *pixels)
+    {
+        checkBound();
+        FakeSubImage subImage;
+        subImage.texture = boundTexture;
+        subImage.level = level;
+        subImage.row = row;
+        subImage.rows = rows;
+        subImage.fromBuffer = boundBuffer == ringName;
+        const unsigned char *source = static_cast<const unsigned char*>(pixels);
+        if (subImage.fromBuffer)
+        {
+            size_t offset = reinterpret_cast<size_t>(pixels);
+            if (offset > ring.size() || size > ring.size() - offset)
+            {
+                state.errors++;
+                return;
+            }
+            source = ring.data() + offset;
+            RingRead read = { state.subImages.size(), offset, state.fences + 1 };
+            reads.push_back(read);
+        }
+        else if (source == NULL)
+        {
+            state.errors++;
+            return;
+        }
+        subImage.data.assign(source, source + size);
+        state.subImages.push_back(subImage);
+    }
+
+    void GLAPIENTRY fakeCompressedTexSubImage2D(GLenum, GLint level, GLint, GLint yoffset, GLsizei, GLsizei height,
+                                                GLenum, GLsizei imageSize, const void *data)
+    {
+        recordSubImage(level, yoffset, height, static_cast<size_t>(imageSize), data);
+    }
+
+    void GLAPIENTRY fakeGenBuffers(GLsizei n, GLuint *buffers)
+    {
+        if (n != 1 || !ring.empty())
+            state.errors++;
+        buffers[0] = ringName;
+    }
+
+    void GLAPIENTRY fakeDeleteBuffers(GLsizei, const GLuint *)
+    {
+        reads.clear();
+        ring.clear();
+    }
+
+    void GLAPIENTRY fakeBindBuffer(GLenum, GLuint buffer)
+    {
+        boundBuffer = buffer;
+    }
+
+    void GLAPIENTRY fakeBufferStorage(GLenum, GLsizeiptr size, const void *, GLbitfield)
+    {
+        ring.assign(static_cast<size_t>(size), 0);
+    }
+
+    void GLAPIENTRY fakeBufferData(GLenum, GLsizeiptr size, const void *, GLenum)
+    {
+        ring.assign(static_cast<size_t>(size), 0);
+    }
+
+    void *GLAPIENTRY fakeMapBufferRange(GLenum, GLintptr offset, GLsizeiptr length, GLbitfield)
+    {
+        if (boundBuffer != ringName || offset < 0 || static_cast<size_t>(offset + length) > ring.size())
+        {
+            state.errors++;
+            return NULL;
+        }
+        return ring.data() + offset;
+    }
+
+    GLboolean GLAPIENTRY fakeUnmapBuffer(GLenum)
+    {
+        return GL_TRUE;
+    }
+
+    //fences are their number, counting from 1
+    GLsync GLAPIENTRY fakeFenceSync(GLenum, GLbitfield)
+    {
+        return reinterpret_cast<GLsync>(++state.fences);
+    }
+
+    void GLAPIENTRY fakeDeleteSync(GLsync)
+    {
+    }
+
+    GLenum GLAPIENTRY fakeClientWaitSync(GLsync sync, GLbitfield, GLuint64 timeout)
+    {
+        size_t fence = reinterpret_cast<size_t>(sync);
+        if (fence <= state.signalled)
+            return GL_ALREADY_SIGNALED;
+        if (timeout == 0)
+            return GL_TIMEOUT_EXPIRED;
+        state.signalled = fence;
+        retireReads();
+        return GL_CONDITION_SATISFIED;
+    }
+}
+
+FakeGL &fakeGL()
+{
+    return state;
+}
+
+void fakeGLReset()
+{
+    state.textures.clear();
+    state.deleted.clear();
+    state.baseLevels.clear();
+    state.allocations.clear();
+    state.uploads.clear();
+    state.subImages.clear();
+    state.errors = 0;
+    reads.clear();
+}
+
+void fakeGLBufferStorage(bool supported)
+{
+    __GLEW_ARB_buffer_storage = supported ? GL_TRUE : GL_FALSE;
+}
+
+void fakeGLFrame()
+{
+    state.signalled = std::max(state.signalled, state.lastFrameFences);
+    state.lastFrameFences = state.fences;
+    retireReads();
+}
+
+//what the coursework's GL would say with none of the extensions the
+//caches and uploader look for, until a test turns one on
+GLboolean __GLEW_VERSION_4_2 = GL_FALSE;
+GLboolean __GLEW_VERSION_4_4 = GL_FALSE;
+GLboolean __GLEW_EXT_texture_compression_s3tc = GL_FALSE;
+GLboolean __GLEW_ARB_texture_compression_bptc = GL_FALSE;
+GLboolean __GLEW_ARB_buffer_storage = GL_FALSE;
+
+PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC __glewCompressedTexSubImage2D = fakeCompressedTexSubImage2D;
+PFNGLGENBUFFERSPROC __glewGenBuffers = fakeGenBuffers;
+PFNGLDELETEBUFFERSPROC __glewDeleteBuffers = fakeDeleteBuffers;
+PFNGLBINDBUFFERPROC __glewBindBuffer = fakeBindBuffer;
+PFNGLBUFFERSTORAGEPROC __glewBufferStorage = fakeBufferStorage;
+PFNGLBUFFERDATAPROC __glewBufferData = fakeBufferData;
+PFNGLMAPBUFFERRANGEPROC __glewMapBufferRange = fakeMapBufferRange;
+PFNGLUNMAPBUFFERPROC __glewUnmapBuffer = fakeUnmapBuffer;
+PFNGLFENCESYNCPROC __glewFenceSync = fakeFenceSync;
+PFNGLDELETESYNCPROC __glewDeleteSync = fakeDeleteSync;
+PFNGLCLIENTWAITSYNCPROC __glewClientWaitSync = fakeClientWaitSync;
+
+void GLAPIENTRY glGenTextures(GLsizei n, GLuint *textures)
+{
+    for (GLsizei i = 0; i < n; i++)
+    {
+        textures[i] = nextTexture++;
+        state.textures.insert(textures[i]);
+    }
+}
+
+void GLAPIENTRY glDeleteTextures(GLsizei n, const GLuint *textures)
+{
+    //deleting 0 is allowed and does nothing
+    for (GLsizei i = 0; i < n; i++)
+    {
+        if (textures[i] == 0)
+            continue;
+        if (state.textures.erase(textures[i]) == 0)
+            state.errors++;
+        state.deleted.push_back(textures[i]);
+    }
+}
+
+void GLAPIENTRY glBindTexture(GLenum, GLuint texture)
+{
+    boundTexture = texture;
+}
+
+void GLAPIENTRY glTexImage2D(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void *)
+{
+    checkBound();
+}
+
+void GLAPIENTRY glTexSubImage2D(GLenum, GLint level, GLint, GLint yoffset, GLsizei width, GLsizei height,
+                                GLenum format, GLenum, const void *pixels)
+{
+    //GL_UNPACK_ALIGNMENT is left at 1 for these, so rows are packed
+    int components = format == GL_RED ? 1 : format == GL_RG ? 2 : format == GL_RGB ? 3 : 4;
+    recordSubImage(level, yoffset, height, static_cast<size_t>(width) * height * components, pixels);
+}
+
+void GLAPIENTRY glTexParameteri(GLenum, GLenum pname, GLint param)
+{
+    if (pname == GL_TEXTURE_BASE_LEVEL)
+        state.baseLevels[boundTexture] = param;
+}
+
+void GLAPIENTRY glPixelStorei(GLenum, GLint)
+{
+}
+
+bool allocateTextureStorage(unsigned int textureID, const MipChain &)
+{
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    checkBound();
+    state.allocations[textureID]++;
+    return true;
+}
+
+void uploadTexture(unsigned int textureID, const MipChain &levels)
+{
+    allocateTextureStorage(textureID, levels);
+    state.uploads[textureID]++;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <vector>
+#include <cstddef>
+
+//A stand-in for the GL the texture cache and uploader talk to, so their
+//tests run without a context or a GPU. It is linked in place of the GL and
+//GLEW libraries and keeps textures, one pixel unpack buffer and fences in
+//memory. uploadTexture and allocateTextureStorage live with AssetLoader,
+//which brings Model and the rest of the renderer along, so they are faked
+//here too. GL 1.1 is imported from a DLL on Windows, where this can't
+//replace it.
+
+//Rows of one level sent by glTexSubImage2D or glCompressedTexSubImage2D,
+//with the bytes the GL would have read
+struct FakeSubImage
+{
+    unsigned int texture;
+    int level;
+    int row;
+    int rows;
+    bool fromBuffer;            //read from the bound unpack buffer
+    std::vector<unsigned char> data;
+};
+
+struct FakeGL
+{
+    std::set<unsigned int> textures;        //generated and not deleted
+    std::vector<unsigned int> deleted;      //in the order they went
+    std::map<unsigned int, int> baseLevels; //GL_TEXTURE_BASE_LEVEL of each
+    std::map<unsigned int, int> allocations;//allocateTextureStorage calls
+    std::map<unsigned int, int> uploads;    //whole uploadTexture calls
+    std::vector<FakeSubImage> subImages;
+    size_t fences;              //made so far
+    size_t signalled;           //the first this many have completed
+    size_t lastFrameFences;     //made before the last fakeGLFrame()
+    int errors;                 //calls a real GL would have rejected, and ring
+                                //memory changed before the GL had read it
+};
+
+FakeGL &fakeGL();
+
+//Forget every texture and call, the GL state stays as it is
+void fakeGLReset();
+
+//Whether the uploader will find buffer storage and map its ring for good,
+//set before it is made
+void fakeGLBufferStorage(bool supported);
+
+//The GPU one frame behind: fences made before the previous call complete.
+//Waiting on a fence with a timeout completes it straight away. Sub images
+//are read from the ring when they are sent and again when their fence
+//completes, so ring memory reused too early counts as an error.
+void fakeGLFrame();
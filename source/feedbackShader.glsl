@@ -0,0 +1,29 @@
+#version 330 core
+in vec3 FragPos;
+in vec2 UV;
+in vec3 Normal;
+in vec4 Tangent;
+
+out vec4 FragColor;
+
+//virtual texture feedback, see VirtualTexture. Writes the page and level
+//the main pass will want here, drawn at a fraction of the resolution so
+//feedbackBias moves the level back to what full resolution picks
+uniform vec2 virtualPages;
+uniform int virtualLevels;
+uniform float pageSize;
+uniform float feedbackBias;
+
+void main()
+{
+    //same level as sampleVirtual in fragmentShader.glsl
+    vec2 texels = UV * virtualPages * pageSize;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) - feedbackBias;
+    int level = clamp(int(floor(lod)), 0, virtualLevels - 1);
+
+    ivec2 levelPages = max(ivec2(virtualPages) >> level, ivec2(1));
+    ivec2 page = min(ivec2(fract(UV) * vec2(levelPages)), levelPages - 1);
+    FragColor = vec4(vec2(page), float(level), 255.0) / 255.0;
+}
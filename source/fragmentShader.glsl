@@ -2,12 +2,29 @@
 in vec3 FragPos;
 in vec2 UV;
 in vec3 Normal;
+in vec4 Tangent;
 
 out vec4 FragColor;
 
 uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
 uniform sampler2D specularMap;
+
+//maps packed into texture arrays, see TextureArrayPacker. x is the layer
+//and y the uv scale, 0 samples the plain map instead
+uniform sampler2DArray diffuseArray;
+uniform sampler2DArray normalArray;
+uniform sampler2DArray specularArray;
+uniform vec2 diffuseLayer;
+uniform vec2 normalLayer;
+uniform vec2 specularLayer;
+
+vec4 sampleMap(sampler2D map, sampler2DArray array, vec2 layer, vec2 uv)
+{
+    if(layer.y == 0.0)
+        return texture(map, uv);
+    return texture(array, vec3(uv * layer.y, layer.x));
+}
 uniform int surfaceType;
 uniform vec3 lightPos;
 uniform vec3 lightColor;
@@ -19,12 +36,99 @@ uniform float spotCutOff;
 uniform float spotOuterCutOff;
 uniform vec3 spotLightColor;
 
+//material table shared by every submesh of a model, see PackedMaterial.
+//materialIndex -1 keeps the built in constants.
+struct Material
+{
+    vec4 ambient;
+    vec4 diffuse;   //w is opacity
+    vec4 specular;  //w is shininess
+};
+layout(std140) uniform MaterialTable
+{
+    Material materials[256];
+};
+uniform int materialIndex;
+
+//0 ignores the normal map, 1 uses the vertex tangents and 2 builds the
+//tangent frame from screen space derivatives of the position and uv
+uniform int normalMapping;
+
+//virtual texturing of the diffuse map, see VirtualTexture. pageTable has
+//a level per mip level and a texel per page, the slot in physicalPages of
+//the finest resident page covering it and that page's level
+uniform bool virtualDiffuse;
+uniform sampler2D pageTable;
+uniform sampler2D physicalPages;
+uniform vec2 virtualPages;
+uniform int virtualLevels;
+uniform float pageSize;
+uniform float pageBorder;
+uniform float physicalSize;
+
+vec3 sampleVirtual(vec2 uv)
+{
+    //same level as feedbackShader.glsl asks for
+    vec2 texels = uv * virtualPages * pageSize;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    int level = clamp(int(floor(lod)), 0, virtualLevels - 1);
+
+    //black until any page covering it is resident, like a loading texture
+    vec2 wrapped = fract(uv);
+    ivec2 levelPages = max(ivec2(virtualPages) >> level, ivec2(1));
+    vec4 entry = texelFetch(pageTable, min(ivec2(wrapped * vec2(levelPages)), levelPages - 1), level);
+    if(entry.a == 0.0)
+        return vec3(0.0);
+
+    //position within the page that is resident, which may be coarser
+    int residentLevel = int(entry.b * 255.0 + 0.5);
+    vec2 residentPages = vec2(max(ivec2(virtualPages) >> residentLevel, ivec2(1)));
+    vec2 inPage = fract(wrapped * residentPages);
+    vec2 slot = floor(entry.rg * 255.0 + 0.5);
+    vec2 texel = slot * (pageSize + 2.0 * pageBorder) + pageBorder + inPage * pageSize;
+    return textureLod(physicalPages, texel / physicalSize, 0.0).rgb;
+}
+
+//cotangent frame from derivatives (Schuler), the per pixel alternative to
+//vertex tangents. The derivatives are taken by the caller, they are
+//undefined inside the branch on the normal map's texel.
+mat3 derivativeTBN(vec3 N, vec3 dp1, vec3 dp2, vec2 duv1, vec2 duv2)
+{
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(max(dot(T, T), dot(B, B)), 1e-20));
+    return mat3(T * invmax, B * invmax, N);
+}
+
 void main()
 {
+    vec3 dPdx = dFdx(FragPos);
+    vec3 dPdy = dFdy(FragPos);
+    vec2 dUVdx = dFdx(UV);
+    vec2 dUVdy = dFdy(UV);
+
     vec3 normal = normalize(Normal);
+    //black is the placeholder of a normal map that is still loading. Only
+    //x and y are read, BC5 normal maps have no z so it is rebuilt from them
+    vec2 mapXY = sampleMap(normalMap, normalArray, normalLayer, UV).rg;
+    if(normalMapping != 0 && mapXY != vec2(0.0)) {
+        mapXY = mapXY * 2.0 - 1.0;
+        vec3 mapNormal = vec3(mapXY, sqrt(max(1.0 - dot(mapXY, mapXY), 0.0)));
+        if(normalMapping == 1) {
+            //MikkTSpace: unnormalised interpolated frame, bitangent from the sign
+            vec3 bitangent = Tangent.w * cross(Normal, Tangent.xyz);
+            normal = normalize(mapNormal.x * Tangent.xyz + mapNormal.y * bitangent + mapNormal.z * Normal);
+        }
+        else
+            normal = normalize(derivativeTBN(normal, dPdx, dPdy, dUVdx, dUVdy) * mapNormal);
+    }
     vec3 viewDir = normalize(viewPos - FragPos);
 
-    vec3 diffuseTex = texture(diffuseMap, UV).rgb;
+    vec3 diffuseTex = virtualDiffuse ? sampleVirtual(UV) : sampleMap(diffuseMap, diffuseArray, diffuseLayer, UV).rgb;
     if(diffuseTex == vec3(0.0)) {
         if(surfaceType == 0)
             diffuseTex = vec3(0.5);
@@ -34,17 +138,27 @@ void main()
             diffuseTex = vec3(0.6, 0.3, 0.3);
     }
 
+    vec3 ambientColor = vec3(1.0);
+    vec3 diffuseColor = vec3(1.0);
+    vec3 specularColor = vec3(1.0);
+    float shininess = 32.0;
+    if(materialIndex >= 0) {
+        ambientColor = materials[materialIndex].ambient.rgb;
+        diffuseColor = materials[materialIndex].diffuse.rgb;
+        specularColor = materials[materialIndex].specular.rgb;
+        shininess = materials[materialIndex].specular.w;
+    }
    
-    vec3 ambient = 0.2 * diffuseTex;
+    vec3 ambient = 0.2 * ambientColor * diffuseColor * diffuseTex;
 
     //lighting and reflective work
     vec3 lightDir = normalize(lightPos - FragPos);
     float diff = max(dot(normal, lightDir), 0.0);
-    float specStrength = max(texture(specularMap, UV).r, 0.5);
+    float specStrength = max(sampleMap(specularMap, specularArray, specularLayer, UV).r, 0.5);
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
-    vec3 diffuse = diff * diffuseTex * lightColor;
-    vec3 specular = spec * specStrength * lightColor;
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 diffuse = diff * diffuseColor * diffuseTex * lightColor;
+    vec3 specular = spec * specStrength * specularColor * lightColor;
 
     vec3 lightToFrag = normalize(FragPos - spotLightPos);
     float theta = dot(lightToFrag, normalize(spotLightDir)); // NO negation here
@@ -55,11 +169,11 @@ void main()
     float attenuation = 1.0 / (1.0 + 0.09 * distance + 0.032 * distance * distance);
 
     float spotDiff = max(dot(normal, -normalize(spotLightDir)), 0.0);
-    vec3 spotDiffuse = spotDiff * diffuseTex * spotLightColor * intensity * attenuation;
+    vec3 spotDiffuse = spotDiff * diffuseColor * diffuseTex * spotLightColor * intensity * attenuation;
 
     vec3 spotReflectDir = reflect(spotLightDir, normal);
-    float spotSpec = pow(max(dot(viewDir, spotReflectDir), 0.0), 32.0);
-    vec3 spotSpecular = specStrength * spotSpec * spotLightColor * intensity * attenuation;
+    float spotSpec = pow(max(dot(viewDir, spotReflectDir), 0.0), shininess);
+    vec3 spotSpecular = specStrength * spotSpec * specularColor * spotLightColor * intensity * attenuation;
 
     vec3 result = ambient + diffuse + specular + spotDiffuse + spotSpecular;
 
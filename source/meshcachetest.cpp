@@ -0,0 +1,168 @@
+//mesh cache test. Saves a small cooked mesh of two LODs with meshlets,
+//checks it opens with every stream intact, then opens broken copies of
+//it: sections past the end of the file, offsets that wrap round, no LODs,
+//submeshes and meshlets outside the index stream and indices outside the
+//vertex stream must all be refused so the model is cooked again rather
+//than drawn out of bounds. Exits with 1 if anything fails, runs without a
+//GPU.
+#include <vector>
+#include <cstring>
+#include <stdio.h>
+
+#include <common/meshcache.hpp>
+#include <common/mappedfile.hpp>
+
+namespace
+{
+    const char *sourcePath = "mesh_cache_test.obj";
+
+    //where MeshCache::save puts the fields the broken copies change
+    const size_t headerNumLods = 52;
+    const size_t headerSectionOffset = 96;
+    const size_t headerSectionSize = 152;
+    const int sectionVertices = 0;
+    const int sectionIndices = 1;
+    const int sectionSubmeshes = 2;
+    const int sectionLodErrors = 3;
+    const int sectionMeshlets = 4;
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    bool readFile(const char *path, std::vector<char> &data)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+        data.assign(file.data(), file.data() + file.size());
+        return true;
+    }
+
+    bool writeFile(const char *path, const std::vector<char> &data)
+    {
+        FILE *out = fopen(path, "wb");
+        if (out == NULL)
+            return false;
+        bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+        return fclose(out) == 0 && ok;
+    }
+
+    template<typename T> T readField(const std::vector<char> &data, size_t offset)
+    {
+        T value;
+        memcpy(&value, &data[offset], sizeof(T));
+        return value;
+    }
+
+    template<typename T> void writeField(std::vector<char> &data, size_t offset, T value)
+    {
+        memcpy(&data[offset], &value, sizeof(T));
+    }
+
+    //writes a changed copy of the cache in its place, true if it opens
+    bool openBroken(const std::vector<char> &cache)
+    {
+        MeshCache broken;
+        return writeFile(MeshCache::cachePath(sourcePath).c_str(), cache) && broken.open(sourcePath);
+    }
+
+    size_t sectionOffset(const std::vector<char> &cache, int section)
+    {
+        return static_cast<size_t>(readField<unsigned long long>(cache, headerSectionOffset + section * 8));
+    }
+}
+
+int main()
+{
+    //the source only has to exist, the cache records its size and time
+    std::vector<char> source(64, '#');
+    if (!writeFile(sourcePath, source))
+    {
+        printf("Couldn't write %s\n", sourcePath);
+        return 1;
+    }
+
+    //a quad of two triangles, then one triangle as the second LOD
+    std::vector<PackedVertex> vertices(4);
+    const unsigned short indices[9] = { 0, 1, 2, 2, 1, 3, 0, 1, 3 };
+    const Submesh submeshes[2] = { { 0, 6, 0, 0 }, { 6, 3, 0, 0 } };
+    const float lodErrors[2] = { 0.0f, 0.5f };
+    Meshlet meshlets[2] = { Meshlet(), Meshlet() };
+    meshlets[0].firstIndex = 0;
+    meshlets[0].numIndices = 6;
+    meshlets[1].firstIndex = 6;
+    meshlets[1].numIndices = 3;
+
+    MeshView mesh = MeshView();
+    mesh.vertices = vertices.data();
+    mesh.numVertices = static_cast<unsigned int>(vertices.size());
+    mesh.indices = indices;
+    mesh.indexSize = sizeof(unsigned short);
+    mesh.numIndices = 9;
+    mesh.submeshes = submeshes;
+    mesh.numSubmeshes = 1;
+    mesh.lodErrors = lodErrors;
+    mesh.numLods = 2;
+    mesh.meshlets = meshlets;
+    mesh.numMeshlets = 2;
+    check(MeshCache::save(sourcePath, mesh), "cache saved");
+
+    MeshCache cache;
+    bool opened = cache.open(sourcePath);
+    const MeshView &view = cache.view();
+    check(opened && view.numIndices == 9 && view.numLods == 2 && view.numMeshlets == 2 &&
+          memcmp(view.indices, indices, sizeof(indices)) == 0 &&
+          memcmp(view.submeshes, submeshes, sizeof(submeshes)) == 0, "cache opens with its streams");
+    cache.close();
+
+    std::vector<char> saved;
+    if (!readFile(MeshCache::cachePath(sourcePath).c_str(), saved))
+    {
+        printf("Couldn't read the cache back\n");
+        return 1;
+    }
+
+    std::vector<char> broken(saved.begin(), saved.end() - 64);
+    check(!openBroken(broken), "truncated cache refused");
+
+    //offset + size of the 64 byte vertex section wraps round to 0
+    broken = saved;
+    writeField<unsigned long long>(broken, headerSectionOffset + sectionVertices * 8, ~0ull - 63);
+    check(!openBroken(broken), "section offset that wraps refused");
+
+    broken = saved;
+    writeField<unsigned int>(broken, headerNumLods, 0);
+    writeField<unsigned long long>(broken, headerSectionSize + sectionSubmeshes * 8, 0);
+    writeField<unsigned long long>(broken, headerSectionSize + sectionLodErrors * 8, 0);
+    check(!openBroken(broken), "cache without LODs refused");
+
+    broken = saved;
+    writeField<unsigned int>(broken, sectionOffset(saved, sectionSubmeshes) + sizeof(Submesh), 8);
+    check(!openBroken(broken), "submesh past the indices refused");
+
+    //first + count wraps round in 32 bits
+    broken = saved;
+    writeField<unsigned int>(broken, sectionOffset(saved, sectionSubmeshes), ~0u - 2);
+    check(!openBroken(broken), "submesh whose range wraps refused");
+
+    broken = saved;
+    writeField<unsigned int>(broken, sectionOffset(saved, sectionMeshlets) + sizeof(Meshlet) + 4, 4);
+    check(!openBroken(broken), "meshlet past the indices refused");
+
+    broken = saved;
+    writeField<unsigned short>(broken, sectionOffset(saved, sectionIndices) + 8 * 2, 4);
+    check(!openBroken(broken), "index past the vertices refused");
+
+    check(openBroken(saved), "the saved cache still opens");
+
+    remove(MeshCache::cachePath(sourcePath).c_str());
+    remove(sourcePath);
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
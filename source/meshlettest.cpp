@@ -0,0 +1,192 @@
+//Meshlet test. Splits a 130k triangle sphere into meshlets, once in row
+//order and once with its triangles shuffled, and checks the meshlets run
+//one after another over the whole range within the vertex and triangle
+//limits, with every vertex inside their spheres. Then culls them from 200
+//random cameras outside the sphere, half of them just off its surface:
+//every triangle with a corner inside the frustum has to be in a range
+//that's kept, and with backface culling every triangle facing the camera
+//too. The ranges have to be in order, apart and whole meshlets. Exits
+//with 1 if anything fails.
+#include <set>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/meshlet.hpp>
+
+namespace
+{
+    const int sphereSegments = 256;
+    const int numCameras = 200;
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    //a unit UV sphere, counter-clockwise seen from outside
+    void makeSphere(int segments, std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices)
+    {
+        for (int y = 0; y <= segments; y++)
+            for (int x = 0; x <= segments; x++)
+            {
+                float longitude = x * 6.2831853f / segments, latitude = y * 3.1415927f / segments;
+                positions.push_back(glm::vec3(sinf(latitude) * cosf(longitude), cosf(latitude),
+                                              sinf(latitude) * sinf(longitude)));
+            }
+        for (int y = 0; y < segments; y++)
+            for (int x = 0; x < segments; x++)
+            {
+                unsigned int a = y * (segments + 1) + x, b = a + 1, c = a + segments + 1, d = c + 1;
+                unsigned int quad[6] = { a, b, c, b, d, c };
+                indices.insert(indices.end(), quad + (y == 0 ? 3 : 0), quad + (y == segments - 1 ? 3 : 6));
+            }
+    }
+
+    //meshlets one after another over the indices, in the limits, with
+    //their vertex counts right and every vertex in their spheres
+    bool wellFormed(const std::vector<Meshlet> &meshlets, const std::vector<unsigned int> &indices,
+                    const std::vector<glm::vec3> &positions)
+    {
+        unsigned int next = 0;
+        for (size_t i = 0; i < meshlets.size(); i++)
+        {
+            const Meshlet &meshlet = meshlets[i];
+            if (meshlet.firstIndex != next || meshlet.numIndices == 0 || meshlet.numIndices % 3 != 0 ||
+                meshlet.numIndices / 3 > maxMeshletTriangles || meshlet.numVertices > maxMeshletVertices)
+                return false;
+            std::set<unsigned int> vertices(indices.begin() + meshlet.firstIndex,
+                                            indices.begin() + meshlet.firstIndex + meshlet.numIndices);
+            if (vertices.size() != meshlet.numVertices)
+                return false;
+            for (std::set<unsigned int>::const_iterator v = vertices.begin(); v != vertices.end(); ++v)
+                if (glm::length(positions[*v] - meshlet.centre) > meshlet.radius * 1.0001f)
+                    return false;
+            next += meshlet.numIndices;
+        }
+        return next == indices.size();
+    }
+
+    //ranges in order, not touching, each made of whole meshlets
+    bool rangesValid(const std::vector<IndexRange> &ranges, const std::vector<Meshlet> &meshlets)
+    {
+        std::set<unsigned int> starts, ends;
+        for (size_t i = 0; i < meshlets.size(); i++)
+        {
+            starts.insert(meshlets[i].firstIndex);
+            ends.insert(meshlets[i].firstIndex + meshlets[i].numIndices);
+        }
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            if (!starts.count(ranges[i].firstIndex) || !ends.count(ranges[i].firstIndex + ranges[i].numIndices))
+                return false;
+            if (i > 0 && ranges[i].firstIndex <= ranges[i - 1].firstIndex + ranges[i - 1].numIndices)
+                return false;
+        }
+        return true;
+    }
+
+    bool inFrustum(const glm::mat4 &modelViewProjection, const glm::vec3 &p)
+    {
+        glm::vec4 clip = modelViewProjection * glm::vec4(p, 1.0f);
+        return clip.w > 0.0f && std::fabs(clip.x) < clip.w && std::fabs(clip.y) < clip.w && std::fabs(clip.z) < clip.w;
+    }
+
+    bool facing(const glm::vec3 &camera, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+    {
+        return glm::dot(glm::cross(b - a, c - a), camera - a) > 0.0f;
+    }
+
+    void cullAndCheck(const char *name, const std::vector<unsigned int> &indices, const std::vector<glm::vec3> &positions)
+    {
+        std::vector<Meshlet> meshlets;
+        buildMeshlets(indices.data(), 0, static_cast<unsigned int>(indices.size()), positions.data(),
+                      positions.size(), meshlets);
+        printf("%s: %zu triangles, %zu meshlets\n", name, indices.size() / 3, meshlets.size());
+        char line[96];
+        snprintf(line, sizeof(line), "%s, meshlets cover the range within the limits", name);
+        check(wellFormed(meshlets, indices, positions), line);
+
+        std::mt19937 generator(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        bool frustumKept = true, facingKept = true, valid = true;
+        size_t frustumMeshlets = 0, facingMeshlets = 0;
+        for (int i = 0; i < numCameras; i++)
+        {
+            glm::vec3 direction(unit(generator), unit(generator), unit(generator));
+            if (glm::length(direction) < 0.1f)
+                direction = glm::vec3(0.0f, 0.0f, 1.0f);
+            //half of them close enough for the meshlets' size to matter
+            float distance = i % 2 == 0 ? 1.01f + 0.05f * (unit(generator) + 1.0f) : 1.3f + 3.0f * (unit(generator) + 1.0f);
+            glm::vec3 camera = glm::normalize(direction) * distance;
+            glm::vec3 target(unit(generator) * 0.8f, unit(generator) * 0.8f, unit(generator) * 0.8f);
+            glm::mat4 view = glm::lookAt(camera, target, glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::mat4 projection = glm::perspective(glm::radians(10.0f + 15.0f * (unit(generator) + 1.0f)),
+                                                    1.5f, 0.1f, 100.0f);
+            glm::mat4 modelViewProjection = projection * view;
+
+            for (int backfaces = 0; backfaces < 2; backfaces++)
+            {
+                std::vector<IndexRange> ranges;
+                size_t kept = cullMeshlets(meshlets.data(), meshlets.size(), modelViewProjection, camera,
+                                           backfaces == 1, ranges);
+                (backfaces ? facingMeshlets : frustumMeshlets) += kept;
+                valid = valid && rangesValid(ranges, meshlets);
+
+                std::vector<bool> drawn(indices.size() / 3, false);
+                for (size_t r = 0; r < ranges.size(); r++)
+                    for (unsigned int t = ranges[r].firstIndex / 3; t < (ranges[r].firstIndex + ranges[r].numIndices) / 3; t++)
+                        drawn[t] = true;
+                for (size_t t = 0; t < drawn.size(); t++)
+                {
+                    const glm::vec3 &a = positions[indices[t * 3]], &b = positions[indices[t * 3 + 1]],
+                                    &c = positions[indices[t * 3 + 2]];
+                    bool visible = inFrustum(modelViewProjection, a) || inFrustum(modelViewProjection, b) ||
+                                   inFrustum(modelViewProjection, c);
+                    if (backfaces == 0)
+                        frustumKept = frustumKept && (drawn[t] || !visible);
+                    else
+                        facingKept = facingKept && (drawn[t] || !visible || !facing(camera, a, b, c));
+                }
+            }
+        }
+        printf("%s: %.0f meshlets kept in the frustum, %.0f of them facing the camera\n", name,
+               static_cast<double>(frustumMeshlets) / numCameras, static_cast<double>(facingMeshlets) / numCameras);
+
+        snprintf(line, sizeof(line), "%s, no triangle in the frustum culled", name);
+        check(frustumKept, line);
+        snprintf(line, sizeof(line), "%s, no triangle facing the camera culled", name);
+        check(facingKept, line);
+        snprintf(line, sizeof(line), "%s, ranges in order, apart and whole", name);
+        check(valid, line);
+    }
+}
+
+int main()
+{
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    makeSphere(sphereSegments, positions, indices);
+    cullAndCheck("rows", indices, positions);
+
+    std::mt19937 generator(2);
+    for (size_t i = indices.size() / 3; i > 1; i--)
+    {
+        size_t j = generator() % i;
+        for (int k = 0; k < 3; k++)
+            std::swap(indices[(i - 1) * 3 + k], indices[j * 3 + k]);
+    }
+    cullAndCheck("shuffled", indices, positions);
+
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
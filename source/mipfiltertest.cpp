@@ -0,0 +1,185 @@
+//Mip filter test. Builds mip chains of random images of every component
+//count with every filter, at odd sizes, 1xN and Nx1 among them, on a pool
+//of 4, and holds each level against a scalar box filter written out here
+//pixel by pixel from the same formulas: bytes over 255 or decoded from
+//sRGB, rows summed then pairs, a quarter of that, and the sRGB byte whose
+//halfway thresholds the average lies between. The coursework's textures
+//are checked the same way with the filters the cooker gives them. Exits
+//with 1 if anything fails.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdio.h>
+
+#include <common/mipmap.hpp>
+#include <common/threadpool.hpp>
+
+namespace
+{
+    const unsigned int poolThreads = 4;
+    const int sizes[][2] = {
+        { 1, 1 }, { 2, 2 }, { 1, 37 }, { 53, 1 }, { 3, 5 }, { 17, 16 }, { 64, 64 }, { 101, 67 }, { 300, 301 }
+    };
+    struct Asset { const char *path; MipFilter filter; };
+    const Asset assets[] = {
+        { "../assets/stones_diffuse.png", MIP_SRGB }, { "../assets/stones_normal.png", MIP_NORMAL },
+        { "../assets/stones_specular.png", MIP_LINEAR }, { "../assets/crate.jpg", MIP_SRGB }
+    };
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    float decodeSRGB(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    unsigned char toByte(float v)
+    {
+        return static_cast<unsigned char>(std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f));
+    }
+
+    //the byte above every threshold v reaches
+    unsigned char toSRGBByte(float v)
+    {
+        v = std::min(std::max(v, 0.0f), 1.0f);
+        int byte = 0;
+        while (byte < 255 && v >= decodeSRGB((byte + 0.5f) / 255.0f))
+            byte++;
+        return static_cast<unsigned char>(byte);
+    }
+
+    bool isAlpha(int components, int c)
+    {
+        return (components == 2 && c == 1) || (components == 4 && c == 3);
+    }
+
+    //one level down, a pixel at a time
+    std::vector<unsigned char> referenceLevel(const unsigned char *pixels, int width, int height, int components,
+                                              MipFilter filter)
+    {
+        int nextWidth = std::max(width / 2, 1), nextHeight = std::max(height / 2, 1);
+        std::vector<unsigned char> out(static_cast<size_t>(nextWidth) * nextHeight * components);
+        for (int y = 0; y < nextHeight; y++)
+            for (int x = 0; x < nextWidth; x++)
+            {
+                int ys[2] = { std::min(y * 2, height - 1), std::min(y * 2 + 1, height - 1) };
+                int xs[2] = { x * 2, std::min(x * 2 + 1, width - 1) };
+                float value[4];
+                for (int c = 0; c < components; c++)
+                {
+                    bool srgb = filter == MIP_SRGB && !isAlpha(components, c);
+                    float sums[2];
+                    for (int i = 0; i < 2; i++)
+                    {
+                        float samples[2];
+                        for (int j = 0; j < 2; j++)
+                        {
+                            unsigned char byte = pixels[(static_cast<size_t>(ys[j]) * width + xs[i]) * components + c];
+                            samples[j] = srgb ? decodeSRGB(byte / 255.0f) : byte / 255.0f;
+                        }
+                        sums[i] = samples[0] + samples[1];
+                    }
+                    value[c] = (sums[0] + sums[1]) * 0.25f;
+                }
+
+                unsigned char *pixel = &out[(static_cast<size_t>(y) * nextWidth + x) * components];
+                if (filter == MIP_NORMAL && components >= 3)
+                {
+                    float n[3];
+                    for (int c = 0; c < 3; c++)
+                        n[c] = value[c] * 2.0f - 1.0f;
+                    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (length < 1e-6f)
+                    {
+                        n[0] = n[1] = 0.0f;
+                        n[2] = length = 1.0f;
+                    }
+                    for (int c = 0; c < 3; c++)
+                        pixel[c] = toByte((n[c] / length) * 0.5f + 0.5f);
+                    if (components == 4)
+                        pixel[3] = toByte(value[3]);
+                    continue;
+                }
+                for (int c = 0; c < components; c++)
+                    pixel[c] = filter == MIP_SRGB && !isAlpha(components, c) ? toSRGBByte(value[c]) : toByte(value[c]);
+            }
+        return out;
+    }
+
+    //every level of chain against the reference made from the level above
+    bool matchesReference(const MipChain &chain, MipFilter filter)
+    {
+        if (chain.numLevels() != mipLevelCount(chain.width, chain.height))
+            return false;
+        for (unsigned int i = 1; i < chain.numLevels(); i++)
+        {
+            std::vector<unsigned char> expected = referenceLevel(chain.level(i - 1), chain.levelWidth(i - 1),
+                                                                 chain.levelHeight(i - 1), chain.components, filter);
+            if (expected.size() != chain.levelSize(i) || memcmp(expected.data(), chain.level(i), expected.size()) != 0)
+                return false;
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    ThreadPool pool(poolThreads);
+    std::mt19937 generator(1);
+    const char *filterNames[] = { "linear", "sRGB", "normal" };
+
+    //random images, with runs of one value so sums land on the thresholds
+    for (int filter = MIP_LINEAR; filter <= MIP_NORMAL; filter++)
+    {
+        bool matched = true;
+        for (int components = 1; components <= 4; components++)
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            {
+                int width = sizes[s][0], height = sizes[s][1];
+                std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * components);
+                for (size_t i = 0; i < pixels.size(); i++)
+                    pixels[i] = generator() % 4 == 0 && i > 0 ? pixels[i - 1] : static_cast<unsigned char>(generator());
+                MipChain chain;
+                generateMipChain(pixels.data(), width, height, components, static_cast<MipFilter>(filter), chain, pool);
+                matched = matched && matchesReference(chain, static_cast<MipFilter>(filter));
+            }
+        char what[64];
+        snprintf(what, sizeof(what), "random %s chains match the scalar filter", filterNames[filter]);
+        check(matched, what);
+    }
+
+    //the coursework's, 4 channels as the cooker loads them
+    bool found = true, matched = true;
+    for (size_t i = 0; i < sizeof(assets) / sizeof(assets[0]); i++)
+    {
+        int width, height, components;
+        unsigned char *pixels = stbi_load(assets[i].path, &width, &height, &components, 4);
+        if (!pixels)
+        {
+            printf("%s couldn't be loaded\n", assets[i].path);
+            found = false;
+            continue;
+        }
+        MipChain chain;
+        generateMipChain(pixels, width, height, 4, assets[i].filter, chain, pool);
+        matched = matched && matchesReference(chain, assets[i].filter);
+        stbi_image_free(pixels);
+    }
+    check(found, "coursework textures loaded");
+    check(matched, "coursework texture chains match the scalar filter");
+
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
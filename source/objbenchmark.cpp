@@ -0,0 +1,234 @@
+//OBJ parse benchmark. Parses the OBJ files given on the command line, or a
+//generated grid of about 50 MB when there are none, with the fscanf loop
+//Model::loadObj used to have, then with parseObj on one thread and on
+//every core, and prints the throughput of each in MB/s. The parsed corners
+//are checked against the fscanf ones, so exits with 1 if they differ.
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include <common/objparser.hpp>
+#include <common/mappedfile.hpp>
+
+namespace
+{
+    const int repeats = 3;
+    const int generatedGrid = 512;
+    const char *generatedPath = "obj_benchmark.obj";
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    //a grid of quads split into triangles, every corner with a uv and normal
+    bool writeGrid(const char *path, int size)
+    {
+        FILE *file = fopen(path, "w");
+        if (file == NULL)
+            return false;
+        fprintf(file, "# %dx%d grid written by the OBJ benchmark\n", size, size);
+        for (int y = 0; y <= size; y++)
+            for (int x = 0; x <= size; x++)
+            {
+                float u = static_cast<float>(x) / size, v = static_cast<float>(y) / size;
+                fprintf(file, "v %f %f %f\n", u * 10.0f - 5.0f, 0.5f * sinf(u * 20.0f) * cosf(v * 20.0f), v * 10.0f - 5.0f);
+                fprintf(file, "vt %f %f\n", u, v);
+                fprintf(file, "vn %f %f %f\n", 0.0f, 1.0f, 0.0f);
+            }
+        for (int y = 0; y < size; y++)
+            for (int x = 0; x < size; x++)
+            {
+                int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+                fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+                fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+            }
+        return fclose(file) == 0;
+    }
+
+    //the loader as it was before the OBJ parser, one corner per output
+    //vertex. Only reads triangles with all three indices.
+    bool loadObjReference(const char *path, std::vector<glm::vec3> &outVertices,
+                          std::vector<glm::vec2> &outUVs, std::vector<glm::vec3> &outNormals)
+    {
+        std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+        std::vector<glm::vec3> tempVertices;
+        std::vector<glm::vec2> tempUVs;
+        std::vector<glm::vec3> tempNormals;
+
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+            return false;
+
+        while (true)
+        {
+            char lineHeader[128];
+            int res = fscanf(file, "%127s", lineHeader);
+            if (res == EOF)
+                break;
+
+            if (strcmp(lineHeader, "v") == 0)
+            {
+                glm::vec3 vertex;
+                if (fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z) != 3)
+                    break;
+                tempVertices.push_back(vertex);
+            }
+            else if (strcmp(lineHeader, "vt") == 0)
+            {
+                glm::vec2 uv;
+                if (fscanf(file, "%f %f\n", &uv.x, &uv.y) != 2)
+                    break;
+                tempUVs.push_back(uv);
+            }
+            else if (strcmp(lineHeader, "vn") == 0)
+            {
+                glm::vec3 normal;
+                if (fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z) != 3)
+                    break;
+                tempNormals.push_back(normal);
+            }
+            else if (strcmp(lineHeader, "f") == 0)
+            {
+                unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
+                int matches = fscanf(file, "%u/%u/%u %u/%u/%u %u/%u/%u\n",
+                                     &vertexIndex[0], &uvIndex[0], &normalIndex[0],
+                                     &vertexIndex[1], &uvIndex[1], &normalIndex[1],
+                                     &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
+                if (matches != 9)
+                {
+                    fclose(file);
+                    return false;
+                }
+                vertexIndices.insert(vertexIndices.end(), vertexIndex, vertexIndex + 3);
+                uvIndices.insert(uvIndices.end(), uvIndex, uvIndex + 3);
+                normalIndices.insert(normalIndices.end(), normalIndex, normalIndex + 3);
+            }
+            else
+            {
+                char commentBuffer[1000];
+                if (fgets(commentBuffer, 1000, file) == NULL)
+                    break;
+            }
+        }
+        fclose(file);
+
+        for (size_t i = 0; i < vertexIndices.size(); i++)
+        {
+            if (vertexIndices[i] - 1 >= tempVertices.size() || uvIndices[i] - 1 >= tempUVs.size() ||
+                normalIndices[i] - 1 >= tempNormals.size())
+                return false;
+            outVertices.push_back(tempVertices[vertexIndices[i] - 1]);
+            outUVs.push_back(tempUVs[uvIndices[i] - 1]);
+            outNormals.push_back(tempNormals[normalIndices[i] - 1]);
+        }
+        return true;
+    }
+
+    //the text is decimal, both round it to the nearest float
+    bool sameValues(const float *a, const float *b, int count)
+    {
+        for (int i = 0; i < count; i++)
+            if (fabsf(a[i] - b[i]) > 1e-6f * std::max(1.0f, fabsf(a[i])))
+                return false;
+        return true;
+    }
+
+    //the fastest of a few parses on numThreads, 0 for every core
+    double timeParse(const MappedFile &file, unsigned int numThreads, ObjData &obj, bool &ok)
+    {
+        double best = 0.0;
+        for (int i = 0; i < repeats; i++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ok = parseObj(file.data(), file.size(), obj, numThreads);
+            double milliseconds = millisecondsSince(start);
+            best = i == 0 ? milliseconds : std::min(best, milliseconds);
+        }
+        return best;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+        paths.push_back(argv[i]);
+    bool generated = paths.empty();
+    if (generated)
+    {
+        if (!writeGrid(generatedPath, generatedGrid))
+        {
+            printf("Couldn't write %s\n", generatedPath);
+            return 1;
+        }
+        paths.push_back(generatedPath);
+    }
+
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    int failures = 0;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        const char *path = paths[i].c_str();
+        MappedFile file;
+        if (!file.open(path))
+        {
+            printf("%s couldn't be opened\n", path);
+            failures++;
+            continue;
+        }
+        double megabytes = file.size() / (1024.0 * 1024.0);
+
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool referenceOk = loadObjReference(path, vertices, uvs, normals);
+        double referenceMilliseconds = millisecondsSince(start);
+
+        ObjData obj;
+        bool ok;
+        double serialMilliseconds = timeParse(file, 1, obj, ok);
+        double parallelMilliseconds = timeParse(file, 0, obj, ok);
+        if (!ok)
+        {
+            printf("%s couldn't be parsed\n", path);
+            failures++;
+            continue;
+        }
+
+        //the reference only reads v/vt/vn triangles, anything else isn't compared
+        const char *match = "not compared";
+        if (referenceOk)
+        {
+            bool same = vertices.size() == obj.corners.size();
+            for (size_t c = 0; c < obj.corners.size() && same; c++)
+            {
+                const ObjCorner &corner = obj.corners[c];
+                same = corner.vt >= 0 && corner.vn >= 0 &&
+                       sameValues(&obj.positions[corner.v].x, &vertices[c].x, 3) &&
+                       sameValues(&obj.uvs[corner.vt].x, &uvs[c].x, 2) &&
+                       sameValues(&obj.normals[corner.vn].x, &normals[c].x, 3);
+            }
+            match = same ? "matches fscanf" : "DIFFERS from fscanf";
+            if (!same)
+                failures++;
+        }
+
+        printf("%s: %.1f MB, %zu triangles, %s\n", path, megabytes, obj.corners.size() / 3, match);
+        if (referenceOk)
+            printf("  fscanf            %8.1f ms %8.1f MB/s\n", referenceMilliseconds, megabytes * 1000.0 / referenceMilliseconds);
+        printf("  parseObj 1 thread %8.1f ms %8.1f MB/s\n", serialMilliseconds, megabytes * 1000.0 / serialMilliseconds);
+        printf("  parseObj %2u cores %8.1f ms %8.1f MB/s\n", cores, parallelMilliseconds, megabytes * 1000.0 / parallelMilliseconds);
+    }
+
+    if (generated)
+        remove(generatedPath);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+//OBJ parse test. Generates about 12 MB of OBJ text with every corner form,
+//polygons, CRLF lines, comments, materials and relative indices reaching
+//back across many chunks, then parses it on one thread and split into
+//chunks on a pool of 8. Both have to give the corners the generator wrote
+//and the same arrays, and both have to reject an index out of range in
+//the middle of the file. Empty and vertex only files parse to no corners.
+//Runs on any number of cores as the pool is its own, exits with 1 if
+//anything fails.
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include <common/objparser.hpp>
+#include <common/threadpool.hpp>
+
+namespace
+{
+    const size_t generatedBytes = 12 << 20;
+    const unsigned int poolThreads = 8;
+    const int maxBackReference = 200000;
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    //what the generator wrote, for comparing the parses to
+    struct Expected
+    {
+        size_t positions, uvs, normals;
+        std::vector<ObjCorner> corners;
+        std::vector<ObjMaterialUse> materialUses;
+        std::vector<std::string> materialLibraries;
+    };
+
+    void appendLine(std::string &text, const char *line, bool crlf)
+    {
+        text += line;
+        text += crlf ? "\r\n" : "\n";
+    }
+
+    //1-based as written, or relative to what was read so far
+    int writtenIndex(int index, size_t count, bool relative)
+    {
+        return relative ? index - static_cast<int>(count) : index + 1;
+    }
+
+    //one face of 3 to 6 corners in one of the four corner forms, fan
+    //triangulated into expected
+    void appendFace(std::string &text, Expected &expected)
+    {
+        int numCorners = 3 + rand() % 4;
+        int form = rand() % 4;          //v, v/vt, v//vn, v/vt/vn
+        bool relative = rand() % 2 == 0;
+        std::vector<ObjCorner> polygon(numCorners);
+        std::string line = "f";
+        for (int i = 0; i < numCorners; i++)
+        {
+            int back = 1 + rand() % maxBackReference;
+            ObjCorner corner;
+            corner.v = static_cast<int>(expected.positions) - std::min(back, static_cast<int>(expected.positions));
+            corner.vt = form == 1 || form == 3 ? static_cast<int>(expected.uvs) - 1 - rand() % 16 : -1;
+            corner.vn = form == 2 || form == 3 ? static_cast<int>(expected.normals) - 1 - rand() % 16 : -1;
+            polygon[i] = corner;
+
+            char written[64];
+            int v = writtenIndex(corner.v, expected.positions, relative);
+            int vt = writtenIndex(corner.vt, expected.uvs, relative);
+            int vn = writtenIndex(corner.vn, expected.normals, relative);
+            if (form == 0)
+                snprintf(written, sizeof(written), " %d", v);
+            else if (form == 1)
+                snprintf(written, sizeof(written), " %d/%d", v, vt);
+            else if (form == 2)
+                snprintf(written, sizeof(written), " %d//%d", v, vn);
+            else
+                snprintf(written, sizeof(written), " %d/%d/%d", v, vt, vn);
+            line += written;
+        }
+        if (rand() % 8 == 0)
+            line += " # comment";
+        appendLine(text, line.c_str(), rand() % 4 == 0);
+
+        for (int i = 1; i + 1 < numCorners; i++)
+        {
+            expected.corners.push_back(polygon[0]);
+            expected.corners.push_back(polygon[i]);
+            expected.corners.push_back(polygon[i + 1]);
+        }
+    }
+
+    //blocks of 32 vertices with uvs and normals, each followed by faces
+    //that reach back up to maxBackReference vertices
+    std::string generate(Expected &expected)
+    {
+        std::string text;
+        expected = Expected();
+        appendLine(text, "# written by the OBJ parse test", false);
+        appendLine(text, "mtllib first.mtl second.mtl", false);
+        expected.materialLibraries.push_back("first.mtl");
+        expected.materialLibraries.push_back("second.mtl");
+
+        char line[128];
+        while (text.size() < generatedBytes)
+        {
+            for (int i = 0; i < 32; i++)
+            {
+                bool crlf = rand() % 4 == 0;
+                snprintf(line, sizeof(line), "v %d.%03d %d %de-2", rand() % 200 - 100, rand() % 1000, rand() % 50, rand());
+                appendLine(text, line, crlf);
+                snprintf(line, sizeof(line), "vt 0.%04d 0.%04d", rand() % 10000, rand() % 10000);
+                appendLine(text, line, crlf);
+                snprintf(line, sizeof(line), "vn %d %d 1", rand() % 3 - 1, rand() % 3 - 1);
+                appendLine(text, line, crlf);
+                expected.positions++;
+                expected.uvs++;
+                expected.normals++;
+            }
+            if (rand() % 64 == 0)
+            {
+                ObjMaterialUse use = { "material " + std::to_string(rand() % 10), expected.corners.size() };
+                expected.materialUses.push_back(use);
+                appendLine(text, ("usemtl " + use.name).c_str(), false);
+            }
+            if (rand() % 256 == 0)
+            {
+                expected.materialLibraries.push_back("more.mtl");
+                appendLine(text, "mtllib more.mtl", false);
+            }
+            if (rand() % 16 == 0)
+                appendLine(text, "g group", false);
+            for (int i = 0; i < 24; i++)
+                appendFace(text, expected);
+        }
+
+        //no newline after the last face
+        text.resize(text.size() - 1);
+        if (!text.empty() && text[text.size() - 1] == '\r')
+            text.resize(text.size() - 1);
+        return text;
+    }
+
+    bool sameCorners(const std::vector<ObjCorner> &a, const std::vector<ObjCorner> &b)
+    {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(ObjCorner)) == 0);
+    }
+
+    bool sameUses(const std::vector<ObjMaterialUse> &a, const std::vector<ObjMaterialUse> &b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++)
+            if (a[i].name != b[i].name || a[i].firstCorner != b[i].firstCorner)
+                return false;
+        return true;
+    }
+
+    bool matchesExpected(const ObjData &obj, const Expected &expected)
+    {
+        return obj.positions.size() == expected.positions && obj.uvs.size() == expected.uvs &&
+               obj.normals.size() == expected.normals && sameCorners(obj.corners, expected.corners) &&
+               sameUses(obj.materialUses, expected.materialUses) &&
+               obj.materialLibraries == expected.materialLibraries;
+    }
+
+    bool sameData(const ObjData &a, const ObjData &b)
+    {
+        return a.positions == b.positions && a.uvs == b.uvs && a.normals == b.normals &&
+               sameCorners(a.corners, b.corners) && sameUses(a.materialUses, b.materialUses) &&
+               a.materialLibraries == b.materialLibraries;
+    }
+
+    //a serial and a chunked parse of text, true if both give ok
+    bool parseBoth(const std::string &text, ObjData &serial, ObjData &chunked, ThreadPool &pool, bool ok)
+    {
+        bool serialOk = parseObj(text.data(), text.size(), serial, 1, pool);
+        bool chunkedOk = parseObj(text.data(), text.size(), chunked, poolThreads, pool);
+        return serialOk == ok && chunkedOk == ok;
+    }
+}
+
+int main()
+{
+    srand(1);
+    ThreadPool pool(poolThreads);
+
+    Expected expected;
+    std::string text = generate(expected);
+    printf("%zu bytes, %zu vertices, %zu corners\n", text.size(), expected.positions, expected.corners.size());
+
+    ObjData serial, chunked;
+    check(parseBoth(text, serial, chunked, pool, true), "generated file parses");
+    check(matchesExpected(serial, expected), "serial parse gives the corners written");
+    check(matchesExpected(chunked, expected), "chunked parse gives the corners written");
+    check(sameData(serial, chunked), "serial and chunked parses are identical");
+
+    //a relative index reaching back past the first vertex, in the middle
+    std::string broken = text;
+    size_t middle = broken.find('\n', broken.size() / 2) + 1;
+    broken.insert(middle, "f 1 2 -99999999\n");
+    check(parseBoth(broken, serial, chunked, pool, false), "relative index before the first vertex rejected");
+
+    broken = text;
+    broken.insert(middle, "f 1 2 99999999\n");
+    check(parseBoth(broken, serial, chunked, pool, false), "index past the last vertex rejected");
+
+    std::string empty;
+    check(parseBoth(empty, serial, chunked, pool, true) && serial.corners.empty() && chunked.corners.empty() &&
+          serial.positions.empty(), "empty file parses to nothing");
+
+    std::string vertices = "v 1 2 3\nv 4 5 6\r\nvn 0 1 0";
+    check(parseBoth(vertices, serial, chunked, pool, true) && serial.positions.size() == 2 &&
+          serial.normals.size() == 1 && serial.corners.empty() && sameData(serial, chunked),
+          "vertices without faces parse");
+
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+//page table test. Drives the virtual texture page table through requests,
+//loads and evictions without a GPU: requesting a page has to request its
+//ancestors too, coarsest loaded first, full caches have to evict the least
+//recently used page nothing asked for this frame, and every indirection
+//entry has to point at the finest resident page covering it, checked
+//against a brute force search after each frame of a random run. Exits
+//with 1 if anything fails.
+#include <vector>
+#include <set>
+#include <cstdlib>
+#include <stdio.h>
+
+#include <common/pagetable.hpp>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    //requests the pages of a frame and loads whatever update() picks
+    std::vector<PageLoad> loadFrame(PageTable &table, const int (*pages)[3], size_t numPages)
+    {
+        table.beginFrame();
+        for (size_t i = 0; i < numPages; i++)
+            table.request(pages[i][0], pages[i][1], pages[i][2]);
+        std::vector<PageLoad> loads = table.update(64);
+        for (size_t i = 0; i < loads.size(); i++)
+            table.pageLoaded(loads[i].level, loads[i].x, loads[i].y);
+        return loads;
+    }
+
+    bool isLoad(const PageLoad &load, int level, int x, int y)
+    {
+        return load.level == level && load.x == x && load.y == y;
+    }
+
+    //true if every entry points at the finest resident page covering it
+    //and no two resident pages share a slot
+    bool entriesConsistent(const PageTable &table)
+    {
+        std::set<int> slots;
+        for (int level = 0; level < table.numLevels(); level++)
+            for (int y = 0; y < table.levelPagesY(level); y++)
+                for (int x = 0; x < table.levelPagesX(level); x++)
+                {
+                    int found = level, foundX = x, foundY = y;
+                    while (found < table.numLevels() && !table.isResident(found, foundX, foundY))
+                    {
+                        found++;
+                        foundX >>= 1;
+                        foundY >>= 1;
+                    }
+
+                    const PageTableEntry &entry = table.entry(level, x, y);
+                    if (found == table.numLevels())
+                    {
+                        if (entry.valid)
+                            return false;
+                    }
+                    else if (!entry.valid || entry.level != found ||
+                             entry.slot != table.entry(found, foundX, foundY).slot)
+                        return false;
+                    if (table.isResident(level, x, y) && !slots.insert(entry.slot).second)
+                        return false;
+                }
+        return true;
+    }
+
+    void testAncestors()
+    {
+        //16x8 pages, then 8x4, 4x2, 2x1 and 1x1
+        PageTable table(16, 8, 16);
+        const int frame[][3] = { { 0, 5, 3 } };
+        std::vector<PageLoad> loads = loadFrame(table, frame, 1);
+        check(table.numLevels() == 5 && loads.size() == 5, "a page brings its ancestors");
+        check(loads.size() == 5 && isLoad(loads[0], 4, 0, 0) && isLoad(loads[1], 3, 0, 0) &&
+              isLoad(loads[2], 2, 1, 0) && isLoad(loads[3], 1, 2, 1) && isLoad(loads[4], 0, 5, 3),
+              "coarsest pages load first");
+
+        //the page itself, its sibling falling back to their parent, and a
+        //page far away only covered by the top
+        const PageTableEntry &page = table.entry(0, 5, 3);
+        const PageTableEntry &sibling = table.entry(0, 4, 3);
+        const PageTableEntry &far = table.entry(0, 12, 6);
+        check(loads.size() == 5 && page.valid && page.level == 0 && page.slot == loads[4].slot &&
+              sibling.valid && sibling.level == 1 && sibling.slot == loads[3].slot &&
+              far.valid && far.level == 4, "finest resident page wins");
+        check(entriesConsistent(table), "every entry points at its finest resident page");
+
+        //requesting the same page again loads nothing
+        loads = loadFrame(table, frame, 1);
+        check(loads.empty(), "resident pages aren't loaded again");
+    }
+
+    void testEviction()
+    {
+        //4x4 pages, then 2x2 and 1x1, with room for the top and three more
+        PageTable table(4, 4, 4);
+        const int first[][3] = { { 1, 0, 0 } };
+        const int second[][3] = { { 1, 1, 0 } };
+        const int third[][3] = { { 1, 0, 1 } };
+        loadFrame(table, first, 1);
+        loadFrame(table, second, 1);
+        loadFrame(table, third, 1);
+        int secondSlot = table.entry(1, 1, 0).slot;
+        int thirdSlot = table.entry(1, 0, 1).slot;
+
+        //touching the first page makes the second the least recently used
+        loadFrame(table, first, 1);
+        const int fourth[][3] = { { 1, 1, 1 } };
+        std::vector<PageLoad> loads = loadFrame(table, fourth, 1);
+        check(loads.size() == 1 && loads[0].slot == secondSlot && !table.isResident(1, 1, 0) &&
+              table.isResident(1, 0, 0) && table.isResident(1, 0, 1),
+              "least recently used page evicted first");
+        check(table.entry(0, 2, 0).level == 2 && table.entry(1, 1, 0).level == 2,
+              "evicted page falls back to its parent");
+
+        loads = loadFrame(table, second, 1);
+        check(loads.size() == 1 && loads[0].slot == thirdSlot && !table.isResident(1, 0, 1) &&
+              table.isResident(1, 0, 0), "then the next least recently used");
+
+        //everything is wanted this frame, so nothing can make room
+        const int all[][3] = { { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 1, 0, 1 } };
+        loads = loadFrame(table, all, 4);
+        PageTableStats stats = table.stats();
+        check(loads.empty() && stats.dropped == 1 && table.isResident(2, 0, 0),
+              "pages requested this frame aren't evicted");
+        check(entriesConsistent(table), "every entry points at its finest resident page");
+    }
+
+    void testRandom()
+    {
+        //loads finish a frame late and one in ten fails, like the streamer
+        srand(1);
+        PageTable table(16, 8, 24);
+        std::vector<PageLoad> loading;
+        bool consistent = true, fits = true;
+        for (int frame = 0; frame < 2000; frame++)
+        {
+            table.beginFrame();
+            int centreX = rand() % 16, centreY = rand() % 8;
+            for (int i = 0; i < 6; i++)
+                table.request(rand() % 2, (centreX + rand() % 3) % 16, (centreY + rand() % 3) % 8);
+            std::vector<PageLoad> loads = table.update(4);
+            for (size_t i = 0; i < loading.size(); i++)
+            {
+                if (rand() % 10 != 0)
+                    table.pageLoaded(loading[i].level, loading[i].x, loading[i].y);
+                else
+                    table.pageFailed(loading[i].level, loading[i].x, loading[i].y);
+            }
+            loading = loads;
+
+            PageTableStats stats = table.stats();
+            consistent = consistent && entriesConsistent(table);
+            fits = fits && stats.resident + stats.loading <= static_cast<size_t>(table.numSlots());
+        }
+        PageTableStats stats = table.stats();
+        printf("random run: %zu loads, %zu evictions, %zu dropped\n", stats.loads, stats.evictions, stats.dropped);
+        check(consistent, "entries stay consistent through a random run");
+        check(fits && stats.evictions != 0, "pages fit in the slots");
+        check(table.isResident(table.numLevels() - 1, 0, 0), "top page stays resident");
+    }
+}
+
+int main()
+{
+    testAncestors();
+    testEviction();
+    testRandom();
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+//PNG decode test. Holds stb_image's fast inflate loop, SSE2 unfiltering
+//and unfiltering straight into the output against the paths they replace,
+//stb_image built a second time with STBI_PNG_REFERENCE. Zlib streams from
+//testZlib and the image data of the coursework's PNGs are inflated into
+//memory of stb's own and into buffers too small, exactly big enough and
+//bigger, then corrupted and truncated copies of them, and every result has
+//to be the same. Generated PNGs of every colour type, depth and interlacing
+//and the coursework's PNGs have to load the same at every channel count
+//and at 16 bits, damaged or not. Exits with 1 if anything fails.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+
+#include <random>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdio.h>
+
+#include <source/testpng.hpp>
+#include <source/stbreference.hpp>
+
+namespace
+{
+    const char *assetPaths[] = {
+        "../assets/bricks_diffuse.png", "../assets/bricks_normal.png", "../assets/bricks_specular.png",
+        "../assets/stones_diffuse.png", "../assets/stones_normal.png", "../assets/stones_specular.png"
+    };
+    const size_t generatedSizes[] = { 0, 1, 5, 1000, 70000, 400000 };
+    const int generatedDamaged = 150;
+    const int assetDamaged = 6;
+
+    int failures = 0;
+    std::mt19937 generator(1);
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    //runs, short repeats, copies from far back and noise, so the matches
+    //cover every length and distance
+    std::vector<unsigned char> makeData(size_t size)
+    {
+        std::vector<unsigned char> data;
+        while (data.size() < size)
+        {
+            size_t length = std::min<size_t>(size - data.size(), 1 + generator() % 3000);
+            int kind = static_cast<int>(generator() % 4);
+            size_t period = 1 + generator() % 16;
+            size_t back = 1 + generator() % 32768;
+            for (size_t i = 0; i < length; i++)
+            {
+                size_t at = data.size();
+                if (kind == 1 && at >= period)
+                    data.push_back(data[at - period]);
+                else if (kind == 2 && at >= back)
+                    data.push_back(data[at - back]);
+                else if (kind == 3)
+                    data.push_back(static_cast<unsigned char>(generator() % 4));
+                else
+                    data.push_back(static_cast<unsigned char>(generator()));
+            }
+        }
+        return data;
+    }
+
+    //flips a few bits or cuts the end off
+    std::vector<unsigned char> damage(const std::vector<unsigned char> &data, size_t first, size_t size)
+    {
+        std::vector<unsigned char> damaged = data;
+        if (size == 0)
+            return damaged;
+        if (generator() % 3 == 0)
+            damaged.resize(first + generator() % size);
+        else
+        {
+            int flips = 1 + static_cast<int>(generator() % 4);
+            for (int i = 0; i < flips; i++)
+                damaged[first + generator() % size] ^= static_cast<unsigned char>(1 << (generator() % 8));
+        }
+        return damaged;
+    }
+
+    //inflated by both into memory of their own and into buffers of a few
+    //sizes, true if the results are the same
+    bool sameInflate(const std::vector<unsigned char> &stream)
+    {
+        const char *input = reinterpret_cast<const char*>(stream.data());
+        int length = static_cast<int>(stream.size());
+        int fastLength = 0, referenceLength = 0;
+        char *fast = stbi_zlib_decode_malloc(input, length, &fastLength);
+        char *reference = referenceZlibDecode(input, length, &referenceLength);
+        bool same = (fast == NULL) == (reference == NULL) &&
+                    (fast == NULL || (fastLength == referenceLength && memcmp(fast, reference, fastLength) == 0));
+        stbi_image_free(fast);
+        referenceFree(reference);
+
+        int whole = reference != NULL ? referenceLength : 4096;
+        int sizes[] = { whole, whole - 1, whole / 2, whole + 300, 0 };
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && same; i++)
+        {
+            if (sizes[i] < 0)
+                continue;
+            std::vector<char> fastOut(sizes[i] + 1, 0), referenceOut(sizes[i] + 1, 0);
+            int fastResult = stbi_zlib_decode_buffer(fastOut.data(), sizes[i], input, length);
+            int referenceResult = referenceZlibDecodeBuffer(referenceOut.data(), sizes[i], input, length);
+            same = fastResult == referenceResult &&
+                   (fastResult <= 0 || memcmp(fastOut.data(), referenceOut.data(), fastResult) == 0);
+        }
+        return same;
+    }
+
+    //loaded by both at every channel count and at 16 bits
+    bool sameLoad(const std::vector<unsigned char> &png, bool sixteen = true)
+    {
+        int length = static_cast<int>(png.size());
+        for (int channels = 0; channels <= 4; channels++)
+        {
+            int fx = 0, fy = 0, fc = 0, rx = 0, ry = 0, rc = 0;
+            unsigned char *fast = stbi_load_from_memory(png.data(), length, &fx, &fy, &fc, channels);
+            unsigned char *reference = referenceLoad(png.data(), length, &rx, &ry, &rc, channels);
+            bool same = (fast == NULL) == (reference == NULL) &&
+                        (fast == NULL || (fx == rx && fy == ry && fc == rc &&
+                                          memcmp(fast, reference, static_cast<size_t>(fx) * fy * (channels ? channels : fc)) == 0));
+            stbi_image_free(fast);
+            referenceFree(reference);
+            if (!same)
+                return false;
+        }
+        for (int channels = 0; channels <= 4 && sixteen; channels += 4)
+        {
+            int fx = 0, fy = 0, fc = 0, rx = 0, ry = 0, rc = 0;
+            unsigned short *fast = stbi_load_16_from_memory(png.data(), length, &fx, &fy, &fc, channels);
+            unsigned short *reference = referenceLoad16(png.data(), length, &rx, &ry, &rc, channels);
+            bool same = (fast == NULL) == (reference == NULL) &&
+                        (fast == NULL || (fx == rx && fy == ry && fc == rc &&
+                                          memcmp(fast, reference, static_cast<size_t>(fx) * fy * (channels ? channels : fc) * 2) == 0));
+            stbi_image_free(fast);
+            referenceFree(reference);
+            if (!same)
+                return false;
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    //streams written here
+    bool inflated = true, damagedInflated = true;
+    int damagedStreams = 0;
+    for (size_t i = 0; i < sizeof(generatedSizes) / sizeof(generatedSizes[0]); i++)
+    {
+        std::vector<unsigned char> data = makeData(generatedSizes[i]);
+        std::vector<unsigned char> stream = testZlib(data.data(), data.size(), static_cast<unsigned int>(i));
+        int length = 0;
+        char *decoded = stbi_zlib_decode_malloc(reinterpret_cast<const char*>(stream.data()),
+                                                static_cast<int>(stream.size()), &length);
+        inflated = inflated && decoded != NULL && static_cast<size_t>(length) == data.size() &&
+                   memcmp(decoded, data.data(), data.size()) == 0 && sameInflate(stream);
+        stbi_image_free(decoded);
+        for (int j = 0; j < generatedDamaged; j++, damagedStreams++)
+            damagedInflated = damagedInflated && sameInflate(damage(stream, 2, stream.size() - 2));
+    }
+    check(inflated, "generated streams inflate to what was written");
+    check(damagedInflated, "damaged generated streams inflate the same");
+
+    //PNGs written here, damaged ones with bits flipped in their image data
+    std::vector<TestPngSpec> specs = testPngSpecs();
+    bool loaded = true, damagedLoaded = true;
+    for (size_t i = 0; i < specs.size(); i++)
+    {
+        std::vector<unsigned char> png = testPng(specs[i], static_cast<unsigned int>(i));
+        loaded = loaded && sameLoad(png);
+        PngImageData data;
+        if (pngImageData(png, data))
+        {
+            size_t chunk = generator() % data.offsets.size();
+            damagedLoaded = damagedLoaded && sameLoad(damage(png, data.offsets[chunk], data.sizes[chunk]), false);
+        }
+    }
+    printf("%zu PNGs, %d damaged streams\n", specs.size(), damagedStreams);
+    check(loaded, "generated PNGs load the same");
+    check(damagedLoaded, "damaged generated PNGs load the same");
+
+    //the coursework's, with dynamic Huffman tables
+    bool assetsFound = true, assetsInflated = true, assetsLoaded = true, damagedAssets = true;
+    for (size_t i = 0; i < sizeof(assetPaths) / sizeof(assetPaths[0]); i++)
+    {
+        std::vector<unsigned char> png;
+        PngImageData data;
+        if (!readTestFile(assetPaths[i], png) || !pngImageData(png, data))
+        {
+            printf("%s couldn't be read\n", assetPaths[i]);
+            assetsFound = false;
+            continue;
+        }
+        assetsInflated = assetsInflated && sameInflate(data.stream);
+        assetsLoaded = assetsLoaded && sameLoad(png, false);
+        for (int j = 0; j < assetDamaged; j++)
+        {
+            damagedAssets = damagedAssets && sameInflate(damage(data.stream, 2, data.stream.size() - 2));
+            size_t chunk = generator() % data.offsets.size();
+            damagedAssets = damagedAssets && sameLoad(damage(png, data.offsets[chunk], data.sizes[chunk]), false);
+        }
+    }
+    check(assetsFound, "coursework PNGs read");
+    check(assetsInflated, "coursework PNGs' image data inflates the same");
+    check(assetsLoaded, "coursework PNGs load the same");
+    check(damagedAssets, "damaged coursework PNGs load the same");
+
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
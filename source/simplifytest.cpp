@@ -0,0 +1,184 @@
+//Simplify test. Builds a 130k triangle UV sphere with a seam where the
+//uvs wrap, and the top half of one as an open mesh, then simplifies each
+//the way Model::buildLods does, each level half of the one before, to six
+//levels where Model stops at three so the constraints get pushed. Every
+//LOD has to reach its triangle target, index only real vertices, have no
+//flipped or degenerate triangles, keep no triangle across the seam, stay
+//near the sphere, and on the open mesh keep its border on the rim. Exits
+//with 1 if anything fails.
+#include <map>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include <common/simplify.hpp>
+
+namespace
+{
+    const int sphereSegments = 256;
+    const unsigned int lodLevels = 6;
+
+    //furthest a triangle centre may sink into the sphere at the first
+    //level, doubling with each level after
+    const float firstDeviation = 0.002f;
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    struct Mesh
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uvs;
+        std::vector<unsigned int> indices;
+    };
+
+    //rows of a unit UV sphere down to latitude rows, the last column on
+    //the first one's positions with u of 1, both poles a single position
+    Mesh makeSphere(int segments, int rows)
+    {
+        Mesh mesh;
+        for (int y = 0; y <= rows; y++)
+            for (int x = 0; x <= segments; x++)
+            {
+                float longitude = (x == segments ? 0 : x) * 6.2831853f / segments;
+                float latitude = y * 3.1415927f / segments;
+                glm::vec3 p(sinf(latitude) * cosf(longitude), cosf(latitude), sinf(latitude) * sinf(longitude));
+                if (y == 0)
+                    p = glm::vec3(0.0f, 1.0f, 0.0f);
+                if (y == segments)
+                    p = glm::vec3(0.0f, -1.0f, 0.0f);
+                if (y * 2 == segments)
+                    p.y = 0.0f;
+                mesh.positions.push_back(p);
+                mesh.uvs.push_back(glm::vec2(static_cast<float>(x) / segments, static_cast<float>(y) / segments));
+            }
+        for (int y = 0; y < rows; y++)
+            for (int x = 0; x < segments; x++)
+            {
+                unsigned int a = y * (segments + 1) + x, b = a + 1, c = a + segments + 1, d = c + 1;
+                if (y > 0)
+                {
+                    unsigned int triangle[3] = { a, b, c };
+                    mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+                }
+                if (y < segments - 1)
+                {
+                    unsigned int triangle[3] = { b, d, c };
+                    mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+                }
+            }
+        return mesh;
+    }
+
+    struct LodReport
+    {
+        bool inRange;
+        bool noFlips;
+        bool noSeams;
+        float deviation;    //furthest triangle centre from the sphere
+    };
+
+    LodReport inspect(const Mesh &mesh, const std::vector<unsigned int> &indices)
+    {
+        LodReport report = { true, true, true, 0.0f };
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            if (a >= mesh.positions.size() || b >= mesh.positions.size() || c >= mesh.positions.size())
+            {
+                report.inRange = false;
+                continue;
+            }
+            const glm::vec3 &pa = mesh.positions[a], &pb = mesh.positions[b], &pc = mesh.positions[c];
+            glm::vec3 centre = (pa + pb + pc) / 3.0f;
+            //outward on a sphere, so the normal faces the same way as the centre
+            if (glm::dot(glm::cross(pb - pa, pc - pa), centre) <= 0.0f)
+                report.noFlips = false;
+            float uMin = std::min(mesh.uvs[a].x, std::min(mesh.uvs[b].x, mesh.uvs[c].x));
+            float uMax = std::max(mesh.uvs[a].x, std::max(mesh.uvs[b].x, mesh.uvs[c].x));
+            if (uMax - uMin > 0.5f)
+                report.noSeams = false;
+            report.deviation = std::max(report.deviation, 1.0f - glm::length(centre));
+        }
+        return report;
+    }
+
+    //edges used by one triangle only, by position so the seam isn't one
+    bool borderOnRim(const Mesh &mesh, const std::vector<unsigned int> &indices)
+    {
+        std::map<std::pair<std::vector<float>, std::vector<float> >, int> edges;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+            for (int j = 0; j < 3; j++)
+            {
+                const glm::vec3 &p = mesh.positions[indices[i + j]], &q = mesh.positions[indices[i + (j + 1) % 3]];
+                std::vector<float> a(&p.x, &p.x + 3), b(&q.x, &q.x + 3);
+                edges[a < b ? std::make_pair(a, b) : std::make_pair(b, a)]++;
+            }
+        for (std::map<std::pair<std::vector<float>, std::vector<float> >, int>::const_iterator edge = edges.begin();
+             edge != edges.end(); ++edge)
+            if (edge->second == 1 && (edge->first.first[1] != 0.0f || edge->first.second[1] != 0.0f))
+                return false;
+        return true;
+    }
+
+    void simplifyLevels(const Mesh &mesh, bool open, const char *name)
+    {
+        printf("%s: %zu triangles\n", name, mesh.indices.size() / 3);
+        std::vector<unsigned int> previous = mesh.indices;
+        bool reached = true, inRange = true, noFlips = true, noSeams = true, near = true, rim = true;
+        float maximumDeviation = firstDeviation;
+        for (unsigned int level = 1; level <= lodLevels; level++, maximumDeviation *= 2.0f)
+        {
+            size_t target = (mesh.indices.size() >> level) / 3 * 3;
+            float error = 0.0f;
+            std::vector<unsigned int> lod = simplifyMesh(previous.data(), previous.size(), mesh.positions.data(),
+                                                         mesh.positions.size(), target, error);
+            LodReport report = inspect(mesh, lod);
+            printf("LOD %u: %zu triangles, target %zu, error %g, deviation %g\n", level, lod.size() / 3, target / 3,
+                   error, report.deviation);
+            reached = reached && lod.size() <= target && lod.size() >= target * 9 / 10 && lod.size() % 3 == 0;
+            inRange = inRange && report.inRange;
+            noFlips = noFlips && report.noFlips;
+            noSeams = noSeams && report.noSeams;
+            near = near && report.deviation < maximumDeviation && error < maximumDeviation;
+            if (open)
+                rim = rim && borderOnRim(mesh, lod);
+            previous = lod;
+        }
+
+        char line[96];
+        snprintf(line, sizeof(line), "%s, LODs reach their targets", name);
+        check(reached, line);
+        snprintf(line, sizeof(line), "%s, LODs index the vertex buffer", name);
+        check(inRange, line);
+        snprintf(line, sizeof(line), "%s, no flipped or degenerate triangles", name);
+        check(noFlips, line);
+        snprintf(line, sizeof(line), "%s, no triangles across the uv seam", name);
+        check(noSeams, line);
+        snprintf(line, sizeof(line), "%s, LODs stay near the sphere", name);
+        check(near, line);
+        if (open)
+        {
+            snprintf(line, sizeof(line), "%s, border stays on the rim", name);
+            check(rim, line);
+        }
+    }
+}
+
+int main()
+{
+    simplifyLevels(makeSphere(sphereSegments, sphereSegments), false, "sphere");
+    simplifyLevels(makeSphere(sphereSegments, sphereSegments / 2), true, "hemisphere");
+
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_PNG_REFERENCE
+#include <common/stb_image.hpp>
+
+#include <source/stbreference.hpp>
+
+unsigned char *referenceLoad(const unsigned char *buffer, int length, int *x, int *y, int *channels,
+                             int desiredChannels)
+{
+    return stbi_load_from_memory(buffer, length, x, y, channels, desiredChannels);
+}
+
+unsigned short *referenceLoad16(const unsigned char *buffer, int length, int *x, int *y, int *channels,
+                                int desiredChannels)
+{
+    return stbi_load_16_from_memory(buffer, length, x, y, channels, desiredChannels);
+}
+
+char *referenceZlibDecode(const char *buffer, int length, int *outLength)
+{
+    return stbi_zlib_decode_malloc(buffer, length, outLength);
+}
+
+int referenceZlibDecodeBuffer(char *out, int outLength, const char *buffer, int length)
+{
+    return stbi_zlib_decode_buffer(out, outLength, buffer, length);
+}
+
+void referenceFree(void *pixels)
+{
+    stbi_image_free(pixels);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+//stb_image built a second time with STBI_PNG_REFERENCE and its functions
+//static, so the decoder tests can hold the fast PNG paths against the one
+//symbol at a time inflate and the scalar unfilter loops. Results are freed
+//with referenceFree.
+
+unsigned char *referenceLoad(const unsigned char *buffer, int length, int *x, int *y, int *channels,
+                             int desiredChannels);
+unsigned short *referenceLoad16(const unsigned char *buffer, int length, int *x, int *y, int *channels,
+                                int desiredChannels);
+char *referenceZlibDecode(const char *buffer, int length, int *outLength);
+int referenceZlibDecodeBuffer(char *out, int outLength, const char *buffer, int length);
+void referenceFree(void *pixels);
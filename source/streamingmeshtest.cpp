@@ -0,0 +1,233 @@
+//Streaming mesh test. Writes a 320k triangle terrain OBJ with its faces
+//shuffled and integer positions, imports it with a 256 MB and a 1 MB
+//memory budget into small chunks, and reads the chunks back through
+//readStreamingChunks as StreamingModel would. The table has to agree with
+//the chunks, every index be inside its chunk, every chunk be 64 byte
+//aligned and no bigger than two chunks' worth, and the triangles decoded
+//from the packed vertices, rounded back to the grid, be exactly the ones
+//written, winding included. Damaged copies of the file have to be
+//refused. The OBJ and imports go next to the test. Exits with 1 if
+//anything fails.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/decodearena.hpp>
+#include <common/stb_image.hpp>
+
+#include <array>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include <common/streamingmesh.hpp>
+#include <common/vertexformat.hpp>
+#include <common/mappedfile.hpp>
+
+namespace
+{
+    const char *objPath = "streaming_mesh_test.obj";
+    const char *meshPath = "streaming_mesh_test.stream";
+    const char *damagedPath = "streaming_mesh_test_damaged.stream";
+    const int gridSize = 400;
+    const unsigned int trianglesPerChunk = 4096;
+    const size_t budgets[] = { 256 << 20, 1 << 20 };
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    //corners as whole grid positions, starting at the smallest so index
+    //and chunk order don't matter but the winding does
+    typedef std::array<int, 9> Triangle;
+
+    Triangle makeTriangle(const glm::ivec3 corners[3])
+    {
+        int first = 0;
+        for (int i = 1; i < 3; i++)
+            if (std::lexicographical_compare(&corners[i].x, &corners[i].x + 3, &corners[first].x, &corners[first].x + 3))
+                first = i;
+        Triangle triangle;
+        for (int i = 0; i < 3; i++)
+            for (int k = 0; k < 3; k++)
+                triangle[i * 3 + k] = corners[(first + i) % 3][k];
+        return triangle;
+    }
+
+    int height(int x, int z)
+    {
+        return (x * 7 + z * 13) % 5 + (x / 50) * 3;
+    }
+
+    //a grid of quads as two triangles each, in shuffled order
+    bool writeTerrain(const char *path, std::vector<Triangle> &expected)
+    {
+        FILE *file = fopen(path, "w");
+        if (file == NULL)
+            return false;
+        for (int z = 0; z <= gridSize; z++)
+            for (int x = 0; x <= gridSize; x++)
+            {
+                fprintf(file, "v %d %d %d\n", x, height(x, z), z);
+                fprintf(file, "vt %f %f\n", static_cast<float>(x) / gridSize, static_cast<float>(z) / gridSize);
+            }
+        fprintf(file, "vn 0 1 0\n");
+
+        std::vector<int> faces;
+        for (int z = 0; z < gridSize; z++)
+            for (int x = 0; x < gridSize; x++)
+            {
+                int a = z * (gridSize + 1) + x, b = a + 1, c = a + gridSize + 1, d = c + 1;
+                int quad[6] = { a, c, b, b, c, d };
+                faces.insert(faces.end(), quad, quad + 6);
+            }
+        unsigned int seed = 1;
+        for (size_t i = faces.size() / 3; i > 1; i--)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            size_t j = (seed >> 8) % i;
+            for (int k = 0; k < 3; k++)
+                std::swap(faces[(i - 1) * 3 + k], faces[j * 3 + k]);
+        }
+
+        expected.clear();
+        for (size_t i = 0; i < faces.size(); i += 3)
+        {
+            glm::ivec3 corners[3];
+            for (int k = 0; k < 3; k++)
+            {
+                int x = faces[i + k] % (gridSize + 1), z = faces[i + k] / (gridSize + 1);
+                corners[k] = glm::ivec3(x, height(x, z), z);
+            }
+            expected.push_back(makeTriangle(corners));
+            fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", faces[i] + 1, faces[i] + 1, faces[i + 1] + 1,
+                    faces[i + 1] + 1, faces[i + 2] + 1, faces[i + 2] + 1);
+        }
+        std::sort(expected.begin(), expected.end());
+        return fclose(file) == 0;
+    }
+
+    struct ReadBack
+    {
+        bool tableValid;
+        bool indicesInRange;
+        std::vector<Triangle> triangles;
+    };
+
+    //the chunks of a mapped file, their triangles decoded to the grid
+    bool readChunks(const MappedFile &file, ReadBack &read)
+    {
+        size_t numChunks = 0;
+        unsigned int maxVertices = 0, maxIndexBytes = 0;
+        const StreamingChunk *chunks = readStreamingChunks(file, numChunks, maxVertices, maxIndexBytes);
+        if (chunks == NULL)
+            return false;
+
+        read.tableValid = numChunks > 1;
+        read.indicesInRange = true;
+        read.triangles.clear();
+        unsigned int largestVertices = 0, largestIndexBytes = 0;
+        for (size_t i = 0; i < numChunks; i++)
+        {
+            const StreamingChunk &chunk = chunks[i];
+            largestVertices = std::max(largestVertices, chunk.numVertices);
+            largestIndexBytes = std::max(largestIndexBytes, chunk.numIndices * chunk.indexSize);
+            read.tableValid = read.tableValid && chunk.vertexOffset % 64 == 0 && chunk.indexOffset % 64 == 0 &&
+                              chunk.numIndices % 3 == 0 && chunk.numIndices <= trianglesPerChunk * 2 * 3 &&
+                              chunk.indexSize == (chunk.numVertices <= 65536 ? 2u : 4u);
+
+            const PackedVertex *vertices = reinterpret_cast<const PackedVertex*>(file.data() + chunk.vertexOffset);
+            const unsigned char *indices = reinterpret_cast<const unsigned char*>(file.data() + chunk.indexOffset);
+            glm::vec3 scale = positionScale(chunk.bounds), offset = positionOffset(chunk.bounds);
+            for (unsigned int t = 0; t < chunk.numIndices; t += 3)
+            {
+                glm::ivec3 corners[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int index = chunk.indexSize == 2 ? reinterpret_cast<const unsigned short*>(indices)[t + k]
+                                                              : reinterpret_cast<const unsigned int*>(indices)[t + k];
+                    if (index >= chunk.numVertices)
+                    {
+                        read.indicesInRange = false;
+                        index = 0;
+                    }
+                    for (int c = 0; c < 3; c++)
+                        corners[k][c] = static_cast<int>(std::floor(vertices[index].position[c] / 65535.0f * scale[c] +
+                                                                    offset[c] + 0.5f));
+                }
+                read.triangles.push_back(makeTriangle(corners));
+            }
+        }
+        read.tableValid = read.tableValid && largestVertices == maxVertices && largestIndexBytes == maxIndexBytes;
+        std::sort(read.triangles.begin(), read.triangles.end());
+        printf("%zu chunks, %zu triangles, largest %u vertices\n", numChunks, read.triangles.size(), maxVertices);
+        return true;
+    }
+
+    //a copy of the file with size bytes, one of them changed
+    bool damagedCopyRefused(const MappedFile &file, size_t size, size_t changed, char value)
+    {
+        std::vector<char> copy(file.data(), file.data() + size);
+        if (changed < size)
+            copy[changed] = value;
+        FILE *out = fopen(damagedPath, "wb");
+        bool written = out != NULL && fwrite(copy.data(), 1, copy.size(), out) == copy.size();
+        written = out != NULL && fclose(out) == 0 && written;
+
+        MappedFile damaged;
+        size_t numChunks;
+        unsigned int maxVertices, maxIndexBytes;
+        bool refused = written && damaged.open(damagedPath) &&
+                       readStreamingChunks(damaged, numChunks, maxVertices, maxIndexBytes) == NULL;
+        damaged.close();
+        remove(damagedPath);
+        return refused;
+    }
+}
+
+int main()
+{
+    std::vector<Triangle> expected;
+    if (!writeTerrain(objPath, expected))
+    {
+        printf("Couldn't write %s\n", objPath);
+        return 1;
+    }
+
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+    {
+        char line[96];
+        snprintf(line, sizeof(line), "%zu KB budget, imported", budgets[b] >> 10);
+        bool imported = importStreamingMesh(objPath, meshPath, budgets[b], trianglesPerChunk);
+        check(imported, line);
+        MappedFile file;
+        ReadBack read;
+        snprintf(line, sizeof(line), "%zu KB budget, chunk table read", budgets[b] >> 10);
+        check(imported && file.open(meshPath, MAPPED_RANDOM) && readChunks(file, read), line);
+        snprintf(line, sizeof(line), "%zu KB budget, chunk table agrees with the chunks", budgets[b] >> 10);
+        check(read.tableValid, line);
+        snprintf(line, sizeof(line), "%zu KB budget, indices inside their chunks", budgets[b] >> 10);
+        check(read.indicesInRange, line);
+        snprintf(line, sizeof(line), "%zu KB budget, triangles are the ones written", budgets[b] >> 10);
+        check(read.triangles == expected, line);
+
+        if (b == 0 && file.size() > 64)
+        {
+            check(damagedCopyRefused(file, file.size() / 2, file.size(), 0), "file cut in half refused");
+            check(damagedCopyRefused(file, file.size(), 0, 'X'), "file with the wrong magic refused");
+            check(damagedCopyRefused(file, file.size() - 1, file.size(), 0), "file a byte short refused");
+        }
+        file.close();
+        remove(meshPath);
+    }
+    remove(objPath);
+
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
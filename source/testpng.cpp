@@ -0,0 +1,459 @@
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+#include <source/testpng.hpp>
+
+namespace
+{
+    //deflate's length and distance codes, from RFC 1951
+    const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                   1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+                                    11, 11, 12, 12, 13, 13 };
+
+    const int windowSize = 32768;
+    const int maxMatch = 258;
+    const int maxChain = 32;
+
+    //Adam7 passes, first column and row then the step of each
+    const int adam7[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 },
+                              { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+
+    //bits first in first out, the way deflate packs them
+    struct BitWriter
+    {
+        std::vector<unsigned char> &out;
+        unsigned long long bits;
+        int count;
+
+        explicit BitWriter(std::vector<unsigned char> &out) : out(out), bits(0), count(0) {}
+
+        void put(unsigned int value, int n)
+        {
+            bits |= static_cast<unsigned long long>(value) << count;
+            count += n;
+            while (count >= 8)
+            {
+                out.push_back(static_cast<unsigned char>(bits));
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+
+        //Huffman codes go most significant bit first
+        void putCode(unsigned int code, int n)
+        {
+            unsigned int reversed = 0;
+            for (int i = 0; i < n; i++)
+                reversed |= ((code >> i) & 1) << (n - 1 - i);
+            put(reversed, n);
+        }
+
+        void align()
+        {
+            if (count > 0)
+                put(0, 8 - count);
+        }
+    };
+
+    void putLiteralOrLength(BitWriter &writer, int symbol)
+    {
+        if (symbol < 144)
+            writer.putCode(0x30 + symbol, 8);
+        else if (symbol < 256)
+            writer.putCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            writer.putCode(symbol - 256, 7);
+        else
+            writer.putCode(0xc0 + symbol - 280, 8);
+    }
+
+    void putMatch(BitWriter &writer, int length, int distance)
+    {
+        int l = 28;
+        while (lengthBase[l] > length)
+            l--;
+        putLiteralOrLength(writer, 257 + l);
+        writer.put(length - lengthBase[l], lengthExtra[l]);
+        int d = 29;
+        while (distanceBase[d] > distance)
+            d--;
+        writer.putCode(d, 5);
+        writer.put(distance - distanceBase[d], distanceExtra[d]);
+    }
+
+    unsigned int hash3(const unsigned char *p)
+    {
+        return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & 0xffff;
+    }
+
+    unsigned int adler32(const unsigned char *data, size_t size)
+    {
+        unsigned int a = 1, b = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    unsigned int crc32(const unsigned char *data, size_t size)
+    {
+        static unsigned int table[256];
+        if (table[1] == 0)
+            for (unsigned int n = 0; n < 256; n++)
+            {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+        unsigned int crc = 0xffffffffu;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 255] ^ (crc >> 8);
+        return crc ^ 0xffffffffu;
+    }
+
+    void putBigEndian32(std::vector<unsigned char> &out, unsigned int value)
+    {
+        out.push_back(static_cast<unsigned char>(value >> 24));
+        out.push_back(static_cast<unsigned char>(value >> 16));
+        out.push_back(static_cast<unsigned char>(value >> 8));
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    unsigned int readBigEndian32(const unsigned char *p)
+    {
+        return (static_cast<unsigned int>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    void putChunk(std::vector<unsigned char> &png, const char *type, const unsigned char *data, size_t size)
+    {
+        putBigEndian32(png, static_cast<unsigned int>(size));
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data, data + size);
+        putBigEndian32(png, crc32(&png[start], png.size() - start));
+    }
+
+    int channelsOf(int colourType)
+    {
+        return colourType == 2 ? 3 : colourType == 4 ? 2 : colourType == 6 ? 4 : 1;
+    }
+
+    //rows of samples, each row one of a few kinds so there is something
+    //for LZ77 to find at every distance
+    std::vector<unsigned int> makeSamples(const TestPngSpec &spec, std::mt19937 &random)
+    {
+        int channels = channelsOf(spec.colourType);
+        unsigned int maxSample = (1u << spec.depth) - 1;
+        size_t rowSamples = static_cast<size_t>(spec.width) * channels;
+        std::vector<unsigned int> samples(rowSamples * spec.height);
+        for (int y = 0; y < spec.height; y++)
+        {
+            unsigned int *row = &samples[y * rowSamples];
+            int kind = static_cast<int>(random() % 5);
+            unsigned int period = 1 + random() % 7;
+            unsigned int base = random() & maxSample;
+            for (size_t i = 0; i < rowSamples; i++)
+            {
+                if (kind == 0)
+                    row[i] = random() & maxSample;
+                else if (kind == 1 && y > 0)
+                    row[i] = random() % 16 == 0 ? random() & maxSample : row[i - rowSamples];
+                else if (kind == 2)
+                    row[i] = base;
+                else if (kind == 3)
+                    row[i] = (base + static_cast<unsigned int>(i % (period * channels))) & maxSample;
+                else
+                    row[i] = static_cast<unsigned int>(i * maxSample / std::max<size_t>(rowSamples - 1, 1)) & maxSample;
+            }
+        }
+        return samples;
+    }
+
+    //one row of samples packed as the file holds them
+    void packRow(const unsigned int *samples, size_t count, int depth, std::vector<unsigned char> &out)
+    {
+        if (depth == 16)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                out.push_back(static_cast<unsigned char>(samples[i] >> 8));
+                out.push_back(static_cast<unsigned char>(samples[i]));
+            }
+            return;
+        }
+        unsigned int byte = 0;
+        int bits = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            byte = (byte << depth) | samples[i];
+            bits += depth;
+            if (bits == 8)
+            {
+                out.push_back(static_cast<unsigned char>(byte));
+                byte = 0;
+                bits = 0;
+            }
+        }
+        if (bits > 0)
+            out.push_back(static_cast<unsigned char>(byte << (8 - bits)));
+    }
+
+    int paeth(int a, int b, int c)
+    {
+        int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+        return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+    }
+
+    //filters rows of rowBytes each with a random filter, in place after
+    //their filter byte
+    void filterRows(const std::vector<unsigned char> &rows, size_t rowBytes, int bpp, std::mt19937 &random,
+                    std::vector<unsigned char> &out)
+    {
+        size_t numRows = rowBytes == 0 ? 0 : rows.size() / rowBytes;
+        for (size_t y = 0; y < numRows; y++)
+        {
+            const unsigned char *cur = &rows[y * rowBytes];
+            const unsigned char *prior = y > 0 ? cur - rowBytes : NULL;
+            int filter = static_cast<int>(random() % 5);
+            out.push_back(static_cast<unsigned char>(filter));
+            for (size_t i = 0; i < rowBytes; i++)
+            {
+                int a = i >= static_cast<size_t>(bpp) ? cur[i - bpp] : 0;
+                int b = prior != NULL ? prior[i] : 0;
+                int c = prior != NULL && i >= static_cast<size_t>(bpp) ? prior[i - bpp] : 0;
+                int predicted = filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 :
+                                filter == 4 ? paeth(a, b, c) : 0;
+                out.push_back(static_cast<unsigned char>(cur[i] - predicted));
+            }
+        }
+    }
+}
+
+std::vector<unsigned char> testZlib(const unsigned char *data, size_t size, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    std::vector<unsigned char> out;
+    out.push_back(0x78);
+    out.push_back(0x01);
+    BitWriter writer(out);
+
+    std::vector<int> head(65536, -1);
+    std::vector<int> previous(windowSize, -1);
+    size_t position = 0;
+    do
+    {
+        size_t blockEnd = std::min(size, position + 1 + random() % 20000);
+        bool final = blockEnd == size;
+        if (random() % 5 == 0)
+        {
+            //stored blocks are at most 65535 bytes, these are well under
+            writer.put(final ? 1 : 0, 1);
+            writer.put(0, 2);
+            writer.align();
+            unsigned int length = static_cast<unsigned int>(blockEnd - position);
+            writer.put(length, 16);
+            writer.put(~length & 0xffff, 16);
+            for (; position < blockEnd; position++)
+            {
+                writer.put(data[position], 8);
+                if (position + 2 < size)
+                {
+                    unsigned int h = hash3(data + position);
+                    previous[position % windowSize] = head[h];
+                    head[h] = static_cast<int>(position);
+                }
+            }
+            continue;
+        }
+
+        writer.put(final ? 1 : 0, 1);
+        writer.put(1, 2);
+        while (position < blockEnd)
+        {
+            int bestLength = 0, bestDistance = 0;
+            if (position + 2 < size)
+            {
+                unsigned int h = hash3(data + position);
+                int candidate = head[h];
+                int limit = static_cast<int>(std::min<size_t>(maxMatch, blockEnd - position));
+                for (int chain = 0; candidate >= 0 && chain < maxChain; chain++)
+                {
+                    int distance = static_cast<int>(position) - candidate;
+                    if (distance > windowSize - 1)
+                        break;
+                    int length = 0;
+                    while (length < limit && data[candidate + length] == data[position + length])
+                        length++;
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = distance;
+                    }
+                    int next = previous[candidate % windowSize];
+                    if (next >= candidate)
+                        break;
+                    candidate = next;
+                }
+            }
+            size_t advance = 1;
+            if (bestLength >= 3)
+            {
+                putMatch(writer, bestLength, bestDistance);
+                advance = static_cast<size_t>(bestLength);
+            }
+            else
+                putLiteralOrLength(writer, data[position]);
+            for (size_t i = 0; i < advance; i++, position++)
+                if (position + 2 < size)
+                {
+                    unsigned int h = hash3(data + position);
+                    previous[position % windowSize] = head[h];
+                    head[h] = static_cast<int>(position);
+                }
+        }
+        putLiteralOrLength(writer, 256);
+    } while (position < size);
+    writer.align();
+    putBigEndian32(out, adler32(data, size));
+    return out;
+}
+
+std::vector<unsigned char> testPng(const TestPngSpec &spec, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    int channels = channelsOf(spec.colourType);
+    std::vector<unsigned int> samples = makeSamples(spec, random);
+    int bpp = std::max(1, channels * spec.depth / 8);
+
+    //the passes one after another, each its own filtered image
+    std::vector<unsigned char> filtered;
+    int passes = spec.interlaced ? 7 : 1;
+    for (int pass = 0; pass < passes; pass++)
+    {
+        int x0 = spec.interlaced ? adam7[pass][0] : 0, y0 = spec.interlaced ? adam7[pass][1] : 0;
+        int dx = spec.interlaced ? adam7[pass][2] : 1, dy = spec.interlaced ? adam7[pass][3] : 1;
+        int passWidth = (spec.width - x0 + dx - 1) / dx, passHeight = (spec.height - y0 + dy - 1) / dy;
+        if (passWidth <= 0 || passHeight <= 0)
+            continue;
+        std::vector<unsigned char> rows;
+        std::vector<unsigned int> rowSamples;
+        for (int y = y0; y < spec.height; y += dy)
+        {
+            rowSamples.clear();
+            for (int x = x0; x < spec.width; x += dx)
+                for (int c = 0; c < channels; c++)
+                    rowSamples.push_back(samples[(static_cast<size_t>(y) * spec.width + x) * channels + c]);
+            packRow(rowSamples.data(), rowSamples.size(), spec.depth, rows);
+        }
+        filterRows(rows, rows.size() / passHeight, bpp, random, filtered);
+    }
+
+    std::vector<unsigned char> png;
+    const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    png.insert(png.end(), signature, signature + 8);
+    std::vector<unsigned char> header;
+    putBigEndian32(header, spec.width);
+    putBigEndian32(header, spec.height);
+    header.push_back(static_cast<unsigned char>(spec.depth));
+    header.push_back(static_cast<unsigned char>(spec.colourType));
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(spec.interlaced ? 1 : 0);
+    putChunk(png, "IHDR", header.data(), header.size());
+
+    if (spec.colourType == 3)
+    {
+        std::vector<unsigned char> palette(3 << spec.depth), alpha(1 << spec.depth);
+        for (size_t i = 0; i < palette.size(); i++)
+            palette[i] = static_cast<unsigned char>(random());
+        for (size_t i = 0; i < alpha.size(); i++)
+            alpha[i] = static_cast<unsigned char>(random());
+        putChunk(png, "PLTE", palette.data(), palette.size());
+        if (spec.transparency)
+            putChunk(png, "tRNS", alpha.data(), alpha.size() / 2 + 1);
+    }
+    else if (spec.transparency && (spec.colourType == 0 || spec.colourType == 2))
+    {
+        //the colour of the first pixel, so some are transparent
+        std::vector<unsigned char> key;
+        for (int c = 0; c < channels; c++)
+        {
+            key.push_back(static_cast<unsigned char>(samples[c] >> 8));
+            key.push_back(static_cast<unsigned char>(samples[c]));
+        }
+        putChunk(png, "tRNS", key.data(), key.size());
+    }
+
+    //image data over IDAT chunks of random sizes, some tiny
+    std::vector<unsigned char> stream = testZlib(filtered.data(), filtered.size(), seed + 1);
+    for (size_t offset = 0; offset < stream.size(); )
+    {
+        size_t size = std::min<size_t>(stream.size() - offset, random() % 4 == 0 ? 1 + random() % 8 : 1 + random() % 8192);
+        putChunk(png, "IDAT", &stream[offset], size);
+        offset += size;
+    }
+    putChunk(png, "IEND", NULL, 0);
+    return png;
+}
+
+std::vector<TestPngSpec> testPngSpecs()
+{
+    struct { int colourType, depth; } formats[] = {
+        { 0, 1 }, { 0, 2 }, { 0, 4 }, { 0, 8 }, { 0, 16 }, { 2, 8 }, { 2, 16 }, { 3, 1 }, { 3, 2 }, { 3, 4 },
+        { 3, 8 }, { 4, 8 }, { 4, 16 }, { 6, 8 }, { 6, 16 }
+    };
+    struct { int width, height; } sizes[] = { { 1, 1 }, { 7, 5 }, { 33, 17 }, { 300, 41 }, { 129, 200 } };
+    std::vector<TestPngSpec> specs;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            for (int variant = 0; variant < 2; variant++)
+            {
+                TestPngSpec spec = { sizes[s].width, sizes[s].height, formats[f].colourType, formats[f].depth,
+                                     variant == 1, (s + variant) % 2 == 0 };
+                specs.push_back(spec);
+            }
+    return specs;
+}
+
+bool pngImageData(const std::vector<unsigned char> &png, PngImageData &data)
+{
+    data = PngImageData();
+    size_t offset = 8;
+    while (offset + 12 <= png.size())
+    {
+        size_t size = readBigEndian32(&png[offset]);
+        if (size > png.size() - offset - 12)
+            return false;
+        if (memcmp(&png[offset + 4], "IDAT", 4) == 0)
+        {
+            data.offsets.push_back(offset + 8);
+            data.sizes.push_back(size);
+            data.stream.insert(data.stream.end(), png.begin() + offset + 8, png.begin() + offset + 8 + size);
+        }
+        offset += size + 12;
+    }
+    return !data.stream.empty();
+}
+
+bool readTestFile(const char *path, std::vector<unsigned char> &data)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    data.clear();
+    unsigned char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + read);
+    return fclose(file) == 0;
+}
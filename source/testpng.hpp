@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+//PNGs and zlib streams written for the decoder tests, so they can cover
+//what the coursework's assets don't: every colour type and bit depth,
+//interlacing, palettes, a random filter per row and image data split over
+//many IDAT chunks. The deflate is LZ77 with the fixed Huffman codes and
+//stored blocks mixed in, which reaches every path of the inflate loops but
+//dynamic code tables. The assets' PNGs have those.
+
+struct TestPngSpec
+{
+    int width;
+    int height;
+    int colourType;     //0 grey, 2 RGB, 3 palette, 4 grey and alpha, 6 RGBA
+    int depth;          //bits per sample
+    bool interlaced;    //Adam7
+    bool transparency;  //a tRNS chunk
+};
+
+//zlib stream of size bytes in blocks of both kinds
+std::vector<unsigned char> testZlib(const unsigned char *data, size_t size, unsigned int seed);
+
+//A PNG of spec with pixels made of runs, repeats, short patterns and
+//noise, so it compresses a bit like a real image
+std::vector<unsigned char> testPng(const TestPngSpec &spec, unsigned int seed);
+
+//Every colour type at every depth it allows, interlaced and not, with and
+//without transparency, at a few awkward sizes
+std::vector<TestPngSpec> testPngSpecs();
+
+//The IDAT chunks of a PNG joined, their offsets in it and their sizes
+struct PngImageData
+{
+    std::vector<unsigned char> stream;
+    std::vector<size_t> offsets;
+    std::vector<size_t> sizes;
+};
+bool pngImageData(const std::vector<unsigned char> &png, PngImageData &data);
+
+bool readTestFile(const char *path, std::vector<unsigned char> &data);
@@ -0,0 +1,223 @@
+//startup texture decoding benchmark. Decodes the coursework textures (or
+//the files given on the command line) one stbi_load after another the way
+//startup used to, then with decodeImages on pools of 1, 2, 4 ... threads
+//up to the core count, and prints the wall clock time of each. The PNGs
+//get a line each with their single thread decode throughput and how much
+//of it is inflating the image data. Last it cooks them to texture
+//containers, uncompressed and block compressed, and times mapping those,
+//which is all a load costs once they exist. Decoding on every core is
+//also timed with stb_image's allocations from the heap and from the
+//decode arenas, with how many there were and the peak of each image.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/decodearena.hpp>
+#include <common/stb_image.hpp>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <stdio.h>
+
+#include <common/imagedecoder.hpp>
+#include <common/decodearena.hpp>
+#include <common/texturecook.hpp>
+#include <common/threadpool.hpp>
+#include <common/mappedfile.hpp>
+
+namespace
+{
+    const int repeats = 5;
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    unsigned int bigEndian32(const unsigned char *bytes)
+    {
+        return (static_cast<unsigned int>(bytes[0]) << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+    }
+
+    //the IDAT chunks of a PNG joined into the zlib stream stb_image inflates,
+    //empty if it isn't one
+    std::vector<char> pngImageData(const MappedFile &file)
+    {
+        static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        std::vector<char> stream;
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(file.data());
+        if (file.size() < 8 || memcmp(bytes, signature, 8) != 0)
+            return stream;
+        for (size_t offset = 8; offset + 12 <= file.size();)
+        {
+            size_t length = bigEndian32(bytes + offset);
+            if (length > file.size() - offset - 12)
+                break;
+            if (memcmp(bytes + offset + 4, "IDAT", 4) == 0)
+                stream.insert(stream.end(), file.data() + offset + 8, file.data() + offset + 8 + length);
+            offset += length + 12;
+        }
+        return stream;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty())
+    {
+        const char *assets[] = {
+            "../assets/crate.jpg",
+            "../assets/stones_diffuse.png",
+            "../assets/stones_specular.png",
+            "../assets/bricks_diffuse.png",
+            "../assets/bricks_specular.png"
+        };
+        paths.assign(assets, assets + sizeof(assets) / sizeof(assets[0]));
+    }
+
+    //serial FILE* loads, best of a few runs so the page cache is warm
+    double serial = 1e30;
+    unsigned long long pixelBytes = 0;
+    for (int r = 0; r < repeats; r++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        pixelBytes = 0;
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            int width, height, components;
+            stbi_set_flip_vertically_on_load(true);
+            unsigned char *pixels = stbi_load(paths[i].c_str(), &width, &height, &components, 0);
+            if (pixels == NULL)
+            {
+                printf("Couldn't decode %s\n", paths[i].c_str());
+                return 1;
+            }
+            pixelBytes += static_cast<unsigned long long>(width) * height * components;
+            stbi_image_free(pixels);
+        }
+        serial = std::min(serial, millisecondsSince(start));
+    }
+    printf("%zu images, %.1f MB decoded\n", paths.size(), pixelBytes / 1048576.0);
+    printf("serial stbi_load      %8.1f ms\n", serial);
+
+    //one PNG at a time from memory, against inflating its image data alone
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        MappedFile file;
+        std::vector<char> stream;
+        if (!file.open(paths[i].c_str()) || (stream = pngImageData(file)).empty())
+            continue;
+        double decode = 1e30, inflate = 1e30;
+        unsigned long long decodedBytes = 0, inflatedBytes = 0;
+        for (int r = 0; r < repeats; r++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            int width, height, components;
+            unsigned char *pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(file.data()),
+                                                          static_cast<int>(file.size()), &width, &height, &components, 0);
+            decode = std::min(decode, millisecondsSince(start));
+            if (pixels == NULL)
+                break;
+            decodedBytes = static_cast<unsigned long long>(width) * height * components;
+            stbi_image_free(pixels);
+
+            //sized like the PNG loader sizes it, rows plus a filter byte each
+            start = std::chrono::steady_clock::now();
+            int length;
+            char *inflated = stbi_zlib_decode_malloc_guesssize_headerflag(stream.data(), static_cast<int>(stream.size()),
+                                                                          static_cast<int>(decodedBytes + height), &length, 1);
+            inflate = std::min(inflate, millisecondsSince(start));
+            inflatedBytes = static_cast<unsigned long long>(length);
+            stbi_image_free(inflated);
+        }
+        if (decodedBytes == 0)
+            continue;
+        printf("%-30s %8.1f ms, %6.1f MB/s in, %6.1f MB/s out, inflate %5.1f ms (%.0f MB/s out)\n",
+               paths[i].c_str(), decode, file.size() / 1048576.0 / (decode / 1000.0),
+               decodedBytes / 1048576.0 / (decode / 1000.0), inflate, inflatedBytes / 1048576.0 / (inflate / 1000.0));
+    }
+
+    //mapped files decoded on the pool, delivered in completion order
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    double oneThread = 0.0;
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, cores))
+    {
+        ThreadPool pool(threads);
+        double best = 1e30;
+        for (int r = 0; r < repeats; r++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            decodeImages(paths, true, pool, [](size_t, DecodedImage &) {});
+            best = std::min(best, millisecondsSince(start));
+        }
+        if (threads == 1)
+            oneThread = best;
+        printf("decodeImages %2u threads %8.1f ms, %.2fx one thread, %.2fx serial\n",
+               threads, best, oneThread / best, serial / best);
+        if (threads == cores)
+            break;
+    }
+
+    //on every core with stb_image's scratch from the heap, then from the
+    //decode arenas. Allocations are of the last run, once the arenas have
+    //warmed up.
+    for (int enabled = 0; enabled < 2; enabled++)
+    {
+        setDecodeArenaEnabled(enabled != 0);
+        ThreadPool pool(cores);
+        double best = 1e30;
+        DecodeAllocationStats total;
+        for (int r = 0; r < repeats; r++)
+        {
+            memset(&total, 0, sizeof(total));
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            decodeImages(paths, true, pool, [&total](size_t, DecodedImage &image)
+            {
+                total.allocations += image.allocations.allocations;
+                total.heapAllocations += image.allocations.heapAllocations;
+                total.peakBytes = std::max(total.peakBytes, image.allocations.peakBytes);
+            });
+            best = std::min(best, millisecondsSince(start));
+        }
+        printf("decodeImages %s %8.1f ms, %llu allocations, %llu from the heap, %.1f MB peak per image\n",
+               enabled ? "arena" : "heap ", best, total.allocations, total.heapAllocations, total.peakBytes / 1048576.0);
+    }
+    setDecodeArenaEnabled(true);
+
+    //containers are made once, untimed, then mapped like the cache does
+    const unsigned int formatSets[2] = { 0, (1u << BLOCK_NONE) - 1 };
+    const char *formatNames[2] = { "uncompressed", "compressed  " };
+    for (int set = 0; set < 2; set++)
+    {
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            DecodedImage image;
+            cookTexture(paths[i].c_str(), true, formatSets[set], image);
+        }
+        double best = 1e30;
+        unsigned long long levelBytes = 0;
+        for (int r = 0; r < repeats; r++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            levelBytes = 0;
+            for (size_t i = 0; i < paths.size(); i++)
+            {
+                DecodedImage image;
+                if (!loadCookedTexture(paths[i].c_str(), true, formatSets[set], image))
+                {
+                    printf("Couldn't map the container of %s\n", paths[i].c_str());
+                    return 1;
+                }
+                levelBytes += image.levels->bytes();
+            }
+            best = std::min(best, millisecondsSince(start));
+        }
+        printf("%s containers %8.1f ms, %.1f MB with mipmaps, %.2fx serial\n",
+               formatNames[set], best, levelBytes / 1048576.0, serial / best);
+    }
+    return 0;
+}
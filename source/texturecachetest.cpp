@@ -0,0 +1,168 @@
+//texture cache test. Loads copies of the coursework textures through a
+//TextureCache on the fake GL: a path loaded twice and a second path with
+//the same contents have to share one texture and one decode, missing and
+//broken files get the fallback, textures nothing refers to any more are
+//collected and streamed textures stay pending until the uploader is done.
+//Then a second cache reading the failure list the first one wrote has to
+//answer the missing and broken files without trying them again, and
+//forget the missing one once it appears. Exits with 1 if anything fails,
+//runs from source/ without a GPU.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/decodearena.hpp>
+#include <common/stb_image.hpp>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+
+#include <common/texturecache.hpp>
+#include <common/textureupload.hpp>
+#include <common/texturecook.hpp>
+#include <common/mappedfile.hpp>
+#include <source/fakegl.hpp>
+
+namespace
+{
+    const char *failureListPath = "texture_cache_test.failures";
+    const char *cratePath = "texture_cache_test_crate.jpg";
+    const char *copyPath = "texture_cache_test_copy.jpg";
+    const char *specularPath = "texture_cache_test_specular.png";
+    const char *missingPath = "texture_cache_test_missing.jpg";
+    const char *brokenPath = "texture_cache_test_broken.png";
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    bool copyFile(const char *from, const char *to)
+    {
+        MappedFile file;
+        if (!file.open(from))
+            return false;
+        FILE *out = fopen(to, "wb");
+        if (out == NULL)
+            return false;
+        bool ok = fwrite(file.data(), 1, file.size(), out) == file.size();
+        return fclose(out) == 0 && ok;
+    }
+
+    bool wasDeleted(unsigned int texture)
+    {
+        const std::vector<unsigned int> &deleted = fakeGL().deleted;
+        return std::find(deleted.begin(), deleted.end(), texture) != deleted.end();
+    }
+
+    void removeFiles()
+    {
+        const char *paths[] = { cratePath, copyPath, specularPath, missingPath, brokenPath };
+        for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+        {
+            remove(paths[i]);
+            remove(cookedTexturePath(paths[i], true).c_str());
+            remove(cookedTexturePath(paths[i], false).c_str());
+        }
+        remove(failureListPath);
+    }
+
+    void testFirstRun()
+    {
+        TextureCache cache(failureListPath);
+        TextureHandle crate = cache.load(cratePath);
+        TextureHandle again = cache.load(cratePath);
+        TextureHandle copy = cache.load(copyPath);
+        TextureCacheStats stats = cache.stats();
+        check(crate.id() != 0 && again.id() == crate.id() && stats.decodes == 1 && stats.hits == 2,
+              "a path loaded twice is decoded once");
+        check(copy.id() == crate.id() && stats.contentHits == 1, "the same contents under another path share it");
+        check(fakeGL().uploads[crate.id()] == 1, "and it is uploaded once");
+
+        TextureHandle unflipped = cache.load(cratePath, false);
+        check(unflipped.id() != 0 && unflipped.id() != crate.id() && cache.stats().decodes == 2,
+              "flipped and unflipped are different textures");
+
+        bool needsLoad = true;
+        TextureHandle reserved = cache.reserve(copyPath, true, needsLoad);
+        check(!needsLoad && reserved.id() == crate.id(), "reserving a cached path needs no load");
+
+        TextureHandle missing = cache.load(missingPath);
+        TextureHandle broken = cache.load(brokenPath);
+        TextureHandle fallback = cache.fallback();
+        stats = cache.stats();
+        check(missing.id() == fallback.id() && broken.id() == fallback.id() && stats.failures == 2 &&
+              !missing.isPending(), "missing and broken files get the fallback");
+
+        //only the unflipped crate has no handle left
+        unsigned int unflippedID = unflipped.id();
+        unflipped = TextureHandle();
+        size_t collected = cache.collect();
+        check(collected == 1 && wasDeleted(unflippedID) && !wasDeleted(crate.id()) && !wasDeleted(fallback.id()),
+              "unreferenced textures are collected");
+        check(cache.collect() == 0, "and only once");
+
+        TextureUploader uploader(1 << 20, 256 << 10);
+        cache.setUploader(&uploader);
+        TextureHandle specular = cache.load(specularPath);
+        bool pending = specular.isPending();
+        uploader.finish();
+        size_t finest = 0;
+        for (size_t i = 0; i < fakeGL().subImages.size(); i++)
+            if (fakeGL().subImages[i].texture == specular.id() && fakeGL().subImages[i].level == 0)
+                finest++;
+        check(pending && !specular.isPending() && finest != 0 && fakeGL().uploads[specular.id()] == 0,
+              "streamed textures are pending until the uploader is done");
+        cache.setUploader(NULL);
+
+        cache.clear();
+        check(crate.id() == 0 && specular.id() == 0 && fakeGL().textures.empty(),
+              "clear deletes every texture");
+        check(fakeGL().errors == 0, "no GL errors");
+    }
+
+    void testSecondRun()
+    {
+        fakeGLReset();
+        TextureCache cache(failureListPath);
+        TextureHandle missing = cache.load(missingPath);
+        TextureHandle broken = cache.load(brokenPath);
+        TextureCacheStats stats = cache.stats();
+        check(missing.id() == cache.fallback().id() && broken.id() == missing.id() &&
+              stats.failureHits == 2 && stats.failures == 0 && stats.decodes == 0,
+              "known failures are answered from the failure list");
+
+        copyFile(cratePath, missingPath);
+        TextureHandle appeared = cache.load(missingPath);
+        stats = cache.stats();
+        check(appeared.id() != missing.id() && stats.decodes == 1 && stats.failures == 0,
+              "a missing file that appears is loaded");
+        cache.clear();
+        check(fakeGL().errors == 0, "no GL errors");
+    }
+}
+
+int main()
+{
+    //copies, so nothing is cooked next to the coursework's own textures
+    removeFiles();
+    FILE *broken = fopen(brokenPath, "wb");
+    bool written = broken != NULL && fputs("not a png", broken) >= 0;
+    written = broken != NULL && fclose(broken) == 0 && written;
+    if (!written || !copyFile("../assets/crate.jpg", cratePath) || !copyFile("../assets/crate.jpg", copyPath) ||
+        !copyFile("../assets/bricks_specular.png", specularPath))
+    {
+        printf("Couldn't copy the test textures\n");
+        removeFiles();
+        return 1;
+    }
+
+    testFirstRun();
+    testSecondRun();
+    removeFiles();
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
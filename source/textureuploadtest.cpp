@@ -0,0 +1,213 @@
+//texture upload test. Streams mip chains of random pixels, uncompressed
+//and block compressed, through a TextureUploader on the fake GL, once with
+//a persistently mapped ring and once mapping it each band. Every level has
+//to arrive whole and unchanged, coarsest first and in bands of rows from
+//the top, with the base level starting at the coarsest level and ending
+//at 0. The fake's GPU runs a frame behind so ring memory reused before
+//its fence completes shows up. Cancelled textures get nothing more and
+//finish() sends what is left. Exits with 1 if anything fails, runs
+//without a GPU.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/decodearena.hpp>
+#include <common/stb_image.hpp>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <common/textureupload.hpp>
+#include <common/texturecook.hpp>
+#include <source/fakegl.hpp>
+
+namespace
+{
+    const size_t ringBytes = 1 << 20;
+    const size_t frameBudget = 256 << 10;
+    const int maximumFrames = 10000;
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    struct TestTexture
+    {
+        unsigned int id;
+        std::shared_ptr<MipChain> levels;
+        int done;
+    };
+
+    std::shared_ptr<MipChain> makeChain(int width, int height, int components, BlockFormat format)
+    {
+        std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * components);
+        for (size_t i = 0; i < pixels.size(); i++)
+            pixels[i] = static_cast<unsigned char>(rand());
+        MipChain chain;
+        generateMipChain(pixels.data(), width, height, components, MIP_LINEAR, chain);
+        std::shared_ptr<MipChain> levels = std::make_shared<MipChain>();
+        if (format == BLOCK_NONE)
+            *levels = chain;
+        else
+            compressMipChain(chain, format, *levels);
+        return levels;
+    }
+
+    void startUpload(TextureUploader &uploader, TestTexture &texture, int width, int height, int components,
+                     BlockFormat format)
+    {
+        glGenTextures(1, &texture.id);
+        texture.levels = makeChain(width, height, components, format);
+        texture.done = 0;
+        int *done = &texture.done;
+        uploader.upload(texture.id, texture.levels, [done]() { (*done)++; });
+    }
+
+    size_t subImagesOf(unsigned int texture)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < fakeGL().subImages.size(); i++)
+            if (fakeGL().subImages[i].texture == texture)
+                count++;
+        return count;
+    }
+
+    //true if the bands of texture came coarsest level first, each level's
+    //in order from its top row and together exactly its bytes
+    bool arrivedWhole(const TestTexture &texture, bool &split)
+    {
+        const MipChain &levels = *texture.levels;
+        int level = static_cast<int>(levels.numLevels());
+        int row = 0;
+        std::vector<unsigned char> data;
+        split = false;
+        for (size_t i = 0; i <= fakeGL().subImages.size(); i++)
+        {
+            bool last = i == fakeGL().subImages.size();
+            if (!last && fakeGL().subImages[i].texture != texture.id)
+                continue;
+            const FakeSubImage *band = last ? nullptr : &fakeGL().subImages[i];
+
+            //a new level starts once the one before is complete
+            if (last || band->level != level)
+            {
+                if (level < static_cast<int>(levels.numLevels()) &&
+                    (row != levels.levelHeight(level) || data.size() != levels.levelSize(level) ||
+                     memcmp(data.data(), levels.level(level), data.size()) != 0))
+                    return false;
+                if (last)
+                    return level == 0;
+                if (band->level != level - 1)
+                    return false;
+                level = band->level;
+                row = 0;
+                data.clear();
+            }
+            else
+                split = true;
+            if (!band->fromBuffer || band->row != row)
+                return false;
+            row += band->rows;
+            data.insert(data.end(), band->data.begin(), band->data.end());
+        }
+        return false;
+    }
+
+    void testMode(bool persistent)
+    {
+        printf("%s ring\n", persistent ? "persistently mapped" : "mapped each band");
+        fakeGLReset();
+        fakeGLBufferStorage(persistent);
+        TextureUploader uploader(ringBytes, frameBudget);
+        check(uploader.isPersistent() == persistent, "ring mapped as the GL allows");
+
+        //odd sizes, every block format and widths that aren't whole blocks
+        struct { int width, height, components; BlockFormat format; } specs[] = {
+            { 1024, 512, 4, BLOCK_NONE }, { 512, 512, 4, BLOCK_BC7 }, { 300, 200, 3, BLOCK_NONE },
+            { 256, 1024, 1, BLOCK_BC4 }, { 64, 64, 4, BLOCK_BC1 }, { 513, 77, 2, BLOCK_BC5 }
+        };
+        const int numTextures = sizeof(specs) / sizeof(specs[0]);
+        const int cancelled = 4;
+        std::vector<TestTexture> textures(numTextures);
+        for (int i = 0; i < numTextures; i++)
+            startUpload(uploader, textures[i], specs[i].width, specs[i].height, specs[i].components, specs[i].format);
+        bool coarsest = true;
+        for (int i = 0; i < numTextures; i++)
+            coarsest = coarsest && fakeGL().baseLevels[textures[i].id] ==
+                                   static_cast<int>(textures[i].levels->numLevels()) - 1;
+        check(coarsest, "base level starts at the coarsest level");
+        uploader.cancel(textures[cancelled].id);
+
+        int frames = 0;
+        while (uploader.update() > 0 && frames < maximumFrames)
+        {
+            fakeGLFrame();
+            frames++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        printf("%d frames, %zu bands\n", frames, fakeGL().subImages.size());
+        check(uploader.pending() == 0 && frames > 1, "uploads spread over several frames");
+
+        bool whole = true, split = false, baseZero = true, done = true;
+        for (int i = 0; i < numTextures; i++)
+        {
+            if (i == cancelled)
+                continue;
+            bool levelSplit;
+            bool arrived = arrivedWhole(textures[i], levelSplit);
+            whole = whole && arrived;
+            split = split || (arrived && levelSplit);
+            baseZero = baseZero && fakeGL().baseLevels[textures[i].id] == 0;
+            done = done && textures[i].done == 1;
+        }
+        check(whole, "every level arrives whole, coarsest first");
+        check(split, "large levels are split into bands");
+        check(baseZero && done, "base level reaches 0 and done runs once");
+        check(subImagesOf(textures[cancelled].id) == 0 && textures[cancelled].done == 0,
+              "a texture cancelled before it started gets nothing");
+
+        //one frame of a big texture, then cancelled part way
+        TestTexture partial;
+        startUpload(uploader, partial, 2048, 2048, 4, BLOCK_NONE);
+        uploader.update();
+        fakeGLFrame();
+        uploader.cancel(partial.id);
+        size_t sent = subImagesOf(partial.id);
+        uploader.update();
+        fakeGLFrame();
+        uploader.finish();
+        check(subImagesOf(partial.id) == sent && partial.done == 0 && fakeGL().baseLevels[partial.id] != 0,
+              "a texture cancelled part way gets nothing more");
+
+        //finish() sends everything without waiting for frames
+        TestTexture finished;
+        startUpload(uploader, finished, 700, 300, 4, BLOCK_NONE);
+        uploader.finish();
+        bool finishedSplit;
+        check(uploader.pending() == 0 && finished.done == 1 && arrivedWhole(finished, finishedSplit) &&
+              fakeGL().baseLevels[finished.id] == 0, "finish sends what is left");
+
+        uploader.update();
+        fakeGLFrame();
+        fakeGLFrame();
+        check(fakeGL().errors == 0, "ring memory isn't reused before the GL reads it");
+    }
+}
+
+int main()
+{
+    srand(1);
+    testMode(true);
+    testMode(false);
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
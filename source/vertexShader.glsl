@@ -1,19 +1,56 @@
 #version 330 core
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
+layout(location = 0) in vec3 position;  // 16-bit unorm within the mesh bounds
+layout(location = 1) in vec2 normal;    // octahedral encoded
 layout(location = 2) in vec2 uv;
+layout(location = 3) in float tangent;  // 16-bit angle around the normal, top bit sign
 
 out vec3 FragPos;
 out vec2 UV;
 out vec3 Normal;
+out vec4 Tangent;   // w is the bitangent sign
 
 uniform mat4 MVP;
 uniform mat4 model;
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Same basis as tangentBasis in vertexformat.cpp
+void tangentBasis(vec3 n, out vec3 b1, out vec3 b2)
+{
+    float s = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + n.z);
+    float b = n.x * n.y * a;
+    b1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+    b2 = vec3(b, s + n.y * n.y * a, -n.y);
+}
+
+vec4 decodeTangent(vec3 n, float code)
+{
+    float bits = floor(code * 65535.0 + 0.5);
+    float s = bits >= 32768.0 ? -1.0 : 1.0;
+    float angle = mod(bits, 32768.0) * (6.28318530718 / 32768.0);
+    vec3 b1, b2;
+    tangentBasis(n, b1, b2);
+    return vec4(b1 * cos(angle) + b2 * sin(angle), s);
+}
 
 void main()
 {
-    gl_Position = MVP * vec4(position, 1.0);
-    FragPos = vec3(model * vec4(position, 1.0));
+    vec3 localPos = position * positionScale + positionOffset;
+    gl_Position = MVP * vec4(localPos, 1.0);
+    FragPos = vec3(model * vec4(localPos, 1.0));
     UV = uv;
-    Normal = mat3(transpose(inverse(model))) * normal;
+    vec3 n = decodeOctahedral(normal);
+    Normal = mat3(transpose(inverse(model))) * n;
+    vec4 t = decodeTangent(n, tangent);
+    Tangent = vec4(mat3(model) * t.xyz, t.w);
 }
\ No newline at end of file
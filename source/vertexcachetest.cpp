@@ -0,0 +1,139 @@
+//vertex cache test. Writes a sphere with its triangles in random order,
+//loads it as a Model with and without MODEL_OPTIMISE and runs the vertex
+//cache simulator over both index lists. Prints the ACMR and ATVR before
+//and after optimise() and exits with 1 if either didn't improve, if the
+//optimised ACMR is far from what Tipsify reaches on a grid, or if the
+//triangles changed. Loading doesn't touch GL, so no GPU is needed.
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/decodearena.hpp>
+#include <common/stb_image.hpp>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+#include <common/model.hpp>
+#include <common/meshcache.hpp>
+#include <common/meshoptimiser.hpp>
+
+namespace
+{
+    const char *spherePath = "vertex_cache_test.obj";
+    const int sphereSegments = 96;
+
+    //Tipsify gets a grid to about 0.65 with a 16 entry cache
+    const float maximumACMR = 0.75f;
+
+    //a UV sphere, its faces shuffled so the file order is bad for the cache
+    bool writeSphere(const char *path, int segments)
+    {
+        FILE *file = fopen(path, "w");
+        if (file == NULL)
+            return false;
+        for (int y = 0; y <= segments; y++)
+            for (int x = 0; x <= segments; x++)
+            {
+                float longitude = x * 6.2831853f / segments, latitude = y * 3.1415927f / segments;
+                glm::vec3 p(sinf(latitude) * cosf(longitude), cosf(latitude), sinf(latitude) * sinf(longitude));
+                fprintf(file, "v %f %f %f\n", p.x, p.y, p.z);
+                fprintf(file, "vt %f %f\n", static_cast<float>(x) / segments, static_cast<float>(y) / segments);
+                fprintf(file, "vn %f %f %f\n", p.x, p.y, p.z);
+            }
+
+        std::vector<int> faces;
+        for (int y = 0; y < segments; y++)
+            for (int x = 0; x < segments; x++)
+            {
+                int a = y * (segments + 1) + x + 1, b = a + 1, c = a + segments + 1, d = c + 1;
+                int quad[6] = { a, c, b, b, c, d };
+                faces.insert(faces.end(), quad, quad + 6);
+            }
+        unsigned int seed = 1;
+        for (size_t i = faces.size() / 3; i > 1; i--)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            size_t j = (seed >> 8) % i;
+            for (int k = 0; k < 3; k++)
+                std::swap(faces[(i - 1) * 3 + k], faces[j * 3 + k]);
+        }
+        for (size_t i = 0; i < faces.size(); i += 3)
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", faces[i], faces[i], faces[i],
+                    faces[i + 1], faces[i + 1], faces[i + 1], faces[i + 2], faces[i + 2], faces[i + 2]);
+        return fclose(file) == 0;
+    }
+
+    //the full detail triangles as positions, each rotated to start at its
+    //smallest corner and sorted, so index and vertex order don't matter
+    std::vector<std::vector<float> > triangleSet(const Model &model)
+    {
+        std::vector<std::vector<float> > triangles;
+        for (size_t i = 0; i + 2 < model.indices.size(); i += 3)
+        {
+            std::vector<float> corners[3];
+            for (int j = 0; j < 3; j++)
+            {
+                const glm::vec3 &p = model.vertices[model.indices[i + j]];
+                corners[j].push_back(p.x);
+                corners[j].push_back(p.y);
+                corners[j].push_back(p.z);
+            }
+            int first = static_cast<int>(std::min_element(corners, corners + 3) - corners);
+            std::vector<float> triangle;
+            for (int j = 0; j < 3; j++)
+                triangle.insert(triangle.end(), corners[(first + j) % 3].begin(), corners[(first + j) % 3].end());
+            triangles.push_back(triangle);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+}
+
+int main()
+{
+    if (!writeSphere(spherePath, sphereSegments))
+    {
+        printf("Couldn't write %s\n", spherePath);
+        return 1;
+    }
+
+    //each load writes its own cooked mesh, it has to go before the next
+    Model original;
+    bool loaded = original.load(spherePath, 0, 0);
+    remove(MeshCache::cachePath(spherePath).c_str());
+    Model optimised;
+    loaded = optimised.load(spherePath, MODEL_OPTIMISE, 0) && loaded;
+    remove(MeshCache::cachePath(spherePath).c_str());
+    remove(spherePath);
+    if (!loaded || original.indices.empty())
+    {
+        printf("Couldn't load %s\n", spherePath);
+        return 1;
+    }
+
+    VertexCacheStats before = analyseVertexCache(original.indices.data(), original.indices.size(), original.vertices.size());
+    VertexCacheStats after = analyseVertexCache(optimised.indices.data(), optimised.indices.size(), optimised.vertices.size());
+    printf("%zu triangles, %zu vertices\n", original.indices.size() / 3, original.vertices.size());
+    printf("ACMR %.3f -> %.3f (ideal 0.5, at most %.2f)\n", before.acmr, after.acmr, maximumACMR);
+    printf("ATVR %.3f -> %.3f (ideal 1.0)\n", before.atvr, after.atvr);
+
+    int failures = 0;
+    if (!(after.acmr < before.acmr && after.atvr < before.atvr))
+    {
+        printf("optimise() didn't improve the vertex cache\n");
+        failures++;
+    }
+    if (after.acmr > maximumACMR)
+    {
+        printf("optimised ACMR is above %.2f\n", maximumACMR);
+        failures++;
+    }
+    if (optimised.vertices.size() != original.vertices.size() || triangleSet(optimised) != triangleSet(original))
+    {
+        printf("optimise() changed the triangles\n");
+        failures++;
+    }
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
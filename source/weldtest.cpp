@@ -0,0 +1,135 @@
+//Vertex weld test. Feeds VertexWelder 300000 corners drawn from a small
+//pool, so most repeat, with pool entries differing only in one bit of one
+//component, -0 against 0 among them, and checks against a map of the
+//corners' bytes: every corner's index gives back its bytes, every
+//distinct corner gets exactly one vertex, and indices are handed out in
+//order of first appearance. Once with reserve() and once growing from
+//nothing. Exits with 1 if anything fails.
+#include <map>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include <common/mesh.hpp>
+
+namespace
+{
+    const size_t numCorners = 300000;
+    const size_t poolSize = 40000;
+
+    int failures = 0;
+
+    void check(bool passed, const char *what)
+    {
+        printf("%-60s %s\n", what, passed ? "ok" : "FAILED");
+        if (!passed)
+            failures++;
+    }
+
+    struct Corner
+    {
+        glm::vec3 position;
+        glm::vec2 uv;
+        glm::vec3 normal;
+    };
+
+    std::string cornerBytes(const glm::vec3 &position, const glm::vec2 &uv, const glm::vec3 &normal)
+    {
+        std::string bytes(reinterpret_cast<const char*>(&position), sizeof(position));
+        bytes.append(reinterpret_cast<const char*>(&uv), sizeof(uv));
+        bytes.append(reinterpret_cast<const char*>(&normal), sizeof(normal));
+        return bytes;
+    }
+
+    //random corners, half of them a copy of an earlier one with one bit of
+    //one component flipped
+    std::vector<Corner> makePool(std::mt19937 &generator)
+    {
+        std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+        std::vector<Corner> pool(poolSize);
+        for (size_t i = 0; i < poolSize; i++)
+        {
+            Corner &corner = pool[i];
+            if (i > 0 && generator() % 2 == 0)
+            {
+                corner = pool[generator() % i];
+                float *components[8] = { &corner.position.x, &corner.position.y, &corner.position.z,
+                                         &corner.uv.x, &corner.uv.y,
+                                         &corner.normal.x, &corner.normal.y, &corner.normal.z };
+                float *flipped = components[generator() % 8];
+                unsigned int bits;
+                memcpy(&bits, flipped, sizeof(bits));
+                bits ^= 1u << (generator() % 32);
+                memcpy(flipped, &bits, sizeof(bits));
+                continue;
+            }
+            corner.position = glm::vec3(value(generator), value(generator), value(generator));
+            corner.uv = glm::vec2(value(generator), value(generator));
+            corner.normal = glm::vec3(value(generator), value(generator), value(generator));
+        }
+
+        //0 and -0 compare equal but aren't the same bytes
+        pool[1] = pool[0];
+        pool[1].position.z = 0.0f;
+        pool[2] = pool[1];
+        pool[2].position.z = -0.0f;
+        return pool;
+    }
+
+    //welds corners and checks it against the byte strings
+    void weld(const std::vector<Corner> &corners, bool reserve, const char *what)
+    {
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        VertexWelder welder(vertices, uvs, normals);
+        if (reserve)
+            welder.reserve(poolSize);
+
+        std::map<std::string, unsigned int> expected;
+        bool sameBytes = true, oneEach = true;
+        for (size_t i = 0; i < corners.size(); i++)
+        {
+            const Corner &c = corners[i];
+            unsigned int index = welder.add(c.position, c.uv, c.normal);
+            std::string bytes = cornerBytes(c.position, c.uv, c.normal);
+            std::map<std::string, unsigned int>::iterator found = expected.find(bytes);
+            if (found == expected.end())
+            {
+                oneEach = oneEach && index == expected.size();
+                expected[bytes] = index;
+            }
+            else
+                oneEach = oneEach && index == found->second;
+            sameBytes = sameBytes && index < vertices.size() &&
+                        cornerBytes(vertices[index], uvs[index], normals[index]) == bytes;
+        }
+        oneEach = oneEach && vertices.size() == expected.size() && uvs.size() == expected.size() &&
+                  normals.size() == expected.size();
+
+        printf("%zu corners, %zu vertices\n", corners.size(), vertices.size());
+        char line[96];
+        snprintf(line, sizeof(line), "%s, indices give back the corners' bytes", what);
+        check(sameBytes, line);
+        snprintf(line, sizeof(line), "%s, one vertex per distinct corner", what);
+        check(oneEach, line);
+    }
+}
+
+int main()
+{
+    std::mt19937 generator(1);
+    std::vector<Corner> pool = makePool(generator);
+    std::vector<Corner> corners(numCorners);
+    for (size_t i = 0; i < numCorners; i++)
+        corners[i] = pool[generator() % poolSize];
+
+    weld(corners, true, "reserved");
+    weld(corners, false, "grown");
+
+    printf("%d failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}